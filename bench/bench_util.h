@@ -0,0 +1,143 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <stdio.h>  /* FILE          */
+#include <stdlib.h> /* realloc       */
+#include <string.h> /* memcpy        */
+#include <time.h>   /* clock_gettime */
+
+#include "opcodes.h" /* opcodes */
+#include "vm.h"      /* vm api  */
+
+/*
+* Helpers shared by the micro-benchmarks: a tiny writer for .bcc files, so
+* the workloads can be generated at any size, and a monotonic clock.
+*/
+
+#define BENCH_MAGIC_NUM 0xBABEFACE
+
+typedef struct bench_buffer
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} bench_buffer_t;
+
+typedef struct bench_program
+{
+    bench_buffer_t pool;
+    bench_buffer_t code;
+    unsigned int pool_count;
+    unsigned int num_instructions;
+} bench_program_t;
+
+static void bench_append(bench_buffer_t *buffer, const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        buffer->capacity = (buffer->capacity + size) * 2;
+        buffer->data = (unsigned char *)realloc(buffer->data, buffer->capacity);
+        if (NULL == buffer->data)
+        {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void bench_append_byte(bench_buffer_t *buffer, int value)
+{
+    unsigned char byte = (unsigned char)value;
+
+    bench_append(buffer, &byte, 1);
+}
+
+static void bench_append_int(bench_buffer_t *buffer, int value)
+{
+    bench_append(buffer, &value, sizeof(int));
+}
+
+/* adds a method constant, locals and params are type strings such as "II" */
+static unsigned int bench_method(bench_program_t *program,
+                                 const char *name,
+                                 int return_type,
+                                 const char *locals,
+                                 const char *params,
+                                 unsigned int offset)
+{
+    static const char type_codes[] = "?BIFLDSRM";
+
+    bench_append_byte(&program->pool, 0x08);
+    bench_append(&program->pool, name, strlen(name) + 1);
+    bench_append_byte(&program->pool, return_type);
+
+    bench_append_byte(&program->pool, strlen(locals));
+    for (const char *type = locals; *type; ++type)
+    {
+        bench_append_byte(&program->pool, strchr(type_codes, *type) - type_codes);
+    }
+
+    bench_append_byte(&program->pool, strlen(params));
+    for (const char *type = params; *type; ++type)
+    {
+        bench_append_byte(&program->pool, strchr(type_codes, *type) - type_codes);
+    }
+
+    bench_append_int(&program->pool, offset);
+
+    return program->pool_count++;
+}
+
+/* adds a double constant, as two ints with the low one first */
+static unsigned int bench_double(bench_program_t *program, double value)
+{
+    bench_append_byte(&program->pool, 0x05);
+    bench_append(&program->pool, &value, sizeof(double));
+
+    return program->pool_count++;
+}
+
+/* appends an instruction and returns its index */
+static unsigned int bench_op(bench_program_t *program, int opcode, int arg)
+{
+    bench_append_int(&program->code, opcode);
+    bench_append_int(&program->code, arg);
+
+    return program->num_instructions++;
+}
+
+static void bench_save(bench_program_t *program, const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    int magic = BENCH_MAGIC_NUM;
+
+    if (NULL == file)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    fwrite(&magic, sizeof(int), 1, file);
+    fputc(program->pool_count, file);
+    fwrite(program->pool.data, 1, program->pool.size, file);
+    fwrite(program->code.data, 1, program->code.size, file);
+    fclose(file);
+
+    free(program->pool.data);
+    free(program->code.data);
+    memset(program, 0, sizeof(bench_program_t));
+}
+
+static double bench_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#endif // BENCH_UTIL_H
@@ -0,0 +1,202 @@
+#include <dlfcn.h>  /* dlopen  */
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkdtemp */
+#include <unistd.h> /* unlink  */
+
+#include "vm_aot.h" /* vm_aot_translate_file */
+
+#include "bench_util.h"
+
+/*
+* The jit benchmark's workload, a binary call tree of DEPTH levels whose
+* leaves run BLOCKS blocks of integer arithmetic, run by the engines and by
+* its translation to C. The translation is built with gcc -O2 as a shared
+* object against the library and run with vm_run_native on a context of
+* the same file; it is skipped when gcc is not there.
+*/
+
+#define DEPTH 16
+#define BLOCKS 40
+#define BLOCK_SIZE 12
+#define RUNS 3
+#define METHOD_SIZE 6
+#define MAIN_SIZE 4
+#define ENGINES 4
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+    char name[32];
+
+    bench_method(&program, "main", 0x02, "", "", 0);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, (DEPTH - 1 == level ? "II" : ""), "I",
+            MAIN_SIZE + level * METHOD_SIZE);
+    }
+
+    bench_op(&program, OP_IPUSH, 1);
+    bench_op(&program, OP_CALL, 1);
+    bench_op(&program, OP_IPRINT, 0);
+    bench_op(&program, OP_RET, 0);
+
+    for (int level = 0; level < DEPTH - 1; ++level)
+    {
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_IADD, 0);
+        bench_op(&program, OP_IRET, 0);
+    }
+
+    // a = ((a + 7) * 3 - a) / 2, BLOCKS times
+    for (int block = 0; block < BLOCKS; ++block)
+    {
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_IPUSH, 7);
+        bench_op(&program, OP_IADD, 0);
+        bench_op(&program, OP_ISTORE, 1);
+        bench_op(&program, OP_ILOAD, 1);
+        bench_op(&program, OP_IPUSH, 3);
+        bench_op(&program, OP_IMULT, 0);
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_ISUB, 0);
+        bench_op(&program, OP_IPUSH, 2);
+        bench_op(&program, OP_IDIV, 0);
+        bench_op(&program, OP_ISTORE, 0);
+    }
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IRET, 0);
+
+    bench_save(&program, path);
+}
+
+/* runs the program on engine, or its translation when code is not NULL */
+static double run_once(const char *path, enum vm_engine engine, vm_aot_code_t code, FILE *output)
+{
+    vm_t *vm = NULL;
+    double start = 0, end = 0;
+
+    vm = vm_create(path, 0, 0, output, stdin, stderr, engine);
+    if (NULL == vm)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        exit(1);
+    }
+
+    start = bench_now();
+    if (NULL == code)
+    {
+        vm_run(vm);
+    }
+    else
+    {
+        vm_run_native(vm, code);
+    }
+    end = bench_now();
+
+    vm_free(vm);
+
+    return end - start;
+}
+
+static double run_best(const char *path, enum vm_engine engine, vm_aot_code_t code, FILE *output)
+{
+    double best = 1e9;
+
+    for (int run = 0; run < RUNS; ++run)
+    {
+        double elapsed = run_once(path, engine, code, output);
+
+        best = (elapsed < best ? elapsed : best);
+    }
+
+    return best;
+}
+
+/* translates the program at path and builds it as a shared object, NULL when that fails */
+static void *build_translation(const char *path, const char *source, const char *object)
+{
+    char command[512];
+
+    if (0 != vm_aot_translate_file(path, source, stderr))
+    {
+        return NULL;
+    }
+
+    snprintf(command, sizeof(command),
+        "gcc -O2 -shared -fPIC -DVM_COMPACT_VALUES=%d -Iinclude/ -o %s %s -Llib/ -lvm -lm 2>/dev/null",
+        VM_COMPACT_VALUES, object, source);
+    if (0 != system(command))
+    {
+        return NULL;
+    }
+
+    return dlopen(object, RTLD_NOW);
+}
+
+int main(void)
+{
+    char directory[] = "/tmp/vm_bench_aot_XXXXXX";
+    char path[64], source[64], object[64];
+    const char *engine_names[ENGINES] = { "handlers", "threaded", "jit", "register" };
+    enum vm_engine engines[ENGINES] = { VM_ENGINE_HANDLERS, VM_ENGINE_THREADED, VM_ENGINE_JIT, VM_ENGINE_REGISTER };
+    double leaves = (double)(1L << (DEPTH - 1));
+    double instructions = leaves * (BLOCKS * BLOCK_SIZE + 2);
+    double best[ENGINES] = {0}, native = 0;
+    FILE *output = fopen("/dev/null", "w");
+    vm_aot_code_t code = NULL;
+    void *translation = NULL;
+
+    if (NULL == mkdtemp(directory) || NULL == output)
+    {
+        perror("vm_bench_aot");
+        return 1;
+    }
+
+    snprintf(path, sizeof(path), "%s/program.bcc", directory);
+    snprintf(source, sizeof(source), "%s/program.c", directory);
+    snprintf(object, sizeof(object), "%s/program.so", directory);
+    build_program(path);
+
+    for (int i = 0; i < ENGINES; ++i)
+    {
+        best[i] = run_best(path, engines[i], NULL, output);
+
+        printf("%-9s %8.1f M leaf instructions/s (%.3fs)\n",
+            engine_names[i], instructions / best[i] / 1e6, best[i]);
+    }
+
+    translation = build_translation(path, source, object);
+    if (NULL != translation)
+    {
+        code = (vm_aot_code_t)dlsym(translation, "aot_run");
+    }
+
+    if (NULL != code)
+    {
+        native = run_best(path, VM_ENGINE_HANDLERS, code, output);
+
+        printf("%-9s %8.1f M leaf instructions/s (%.3fs, %.1fx handlers, %.1fx jit)\n",
+            "aot", instructions / native / 1e6, native, best[0] / native, best[2] / native);
+    }
+    else
+    {
+        printf("%-9s skipped, the translation could not be built with gcc\n", "aot");
+    }
+
+    if (NULL != translation)
+    {
+        dlclose(translation);
+    }
+
+    unlink(path);
+    unlink(source);
+    unlink(object);
+    rmdir(directory);
+    fclose(output);
+
+    return 0;
+}
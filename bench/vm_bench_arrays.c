@@ -0,0 +1,195 @@
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+
+/*
+* Bulk array operations against the same loops compiled natively: main
+* allocates three integer arrays of LENGTH elements, then a binary call tree
+* of DEPTH levels runs one bulk opcode over them in every leaf. The dispatch
+* of the tree is noise next to the arrays, so the time per element is the
+* time of the kernels.
+*/
+
+#define LENGTH (1 << 20)
+#define DEPTH 8
+#define HEAP_SIZE (64 * 1024 * 1024)
+#define RUNS 3
+
+enum bulk_op { BULK_SUM, BULK_DOT, BULK_ADD };
+
+static const char *op_names[] = { "asum", "adot", "aadd" };
+
+static int left[LENGTH], right[LENGTH], sum[LENGTH];
+static volatile int sink;
+
+static void build_program(const char *path, enum bulk_op op)
+{
+    bench_program_t program = {0};
+    unsigned int main_size = 20;
+    unsigned int level_size = 9;
+
+    bench_method(&program, "main", 0x02, "RRR", "", 0);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, "", "RRR", main_size + level * level_size);
+    }
+    bench_method(&program, "leaf", 0x02, "", "RRR", main_size + DEPTH * level_size);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        bench_op(&program, OP_IPUSH, LENGTH);
+        bench_op(&program, OP_NEWARRAY, 0x02); // integer elements
+        bench_op(&program, OP_RSTORE, i);
+    }
+    bench_op(&program, OP_RLOAD, 0);
+    bench_op(&program, OP_IPUSH, 3);
+    bench_op(&program, OP_AFILL, 0);
+    bench_op(&program, OP_RLOAD, 1);
+    bench_op(&program, OP_IPUSH, 2);
+    bench_op(&program, OP_AFILL, 0);
+    bench_op(&program, OP_RLOAD, 0);
+    bench_op(&program, OP_RLOAD, 1);
+    bench_op(&program, OP_RLOAD, 2);
+    bench_op(&program, OP_CALL, 1);
+    bench_op(&program, OP_STOP, 0);
+
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        for (int call = 0; call < 2; ++call)
+        {
+            bench_op(&program, OP_RLOAD, 0);
+            bench_op(&program, OP_RLOAD, 1);
+            bench_op(&program, OP_RLOAD, 2);
+            bench_op(&program, OP_CALL, level + 2);
+        }
+        bench_op(&program, OP_RET, 0);
+    }
+
+    bench_op(&program, OP_RLOAD, 0);
+    switch (op)
+    {
+        case BULK_SUM:
+            bench_op(&program, OP_ASUM, 0);
+            bench_op(&program, OP_POP, 0);
+            break;
+        case BULK_DOT:
+            bench_op(&program, OP_RLOAD, 1);
+            bench_op(&program, OP_ADOT, 0);
+            bench_op(&program, OP_POP, 0);
+            break;
+        case BULK_ADD:
+            bench_op(&program, OP_RLOAD, 1);
+            bench_op(&program, OP_RLOAD, 2);
+            bench_op(&program, OP_AADD, 0);
+            break;
+    }
+    bench_op(&program, OP_RET, 0);
+
+    bench_save(&program, path);
+}
+
+/* the loops an interpreter without bulk opcodes could at best hope for */
+static double run_native(enum bulk_op op)
+{
+    double start = bench_now();
+
+    for (int leaf = 0; leaf < (1 << DEPTH); ++leaf)
+    {
+        unsigned int result = 0;
+
+        if (BULK_SUM == op)
+        {
+            for (int i = 0; i < LENGTH; ++i)
+            {
+                result += (unsigned int)left[i];
+            }
+        }
+        else if (BULK_DOT == op)
+        {
+            for (int i = 0; i < LENGTH; ++i)
+            {
+                result += (unsigned int)left[i] * (unsigned int)right[i];
+            }
+        }
+        else
+        {
+            for (int i = 0; i < LENGTH; ++i)
+            {
+                sum[i] = (int)((unsigned int)left[i] + (unsigned int)right[i]);
+            }
+            result = (unsigned int)sum[leaf];
+        }
+        sink = (int)result;
+    }
+
+    return bench_now() - start;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_arrays_XXXXXX";
+    double elements = (double)LENGTH * (1 << DEPTH);
+    int fd = mkstemp(path);
+
+    if (-1 == fd)
+    {
+        perror("vm_bench_arrays");
+        return 1;
+    }
+    close(fd);
+
+    for (int i = 0; i < LENGTH; ++i)
+    {
+        left[i] = 3;
+        right[i] = 2;
+    }
+
+    printf("%8s %14s %14s %8s\n", "op", "vm ns/elem", "native ns/elem", "ratio");
+
+    for (int op = BULK_SUM; op <= BULK_ADD; ++op)
+    {
+        double best_vm = 0, best_native = 0;
+
+        build_program(path, (enum bulk_op)op);
+
+        for (int run = 0; run < RUNS; ++run)
+        {
+            vm_gc_stats_t stats = {0};
+            vm_t *vm = vm_create(path, 0, HEAP_SIZE, stdout, stdin, stderr, VM_ENGINE_THREADED);
+            double native = 0;
+
+            if (NULL == vm)
+            {
+                fprintf(stderr, "could not load %s\n", path);
+                return 1;
+            }
+
+            vm_run(vm);
+            vm_context_get_gc_stats(vm, &stats);
+            vm_free(vm);
+
+            native = run_native((enum bulk_op)op);
+
+            if (0 == run || stats.run_time < best_vm)
+            {
+                best_vm = stats.run_time;
+            }
+            if (0 == run || native < best_native)
+            {
+                best_native = native;
+            }
+        }
+
+        printf("%8s %14.3f %14.3f %8.2f\n",
+            op_names[op], best_vm * 1e9 / elements, best_native * 1e9 / elements, best_vm / best_native);
+    }
+
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkdtemp */
+#include <string.h> /* memcmp  */
+#include <unistd.h> /* unlink  */
+
+#include "vm_assembler.h" /* vm_assemble_file */
+
+#include "bench_util.h"
+
+/*
+* A build pipeline's batch: FILES small .bc sources, each one a few methods
+* with labels, constants and a loop, assembled in one process by the
+* library's assembler. When java and bytecode_compiler/BytecodeCompiler.jar
+* are there, JVM_FILES of them are compiled by the Java compiler too, one
+* JVM per file the way the makefile ran it before vm_asm, the per-file
+* times are compared and every file the JVM wrote must be the one
+* vm_assemble wrote, byte for byte. Without them only the native time is
+* measured, nothing is estimated.
+*/
+
+#define FILES 2000
+#define JVM_FILES 20
+#define JAR "bytecode_compiler/BytecodeCompiler.jar"
+
+static void write_source(const char *path, unsigned int seed)
+{
+    FILE *source = fopen(path, "w");
+
+    if (NULL == source)
+    {
+        perror("vm_bench_assembler");
+        exit(1);
+    }
+
+    fprintf(source, "const 5\nI %u\nS \"file %u\"\nM \"main\" I 0 0\nM \"sum\" I 1I 1I\nD %u.25\n\n", seed, seed, seed);
+    fprintf(source, "main:\n    cload 1 @ the name\n    sprint\n    ipush %u\n    call 3\n    iprint\n    stop\n\n", seed % 100);
+    fprintf(source, "sum:\n    ipush 0\n    istore 1\nloop:\n    iload 0\n    ifeq done\n");
+    fprintf(source, "    iload 1\n    iload 0\n    iadd\n    istore 1\n    iload 0\n    ipush 1\n    isub\n    istore 0\n");
+    fprintf(source, "    goto loop\ndone:\n    iload 1\n    iret\n");
+    fclose(source);
+}
+
+/* 1 if both files can be read and hold the same bytes */
+static int is_same_file(const char *path, const char *other_path)
+{
+    FILE *file = fopen(path, "rb"), *other = fopen(other_path, "rb");
+    char block[4096], other_block[4096];
+    size_t size = 0, other_size = 0;
+    int same = (NULL != file && NULL != other);
+
+    while (same)
+    {
+        size = fread(block, 1, sizeof(block), file);
+        other_size = fread(other_block, 1, sizeof(other_block), other);
+        same = (size == other_size && 0 == memcmp(block, other_block, size));
+        if (0 == size)
+        {
+            break;
+        }
+    }
+
+    if (NULL != file)
+    {
+        fclose(file);
+    }
+    if (NULL != other)
+    {
+        fclose(other);
+    }
+
+    return same;
+}
+
+int main(void)
+{
+    char directory[] = "/tmp/vm_bench_assembler_XXXXXX";
+    char input[FILES][64], output[FILES][64], jvm_output[JVM_FILES][64], command[256];
+    double start = 0, native_time = 0, jvm_time = 0;
+    unsigned int num_different = 0;
+    int has_jvm = 0;
+
+    if (NULL == mkdtemp(directory))
+    {
+        perror("vm_bench_assembler");
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < FILES; ++i)
+    {
+        snprintf(input[i], sizeof(input[i]), "%s/source%u.bc", directory, i);
+        snprintf(output[i], sizeof(output[i]), "%s/source%u.bcc", directory, i);
+        write_source(input[i], i);
+    }
+    for (unsigned int i = 0; i < JVM_FILES; ++i)
+    {
+        snprintf(jvm_output[i], sizeof(jvm_output[i]), "%s/source%u.jvm.bcc", directory, i);
+    }
+
+    start = bench_now();
+    for (unsigned int i = 0; i < FILES; ++i)
+    {
+        if (0 != vm_assemble_file(input[i], output[i], 0, stderr))
+        {
+            return 1;
+        }
+    }
+    native_time = (bench_now() - start) / FILES;
+
+    printf("vm_assemble %10.1f us/file (%d files in %.3fs)\n", native_time * 1e6, FILES, native_time * FILES);
+
+    has_jvm = (0 == system("java -version >/dev/null 2>&1") && 0 == access(JAR, R_OK));
+    if (has_jvm)
+    {
+        start = bench_now();
+        for (unsigned int i = 0; i < JVM_FILES; ++i)
+        {
+            snprintf(command, sizeof(command), "java -jar " JAR " %s %s >/dev/null", input[i], jvm_output[i]);
+            if (0 != system(command))
+            {
+                has_jvm = 0;
+                break;
+            }
+        }
+        jvm_time = (bench_now() - start) / JVM_FILES;
+    }
+
+    if (has_jvm)
+    {
+        for (unsigned int i = 0; i < JVM_FILES; ++i)
+        {
+            num_different += !is_same_file(output[i], jvm_output[i]);
+        }
+
+        printf("java -jar    %10.1f us/file (%d files)\n", jvm_time * 1e6, JVM_FILES);
+        printf("vm_assemble is %.0fx faster per file\n", jvm_time / native_time);
+        printf("%u of %d files differ from the Java compiler's\n", num_different, JVM_FILES);
+    }
+    else
+    {
+        printf("java -jar    skipped, java or %s is missing or failed\n", JAR);
+    }
+
+    for (unsigned int i = 0; i < FILES; ++i)
+    {
+        unlink(input[i]);
+        unlink(output[i]);
+    }
+    for (unsigned int i = 0; i < JVM_FILES; ++i)
+    {
+        unlink(jvm_output[i]);
+    }
+    rmdir(directory);
+
+    return (0 == num_different ? 0 : 1);
+}
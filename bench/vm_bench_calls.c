@@ -0,0 +1,113 @@
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+
+/*
+* Call-heavy workload: a complete binary call tree of DEPTH levels, where
+* every method calls the next level twice and adds up the results. The tree
+* is spelled out as one method per level since the VM has no branches to end
+* a recursion with.
+*/
+
+#define DEPTH 21
+#define RUNS 5
+#define METHOD_SIZE 6
+#define MAIN_SIZE 4
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+
+    bench_method(&program, "main", 0x02, "", "", 0);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, "", "I", MAIN_SIZE + level * METHOD_SIZE);
+    }
+
+    bench_op(&program, OP_IPUSH, 0);
+    bench_op(&program, OP_CALL, 1);
+    bench_op(&program, OP_IPRINT, 0);
+    bench_op(&program, OP_RET, 0);
+
+    for (int level = 0; level < DEPTH - 1; ++level)
+    {
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_IADD, 0);
+        bench_op(&program, OP_IRET, 0);
+    }
+
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IPUSH, 1);
+    bench_op(&program, OP_IADD, 0);
+    bench_op(&program, OP_IRET, 0);
+
+    bench_save(&program, path);
+}
+
+static double run_once(const char *path, enum vm_engine engine, FILE *output)
+{
+    vm_t *vm = NULL;
+    double start = 0, end = 0;
+
+    vm = vm_create(path, 0, 0, output, stdin, stderr, engine);
+    if (NULL == vm)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        exit(1);
+    }
+
+    start = bench_now();
+    vm_run(vm);
+    end = bench_now();
+
+    vm_free(vm);
+
+    return end - start;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_calls_XXXXXX";
+    const char *engine_names[] = { "handlers", "threaded", "register" };
+    enum vm_engine engines[] = { VM_ENGINE_HANDLERS, VM_ENGINE_THREADED, VM_ENGINE_REGISTER };
+    double calls = (double)((1L << DEPTH) - 1);
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_calls");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        double best = 1e9;
+
+        for (int run = 0; run < RUNS; ++run)
+        {
+            double elapsed = run_once(path, engines[i], output);
+
+            best = (elapsed < best ? elapsed : best);
+        }
+
+        printf("%-9s %10.0f calls/s (%.0f calls in %.3fs)\n",
+            engine_names[i], calls / best, calls, best);
+    }
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
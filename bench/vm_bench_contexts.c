@@ -0,0 +1,129 @@
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+
+/*
+* Per-request cost of running a small script many times: loading it for every
+* request with vm_create, creating a fresh context on one shared program, and
+* resetting a single pooled context between requests.
+*/
+
+#define REQUESTS 20000
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+
+    bench_method(&program, "main", 0x02, "I", "", 0);
+
+    bench_op(&program, OP_IPUSH, 20);
+    bench_op(&program, OP_IPUSH, 22);
+    bench_op(&program, OP_IADD, 0);
+    bench_op(&program, OP_ISTORE, 0);
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IPRINT, 0);
+    bench_op(&program, OP_RET, 0);
+
+    bench_save(&program, path);
+}
+
+static void check(const void *pointer, const char *what)
+{
+    if (NULL == pointer)
+    {
+        fprintf(stderr, "could not create %s\n", what);
+        exit(1);
+    }
+}
+
+static double run_vm_create(const char *path, FILE *output)
+{
+    double start = bench_now();
+
+    for (int i = 0; i < REQUESTS; ++i)
+    {
+        vm_t *vm = vm_create(path, 0, 0, output, stdin, stderr, VM_ENGINE_DEFAULT);
+
+        check(vm, "vm");
+        vm_run(vm);
+        vm_free(vm);
+    }
+
+    return bench_now() - start;
+}
+
+static double run_context_create(const vm_program_t *program, FILE *output)
+{
+    double start = bench_now();
+
+    for (int i = 0; i < REQUESTS; ++i)
+    {
+        vm_context_t *context = vm_context_create(program, 0, 0, output, stdin, stderr,
+                                                  VM_ENGINE_DEFAULT);
+
+        check(context, "context");
+        vm_run(context);
+        vm_context_free(context);
+    }
+
+    return bench_now() - start;
+}
+
+static double run_context_reset(const vm_program_t *program, FILE *output)
+{
+    vm_context_t *context = vm_context_create(program, 0, 0, output, stdin, stderr,
+                                              VM_ENGINE_DEFAULT);
+    double start = 0, end = 0;
+
+    check(context, "context");
+
+    start = bench_now();
+    for (int i = 0; i < REQUESTS; ++i)
+    {
+        vm_context_reset(context);
+        vm_run(context);
+    }
+    end = bench_now();
+
+    vm_context_free(context);
+
+    return end - start;
+}
+
+static void report(const char *name, double elapsed)
+{
+    printf("%-15s %8.2f us/request (%d requests in %.3fs)\n",
+        name, elapsed * 1e6 / REQUESTS, REQUESTS, elapsed);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_contexts_XXXXXX";
+    FILE *output = fopen("/dev/null", "w");
+    vm_program_t *program = NULL;
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_contexts");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    program = vm_program_load(path, stderr);
+    check(program, "program");
+
+    report("vm_create", run_vm_create(path, output));
+    report("context_create", run_context_create(program, output));
+    report("context_reset", run_context_reset(program, output));
+
+    vm_program_free(program);
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
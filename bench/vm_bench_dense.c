@@ -0,0 +1,140 @@
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "vm_impl.h" /* vm_program_t */
+
+#include "bench_util.h"
+
+/*
+* Code size and speed of the dense encoding against the fixed-width one.
+* METHODS methods of BODY instructions each are called round robin, so the
+* whole code region, several times the size of the data cache in the
+* fixed-width encoding, is walked ROUNDS times per run.
+*/
+
+#define METHODS 120 // v1 constant pools hold up to 127 entries
+#define BODY 8192 // a multiple of 4
+#define ROUNDS 20
+#define RUNS 5
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+    unsigned int method_size = BODY + 1;
+    unsigned int main_size = METHODS * ROUNDS + 1;
+
+    bench_method(&program, "main", 0x02, "", "", 0);
+    for (int i = 0; i < METHODS; ++i)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "method%d", i);
+        bench_method(&program, name, 0x02, "I", "", main_size + i * method_size);
+    }
+
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (int i = 0; i < METHODS; ++i)
+        {
+            bench_op(&program, OP_CALL, i + 1);
+        }
+    }
+    bench_op(&program, OP_STOP, 0);
+
+    // small operands, as in compiled code: local indices and short immediates
+    for (int i = 0; i < METHODS; ++i)
+    {
+        for (int j = 0; j < BODY; j += 4)
+        {
+            bench_op(&program, OP_ILOAD, 0);
+            bench_op(&program, OP_IPUSH, (i + j) % 100 - 50);
+            bench_op(&program, OP_IADD, 0);
+            bench_op(&program, OP_ISTORE, 0);
+        }
+        bench_op(&program, OP_RET, 0);
+    }
+
+    bench_save(&program, path);
+}
+
+static double run_once(vm_program_t *program, enum vm_engine engine, FILE *output)
+{
+    vm_context_t *context = NULL;
+    double start = 0, end = 0;
+
+    context = vm_context_create(program, 0, 0, output, stdin, stderr, engine);
+    if (NULL == context)
+    {
+        fprintf(stderr, "could not create a context\n");
+        exit(1);
+    }
+
+    start = bench_now();
+    vm_run(context);
+    end = bench_now();
+
+    if (VM_FINISHED != context->state)
+    {
+        fprintf(stderr, "the program did not finish\n");
+        exit(1);
+    }
+
+    vm_context_free(context);
+
+    return end - start;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_dense_XXXXXX";
+    const char *engine_names[] = { "handlers", "threaded", "dense" };
+    enum vm_engine engines[] = { VM_ENGINE_HANDLERS, VM_ENGINE_THREADED, VM_ENGINE_DENSE };
+    double instructions = (double)ROUNDS * METHODS * (BODY + 2) + 1;
+    vm_program_t *program = NULL;
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_dense");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    program = vm_program_load(path, stderr);
+    if (NULL == program)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        return 1;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        double best = 1e9;
+
+        for (int run = 0; run < RUNS; ++run)
+        {
+            double elapsed = run_once(program, engines[i], output);
+
+            best = (elapsed < best ? elapsed : best);
+        }
+
+        printf("%-9s %8.1f M instructions/s (%.3fs)\n",
+            engine_names[i], instructions / best / 1e6, best);
+    }
+
+    printf("%u instructions, fixed-width %zu KB, dense %u KB (%.2f bytes per instruction)\n",
+        program->num_instructions,
+        program->num_instructions * sizeof(vm_instruction_t) / 1024,
+        program->dense_code_size / 1024,
+        (double)program->dense_code_size / program->num_instructions);
+
+    vm_program_free(program);
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+
+/*
+* Allocation-heavy workload: main builds a list of LIVE nodes that stays
+* reachable for the whole run, then a binary call tree of DEPTH levels
+* allocates two short-lived objects in every leaf. The list is promoted to
+* the old generation once, so the minor pauses should stay short whatever
+* LIVE is, and only the rare full collections should grow with it.
+*/
+
+#define DEPTH 20
+#define HEAP_SIZE (8 * 1024 * 1024)
+#define RUNS 3
+
+static const unsigned int live_sizes[] = { 0, 1000, 10000, 50000 };
+
+static void build_program(const char *path, unsigned int live)
+{
+    bench_program_t program = {0};
+    unsigned int main_size = live * 4 + 2;
+    unsigned int push_size = 10;
+    unsigned int level_size = 3;
+
+    bench_method(&program, "main", 0x02, "R", "", 0);
+    bench_method(&program, "push", 0x07, "R", "RI", main_size);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, "", "", main_size + push_size + level * level_size);
+    }
+
+    for (unsigned int i = 0; i < live; ++i)
+    {
+        bench_op(&program, OP_RLOAD, 0);
+        bench_op(&program, OP_IPUSH, (int)i);
+        bench_op(&program, OP_CALL, 1);
+        bench_op(&program, OP_RSTORE, 0);
+    }
+    bench_op(&program, OP_CALL, 2);
+    bench_op(&program, OP_STOP, 0);
+
+    // a node is { value, next }
+    bench_op(&program, OP_NEW, 2);
+    bench_op(&program, OP_RSTORE, 2);
+    bench_op(&program, OP_RLOAD, 2);
+    bench_op(&program, OP_ILOAD, 1);
+    bench_op(&program, OP_IPUTFIELD, 0);
+    bench_op(&program, OP_RLOAD, 2);
+    bench_op(&program, OP_RLOAD, 0);
+    bench_op(&program, OP_RPUTFIELD, 1);
+    bench_op(&program, OP_RLOAD, 2);
+    bench_op(&program, OP_RRET, 0);
+
+    for (int level = 0; level < DEPTH - 1; ++level)
+    {
+        bench_op(&program, OP_CALL, level + 3);
+        bench_op(&program, OP_CALL, level + 3);
+        bench_op(&program, OP_RET, 0);
+    }
+
+    bench_op(&program, OP_NEW, 4);
+    bench_op(&program, OP_POP, 0);
+    bench_op(&program, OP_NEW, 2);
+    bench_op(&program, OP_POP, 0);
+    bench_op(&program, OP_RET, 0);
+
+    bench_save(&program, path);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_gc_XXXXXX";
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_gc");
+        return 1;
+    }
+    close(fd);
+
+    printf("%8s %12s %12s %8s %8s %12s %12s\n",
+        "live", "MB/s", "ns/object", "minor", "full", "minor pause", "max pause");
+
+    for (unsigned int i = 0; i < sizeof(live_sizes) / sizeof(live_sizes[0]); ++i)
+    {
+        vm_gc_stats_t best = {0};
+
+        build_program(path, live_sizes[i]);
+
+        for (int run = 0; run < RUNS; ++run)
+        {
+            vm_gc_stats_t stats = {0};
+            vm_t *vm = vm_create(path, 0, HEAP_SIZE, output, stdin, stderr, VM_ENGINE_THREADED);
+
+            if (NULL == vm)
+            {
+                fprintf(stderr, "could not load %s\n", path);
+                return 1;
+            }
+
+            vm_run(vm);
+            vm_context_get_gc_stats(vm, &stats);
+            vm_free(vm);
+
+            if (0 == run || stats.run_time < best.run_time)
+            {
+                best = stats;
+            }
+        }
+
+        printf("%8u %12.1f %12.1f %8u %8u %9.1f us %9.1f us\n",
+            live_sizes[i],
+            best.bytes_allocated / best.run_time / 1e6,
+            best.run_time * 1e9 / best.objects_allocated,
+            best.minor_collections,
+            best.collections - best.minor_collections,
+            (0 == best.minor_collections ? 0 : best.minor_pause_time * 1e6 / best.minor_collections),
+            best.max_pause_time * 1e6);
+    }
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
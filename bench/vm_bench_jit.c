@@ -0,0 +1,130 @@
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+
+/*
+* Integer-heavy workload: a binary call tree of DEPTH levels whose leaves run
+* BLOCKS straight-line blocks of iload/ipush/iadd/imult/isub/idiv/istore.
+* Almost all the time is spent in the leaves, which is what the jit compiles.
+*/
+
+#define DEPTH 16
+#define BLOCKS 40
+#define BLOCK_SIZE 12
+#define RUNS 3
+#define METHOD_SIZE 6
+#define MAIN_SIZE 4
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+    char name[32];
+
+    bench_method(&program, "main", 0x02, "", "", 0);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, (DEPTH - 1 == level ? "II" : ""), "I",
+            MAIN_SIZE + level * METHOD_SIZE);
+    }
+
+    bench_op(&program, OP_IPUSH, 1);
+    bench_op(&program, OP_CALL, 1);
+    bench_op(&program, OP_IPRINT, 0);
+    bench_op(&program, OP_RET, 0);
+
+    for (int level = 0; level < DEPTH - 1; ++level)
+    {
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_IADD, 0);
+        bench_op(&program, OP_IRET, 0);
+    }
+
+    // a = ((a + 7) * 3 - a) / 2, BLOCKS times
+    for (int block = 0; block < BLOCKS; ++block)
+    {
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_IPUSH, 7);
+        bench_op(&program, OP_IADD, 0);
+        bench_op(&program, OP_ISTORE, 1);
+        bench_op(&program, OP_ILOAD, 1);
+        bench_op(&program, OP_IPUSH, 3);
+        bench_op(&program, OP_IMULT, 0);
+        bench_op(&program, OP_ILOAD, 0);
+        bench_op(&program, OP_ISUB, 0);
+        bench_op(&program, OP_IPUSH, 2);
+        bench_op(&program, OP_IDIV, 0);
+        bench_op(&program, OP_ISTORE, 0);
+    }
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IRET, 0);
+
+    bench_save(&program, path);
+}
+
+static double run_once(const char *path, enum vm_engine engine, FILE *output)
+{
+    vm_t *vm = NULL;
+    double start = 0, end = 0;
+
+    vm = vm_create(path, 0, 0, output, stdin, stderr, engine);
+    if (NULL == vm)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        exit(1);
+    }
+
+    start = bench_now();
+    vm_run(vm);
+    end = bench_now();
+
+    vm_free(vm);
+
+    return end - start;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_jit_XXXXXX";
+    const char *engine_names[] = { "handlers", "threaded", "jit", "register" };
+    enum vm_engine engines[] = { VM_ENGINE_HANDLERS, VM_ENGINE_THREADED, VM_ENGINE_JIT, VM_ENGINE_REGISTER };
+    double leaves = (double)(1L << (DEPTH - 1));
+    double instructions = leaves * (BLOCKS * BLOCK_SIZE + 2);
+    double best[4] = {0};
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_jit");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        best[i] = 1e9;
+
+        for (int run = 0; run < RUNS; ++run)
+        {
+            double elapsed = run_once(path, engines[i], output);
+
+            best[i] = (elapsed < best[i] ? elapsed : best[i]);
+        }
+
+        printf("%-9s %8.1f M leaf instructions/s (%.3fs, %.1fx handlers)\n",
+            engine_names[i], instructions / best[i] / 1e6, best[i], best[0] / best[i]);
+    }
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
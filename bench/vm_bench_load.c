@@ -0,0 +1,179 @@
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "vm_impl.h"   /* vm_program_t  */
+#include "vm_loader.h" /* v2 file layout */
+
+#include "bench_util.h"
+
+/*
+* Start-up cost of a large v2 program: METHODS methods of BODY instructions
+* each, of which main only calls CALLED. Loading decodes the method table and
+* prepares main, the rest is prepared on its first call. The eager column
+* prepares every method right after loading, which is what a v1 file pays.
+*/
+
+#define METHODS 20000
+#define BODY 64
+#define CALLED 10
+#define RUNS 5
+
+static void build_program(const char *path)
+{
+    bench_buffer_t constants = {0}, methods = {0}, strings = {0}, code = {0}, file = {0};
+    vm_file_header_t header = { MAGIC_NUM_V2, BYTECODE_VERSION, 4 };
+    vm_file_section_t sections[4] = {
+        { VM_SECTION_CONSTANTS }, { VM_SECTION_METHODS }, { VM_SECTION_STRINGS }, { VM_SECTION_CODE }
+    };
+    bench_buffer_t *contents[4] = { &constants, &methods, &strings, &code };
+    vm_file_constant_t constant = { VM_TYPE_METHOD };
+    vm_file_method_t method = {0};
+    vm_instruction_t instruction = {0};
+    unsigned int offset = sizeof(header) + sizeof(sections);
+    char name[32];
+    FILE *output = NULL;
+
+    // main is method 0, everything else takes an int and returns one
+    for (unsigned int i = 0; i <= METHODS; ++i)
+    {
+        snprintf(name, sizeof(name), (0 == i ? "main" : "method%u"), i);
+
+        method.name_offset = strings.size;
+        method.name_length = strlen(name);
+        bench_append(&strings, name, strlen(name) + 1);
+
+        method.return_type = VM_TYPE_INTEGER;
+        method.num_params = (0 == i ? 0 : 1);
+        method.num_locals = 0;
+        method.types_offset = strings.size;
+        bench_append_byte(&strings, VM_TYPE_INTEGER);
+
+        method.code_offset = code.size / sizeof(vm_instruction_t);
+        if (0 == i)
+        {
+            for (unsigned int j = 1; j <= CALLED; ++j)
+            {
+                instruction = (vm_instruction_t){ OP_IPUSH, j };
+                bench_append(&code, &instruction, sizeof(instruction));
+                instruction = (vm_instruction_t){ OP_CALL, j * (METHODS / CALLED) };
+                bench_append(&code, &instruction, sizeof(instruction));
+                instruction = (vm_instruction_t){ OP_POP, 0 };
+                bench_append(&code, &instruction, sizeof(instruction));
+            }
+            instruction = (vm_instruction_t){ OP_STOP, 0 };
+            bench_append(&code, &instruction, sizeof(instruction));
+        }
+        else
+        {
+            instruction = (vm_instruction_t){ OP_ILOAD, 0 };
+            bench_append(&code, &instruction, sizeof(instruction));
+            for (unsigned int j = 0; j < (BODY - 2) / 2; ++j)
+            {
+                instruction = (vm_instruction_t){ OP_IPUSH, (int)j };
+                bench_append(&code, &instruction, sizeof(instruction));
+                instruction = (vm_instruction_t){ OP_IADD, 0 };
+                bench_append(&code, &instruction, sizeof(instruction));
+            }
+            instruction = (vm_instruction_t){ OP_IRET, 0 };
+            bench_append(&code, &instruction, sizeof(instruction));
+        }
+        method.code_length = code.size / sizeof(vm_instruction_t) - method.code_offset;
+        bench_append(&methods, &method, sizeof(method));
+
+        constant.a = i;
+        bench_append(&constants, &constant, sizeof(constant));
+    }
+
+    bench_append(&file, &header, sizeof(header));
+    for (int i = 0; i < 4; ++i)
+    {
+        // every section starts 4-byte aligned
+        while (0 != contents[i]->size % 4)
+        {
+            bench_append_byte(contents[i], 0);
+        }
+        sections[i].offset = offset;
+        sections[i].size = contents[i]->size;
+        offset += contents[i]->size;
+    }
+    bench_append(&file, sections, sizeof(sections));
+
+    output = fopen(path, "wb");
+    if (NULL == output)
+    {
+        perror(path);
+        exit(1);
+    }
+
+    fwrite(file.data, 1, file.size, output);
+    for (int i = 0; i < 4; ++i)
+    {
+        fwrite(contents[i]->data, 1, contents[i]->size, output);
+        free(contents[i]->data);
+    }
+    fclose(output);
+    free(file.data);
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_load_XXXXXX";
+    double lazy = 1e9, run = 1e9, eager = 1e9;
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_load");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    for (int i = 0; i < RUNS; ++i)
+    {
+        vm_program_t *program = NULL;
+        vm_context_t *context = NULL;
+        double start = 0, loaded = 0, end = 0;
+
+        start = bench_now();
+        program = vm_program_load(path, stderr);
+        loaded = bench_now();
+        if (NULL == program)
+        {
+            fprintf(stderr, "could not load %s\n", path);
+            return 1;
+        }
+
+        context = vm_context_create(program, 0, 0, output, stdin, stderr, VM_ENGINE_THREADED);
+        vm_run(context);
+        end = bench_now();
+
+        lazy = (loaded - start < lazy ? loaded - start : lazy);
+        run = (end - start < run ? end - start : run);
+
+        // what loading costs when every method is verified and translated up front
+        start = bench_now();
+        for (unsigned int j = 0; j < program->num_methods; ++j)
+        {
+            prepare_method(program, &program->method_table[j]);
+        }
+        end = bench_now();
+        eager = (end - start < eager ? end - start : eager);
+
+        vm_context_free(context);
+        vm_program_free(program);
+    }
+
+    printf("%d methods, %d called\n", METHODS, CALLED);
+    printf("lazy load      %8.2f ms\n", lazy * 1e3);
+    printf("load and run   %8.2f ms\n", run * 1e3);
+    printf("eager load     %8.2f ms\n", (lazy + eager) * 1e3);
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
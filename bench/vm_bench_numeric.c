@@ -0,0 +1,555 @@
+#include <math.h>   /* sqrt    */
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+#include "vm_numeric.h" /* compare_doubles */
+
+/*
+* Double-precision kernels against the same code compiled natively. There
+* are no branches yet, so both run under a binary call tree of DEPTH levels:
+* - mandelbrot: every leaf is one point of a 2^(DEPTH/2) square grid, whose
+*   coordinates are summed up along the path to it, iterated ITERATIONS
+*   times. The leaves compare 4 to the squared magnitude, 1 for the points
+*   that stay inside and -1 for the ones that escape, and main prints the
+*   sum.
+* - nbody: the five planets of the classic benchmark in a double array,
+*   every leaf advances them one step, and main prints their energy.
+* Both programs print what the native code computes, to the last digit.
+*/
+
+#define DEPTH 16
+#define ITERATIONS 32
+#define RUNS 3
+
+#define NUM_BODIES 5
+#define BODY_SIZE 7 // x, y, z, vx, vy, vz, mass
+#define DT 0.01
+
+enum field { X, Y, Z, VX, VY, VZ, MASS };
+
+static const double grid_left = -2.0, grid_bottom = -1.25, grid_size = 2.5;
+
+static double bodies[NUM_BODIES * BODY_SIZE];
+static volatile double sink;
+
+/* the step added at a level, in the real coordinate on even levels and the imaginary one on odd */
+static double get_grid_step(int level)
+{
+    return grid_size / (1 << (DEPTH / 2)) * (1 << (level / 2));
+}
+
+static void build_mandelbrot(const char *path)
+{
+    bench_program_t program = {0};
+    unsigned int offsets[DEPTH + 2] = {0};
+    unsigned int leaf = DEPTH + 1, constants = DEPTH + 2;
+    enum { CR, CI, ZR, ZI, T };
+
+    // main, the levels and the leaf, then the steps of the levels and the corner
+    offsets[0] = bench_op(&program, OP_CLOAD, constants + DEPTH);
+    bench_op(&program, OP_CLOAD, constants + DEPTH + 1);
+    bench_op(&program, OP_CALL, 1);
+    bench_op(&program, OP_IPRINT, 0);
+    bench_op(&program, OP_STOP, 0);
+
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        offsets[level + 1] = bench_op(&program, OP_DLOAD, CR);
+        bench_op(&program, OP_DLOAD, CI);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_DLOAD, CR);
+        if (level % 2)
+        {
+            bench_op(&program, OP_DLOAD, CI);
+            bench_op(&program, OP_CLOAD, constants + level);
+            bench_op(&program, OP_DADD, 0);
+        }
+        else
+        {
+            bench_op(&program, OP_CLOAD, constants + level);
+            bench_op(&program, OP_DADD, 0);
+            bench_op(&program, OP_DLOAD, CI);
+        }
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_IADD, 0);
+        bench_op(&program, OP_IRET, 0);
+    }
+
+    // z = z * z + c, unrolled
+    offsets[leaf] = bench_op(&program, OP_NOOP, 0);
+    for (int i = 0; i < ITERATIONS; ++i)
+    {
+        bench_op(&program, OP_DLOAD, ZR);
+        bench_op(&program, OP_DLOAD, ZR);
+        bench_op(&program, OP_DMULT, 0);
+        bench_op(&program, OP_DLOAD, ZI);
+        bench_op(&program, OP_DLOAD, ZI);
+        bench_op(&program, OP_DMULT, 0);
+        bench_op(&program, OP_DSUB, 0);
+        bench_op(&program, OP_DLOAD, CR);
+        bench_op(&program, OP_DADD, 0);
+        bench_op(&program, OP_DSTORE, T);
+        bench_op(&program, OP_DLOAD, ZR);
+        bench_op(&program, OP_DLOAD, ZI);
+        bench_op(&program, OP_DMULT, 0);
+        bench_op(&program, OP_DPUSH, 2);
+        bench_op(&program, OP_DMULT, 0);
+        bench_op(&program, OP_DLOAD, CI);
+        bench_op(&program, OP_DADD, 0);
+        bench_op(&program, OP_DSTORE, ZI);
+        bench_op(&program, OP_DLOAD, T);
+        bench_op(&program, OP_DSTORE, ZR);
+    }
+    // an escaped point has overflowed to infinity or NaN, which compare as not less than 4
+    bench_op(&program, OP_DPUSH, 4);
+    bench_op(&program, OP_DLOAD, ZR);
+    bench_op(&program, OP_DLOAD, ZR);
+    bench_op(&program, OP_DMULT, 0);
+    bench_op(&program, OP_DLOAD, ZI);
+    bench_op(&program, OP_DLOAD, ZI);
+    bench_op(&program, OP_DMULT, 0);
+    bench_op(&program, OP_DADD, 0);
+    bench_op(&program, OP_DCMP, 0);
+    bench_op(&program, OP_IRET, 0);
+
+    bench_method(&program, "main", 0x02, "", "", offsets[0]);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, "", "DD", offsets[level + 1]);
+    }
+    bench_method(&program, "leaf", 0x02, "DDD", "DD", offsets[leaf]);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        bench_double(&program, get_grid_step(level));
+    }
+    bench_double(&program, grid_left);
+    bench_double(&program, grid_bottom);
+
+    bench_save(&program, path);
+}
+
+static int mandelbrot_point(double cr, double ci)
+{
+    double zr = 0, zi = 0, t = 0;
+
+    for (int i = 0; i < ITERATIONS; ++i)
+    {
+        t = zr * zr - zi * zi + cr;
+        zi = zr * zi * 2 + ci;
+        zr = t;
+    }
+
+    // as dcmp, a point on the circle compares equal
+    return compare_doubles(4, zr * zr + zi * zi);
+}
+
+static int mandelbrot_level(int level, double cr, double ci)
+{
+    int sum = 0;
+
+    if (DEPTH == level)
+    {
+        return mandelbrot_point(cr, ci);
+    }
+
+    sum = mandelbrot_level(level + 1, cr, ci);
+    if (level % 2)
+    {
+        return sum + mandelbrot_level(level + 1, cr, ci + get_grid_step(level));
+    }
+
+    return sum + mandelbrot_level(level + 1, cr + get_grid_step(level), ci);
+}
+
+static void run_mandelbrot(char *result, size_t size)
+{
+    snprintf(result, size, "%d", mandelbrot_level(0, grid_left, grid_bottom));
+}
+
+/* the sun and the four outer planets, with the momentum of the sun offset */
+static void init_bodies(void)
+{
+    const double pi = 3.141592653589793;
+    const double solar_mass = 4 * pi * pi;
+    const double days_per_year = 365.24;
+    static const double planets[NUM_BODIES - 1][BODY_SIZE] = {
+        { 4.84143144246472090e+00, -1.16032004402742839e+00, -1.03622044471123109e-01,
+          1.66007664274403694e-03, 7.69901118419740425e-03, -6.90460016972063023e-05, 9.54791938424326609e-04 },
+        { 8.34336671824457987e+00, 4.12479856412430479e+00, -4.03523417114321381e-01,
+          -2.76742510726862411e-03, 4.99852801234917238e-03, 2.30417297573763929e-05, 2.85885980666130812e-04 },
+        { 1.28943695621391310e+01, -1.51111514016986312e+01, -2.23307578892655734e-01,
+          2.96460137564761618e-03, 2.37847173959480950e-03, -2.96589568540237556e-05, 4.36624404335156298e-05 },
+        { 1.53796971148509165e+01, -2.59193146099879641e+01, 1.79258772950371181e-01,
+          2.68067772490389322e-03, 1.62824170038242295e-03, -9.51592254519715870e-05, 5.15138902046611451e-05 },
+    };
+    double px = 0, py = 0, pz = 0;
+
+    bodies[X] = bodies[Y] = bodies[Z] = 0;
+    bodies[MASS] = solar_mass;
+    for (int i = 1; i < NUM_BODIES; ++i)
+    {
+        double *body = &bodies[i * BODY_SIZE];
+
+        body[X] = planets[i - 1][X];
+        body[Y] = planets[i - 1][Y];
+        body[Z] = planets[i - 1][Z];
+        body[VX] = planets[i - 1][VX] * days_per_year;
+        body[VY] = planets[i - 1][VY] * days_per_year;
+        body[VZ] = planets[i - 1][VZ] * days_per_year;
+        body[MASS] = planets[i - 1][MASS] * solar_mass;
+
+        px += body[VX] * body[MASS];
+        py += body[VY] * body[MASS];
+        pz += body[VZ] * body[MASS];
+    }
+    bodies[VX] = -px / solar_mass;
+    bodies[VY] = -py / solar_mass;
+    bodies[VZ] = -pz / solar_mass;
+}
+
+/* pushes the element of the bodies array in local 0 */
+static void load_field(bench_program_t *program, int body, enum field field)
+{
+    bench_op(program, OP_RLOAD, 0);
+    bench_op(program, OP_IPUSH, body * BODY_SIZE + field);
+    bench_op(program, OP_DALOAD, 0);
+}
+
+/* pushes the differences of the positions of two bodies to the locals from first on */
+static void emit_distance(bench_program_t *program, int i, int j, int first)
+{
+    for (int axis = X; axis <= Z; ++axis)
+    {
+        load_field(program, i, (enum field)axis);
+        load_field(program, j, (enum field)axis);
+        bench_op(program, OP_DSUB, 0);
+        bench_op(program, OP_DSTORE, first + axis);
+    }
+
+    // squared, dx * dx + dy * dy + dz * dz
+    for (int axis = X; axis <= Z; ++axis)
+    {
+        bench_op(program, OP_DLOAD, first + axis);
+        bench_op(program, OP_DLOAD, first + axis);
+        bench_op(program, OP_DMULT, 0);
+        if (axis != X)
+        {
+            bench_op(program, OP_DADD, 0);
+        }
+    }
+}
+
+static void build_nbody(const char *path)
+{
+    bench_program_t program = {0};
+    unsigned int offsets[DEPTH + 2] = {0};
+    unsigned int leaf = DEPTH + 1, constants = DEPTH + 2;
+    unsigned int dt = constants + NUM_BODIES * BODY_SIZE, half = dt + 1;
+    enum { BODIES, DX, DY, DZ, D2, MAG, ENERGY = 1 };
+
+    offsets[0] = bench_op(&program, OP_IPUSH, NUM_BODIES * BODY_SIZE);
+    bench_op(&program, OP_NEWARRAY, 0x05); // double elements
+    bench_op(&program, OP_RSTORE, BODIES);
+    for (int i = 0; i < NUM_BODIES * BODY_SIZE; ++i)
+    {
+        bench_op(&program, OP_RLOAD, BODIES);
+        bench_op(&program, OP_IPUSH, i);
+        bench_op(&program, OP_CLOAD, constants + i);
+        bench_op(&program, OP_DASTORE, 0);
+    }
+    bench_op(&program, OP_RLOAD, BODIES);
+    bench_op(&program, OP_CALL, 1);
+
+    // the energy, the kinetic of every body less the potential of every pair
+    for (int i = 0; i < NUM_BODIES; ++i)
+    {
+        bench_op(&program, OP_DLOAD, ENERGY);
+        bench_op(&program, OP_CLOAD, half);
+        load_field(&program, i, MASS);
+        bench_op(&program, OP_DMULT, 0);
+        for (int axis = VX; axis <= VZ; ++axis)
+        {
+            load_field(&program, i, (enum field)axis);
+            load_field(&program, i, (enum field)axis);
+            bench_op(&program, OP_DMULT, 0);
+            if (axis != VX)
+            {
+                bench_op(&program, OP_DADD, 0);
+            }
+        }
+        bench_op(&program, OP_DMULT, 0);
+        bench_op(&program, OP_DADD, 0);
+        bench_op(&program, OP_DSTORE, ENERGY);
+
+        for (int j = i + 1; j < NUM_BODIES; ++j)
+        {
+            emit_distance(&program, i, j, ENERGY + 1);
+            bench_op(&program, OP_DSQRT, 0);
+            bench_op(&program, OP_DSTORE, ENERGY + 4);
+            bench_op(&program, OP_DLOAD, ENERGY);
+            load_field(&program, i, MASS);
+            load_field(&program, j, MASS);
+            bench_op(&program, OP_DMULT, 0);
+            bench_op(&program, OP_DLOAD, ENERGY + 4);
+            bench_op(&program, OP_DDIV, 0);
+            bench_op(&program, OP_DSUB, 0);
+            bench_op(&program, OP_DSTORE, ENERGY);
+        }
+    }
+    bench_op(&program, OP_DLOAD, ENERGY);
+    bench_op(&program, OP_DPRINT, 0);
+    bench_op(&program, OP_STOP, 0);
+
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        offsets[level + 1] = bench_op(&program, OP_RLOAD, BODIES);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_RLOAD, BODIES);
+        bench_op(&program, OP_CALL, level + 2);
+        bench_op(&program, OP_RET, 0);
+    }
+
+    // one step, the velocities of every pair, then the positions
+    offsets[leaf] = bench_op(&program, OP_NOOP, 0);
+    for (int i = 0; i < NUM_BODIES; ++i)
+    {
+        for (int j = i + 1; j < NUM_BODIES; ++j)
+        {
+            emit_distance(&program, i, j, DX);
+            bench_op(&program, OP_DSTORE, D2);
+            bench_op(&program, OP_CLOAD, dt);
+            bench_op(&program, OP_DLOAD, D2);
+            bench_op(&program, OP_DLOAD, D2);
+            bench_op(&program, OP_DSQRT, 0);
+            bench_op(&program, OP_DMULT, 0);
+            bench_op(&program, OP_DDIV, 0);
+            bench_op(&program, OP_DSTORE, MAG);
+
+            for (int axis = X; axis <= Z; ++axis)
+            {
+                // v[i] -= d * m[j] * mag, v[j] += d * m[i] * mag
+                for (int side = 0; side < 2; ++side)
+                {
+                    int body = (0 == side ? i : j), other = (0 == side ? j : i);
+
+                    bench_op(&program, OP_RLOAD, BODIES);
+                    bench_op(&program, OP_IPUSH, body * BODY_SIZE + VX + axis);
+                    load_field(&program, body, (enum field)(VX + axis));
+                    bench_op(&program, OP_DLOAD, DX + axis);
+                    load_field(&program, other, MASS);
+                    bench_op(&program, OP_DMULT, 0);
+                    bench_op(&program, OP_DLOAD, MAG);
+                    bench_op(&program, OP_DMULT, 0);
+                    bench_op(&program, OP_DSUB + (OP_DADD - OP_DSUB) * side, 0);
+                    bench_op(&program, OP_DASTORE, 0);
+                }
+            }
+        }
+    }
+    for (int i = 0; i < NUM_BODIES; ++i)
+    {
+        for (int axis = X; axis <= Z; ++axis)
+        {
+            bench_op(&program, OP_RLOAD, BODIES);
+            bench_op(&program, OP_IPUSH, i * BODY_SIZE + axis);
+            load_field(&program, i, (enum field)axis);
+            bench_op(&program, OP_CLOAD, dt);
+            load_field(&program, i, (enum field)(VX + axis));
+            bench_op(&program, OP_DMULT, 0);
+            bench_op(&program, OP_DADD, 0);
+            bench_op(&program, OP_DASTORE, 0);
+        }
+    }
+    bench_op(&program, OP_RET, 0);
+
+    bench_method(&program, "main", 0x02, "RDDDDD", "", offsets[0]);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, "", "R", offsets[level + 1]);
+    }
+    bench_method(&program, "leaf", 0x02, "DDDDD", "R", offsets[leaf]);
+    init_bodies();
+    for (int i = 0; i < NUM_BODIES * BODY_SIZE; ++i)
+    {
+        bench_double(&program, bodies[i]);
+    }
+    bench_double(&program, DT);
+    bench_double(&program, 0.5);
+
+    bench_save(&program, path);
+}
+
+/* the same operations in the same order as the generated code */
+static void run_nbody(char *result, size_t size)
+{
+    double energy = 0;
+
+    init_bodies();
+
+    for (long step = 0; step < (1L << DEPTH); ++step)
+    {
+        for (int i = 0; i < NUM_BODIES; ++i)
+        {
+            double *a = &bodies[i * BODY_SIZE];
+
+            for (int j = i + 1; j < NUM_BODIES; ++j)
+            {
+                double *b = &bodies[j * BODY_SIZE];
+                double dx = a[X] - b[X], dy = a[Y] - b[Y], dz = a[Z] - b[Z];
+                double d2 = dx * dx + dy * dy + dz * dz;
+                double mag = DT / (d2 * sqrt(d2));
+
+                a[VX] = a[VX] - dx * b[MASS] * mag;
+                b[VX] = b[VX] + dx * a[MASS] * mag;
+                a[VY] = a[VY] - dy * b[MASS] * mag;
+                b[VY] = b[VY] + dy * a[MASS] * mag;
+                a[VZ] = a[VZ] - dz * b[MASS] * mag;
+                b[VZ] = b[VZ] + dz * a[MASS] * mag;
+            }
+        }
+        for (int i = 0; i < NUM_BODIES; ++i)
+        {
+            double *a = &bodies[i * BODY_SIZE];
+
+            a[X] = a[X] + DT * a[VX];
+            a[Y] = a[Y] + DT * a[VY];
+            a[Z] = a[Z] + DT * a[VZ];
+        }
+    }
+
+    for (int i = 0; i < NUM_BODIES; ++i)
+    {
+        double *a = &bodies[i * BODY_SIZE];
+
+        energy = energy + 0.5 * a[MASS] * (a[VX] * a[VX] + a[VY] * a[VY] + a[VZ] * a[VZ]);
+        for (int j = i + 1; j < NUM_BODIES; ++j)
+        {
+            double *b = &bodies[j * BODY_SIZE];
+            double dx = a[X] - b[X], dy = a[Y] - b[Y], dz = a[Z] - b[Z];
+
+            energy = energy - a[MASS] * b[MASS] / sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+
+    sink = energy;
+    snprintf(result, size, "%.15g", energy);
+}
+
+/* the best run time of the program on the engine, and the line it printed */
+static double run_vm(const char *path, enum vm_engine engine, char *result, size_t size)
+{
+    double best = 0;
+
+    for (int run = 0; run < RUNS; ++run)
+    {
+        vm_gc_stats_t stats = {0};
+        FILE *output = tmpfile();
+        vm_t *vm = NULL;
+
+        if (NULL == output)
+        {
+            perror("vm_bench_numeric");
+            exit(1);
+        }
+
+        vm = vm_create(path, 0, 0, output, stdin, stderr, engine);
+        if (NULL == vm)
+        {
+            fprintf(stderr, "could not load %s\n", path);
+            exit(1);
+        }
+
+        vm_run(vm);
+        vm_context_get_gc_stats(vm, &stats);
+        vm_free(vm);
+
+        rewind(output);
+        if (NULL == fgets(result, size, output))
+        {
+            result[0] = '\0';
+        }
+        result[strcspn(result, "\n")] = '\0';
+        fclose(output);
+
+        if (0 == run || stats.run_time < best)
+        {
+            best = stats.run_time;
+        }
+    }
+
+    return best;
+}
+
+static double run_native(void (*kernel)(char *, size_t), char *result, size_t size)
+{
+    double best = 0;
+
+    for (int run = 0; run < RUNS; ++run)
+    {
+        double start = bench_now();
+
+        kernel(result, size);
+        if (0 == run || bench_now() - start < best)
+        {
+            best = bench_now() - start;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char *name;
+        void (*build)(const char *);
+        void (*native)(char *, size_t);
+    } kernels[] = {
+        { "mandelbrot", build_mandelbrot, run_mandelbrot },
+        { "nbody", build_nbody, run_nbody },
+    };
+    char path[] = "/tmp/vm_bench_numeric_XXXXXX";
+    int fd = mkstemp(path);
+
+    if (-1 == fd)
+    {
+        perror("vm_bench_numeric");
+        return 1;
+    }
+    close(fd);
+
+    printf("%10s %12s %12s %12s %8s %20s %20s\n",
+        "kernel", "threaded ms", "dense ms", "native ms", "ratio", "vm result", "native result");
+
+    for (unsigned int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i)
+    {
+        char threaded_result[64], dense_result[64], native_result[64];
+        double threaded = 0, dense = 0, native = 0;
+
+        kernels[i].build(path);
+        threaded = run_vm(path, VM_ENGINE_THREADED, threaded_result, sizeof(threaded_result));
+        dense = run_vm(path, VM_ENGINE_DENSE, dense_result, sizeof(dense_result));
+        native = run_native(kernels[i].native, native_result, sizeof(native_result));
+
+        if (0 != strcmp(threaded_result, dense_result))
+        {
+            fprintf(stderr, "%s: the engines disagree, %s and %s\n", kernels[i].name, threaded_result, dense_result);
+        }
+
+        printf("%10s %12.1f %12.1f %12.1f %8.1f %20s %20s\n",
+            kernels[i].name, threaded * 1e3, dense * 1e3, native * 1e3, dense / native, dense_result, native_result);
+    }
+
+    unlink(path);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>  /* printf  */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "vm_output.h" /* DEFAULT_OUTPUT_BUFFER_SIZE */
+
+#include "bench_util.h"
+
+/*
+* Output-heavy workload: a loop that prints COUNT integers, one per line.
+* The buffered column is the default output buffer of a context, the
+* unbuffered one sets it to 0 bytes so every print is written and flushed
+* on its own, a syscall per printed value.
+*/
+
+#define COUNT 10000000
+#define LOOP_START 2
+#define LOOP_END 11
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+
+    bench_method(&program, "main", 0x02, "I", "", 0);
+
+    bench_op(&program, OP_IPUSH, COUNT);
+    bench_op(&program, OP_ISTORE, 0);
+    bench_op(&program, OP_ILOAD, 0);          // LOOP_START
+    bench_op(&program, OP_IFEQ, LOOP_END);
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IPRINT, 0);
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IPUSH, 1);
+    bench_op(&program, OP_ISUB, 0);
+    bench_op(&program, OP_ISTORE, 0);
+    bench_op(&program, OP_GOTO, LOOP_START);
+    bench_op(&program, OP_STOP, 0);           // LOOP_END
+
+    bench_save(&program, path);
+}
+
+static double run_once(const char *path, size_t buffer_size, FILE *output)
+{
+    vm_t *vm = NULL;
+    double start = 0, end = 0;
+
+    vm = vm_create(path, 0, 0, output, stdin, stderr, VM_ENGINE_THREADED);
+    if (NULL == vm || 0 != vm_context_set_output_buffer(vm, buffer_size))
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        exit(1);
+    }
+
+    start = bench_now();
+    vm_run(vm);
+    end = bench_now();
+
+    vm_free(vm);
+
+    return end - start;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_output_XXXXXX";
+    const char *names[] = { "buffered", "unbuffered" };
+    size_t buffer_sizes[] = { DEFAULT_OUTPUT_BUFFER_SIZE, 0 };
+    double times[2] = {0};
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_output");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        times[i] = run_once(path, buffer_sizes[i], output);
+
+        printf("%-10s %10.0f prints/s (%d prints in %.3fs)\n",
+            names[i], COUNT / times[i], COUNT, times[i]);
+    }
+    printf("buffered output is %.1fx faster\n", times[1] / times[0]);
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "bench_util.h"
+
+/*
+* Tail recursion: sum(n, acc) calls itself DEPTH levels deep to add up
+* 1..n, and main runs it REPEATS times. The same program is built with a
+* call and with a tailcall in sum, a call needs a frame per level so DEPTH
+* is kept within the default stack. A single sum DEEP levels deep is then
+* run with the tailcall only, on a stack that could not hold DEEP frames.
+*/
+
+#define DEPTH 500
+#define REPEATS 20000
+#define DEEP 10000000
+#define RUNS 5
+#define MAIN_SIZE 14
+#define ENGINES 5
+
+static void build_program(const char *path, int call_opcode, int depth, int repeats)
+{
+    bench_program_t program = {0};
+
+    bench_method(&program, "main", 0x02, "I", "", 0);
+    bench_method(&program, "sum", 0x02, "", "II", MAIN_SIZE);
+
+    bench_op(&program, OP_IPUSH, repeats);
+    bench_op(&program, OP_ISTORE, 0);
+    bench_op(&program, OP_ILOAD, 0); // 2, the loop
+    bench_op(&program, OP_IFEQ, 13);
+    bench_op(&program, OP_IPUSH, depth);
+    bench_op(&program, OP_IPUSH, 0);
+    bench_op(&program, OP_CALL, 1);
+    bench_op(&program, OP_POP, 0);
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IPUSH, 1);
+    bench_op(&program, OP_ISUB, 0);
+    bench_op(&program, OP_ISTORE, 0);
+    bench_op(&program, OP_GOTO, 2);
+    bench_op(&program, OP_RET, 0);
+
+    bench_op(&program, OP_ILOAD, 0); // MAIN_SIZE
+    bench_op(&program, OP_IFEQ, MAIN_SIZE + 10);
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IPUSH, 1);
+    bench_op(&program, OP_ISUB, 0);
+    bench_op(&program, OP_ILOAD, 1);
+    bench_op(&program, OP_ILOAD, 0);
+    bench_op(&program, OP_IADD, 0);
+    bench_op(&program, call_opcode, 1);
+    bench_op(&program, OP_IRET, 0);
+    bench_op(&program, OP_ILOAD, 1); // MAIN_SIZE + 10
+    bench_op(&program, OP_IRET, 0);
+
+    bench_save(&program, path);
+}
+
+/* the time of the run, negative when it fails */
+static double run_once(const char *path, enum vm_engine engine, FILE *output)
+{
+    vm_t *vm = NULL;
+    double start = 0, end = 0;
+    int res = 0;
+
+    vm = vm_create(path, 0, 0, output, stdin, stderr, engine);
+    if (NULL == vm)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        exit(1);
+    }
+
+    start = bench_now();
+    res = vm_run(vm);
+    end = bench_now();
+
+    vm_free(vm);
+
+    return (0 == res ? end - start : -1);
+}
+
+static double run_best(const char *path, enum vm_engine engine, FILE *output)
+{
+    double best = 1e9;
+
+    for (int run = 0; run < RUNS; ++run)
+    {
+        double elapsed = run_once(path, engine, output);
+
+        best = (elapsed < best ? elapsed : best);
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_tailcalls_XXXXXX";
+    const char *engine_names[ENGINES] = { "handlers", "threaded", "jit", "register", "dense" };
+    enum vm_engine engines[ENGINES] = {
+        VM_ENGINE_HANDLERS, VM_ENGINE_THREADED, VM_ENGINE_JIT, VM_ENGINE_REGISTER, VM_ENGINE_DENSE
+    };
+    double calls = (double)DEPTH * REPEATS;
+    double call_time[ENGINES] = {0}, tailcall_time[ENGINES] = {0}, deep_time = 0;
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_tailcalls");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path, OP_CALL, DEPTH, REPEATS);
+    for (int i = 0; i < ENGINES; ++i)
+    {
+        call_time[i] = run_best(path, engines[i], output);
+    }
+
+    build_program(path, OP_TAILCALL, DEPTH, REPEATS);
+    for (int i = 0; i < ENGINES; ++i)
+    {
+        tailcall_time[i] = run_best(path, engines[i], output);
+    }
+
+    for (int i = 0; i < ENGINES; ++i)
+    {
+        printf("%-9s call %10.0f calls/s, tailcall %10.0f calls/s (%.2fx)\n",
+            engine_names[i], calls / call_time[i], calls / tailcall_time[i], call_time[i] / tailcall_time[i]);
+    }
+
+    build_program(path, OP_TAILCALL, DEEP, 1);
+    deep_time = run_once(path, VM_ENGINE_HANDLERS, output);
+    if (0 > deep_time)
+    {
+        printf("handlers  tail recursion %d levels deep failed\n", DEEP);
+    }
+    else
+    {
+        printf("handlers  tail recursion %d levels deep in one frame (%.3fs)\n", DEEP, deep_time);
+    }
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>  /* printf */
+#include <stdlib.h> /* mkstemp */
+#include <unistd.h> /* unlink  */
+
+#include "vm_impl.h" /* vm_value_t */
+
+#include "bench_util.h"
+
+/*
+* Stack-heavy workload for comparing the value layouts: a chain of DEPTH
+* methods with LOCALS integer locals each. Every method writes all of its
+* locals, calls the next one and then reads them all back, so the whole
+* chain of frames is walked twice per call from main. Run it once per
+* layout, make bench_values builds and runs both.
+*/
+
+#define DEPTH 120
+#define LOCALS 100
+#define CALLS 2000
+#define RUNS 5
+#define STACK_SIZE (1 << 22)
+
+static void build_program(const char *path)
+{
+    bench_program_t program = {0};
+    char locals[LOCALS + 1] = {0};
+    unsigned int method_size = LOCALS * 2 + 1 + (LOCALS - 1) * 4 + 1;
+
+    for (int i = 0; i < LOCALS; ++i)
+    {
+        locals[i] = 'I';
+    }
+
+    bench_method(&program, "main", 0x02, "", "", 0);
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        char name[32];
+
+        snprintf(name, sizeof(name), "level%d", level);
+        bench_method(&program, name, 0x02, locals, "", CALLS + 1 + level * method_size);
+    }
+
+    for (int call = 0; call < CALLS; ++call)
+    {
+        bench_op(&program, OP_CALL, 1);
+    }
+    bench_op(&program, OP_STOP, 0);
+
+    for (int level = 0; level < DEPTH; ++level)
+    {
+        for (int i = 0; i < LOCALS; ++i)
+        {
+            bench_op(&program, OP_IPUSH, level + i);
+            bench_op(&program, OP_ISTORE, i);
+        }
+
+        bench_op(&program, (DEPTH - 1 == level ? OP_NOOP : OP_CALL), level + 2);
+
+        for (int i = 0; i < LOCALS - 1; ++i)
+        {
+            bench_op(&program, OP_ILOAD, i);
+            bench_op(&program, OP_ILOAD, i + 1);
+            bench_op(&program, OP_IADD, 0);
+            bench_op(&program, OP_ISTORE, i + 1);
+        }
+
+        bench_op(&program, OP_RET, 0);
+    }
+
+    bench_save(&program, path);
+}
+
+static double run_once(const char *path, enum vm_engine engine, FILE *output)
+{
+    vm_t *vm = NULL;
+    double start = 0, end = 0;
+
+    vm = vm_create(path, STACK_SIZE, 0, output, stdin, stderr, engine);
+    if (NULL == vm)
+    {
+        fprintf(stderr, "could not load %s\n", path);
+        exit(1);
+    }
+
+    start = bench_now();
+    vm_run(vm);
+    end = bench_now();
+
+    if (VM_FINISHED != vm->state)
+    {
+        fprintf(stderr, "%s did not finish\n", path);
+        exit(1);
+    }
+
+    vm_free(vm);
+
+    return end - start;
+}
+
+int main(void)
+{
+    char path[] = "/tmp/vm_bench_values_XXXXXX";
+    const char *engine_names[] = { "handlers", "threaded", "jit", "register" };
+    enum vm_engine engines[] = { VM_ENGINE_HANDLERS, VM_ENGINE_THREADED, VM_ENGINE_JIT, VM_ENGINE_REGISTER };
+    double accesses = (double)CALLS * DEPTH * LOCALS * 3;
+    FILE *output = fopen("/dev/null", "w");
+    int fd = mkstemp(path);
+
+    if (-1 == fd || NULL == output)
+    {
+        perror("vm_bench_values");
+        return 1;
+    }
+    close(fd);
+
+    build_program(path);
+
+    printf("%zu-byte values, %zu KB of stack per chain\n",
+        sizeof(vm_value_t), sizeof(vm_value_t) * DEPTH * (LOCALS + 4) / 1024);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        double best = 1e9;
+
+        for (int run = 0; run < RUNS; ++run)
+        {
+            double elapsed = run_once(path, engines[i], output);
+
+            best = (elapsed < best ? elapsed : best);
+        }
+
+        printf("%-9s %8.1f M local accesses/s (%.3fs)\n",
+            engine_names[i], accesses / best / 1e6, best);
+    }
+
+    unlink(path);
+    fclose(output);
+
+    return 0;
+}
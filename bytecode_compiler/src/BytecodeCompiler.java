@@ -4,16 +4,36 @@ import java.io.FileNotFoundException;
 public class BytecodeCompiler {
     public static void main(String args[]) {
         String inputFile, outputFile;
+        boolean fixedWidth = false;
+        boolean optimize = false;
+        int first = 0;
 
-        if (2 != args.length) {
-            System.out.println("usage: [arg1:input-file] [arg2:output-file]");
+        // the options come before the files, in any order
+        for (; first < args.length && args[first].startsWith("-"); ++first) {
+            if (args[first].equals("--fixed")) {
+                fixedWidth = true;
+            } else if (args[first].equals("-O")) {
+                optimize = true;
+            } else {
+                break;
+            }
+        }
+
+        if (2 != args.length - first) {
+            System.out.println("usage: [--fixed] [-O] [arg1:input-file] [arg2:output-file]");
         } else {
-            inputFile = args[0];
-            outputFile = args[1];
+            inputFile = args[first];
+            outputFile = args[first + 1];
 
             try {
                 Compiler compiler = new Compiler(inputFile, outputFile);
+                compiler.setFixedWidthCode(fixedWidth);
+                compiler.setOptimization(optimize);
                 compiler.compile();
+
+                for (String line : compiler.getOptimizationReport()) {
+                    System.out.println(line);
+                }
             } catch (FileNotFoundException e) {
                 System.out.println("file not found: " + inputFile);
                 System.exit(1);
@@ -26,6 +46,9 @@ public class BytecodeCompiler {
             } catch (Compiler.ConstantPoolException e) {
                 System.out.println(e);
                 System.exit(1);
+            } catch (Compiler.LabelException e) {
+                System.out.println(e);
+                System.exit(1);
             }
         }
     }
@@ -1,38 +1,77 @@
+import java.io.BufferedReader;
+import java.io.ByteArrayOutputStream;
 import java.io.FileNotFoundException;
 import java.io.FileOutputStream;
 import java.io.FileReader;
 import java.io.IOException;
+import java.nio.charset.StandardCharsets;
 import java.util.*;
 
 public class Compiler {
-    private static final int MAGIC_NUMBER = 0xBABEFACE;
+    private static final int MAGIC_NUMBER = 0xBABEFAC2;
+    private static final int VERSION = 2;
+
+    // section ids, see include/vm_loader.h
+    private static final int SECTION_CONSTANTS = 1;
+    private static final int SECTION_METHODS = 2;
+    private static final int SECTION_STRINGS = 3;
+    private static final int SECTION_CODE = 4;
+    private static final int SECTION_DEBUG = 5;
+    private static final int SECTION_DENSE_CODE = 6;
+    private static final int SECTION_DENSE_METHODS = 7;
+
+    private static final int HEADER_SIZE = 8;
+    private static final int SECTION_ENTRY_SIZE = 12;
+
     private String inputFilename = null;
     private String outputFilename = null;
-    private FileOutputStream output = null;
-    private List<Byte> outputBytes = new ArrayList<>();
     private Map<String, Opcode> opcodes = new HashMap<>();
     private Map<String, VMType> types = new HashMap<>();
-    private Map<String, List<Byte>> methods = new HashMap<>();
-    private List<List<Byte>> constantPool = new ArrayList<>();
+    private Map<String, Method> methods = new HashMap<>();
+    private List<Method> methodTable = new ArrayList<>();
+    private List<Constant> constantPool = new ArrayList<>();
+    private ByteArrayOutputStream strings = new ByteArrayOutputStream();
+    private ByteArrayOutputStream code = new ByteArrayOutputStream();
+    private ByteArrayOutputStream denseCode = new ByteArrayOutputStream();
+    private ByteArrayOutputStream debugLines = new ByteArrayOutputStream();
+    private Map<String, Integer> labels = new HashMap<>();
+    private List<Instruction> pending = new ArrayList<>();
+    private List<TailCall> tailCalls = new ArrayList<>();
+    private List<String> optimizationReport = new ArrayList<>();
+    private int numInstructions = 0; // read from the source, the code has numWritten
+    private int numWritten = 0;
+    private int currentLine = 0;
+    private int lastLine = 0;
+    private Method currentMethod = null;
+    private boolean useDenseCode = true;
+    private boolean optimize = false;
 
     public Compiler(String inputFilename, String outputFilename) {
         this.inputFilename = inputFilename;
         this.outputFilename = outputFilename;
-        
+
         initOpcodes();
         initTypes();
     }
 
-    public void compile() 
-    throws IOException, IllegalOpcodeException, FileNotFoundException, ConstantPoolException {
-        Scanner scn = null;
-        int opcodeIndex = 0;
+    // writes the fixed-width CODE section instead of the dense code
+    public void setFixedWidthCode(boolean fixedWidth) {
+        useDenseCode = !fixedWidth;
+    }
 
-        output = new FileOutputStream(outputFilename);
-        scn = new Scanner(new FileReader(inputFilename));
+    // runs the Optimizer on every method, see getOptimizationReport
+    public void setOptimization(boolean enabled) {
+        optimize = enabled;
+    }
+
+    // a line per optimized method with the instructions it had and has
+    public List<String> getOptimizationReport() {
+        return optimizationReport;
+    }
 
-        // write magic number
-        output.write(getIntBytes(MAGIC_NUMBER));
+    public void compile()
+    throws IOException, IllegalOpcodeException, FileNotFoundException, ConstantPoolException, LabelException {
+        SourceScanner scn = new SourceScanner(new FileReader(inputFilename));
 
         // build constant pool
         buildConstantPool(scn);
@@ -40,77 +79,308 @@ public class Compiler {
         while (scn.hasNext()) {
             String opcodeName = scn.next();
             Opcode curOpcode = opcodes.get(opcodeName);
-            
+
             if (null == curOpcode) {
-                // check if it's a method label, if it's not, it's an unknown opcode
-                if (-1 == opcodeName.indexOf(':', 0)) { 
-                    throw new IllegalOpcodeException("unknown opcode: " + opcodeName);
+                // check if it's a method or a branch label, if it's not, it's an unknown opcode
+                if (-1 == opcodeName.indexOf(':', 0)) {
+                    throw new IllegalOpcodeException("unknown opcode: " + opcodeName + " at line " + scn.getLine());
+                }
+
+                if (methods.containsKey(opcodeName.substring(0, opcodeName.length() - 1))) {
+                    startMethod(opcodeName);
+                } else {
+                    addLabel(opcodeName, scn.getLine());
                 }
-                
-                addMethodLocation(opcodeName, opcodeIndex);
             } else {
+                currentLine = scn.getLine();
                 curOpcode.process(scn);
-                
-                if (0xFF != curOpcode.getOpcode()) {
-                    ++opcodeIndex;
-                }
             }
         }
+        endMethod();
 
-        output.write((byte)constantPool.size());
-
-        for (List<Byte> entry : constantPool) {
-            for (Byte b : entry) {
-                output.write(b.byteValue());
+        for (Method method : methodTable) {
+            if (-1 == method.codeOffset) {
+                throw new ConstantPoolException("method: '" + method.name + "' has no code, file: "
+                    + inputFilename);
             }
         }
 
-        for (Byte b : outputBytes) {
-            output.write(b);
+        markTailCalls();
+        writeOutput();
+    }
+
+    /*
+     * Writes the header, the section table and then every section, each one
+     * aligned to 4 bytes so the VM can use it in place. The code goes in the
+     * dense encoding, unless setFixedWidthCode asked for the fixed-width one.
+     */
+    private void writeOutput() throws IOException {
+        ByteArrayOutputStream constants = new ByteArrayOutputStream();
+        ByteArrayOutputStream methodEntries = new ByteArrayOutputStream();
+        ByteArrayOutputStream denseOffsets = new ByteArrayOutputStream();
+        ByteArrayOutputStream file = new ByteArrayOutputStream();
+        FileOutputStream output = null;
+
+        for (Constant constant : constantPool) {
+            writeInt(constants, constant.type);
+            writeInt(constants, constant.a);
+            writeInt(constants, constant.b);
+        }
+
+        for (Method method : methodTable) {
+            writeInt(methodEntries, method.nameOffset);
+            writeInt(methodEntries, method.nameLength);
+            methodEntries.write(method.returnType);
+            methodEntries.write(method.numParams);
+            methodEntries.write(method.numLocals);
+            methodEntries.write(0);
+            writeInt(methodEntries, method.typesOffset);
+            writeInt(methodEntries, method.codeOffset);
+            writeInt(methodEntries, method.codeLength);
+            writeInt(denseOffsets, method.denseOffset);
+        }
+
+        int[] ids = { SECTION_CONSTANTS, SECTION_METHODS, SECTION_STRINGS, SECTION_CODE, SECTION_DEBUG };
+        ByteArrayOutputStream[] sections = { constants, methodEntries, strings, code, debugLines };
+
+        if (useDenseCode) {
+            ids = new int[] { SECTION_CONSTANTS, SECTION_METHODS, SECTION_STRINGS,
+                              SECTION_DENSE_CODE, SECTION_DENSE_METHODS, SECTION_DEBUG };
+            sections = new ByteArrayOutputStream[] { constants, methodEntries, strings,
+                                                     denseCode, denseOffsets, debugLines };
+        }
+        int offset = HEADER_SIZE + SECTION_ENTRY_SIZE * sections.length;
+
+        writeInt(file, MAGIC_NUMBER);
+        writeShort(file, VERSION);
+        writeShort(file, sections.length);
+
+        for (int i = 0; i < sections.length; ++i) {
+            writeInt(file, ids[i]);
+            writeInt(file, offset);
+            writeInt(file, sections[i].size());
+            offset = align(offset + sections[i].size());
         }
 
+        for (ByteArrayOutputStream section : sections) {
+            section.writeTo(file);
+            while (file.size() != align(file.size())) {
+                file.write(0);
+            }
+        }
+
+        output = new FileOutputStream(outputFilename);
+        file.writeTo(output);
         output.flush();
         output.close();
-        scn.close();
     }
 
-    private void addMethodLocation(String methodName, int opcodeIndex) throws ConstantPoolException {
-        List<Byte> output = null;
+    private void startMethod(String label) throws ConstantPoolException, LabelException {
+        String methodName = label.substring(0, label.length() - 1);
+        Method method = methods.get(methodName);
 
-        methodName = methodName.substring(0, methodName.length() - 1);
-        output = methods.get(methodName);
-        
-        if (null == output) {
+        if (null == method) {
             throw new ConstantPoolException("method: '" + methodName + "' not found in constant pool, file: "
                 + inputFilename);
         }
 
-        for (Byte b : getIntBytes(opcodeIndex)) {
-            output.add(b);
+        endMethod();
+
+        method.codeOffset = numInstructions;
+        method.denseOffset = denseCode.size();
+        currentMethod = method;
+    }
+
+    // a method's code runs up to the next method label or the end of the file
+    private void endMethod() throws ConstantPoolException, LabelException {
+        if (null == currentMethod) {
+            writeMethodCode(); // code before the first method, it has no labels
+            return;
+        }
+
+        currentMethod.codeLength = numInstructions - currentMethod.codeOffset;
+        if (0 == currentMethod.codeLength) {
+            throw new ConstantPoolException("method: '" + currentMethod.name + "' has no code, file: "
+                + inputFilename);
         }
+
+        writeMethodCode();
     }
 
-    private void buildConstantPool(Scanner scn) throws ConstantPoolException, IOException {
+    // a branch label names the index of the next instruction, in the method it's in
+    private void addLabel(String label, int line) throws LabelException {
+        String labelName = label.substring(0, label.length() - 1);
+
+        if (null == currentMethod) {
+            throw new LabelException("label: '" + labelName + "' outside a method at line " + line);
+        }
+
+        if (null != labels.put(labelName, pending.size())) {
+            throw new LabelException("label: '" + labelName + "' defined twice in method: '"
+                + currentMethod.name + "' at line " + line);
+        }
+    }
+
+    /*
+     * Writes the instructions of the current method once all of its labels
+     * are known, a forward branch can't be written in the dense code before
+     * the width of its target's varint is known. The method's code offset
+     * and length are the ones of the code written, after the Optimizer.
+     */
+    private void writeMethodCode() throws LabelException {
+        List<Instruction> instructions = pending;
+        Instruction end = new Instruction(0, false, 0, null, 0);
+
+        resolveBranches(numInstructions - pending.size(), end);
+
+        if (optimize && null != currentMethod && !pending.isEmpty()) {
+            instructions = new Optimizer().optimize(pending, end);
+            optimizationReport.add("method: " + currentMethod.name + ", " + pending.size() + " -> "
+                + instructions.size() + " instructions, " + (pending.size() - instructions.size()) + " removed");
+        }
+
+        if (null != currentMethod) {
+            currentMethod.codeOffset = numWritten;
+            currentMethod.codeLength = instructions.size();
+        }
+
+        for (int i = 0; i < instructions.size(); ++i) {
+            instructions.get(i).index = numWritten + i;
+        }
+        end.index = numWritten + instructions.size();
+
+        for (int i = 0; i < instructions.size(); ++i) {
+            Instruction instruction = instructions.get(i);
+            int arg = (null != instruction.target ? instruction.target.resolve().index : instruction.arg);
+
+            addDebugLine(instruction.line);
+
+            if (0x04 == instruction.opcode && i + 1 < instructions.size()
+                && 0 != getReturnBit(instructions.get(i + 1).opcode)) {
+                tailCalls.add(new TailCall(code.size(), denseCode.size(), arg, instructions.get(i + 1).opcode));
+            }
+            if (null != currentMethod) {
+                currentMethod.returns |= getReturnBit(instruction.opcode);
+            }
+
+            writeInt(code, instruction.opcode);
+            writeInt(code, arg);
+
+            denseCode.write(instruction.opcode);
+            if (instruction.hasArg) {
+                writeVarint(denseCode, arg);
+            }
+            ++numWritten;
+        }
+
+        pending.clear();
+        labels.clear();
+    }
+
+    /*
+     * A call followed by a return of what the callee returns becomes a
+     * tailcall, which runs the callee in the caller's frame. The opcode is
+     * the first byte of an instruction in both encodings, so it is replaced
+     * in place, and only when every return of the callee is the one after
+     * the call, which the VM's verifier requires of a tailcall.
+     */
+    private void markTailCalls() {
+        byte[] codeBytes = code.toByteArray();
+        byte[] denseBytes = denseCode.toByteArray();
+
+        for (TailCall tailCall : tailCalls) {
+            if (tailCall.constant < 0 || tailCall.constant >= constantPool.size()) {
+                continue;
+            }
+
+            Constant constant = constantPool.get(tailCall.constant);
+            if (0x08 == constant.type
+                && getReturnBit(tailCall.returnOpcode) == methodTable.get(constant.a).returns) {
+                codeBytes[tailCall.codePosition] = 0x07;
+                denseBytes[tailCall.densePosition] = 0x07;
+            }
+        }
+
+        code.reset();
+        code.write(codeBytes, 0, codeBytes.length);
+        denseCode.reset();
+        denseCode.write(denseBytes, 0, denseBytes.length);
+    }
+
+    // one bit per kind of return, 0 for any other opcode
+    private static int getReturnBit(int opcode) {
+        switch (opcode) {
+            case 0x05: return 0x01; // ret
+            case 0x19: return 0x02; // iret
+            case 0x33: return 0x04; // sret
+            case 0x43: return 0x08; // rret
+            case 0x89: return 0x10; // lret
+            case 0x99: return 0x20; // fret
+            case 0xA9: return 0x40; // dret
+            default: return 0;
+        }
+    }
+
+    /*
+     * Points every branch at the instruction it continues at, a label or an
+     * index counted like the code read so far, first is the index of the
+     * method's first instruction. A numeric target outside the method stays
+     * as it is, for the verifier to report.
+     */
+    private void resolveBranches(int first, Instruction end) throws LabelException {
+        for (Instruction instruction : pending) {
+            int target = instruction.arg - first;
+
+            if (null != instruction.label) {
+                Integer labelTarget = labels.get(instruction.label);
+
+                if (null == labelTarget) {
+                    throw new LabelException("unknown label: '" + instruction.label + "' in method: '"
+                        + (null == currentMethod ? "" : currentMethod.name) + "', file: " + inputFilename);
+                }
+                target = labelTarget;
+            } else if (!instruction.isBranch()) {
+                continue;
+            }
+
+            if (target == pending.size()) {
+                instruction.target = end;
+            } else if (0 <= target && target < pending.size()) {
+                instruction.target = pending.get(target);
+                instruction.target.isTarget = true;
+            }
+        }
+    }
+
+    // one entry per run of instructions from the same source line
+    private void addDebugLine(int line) {
+        if (line == lastLine) {
+            return;
+        }
+
+        writeInt(debugLines, numWritten);
+        writeInt(debugLines, line);
+        lastLine = line;
+    }
+
+    private void buildConstantPool(SourceScanner scn) throws ConstantPoolException, IOException {
         int constantPoolSize = 0;
 
         if (!scn.next().contentEquals("const")) {
             throw new ConstantPoolException("no constant pool was found in: " + inputFilename);
         }
-        
+
         if (!scn.hasNextInt()) {
             throw new ConstantPoolException("missing constant pool size in: " + inputFilename);
         }
 
         constantPoolSize = scn.nextInt();
-        
-        for (int i = 0; i < constantPoolSize; ++i) {
-            List<Byte> entry = new ArrayList<>();
 
+        for (int i = 0; i < constantPoolSize; ++i) {
             String typeIdentifier = scn.next();
             VMType type = resolveType(typeIdentifier);
 
-            type.process(scn, entry);
-            constantPool.add(entry);
+            constantPool.add(type.process(scn));
         }
     }
 
@@ -123,6 +393,8 @@ public class Compiler {
         opcodes.put("pop", new Opcode(0x03, (scn, code) -> writeNoArgOpcode(code)));
         opcodes.put("call", new Opcode(0x04, (scn, code) -> writeSingleIntOpcode(scn, code)));
         opcodes.put("ret", new Opcode(0x05, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("flush", new Opcode(0x06, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("tailcall", new Opcode(0x07, (scn, code) -> writeSingleIntOpcode(scn, code)));
 
         /* integer operations */
         opcodes.put("iload", new Opcode(0x10, (scn, code) -> writeSingleIntOpcode(scn, code)));
@@ -134,103 +406,180 @@ public class Compiler {
         opcodes.put("idiv", new Opcode(0x16, (scn, code) -> writeNoArgOpcode(code)));
         opcodes.put("ineg", new Opcode(0x17, (scn, code) -> writeNoArgOpcode(code)));
         opcodes.put("iprint", new Opcode(0x18, (scn, code) -> writeNoArgOpcode(code)));
-        opcodes.put("iret", new Opcode(0x19, (scn, code) -> writeNoArgOpcode(code)));       
-        
+        opcodes.put("iret", new Opcode(0x19, (scn, code) -> writeNoArgOpcode(code)));
+
+        /* control flow, the arg is a label or the index of an instruction of the method */
+        opcodes.put("goto", new Opcode(0x20, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("ifeq", new Opcode(0x21, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("ifne", new Opcode(0x22, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("if_icmpeq", new Opcode(0x23, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("if_icmpne", new Opcode(0x24, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("if_icmplt", new Opcode(0x25, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("if_icmpge", new Opcode(0x26, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("if_icmpgt", new Opcode(0x27, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("if_icmple", new Opcode(0x28, (scn, code) -> writeBranchOpcode(scn, code)));
+        opcodes.put("tableswitch", new Opcode(0x29, (scn, code) -> writeTableswitch(scn, code)));
+
         /* string operations */
         opcodes.put("sload", new Opcode(0x30, (scn, code) -> writeSingleIntOpcode(scn, code)));
         opcodes.put("sstore", new Opcode(0x31, (scn, code) -> writeSingleIntOpcode(scn, code)));
         opcodes.put("sprint", new Opcode(0x32, (scn, code) -> writeNoArgOpcode(code)));
         opcodes.put("sret", new Opcode(0x33, (scn, code) -> writeNoArgOpcode(code)));
-        
+
+        /* reference operations */
+        opcodes.put("rload", new Opcode(0x40, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("rstore", new Opcode(0x41, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("rnull", new Opcode(0x42, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("rret", new Opcode(0x43, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("new", new Opcode(0x44, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("igetfield", new Opcode(0x45, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("iputfield", new Opcode(0x46, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("sgetfield", new Opcode(0x47, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("sputfield", new Opcode(0x48, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("rgetfield", new Opcode(0x49, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("rputfield", new Opcode(0x4A, (scn, code) -> writeSingleIntOpcode(scn, code)));
+
         /* constant pool operations */
         opcodes.put("cload", new Opcode(0x50, (scn, code) -> writeSingleIntOpcode(scn, code)));
+
+        /* array operations, the arg of newarray is the type code of the elements */
+        opcodes.put("newarray", new Opcode(0x70, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("alen", new Opcode(0x71, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("baload", new Opcode(0x72, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("bastore", new Opcode(0x73, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("iaload", new Opcode(0x74, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("iastore", new Opcode(0x75, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("afill", new Opcode(0x76, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("acopy", new Opcode(0x77, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("asum", new Opcode(0x78, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("adot", new Opcode(0x79, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("aadd", new Opcode(0x7A, (scn, code) -> writeNoArgOpcode(code)));
+
+        /* long operations */
+        opcodes.put("lload", new Opcode(0x80, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("lstore", new Opcode(0x81, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("lpush", new Opcode(0x82, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("ladd", new Opcode(0x83, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lsub", new Opcode(0x84, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lmult", new Opcode(0x85, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("ldiv", new Opcode(0x86, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lneg", new Opcode(0x87, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lprint", new Opcode(0x88, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lret", new Opcode(0x89, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lcmp", new Opcode(0x8A, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("laload", new Opcode(0x8B, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("lastore", new Opcode(0x8C, (scn, code) -> writeNoArgOpcode(code)));
+
+        /* float operations */
+        opcodes.put("fload", new Opcode(0x90, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("fstore", new Opcode(0x91, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("fpush", new Opcode(0x92, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("fadd", new Opcode(0x93, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fsub", new Opcode(0x94, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fmult", new Opcode(0x95, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fdiv", new Opcode(0x96, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fneg", new Opcode(0x97, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fprint", new Opcode(0x98, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fret", new Opcode(0x99, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fcmp", new Opcode(0x9A, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("faload", new Opcode(0x9B, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("fastore", new Opcode(0x9C, (scn, code) -> writeNoArgOpcode(code)));
+
+        /* double operations */
+        opcodes.put("dload", new Opcode(0xA0, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("dstore", new Opcode(0xA1, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("dpush", new Opcode(0xA2, (scn, code) -> writeSingleIntOpcode(scn, code)));
+        opcodes.put("dadd", new Opcode(0xA3, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dsub", new Opcode(0xA4, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dmult", new Opcode(0xA5, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("ddiv", new Opcode(0xA6, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dneg", new Opcode(0xA7, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dprint", new Opcode(0xA8, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dret", new Opcode(0xA9, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dcmp", new Opcode(0xAA, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("daload", new Opcode(0xAB, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dastore", new Opcode(0xAC, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("dsqrt", new Opcode(0xAD, (scn, code) -> writeNoArgOpcode(code)));
+
+        /* conversions */
+        opcodes.put("i2l", new Opcode(0xB0, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("i2f", new Opcode(0xB1, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("i2d", new Opcode(0xB2, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("l2i", new Opcode(0xB3, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("l2f", new Opcode(0xB4, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("l2d", new Opcode(0xB5, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("f2i", new Opcode(0xB6, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("f2l", new Opcode(0xB7, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("f2d", new Opcode(0xB8, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("d2i", new Opcode(0xB9, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("d2l", new Opcode(0xBA, (scn, code) -> writeNoArgOpcode(code)));
+        opcodes.put("d2f", new Opcode(0xBB, (scn, code) -> writeNoArgOpcode(code)));
     }
 
     private void initTypes() {
         // byte
-        types.put("B", new VMType(0x01, (scn, type, output) -> {
-            output.add((byte)type);
-            int intVal = scn.nextInt();
-            output.add(getIntBytes(intVal)[0]);
-        })); 
-        
+        types.put("B", new VMType(0x01, (scn, type) -> new Constant(type, scn.nextInt() & 0xFF, 0)));
+
         // integer
-        types.put("I", new VMType(0x02, (scn, type, output) -> {
-            output.add((byte)type);
-            int intVal = scn.nextInt();
-            for (Byte b : getIntBytes(intVal)) {
-                output.add(b);
-            }
-        })); 
-        
-        // float
-        types.put("F", new VMType(0x03, (scn, type, output) -> {
-            output.add((byte)type);
-        })); 
-        
-        // long
-        types.put("L", new VMType(0x04, (scn, type, output) -> {
-            output.add((byte)type);
-        })); 
-        
-        // double
-        types.put("D", new VMType(0x05, (scn, type, output) -> {
-            output.add((byte)type);
-        })); 
-        
+        types.put("I", new VMType(0x02, (scn, type) -> new Constant(type, scn.nextInt(), 0)));
+
+        // float, its bits
+        types.put("F", new VMType(0x03, (scn, type) ->
+            new Constant(type, Float.floatToIntBits(Float.parseFloat(scn.next())), 0)));
+
+        // long, the low 32 bits first
+        types.put("L", new VMType(0x04, (scn, type) -> newWideConstant(type, Long.parseLong(scn.next()))));
+
+        // double, its bits like a long
+        types.put("D", new VMType(0x05, (scn, type) ->
+            newWideConstant(type, Double.doubleToLongBits(Double.parseDouble(scn.next())))));
+
         // string
-        types.put("S", new VMType(0x06, (scn, type, output) -> {
-            output.add((byte)type);
-            for (Byte b : getStringBytes(scn.nextLine())) {
-                output.add(b);
-            }
-        })); 
-        
+        types.put("S", new VMType(0x06, (scn, type) -> {
+            byte[] bytes = getStringBytes(scn.nextLine());
+
+            return new Constant(type, addString(bytes), bytes.length);
+        }));
+
         // reference
-        types.put("R", new VMType(0x07, (scn, type, output) -> {
-            output.add((byte)type);
-        })); 
-        
-        // method
-        types.put("M", new VMType(0x08, (scn, type, output) -> {
-            output.add((byte)type);
+        types.put("R", new VMType(0x07, (scn, type) -> new Constant(type, 0, 0)));
 
+        // method
+        types.put("M", new VMType(0x08, (scn, type) -> {
+            Method method = new Method();
             String name = scn.next();
             byte[] nameBytes = getStringBytes(name);
 
-            for (byte b : nameBytes) {
-                output.add(b);
-            }
-
-            name = name.substring(1, name.length() - 1); // clear ""
-            methods.put(name, output);
-
-            VMType retType = resolveType(scn.next());
-
-            output.add((byte)retType.getType());
+            method.name = name.substring(1, name.length() - 1); // clear ""
+            method.nameOffset = addString(nameBytes);
+            method.nameLength = nameBytes.length;
+            method.returnType = resolveType(scn.next()).getType();
 
             String locals = scn.next();
-            int numLocals = Integer.parseInt(String.valueOf(locals.charAt(0)));
+            String args = scn.next();
+            byte[] localTypes = getTypeBytes(locals);
+            byte[] argTypes = getTypeBytes(args);
 
-            output.add((byte)numLocals);
+            method.numLocals = localTypes.length;
+            method.numParams = argTypes.length;
 
-            for (int i = 1; i <= numLocals; ++i) {
-                VMType cur = resolveType(String.valueOf(locals.charAt(i)));
-                output.add((byte)cur.getType());
-            }
+            // params first, then locals, the order of the frame
+            method.typesOffset = strings.size();
+            strings.write(argTypes, 0, argTypes.length);
+            strings.write(localTypes, 0, localTypes.length);
 
-            String args = scn.next();
-            int numArgs = Integer.parseInt(String.valueOf(args.charAt(0)));
+            methods.put(method.name, method);
+            methodTable.add(method);
 
-            output.add((byte)numArgs);
-            for (int i = 1; i <= numArgs; ++i) {
-                VMType cur = resolveType(String.valueOf(args.charAt(i)));
-                output.add((byte)cur.getType());
-            }
-        })); 
+            return new Constant(type, methodTable.size() - 1, 0);
+        }));
     }
 
 
+    private static Constant newWideConstant(int type, long bits) {
+        return new Constant(type, (int) bits, (int) (bits >>> 32));
+    }
+
     public static class IllegalOpcodeException extends Exception {
         private static final long serialVersionUID = -5139052286656814625L;
 
@@ -247,21 +596,57 @@ public class Compiler {
         }
     }
 
-    private byte[] getIntBytes(int val) {
-        return new byte[] {
-              (byte)(0xFF & val)
-            , (byte)(((0xFF << 8) & val) >> 8)
-            , (byte)(((0xFF << 16) & val) >> 16)
-            , (byte)(((0xFF << 24) & val) >> 24)
-        };
+    public static class LabelException extends Exception {
+        private static final long serialVersionUID = -5139052286656814625L;
+
+        public LabelException(String msg) {
+            super(msg);
+        }
+    }
+
+    private static int align(int offset) {
+        return (offset + 3) & ~3;
+    }
+
+    private static void writeInt(ByteArrayOutputStream output, int val) {
+        output.write(0xFF & val);
+        output.write(0xFF & (val >> 8));
+        output.write(0xFF & (val >> 16));
+        output.write(0xFF & (val >> 24));
+    }
+
+    private static void writeShort(ByteArrayOutputStream output, int val) {
+        output.write(0xFF & val);
+        output.write(0xFF & (val >> 8));
     }
 
+    // the text between the quotes
     private byte[] getStringBytes(String str) {
         str = str.trim();
-        char[] cStr = str.subSequence(1, str.length()).toString().toCharArray();
-        cStr[cStr.length - 1] = (char)0x0;
-       
-        return new String(cStr).getBytes();
+
+        return str.substring(1, str.length() - 1).getBytes(StandardCharsets.UTF_8);
+    }
+
+    // the string blob keeps a 0 after every string, so the VM can use them in place
+    private int addString(byte[] bytes) {
+        int offset = strings.size();
+
+        strings.write(bytes, 0, bytes.length);
+        strings.write(0);
+
+        return offset;
+    }
+
+    // a count followed by that many type identifiers, "2IS" for an int and a string
+    private byte[] getTypeBytes(String typeList) throws ConstantPoolException {
+        int count = Integer.parseInt(String.valueOf(typeList.charAt(0)));
+        byte[] bytes = new byte[count];
+
+        for (int i = 1; i <= count; ++i) {
+            bytes[i - 1] = (byte)resolveType(String.valueOf(typeList.charAt(i))).getType();
+        }
+
+        return bytes;
     }
 
     private VMType resolveType(String typeName) throws ConstantPoolException {
@@ -274,30 +659,193 @@ public class Compiler {
         return type;
     }
 
-    private void writeNoArgOpcode(int code) throws IOException {
-        for (Byte b : getIntBytes(code)) {
-            outputBytes.add(b);
-        }
-        
-        for (Byte b : getIntBytes(0x0)) {
-            outputBytes.add(b);
+    private void writeNoArgOpcode(int opcode) throws IOException {
+        addInstruction(new Instruction(opcode, false, 0, null, currentLine));
+    }
+
+    private void writeSingleIntOpcode(SourceScanner scn, int opcode) throws IOException {
+        addInstruction(new Instruction(opcode, true, scn.nextInt(), null, currentLine));
+    }
+
+    private void writeBranchOpcode(SourceScanner scn, int opcode) throws IOException {
+        addBranch(opcode, scn.next());
+    }
+
+    // "tableswitch L0 L1 L2" becomes a tableswitch 3 followed by a goto to each label
+    private void writeTableswitch(SourceScanner scn, int opcode) throws IOException {
+        String line = scn.nextLine();
+        int comment = line.indexOf('@');
+        String[] targets = (-1 == comment ? line : line.substring(0, comment)).trim().split("\\s+");
+        int count = (targets[0].isEmpty() ? 0 : targets.length);
+
+        addInstruction(new Instruction(opcode, true, count, null, currentLine));
+        for (int i = 0; i < count; ++i) {
+            addBranch(opcodes.get("goto").getOpcode(), targets[i]);
         }
     }
 
-    private void writeSingleIntOpcode(Scanner scn, int code) throws IOException {
-        for (Byte b : getIntBytes(code)) {
-            outputBytes.add(b);
+    private void addBranch(int opcode, String target) {
+        try {
+            addInstruction(new Instruction(opcode, true, Integer.parseInt(target), null, currentLine));
+        } catch (NumberFormatException e) {
+            addInstruction(new Instruction(opcode, true, 0, target, currentLine));
         }
+    }
+
+    // the code is written when the method ends, see writeMethodCode
+    private void addInstruction(Instruction instruction) {
+        pending.add(instruction);
+        ++numInstructions;
+    }
+
+    // zigzag LEB128, see include/vm_dense.h
+    private static void writeVarint(ByteArrayOutputStream output, int val) {
+        int zigzag = (val << 1) ^ (val >> 31);
 
-        for (Byte b : getIntBytes(scn.nextInt())) {
-            outputBytes.add(b);
+        while (0 != (zigzag & ~0x7F)) {
+            output.write((zigzag & 0x7F) | 0x80);
+            zigzag >>>= 7;
         }
+        output.write(zigzag);
     }
 
-    private void skip(Scanner scn) {
+    private void skip(SourceScanner scn) {
         scn.nextLine();
     }
 
+    private static class Constant {
+        private int type;
+        private int a;
+        private int b;
+
+        public Constant(int type, int a, int b) {
+            this.type = type;
+            this.a = a;
+            this.b = b;
+        }
+    }
+
+    private static class Method {
+        private String name;
+        private int nameOffset;
+        private int nameLength;
+        private int returnType;
+        private int numParams;
+        private int numLocals;
+        private int typesOffset;
+        private int codeOffset = -1;
+        private int codeLength;
+        private int denseOffset;
+        private int returns; // the kinds of return in its code, see getReturnBit
+    }
+
+    // a call followed by a return, see markTailCalls
+    private static class TailCall {
+        private int codePosition;
+        private int densePosition;
+        private int constant;
+        private int returnOpcode;
+
+        public TailCall(int codePosition, int densePosition, int constant, int returnOpcode) {
+            this.codePosition = codePosition;
+            this.densePosition = densePosition;
+            this.constant = constant;
+            this.returnOpcode = returnOpcode;
+        }
+    }
+
+    /*
+     * Splits the source into whitespace separated tokens like java.util.Scanner,
+     * and also knows the line of the last token it returned.
+     */
+    private static class SourceScanner {
+        private List<String> lines = new ArrayList<>();
+        private int lineIndex = 0;
+        private int column = 0;
+
+        public SourceScanner(FileReader reader) throws IOException {
+            BufferedReader input = new BufferedReader(reader);
+            String line = null;
+
+            while (null != (line = input.readLine())) {
+                lines.add(line);
+            }
+            input.close();
+        }
+
+        public boolean hasNext() {
+            while (lineIndex < lines.size()) {
+                String line = lines.get(lineIndex);
+
+                while (column < line.length() && Character.isWhitespace(line.charAt(column))) {
+                    ++column;
+                }
+
+                if (column < line.length()) {
+                    return true;
+                }
+
+                ++lineIndex;
+                column = 0;
+            }
+
+            return false;
+        }
+
+        public String next() {
+            if (!hasNext()) {
+                throw new NoSuchElementException();
+            }
+
+            String line = lines.get(lineIndex);
+            int start = column;
+
+            while (column < line.length() && !Character.isWhitespace(line.charAt(column))) {
+                ++column;
+            }
+
+            return line.substring(start, column);
+        }
+
+        public boolean hasNextInt() {
+            int savedLine = lineIndex;
+            int savedColumn = column;
+
+            try {
+                Integer.parseInt(next());
+
+                return true;
+            } catch (NumberFormatException | NoSuchElementException e) {
+                return false;
+            } finally {
+                lineIndex = savedLine;
+                column = savedColumn;
+            }
+        }
+
+        public int nextInt() {
+            return Integer.parseInt(next());
+        }
+
+        // the rest of the current line
+        public String nextLine() {
+            if (lineIndex >= lines.size()) {
+                throw new NoSuchElementException();
+            }
+
+            String rest = lines.get(lineIndex).substring(column);
+
+            ++lineIndex;
+            column = 0;
+
+            return rest;
+        }
+
+        public int getLine() {
+            return lineIndex + 1;
+        }
+    }
+
     private static class Opcode {
         private int opcode;
         private OpcodeProcessor opcodeProcessor;
@@ -311,13 +859,13 @@ public class Compiler {
             return opcode;
         }
 
-        public void process(Scanner scn) throws IOException {
+        public void process(SourceScanner scn) throws IOException {
             opcodeProcessor.process(scn, getOpcode());
         }
     }
 
     private interface OpcodeProcessor {
-        void process(Scanner input, int code) throws IOException;
+        void process(SourceScanner input, int code) throws IOException;
     }
 
     private static class VMType {
@@ -333,12 +881,12 @@ public class Compiler {
             return type;
         }
 
-        public void process(Scanner scn, List<Byte> output) throws IOException, ConstantPoolException {
-            typeProcessor.process(scn, getType(), output);
+        public Constant process(SourceScanner scn) throws IOException, ConstantPoolException {
+            return typeProcessor.process(scn, getType());
         }
     }
 
     private interface VMTypeProcessor {
-        void process(Scanner input, int type, List<Byte> output) throws IOException, ConstantPoolException;
+        Constant process(SourceScanner input, int type) throws IOException, ConstantPoolException;
     }
 }
@@ -0,0 +1,40 @@
+/*
+ * An instruction of the method being compiled. A branch keeps the
+ * instruction it continues at instead of its index, so the optimizer can
+ * remove and replace instructions without renumbering the branches.
+ */
+class Instruction {
+    int opcode;
+    boolean hasArg;
+    int arg;
+    String label;            // of a branch, until it's resolved to target
+    int line;                // in the source, for the debug section
+    Instruction target;      // where a branch continues, null if it leaves the method
+    Instruction replacedBy;  // what stands in its place once the optimizer removed it
+    boolean isTarget;        // some branch continues here
+    int index;               // in the code section, set when the method is written
+
+    Instruction(int opcode, boolean hasArg, int arg, String label, int line) {
+        this.opcode = opcode;
+        this.hasArg = hasArg;
+        this.arg = arg;
+        this.label = label;
+        this.line = line;
+    }
+
+    // goto and the conditional branches, their arg is an instruction index
+    boolean isBranch() {
+        return 0x20 <= opcode && 0x28 >= opcode;
+    }
+
+    // follows the replacements, a branch to a removed instruction continues at what replaced it
+    Instruction resolve() {
+        Instruction instruction = this;
+
+        while (null != instruction.replacedBy) {
+            instruction = instruction.replacedBy;
+        }
+
+        return instruction;
+    }
+}
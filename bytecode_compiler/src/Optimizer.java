@@ -0,0 +1,383 @@
+import java.util.*;
+
+/*
+ * The -O pass of the compiler, run on the instructions of one method at a
+ * time until none of its rewrites applies:
+ * - integer constants are folded, ipush 2; ipush 3; iadd becomes ipush 5,
+ *   and a branch on constants becomes a goto or goes away;
+ * - a store to a local that no path reads again becomes a pop, together
+ *   with a load of it right after, istore n; iload n, it goes away;
+ * - loads stored back to their local, values pushed only to be popped,
+ *   noops and gotos to the next instruction are removed.
+ * A rewrite never spans a branch target other than its first instruction,
+ * so every path into the method still runs the code it did.
+ */
+class Optimizer {
+    // opcodes, see include/opcodes.h
+    private static final int NOOP = 0x00;
+    private static final int STOP = 0x02;
+    private static final int POP = 0x03;
+    private static final int RET = 0x05;
+    private static final int IPUSH = 0x12;
+    private static final int IADD = 0x13;
+    private static final int ISUB = 0x14;
+    private static final int IMULT = 0x15;
+    private static final int IDIV = 0x16;
+    private static final int INEG = 0x17;
+    private static final int IRET = 0x19;
+    private static final int GOTO = 0x20;
+    private static final int IFEQ = 0x21;
+    private static final int IFNE = 0x22;
+    private static final int IF_ICMPEQ = 0x23;
+    private static final int IF_ICMPNE = 0x24;
+    private static final int IF_ICMPLT = 0x25;
+    private static final int IF_ICMPGE = 0x26;
+    private static final int IF_ICMPGT = 0x27;
+    private static final int IF_ICMPLE = 0x28;
+    private static final int TABLESWITCH = 0x29;
+    private static final int SRET = 0x33;
+    private static final int RNULL = 0x42;
+    private static final int RRET = 0x43;
+    private static final int CLOAD = 0x50;
+    private static final int LPUSH = 0x82;
+    private static final int LRET = 0x89;
+    private static final int FPUSH = 0x92;
+    private static final int FRET = 0x99;
+    private static final int DPUSH = 0xA2;
+    private static final int DRET = 0xA9;
+
+    // every load of a local, the store of the same type is the next opcode
+    private static final Set<Integer> LOADS = new HashSet<>(Arrays.asList(0x10, 0x30, 0x40, 0x80, 0x90, 0xA0));
+    private static final Set<Integer> PUSHES = new HashSet<>(Arrays.asList(IPUSH, LPUSH, FPUSH, DPUSH, CLOAD, RNULL));
+    private static final Set<Integer> RETURNS = new HashSet<>(Arrays.asList(STOP, RET, IRET, SRET, RRET, LRET, FRET, DRET));
+
+    private List<Instruction> code;
+    private Instruction end;
+
+    /*
+     * Returns the optimized code of a method, end stands for the first
+     * instruction after it. Removed instructions are replacedBy what now
+     * stands in their place.
+     */
+    public List<Instruction> optimize(List<Instruction> methodCode, Instruction methodEnd) {
+        boolean changed = true;
+
+        code = new ArrayList<>(methodCode);
+        end = methodEnd;
+
+        for (Instruction instruction : code) {
+            if ((isLoad(instruction.opcode) || isStore(instruction.opcode)) && 0 > instruction.arg) {
+                return code; // left as it is for the verifier to report
+            }
+        }
+
+        while (changed) {
+            changed = foldConstants();
+            changed |= removeDeadStores();
+            changed |= removeNeutralCode();
+        }
+
+        return code;
+    }
+
+    private boolean foldConstants() {
+        boolean changed = false;
+
+        for (int i = 0; i + 1 < code.size(); i = next(i)) {
+            Instruction first = code.get(i);
+            Instruction second = code.get(i + 1);
+
+            if (IPUSH != first.opcode) {
+                continue;
+            }
+
+            if (INEG == second.opcode && canRewrite(i, 2)) {
+                first.arg = -first.arg;
+                remove(i + 1, 1);
+                changed = true;
+            } else if ((IFEQ == second.opcode || IFNE == second.opcode) && canRewrite(i, 2)) {
+                foldBranch(i, 2, (0 == first.arg) == (IFEQ == second.opcode));
+                changed = true;
+            } else if (IPUSH == second.opcode && i + 2 < code.size() && canRewrite(i, 3)) {
+                changed |= foldBinary(i, first.arg, second.arg, code.get(i + 2));
+            }
+        }
+
+        return changed;
+    }
+
+    // ipush a; ipush b; followed by an arithmetic or a compare and branch
+    private boolean foldBinary(int i, int a, int b, Instruction operation) {
+        Instruction result = code.get(i);
+
+        switch (operation.opcode) {
+            case IADD:
+                result.arg = a + b;
+                break;
+            case ISUB:
+                result.arg = a - b;
+                break;
+            case IMULT:
+                result.arg = a * b;
+                break;
+            case IDIV:
+                // left to the VM, which reports the division by zero
+                if (0 == b) {
+                    return false;
+                }
+                result.arg = a / b; // MIN_VALUE / -1 wraps around to MIN_VALUE, like in the VM
+                break;
+            case IF_ICMPEQ:
+                foldBranch(i, 3, a == b);
+                return true;
+            case IF_ICMPNE:
+                foldBranch(i, 3, a != b);
+                return true;
+            case IF_ICMPLT:
+                foldBranch(i, 3, a < b);
+                return true;
+            case IF_ICMPGE:
+                foldBranch(i, 3, a >= b);
+                return true;
+            case IF_ICMPGT:
+                foldBranch(i, 3, a > b);
+                return true;
+            case IF_ICMPLE:
+                foldBranch(i, 3, a <= b);
+                return true;
+            default:
+                return false;
+        }
+
+        remove(i + 1, 2);
+
+        return true;
+    }
+
+    // the count instructions from i end with a branch on constants, taken or not
+    private void foldBranch(int i, int count, boolean taken) {
+        Instruction branch = code.get(i + count - 1);
+
+        if (!taken) {
+            remove(i, count);
+            return;
+        }
+
+        Instruction jump = code.get(i);
+
+        jump.opcode = GOTO;
+        jump.arg = branch.arg;
+        jump.target = branch.target;
+        remove(i + 1, count - 1);
+    }
+
+    /*
+     * A store is dead when no path from it loads the local before storing
+     * it again or leaving the method.
+     */
+    private boolean removeDeadStores() {
+        List<BitSet> liveOut = computeLiveness();
+        boolean changed = false;
+
+        // backwards, so removals don't move what is left to visit
+        for (int i = code.size() - 1; i >= 0; --i) {
+            Instruction store = code.get(i);
+
+            if (!isStore(store.opcode)) {
+                continue;
+            }
+
+            if (i + 1 < code.size() && isLoadOf(code.get(i + 1), store) && canRewrite(i, 2)
+                && !liveOut.get(i + 1).get(store.arg)) {
+                // the value stays on the stack instead of going through the local
+                remove(i, 2);
+            } else if (!liveOut.get(i).get(store.arg)) {
+                store.opcode = POP;
+                store.hasArg = false;
+                store.arg = 0;
+            } else {
+                continue;
+            }
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    private boolean removeNeutralCode() {
+        boolean changed = false;
+        int i = 0;
+
+        while (i < code.size()) {
+            if (isInTable(i) || !removeNeutralCodeAt(i)) {
+                i = next(i);
+                continue;
+            }
+
+            // the code before may pair with what follows the removed code now
+            i = Math.max(i - 1, 0);
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    private boolean removeNeutralCodeAt(int i) {
+        Instruction first = code.get(i);
+        Instruction second = (i + 1 < code.size() ? code.get(i + 1) : null);
+
+        if (NOOP == first.opcode) {
+            remove(i, 1);
+        } else if (GOTO == first.opcode && null != first.target
+                   && first.target.resolve() == (null == second ? end : second)) {
+            remove(i, 1);
+        } else if (null != second && POP == second.opcode && isPush(first.opcode) && canRewrite(i, 2)) {
+            remove(i, 2);
+        } else if (null != second && isLoad(first.opcode) && isStoreOf(second, first) && canRewrite(i, 2)) {
+            remove(i, 2);
+        } else {
+            return false;
+        }
+
+        return true;
+    }
+
+    // the locals read after each instruction, on some path
+    private List<BitSet> computeLiveness() {
+        Map<Instruction, Integer> indices = new IdentityHashMap<>();
+        List<BitSet> liveIn = new ArrayList<>();
+        List<BitSet> liveOut = new ArrayList<>();
+        boolean changed = true;
+
+        for (int i = 0; i < code.size(); ++i) {
+            indices.put(code.get(i), i);
+            liveIn.add(new BitSet());
+            liveOut.add(new BitSet());
+        }
+
+        while (changed) {
+            changed = false;
+
+            for (int i = code.size() - 1; i >= 0; --i) {
+                Instruction instruction = code.get(i);
+                BitSet out = new BitSet();
+                BitSet in = null;
+
+                for (int successor : getSuccessors(i, indices)) {
+                    out.or(liveIn.get(successor));
+                }
+
+                in = (BitSet) out.clone();
+                if (isStore(instruction.opcode)) {
+                    in.clear(instruction.arg);
+                } else if (isLoad(instruction.opcode)) {
+                    in.set(instruction.arg);
+                }
+
+                if (!in.equals(liveIn.get(i)) || !out.equals(liveOut.get(i))) {
+                    liveIn.set(i, in);
+                    liveOut.set(i, out);
+                    changed = true;
+                }
+            }
+        }
+
+        return liveOut;
+    }
+
+    private List<Integer> getSuccessors(int i, Map<Instruction, Integer> indices) {
+        Instruction instruction = code.get(i);
+        List<Integer> successors = new ArrayList<>();
+
+        if (instruction.isBranch() && null != instruction.target) {
+            Integer target = indices.get(instruction.target.resolve());
+
+            if (null != target) {
+                successors.add(target);
+            }
+        }
+
+        if (TABLESWITCH == instruction.opcode) {
+            // the gotos of the table and the instruction after it
+            for (int k = i + 1; k <= i + instruction.arg + 1 && k < code.size(); ++k) {
+                successors.add(k);
+            }
+        } else if (GOTO != instruction.opcode && !RETURNS.contains(instruction.opcode) && i + 1 < code.size()) {
+            successors.add(i + 1);
+        }
+
+        return successors;
+    }
+
+    /*
+     * Removes count instructions from i, a branch to any of them continues
+     * at the instruction that follows them.
+     */
+    private void remove(int i, int count) {
+        Instruction successor = (i + count < code.size() ? code.get(i + count) : end);
+
+        for (int k = 0; k < count; ++k) {
+            Instruction removed = code.remove(i);
+
+            removed.replacedBy = successor;
+            successor.isTarget |= removed.isTarget;
+        }
+    }
+
+    // only the first of the count instructions from i may be a branch target
+    private boolean canRewrite(int i, int count) {
+        for (int k = i + 1; k < i + count; ++k) {
+            if (code.get(k).isTarget || isInTable(k)) {
+                return false;
+            }
+        }
+
+        return !isInTable(i);
+    }
+
+    // the gotos after a tableswitch are its table, they stay as they are
+    private boolean isInTable(int i) {
+        for (int k = i - 1; k >= 0; --k) {
+            Instruction instruction = code.get(k);
+
+            if (TABLESWITCH == instruction.opcode) {
+                return instruction.arg >= i - k;
+            }
+
+            if (GOTO != instruction.opcode) {
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    // skips the table of a tableswitch, i may be past the end after a removal
+    private int next(int i) {
+        if (i >= code.size() || TABLESWITCH != code.get(i).opcode) {
+            return i + 1;
+        }
+
+        return i + 1 + code.get(i).arg;
+    }
+
+    private static boolean isLoad(int opcode) {
+        return LOADS.contains(opcode);
+    }
+
+    private static boolean isStore(int opcode) {
+        return LOADS.contains(opcode - 1);
+    }
+
+    private static boolean isPush(int opcode) {
+        return PUSHES.contains(opcode) || isLoad(opcode);
+    }
+
+    private static boolean isLoadOf(Instruction load, Instruction store) {
+        return load.opcode == store.opcode - 1 && load.arg == store.arg;
+    }
+
+    private static boolean isStoreOf(Instruction store, Instruction load) {
+        return isLoadOf(load, store);
+    }
+}
@@ -10,6 +10,8 @@ typedef int (*opcode_handler)(vm_t *instance);
 
 void init_opcode_handlers(opcode_handler *handlers);
 
+void init_unchecked_opcode_handlers(opcode_handler *handlers);
+
 enum opcodes 
 {
     /*
@@ -21,6 +23,15 @@ enum opcodes
     OP_POP    = 0x03, // pops the top of the operand stack
     OP_CALL   = 0x04, // calls the method in the index at the constant pool
     OP_RET    = 0x05, // return to the calling method (void)
+    OP_FLUSH  = 0x06, // writes the buffered output to the output file
+
+    /*
+    * tailcall returns what its callee returns straight to the caller of the
+    * current method, whose frame the callee takes over. It is followed by a
+    * return of the callee's result type, so "call n; iret" is rewritten in
+    * place, and that return only runs when a branch continues at it.
+    */
+    OP_TAILCALL = 0x07, // calls the method in the index at the constant pool in place of the current one
 
     /*
     * Integer operations
@@ -36,6 +47,23 @@ enum opcodes
     OP_IPRINT = 0x18, // print the integer at the top of the op stack
     OP_IRET   = 0x19, // returns an integer to the calling method
 
+    /*
+    * control flow, the arg of a branch is the instruction it continues at,
+    * counted from the start of the code like call offsets and inside the
+    * method of the branch. The conditional ones pop what they compare and
+    * continue after themselves when it doesn't hold.
+    */
+    OP_GOTO        = 0x20, // continues at arg
+    OP_IFEQ        = 0x21, // pops an integer and continues at arg if it is 0
+    OP_IFNE        = 0x22, // pops an integer and continues at arg if it is not 0
+    OP_IF_ICMPEQ   = 0x23, // pops two integers and continues at arg if they are equal
+    OP_IF_ICMPNE   = 0x24, // pops two integers and continues at arg if they are not equal
+    OP_IF_ICMPLT   = 0x25, // pops two integers and continues at arg if the first is less than the second
+    OP_IF_ICMPGE   = 0x26, // pops two integers and continues at arg if the first is greater or equal
+    OP_IF_ICMPGT   = 0x27, // pops two integers and continues at arg if the first is greater
+    OP_IF_ICMPLE   = 0x28, // pops two integers and continues at arg if the first is less or equal
+    OP_TABLESWITCH = 0x29, // pops an index and continues at the goto index of the arg gotos that follow it, or after them
+
     /*
     * string operations
     */
@@ -44,10 +72,131 @@ enum opcodes
     OP_SPRINT = 0x32, // print the integer at the top of the op stack
     OP_SRET = 0x33, // returns a string to the calling method
 
+    /*
+    * reference operations, objects live on the heap of the context (vm_heap.h).
+    * Fields hold a value of any type, the typed get opcodes check it.
+    */
+    OP_RLOAD     = 0x40, // loads a local reference to the op stack
+    OP_RSTORE    = 0x41, // stores the reference at the top of the op stack to a local
+    OP_RNULL     = 0x42, // pushes the null reference
+    OP_RRET      = 0x43, // returns a reference to the calling method
+    OP_NEW       = 0x44, // allocates an object with arg fields, all null references
+    OP_IGETFIELD = 0x45, // replaces the object at the top of the op stack with its integer field arg
+    OP_IPUTFIELD = 0x46, // pops an integer and an object and stores the integer to the field arg
+    OP_SGETFIELD = 0x47, // replaces the object at the top of the op stack with its string field arg
+    OP_SPUTFIELD = 0x48, // pops a string and an object and stores the string to the field arg
+    OP_RGETFIELD = 0x49, // replaces the object at the top of the op stack with its reference field arg
+    OP_RPUTFIELD = 0x4A, // pops a reference and an object and stores the reference to the field arg
+
     /*
     * constant pool operations
     */
     OP_CLOAD = 0x50, // loads a constant from the constant pool
+    /*
+    * array operations, arrays of bytes, integers, longs, floats or doubles
+    * live on the heap like objects (vm_array.h). Bytes are loaded sign
+    * extended to integers. The loads and stores of the other element types
+    * are with their own operations below.
+    */
+    OP_NEWARRAY = 0x70, // pops a length and pushes a new array of it, of the element type arg
+    OP_ALEN     = 0x71, // replaces the array at the top of the op stack with its length
+    OP_BALOAD   = 0x72, // pops an index and a byte array and pushes the element at the index
+    OP_BASTORE  = 0x73, // pops an integer, an index and a byte array and stores the low byte to the index
+    OP_IALOAD   = 0x74, // pops an index and an integer array and pushes the element at the index
+    OP_IASTORE  = 0x75, // pops an integer, an index and an integer array and stores it to the index
+    OP_AFILL    = 0x76, // pops an integer and an array and sets every element to it, converted to the element type
+    OP_ACOPY    = 0x77, // pops a count, an index, an array, an index and an array and copies count elements from the first to the second
+    OP_ASUM     = 0x78, // replaces the integer array at the top of the op stack with the sum of its elements
+    OP_ADOT     = 0x79, // pops two integer arrays of the same length and pushes their dot product
+    OP_AADD     = 0x7A, // pops three integer arrays of the same length and stores the sums of the elements of the first two to the third
+
+    /*
+    * long operations, in the order of the integer ones. Arithmetic wraps
+    * around, and with compact values (vm_value.h) at 48 bits.
+    */
+    OP_LLOAD   = 0x80, // loads local long to op stack
+    OP_LSTORE  = 0x81, // stores the long at the top of the op stack to a local long
+    OP_LPUSH   = 0x82, // pushes the integer arg as a long
+    OP_LADD    = 0x83, // adds two longs and pushes back the result
+    OP_LSUB    = 0x84, // subtracts two longs and pushes back the result
+    OP_LMULT   = 0x85, // multiplies two longs and pushes back the result
+    OP_LDIV    = 0x86, // divides two longs and pushes back the result
+    OP_LNEG    = 0x87, // negates the long at the top of the op stack
+    OP_LPRINT  = 0x88, // prints the long at the top of the op stack
+    OP_LRET    = 0x89, // returns a long to the calling method
+    OP_LCMP    = 0x8A, // pops two longs and pushes the integer -1, 0 or 1 as the first is less, equal or greater
+    OP_LALOAD  = 0x8B, // pops an index and a long array and pushes the element at the index
+    OP_LASTORE = 0x8C, // pops a long, an index and a long array and stores the long to the index
+
+    /*
+    * float operations, IEEE 754 single precision
+    */
+    OP_FLOAD   = 0x90, // loads local float to op stack
+    OP_FSTORE  = 0x91, // stores the float at the top of the op stack to a local float
+    OP_FPUSH   = 0x92, // pushes the integer arg as a float
+    OP_FADD    = 0x93, // adds two floats and pushes back the result
+    OP_FSUB    = 0x94, // subtracts two floats and pushes back the result
+    OP_FMULT   = 0x95, // multiplies two floats and pushes back the result
+    OP_FDIV    = 0x96, // divides two floats and pushes back the result
+    OP_FNEG    = 0x97, // negates the float at the top of the op stack
+    OP_FPRINT  = 0x98, // prints the float at the top of the op stack
+    OP_FRET    = 0x99, // returns a float to the calling method
+    OP_FCMP    = 0x9A, // pops two floats and pushes the integer -1, 0 or 1, -1 when either is NaN
+    OP_FALOAD  = 0x9B, // pops an index and a float array and pushes the element at the index
+    OP_FASTORE = 0x9C, // pops a float, an index and a float array and stores the float to the index
+
+    /*
+    * double operations, IEEE 754 double precision
+    */
+    OP_DLOAD   = 0xA0, // loads local double to op stack
+    OP_DSTORE  = 0xA1, // stores the double at the top of the op stack to a local double
+    OP_DPUSH   = 0xA2, // pushes the integer arg as a double
+    OP_DADD    = 0xA3, // adds two doubles and pushes back the result
+    OP_DSUB    = 0xA4, // subtracts two doubles and pushes back the result
+    OP_DMULT   = 0xA5, // multiplies two doubles and pushes back the result
+    OP_DDIV    = 0xA6, // divides two doubles and pushes back the result
+    OP_DNEG    = 0xA7, // negates the double at the top of the op stack
+    OP_DPRINT  = 0xA8, // prints the double at the top of the op stack
+    OP_DRET    = 0xA9, // returns a double to the calling method
+    OP_DCMP    = 0xAA, // pops two doubles and pushes the integer -1, 0 or 1, -1 when either is NaN
+    OP_DALOAD  = 0xAB, // pops an index and a double array and pushes the element at the index
+    OP_DASTORE = 0xAC, // pops a double, an index and a double array and stores the double to the index
+    OP_DSQRT   = 0xAD, // replaces the double at the top of the op stack with its square root
+
+    /*
+    * conversions, each replaces the value at the top of the op stack.
+    * Floats and doubles convert to integers and longs rounding toward zero,
+    * NaN to 0 and values out of range to the nearest bound.
+    */
+    OP_I2L = 0xB0, // integer to long
+    OP_I2F = 0xB1, // integer to float
+    OP_I2D = 0xB2, // integer to double
+    OP_L2I = 0xB3, // long to integer, keeps the low 32 bits
+    OP_L2F = 0xB4, // long to float
+    OP_L2D = 0xB5, // long to double
+    OP_F2I = 0xB6, // float to integer
+    OP_F2L = 0xB7, // float to long
+    OP_F2D = 0xB8, // float to double
+    OP_D2I = 0xB9, // double to integer
+    OP_D2L = 0xBA, // double to long
+    OP_D2F = 0xBB, // double to float
+
+    /*
+    * superinstructions, formed at load time by fuse_superinstructions and
+    * never read from a file. A superinstruction replaces the first
+    * instruction of its sequence, takes its operands from the args of the
+    * whole sequence and continues after it.
+    */
+    OP_IADD_LL    = 0x60, // iload a; iload b; iadd
+    OP_ISUB_LL    = 0x61, // iload a; iload b; isub
+    OP_IMULT_LL   = 0x62, // iload a; iload b; imult
+    OP_IADD_LI    = 0x63, // iload a; ipush k; iadd
+    OP_ISUB_LI    = 0x64, // iload a; ipush k; isub
+    OP_IMULT_LI   = 0x65, // iload a; ipush k; imult
+    OP_IADD_LLS   = 0x66, // iload a; iload b; iadd; istore c
+    OP_ISUB_LLS   = 0x67, // iload a; iload b; isub; istore c
+    OP_ISTORE_IMM = 0x68, // ipush k; istore n
+    OP_ILOAD2     = 0x69, // iload a; iload b
 };
 
 typedef struct vm_instruction 
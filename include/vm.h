@@ -2,8 +2,11 @@
 #define VM_H
 
 #include <stddef.h> /* size_t */
+#include <stdio.h>  /* FILE   */
 
 typedef struct vm vm_t;
+typedef struct vm vm_context_t;
+typedef struct vm_program vm_program_t;
 
 typedef void (*err_handler)(const char *message);
 
@@ -16,15 +19,102 @@ enum vm_state
     VM_FINISHED
 };
 
+enum vm_engine
+{
+    VM_ENGINE_DEFAULT,  // the fastest engine available on this platform
+    VM_ENGINE_HANDLERS, // function-pointer dispatch through the opcode handlers table
+    VM_ENGINE_THREADED, // direct-threaded dispatch (computed goto on GCC/Clang)
+    VM_ENGINE_JIT,      // threaded dispatch, hot methods are compiled to native code (x86-64)
+    VM_ENGINE_REGISTER, // three-address register code translated from the bytecode at load time
+    VM_ENGINE_DENSE     // one-byte opcodes with varint operands, decoded as they run
+};
+
+/*
+* What the garbage collector of a context has done since the context was
+* created. Times are in seconds, the allocation rate of a run is
+* bytes_allocated over run_time.
+*/
+typedef struct vm_gc_stats
+{
+    size_t heap_size;           // the bytes objects can take, the nursery and half of the old generation
+    size_t bytes_allocated;     // by every object allocated, headers included
+    size_t objects_allocated;
+    size_t promoted_bytes;      // copied from the nursery to the old generation
+    size_t live_bytes;          // in the old generation after the last collection
+    unsigned int collections;   // of the nursery and full ones
+    unsigned int minor_collections; // of the nursery only
+    double total_pause_time;    // spent collecting
+    double minor_pause_time;    // spent collecting the nursery only
+    double max_pause_time;      // the longest collection
+    double run_time;            // spent in vm_run, collections included
+} vm_gc_stats_t;
+
+/*
+* Loads, parses and verifies a bytecode file. The program is read-only once
+* loaded and can be shared by any number of contexts.
+*/
+vm_program_t *vm_program_load(const char *file_path, FILE *err);
+
+void vm_program_free(vm_program_t *program);
+
+/*
+* Creates an execution context for a loaded program, ready to run from main.
+* The program must outlive the context.
+*/
+vm_context_t *vm_context_create(const vm_program_t *program,
+                                unsigned int stack_size,
+                                size_t heap_size,
+                                FILE *output,
+                                FILE *input,
+                                FILE *err,
+                                enum vm_engine engine);
+
+/* brings a context back to the ready state, at the start of main */
+void vm_context_reset(vm_context_t *context);
+
+/* sets how many calls make a method hot for the jit engine, 0 compiles on the first call */
+void vm_context_set_jit_threshold(vm_context_t *context, unsigned int threshold);
+
+/*
+* Sets how many bytes of printed output a context gathers before writing
+* them to its output file, 0 writes and flushes every print. Returns -1 if
+* the buffer can not be allocated, the context keeps its old one then.
+*/
+int vm_context_set_output_buffer(vm_context_t *context, size_t size);
+
+/* redirects the I/O of a context, NULL keeps the current file */
+void vm_context_set_io(vm_context_t *context, FILE *output, FILE *input, FILE *err);
+
+/*
+* Moves a context to another program and resets it, keeping its stack and
+* frames. The context must not own its current program.
+*/
+void vm_context_set_program(vm_context_t *context, const vm_program_t *program);
+
+/* copies the garbage collector statistics of a context to stats */
+void vm_context_get_gc_stats(const vm_context_t *context, vm_gc_stats_t *stats);
+
+void vm_context_free(vm_context_t *context);
+
+/* loads a program and creates a context that owns it */
 vm_t *vm_create(const char *file_path,
                 unsigned int stack_size,
                 size_t heap_size,
                 FILE *output,
                 FILE *input,
-                FILE *err);
+                FILE *err,
+                enum vm_engine engine);
 
+/* frees a context created by vm_create together with its program */
 void vm_free(vm_t *instance);
 
 int vm_run(vm_t *instance);
 
+/*
+* Runs a ready context with code in place of an engine, under the stack
+* guard and with the output flushed at the end like vm_run. code starts
+* in the main frame and returns -1 on an error it has reported.
+*/
+int vm_run_native(vm_t *instance, int (*code)(vm_t *instance));
+
 #endif // VM_H
\ No newline at end of file
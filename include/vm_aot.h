@@ -0,0 +1,125 @@
+#ifndef VM_AOT_H
+#define VM_AOT_H
+
+#include <stdio.h> /* FILE */
+
+#include "vm_impl.h"    /* private vm header */
+#include "vm_numeric.h" /* integer and long semantics */
+#include "vm_output.h"  /* output_integer    */
+#include "vm_util.h"    /* open_stack_frame  */
+
+/*
+* Ahead-of-time translation of a program to C. Every method becomes a C
+* function whose params, locals and operand stack slots are C variables,
+* typed from the method's local types and the verified operand stack. Calls
+* are direct calls between those functions, a tailcall of the method itself
+* is a jump to its start and one of another method returns to a trampoline
+* in its caller, which calls the callee, and the print opcodes go to the
+* buffered output of the context.
+* The generated file has a main of its own and is built against the
+* library, which loads the program, keeps its frames and its heap and runs
+* the operations with no C translation (objects, fields and arrays) through
+* the opcode handlers.
+*
+*   vm_aot -o program.c program.bcc
+*   gcc -O2 -DVM_COMPACT_VALUES=0 -Iinclude program.c -Llib -lvm -o program
+*
+* The program is loaded again when the executable runs, from the path it
+* was translated from or from its first argument, and it must be the same
+* file, byte for byte. It runs with the output and errors of the handlers
+* engine.
+*/
+
+#define AOT_STOPPED 1 // returned up through the calls by a method that ran stop
+#define AOT_TAIL_CALL 2 // plus k, returned by a method that tail calls method k of the translation
+
+/* the translated main method, run with the context's main frame already open */
+typedef int (*vm_aot_code_t)(vm_t *instance);
+
+/*
+* Translates every method of program, which was loaded from program_path,
+* to C and writes the file to out. The methods of a v2 file are prepared
+* first, so a program that fails verification is reported to err and
+* nothing is written, the result is -1 then.
+*/
+int vm_aot_translate(vm_program_t *program, const char *program_path, FILE *out, FILE *err);
+
+/* loads the program at input_path and writes its translation to output_path */
+int vm_aot_translate_file(const char *input_path, const char *output_path, FILE *err);
+
+/* identifies the file a program was loaded from, translations are only run on their own file */
+unsigned long long vm_aot_program_hash(const vm_program_t *program);
+
+/*
+* The main of a translated program: loads the file, argv[1] or else
+* program_path, checks it against program_hash and runs code on a new
+* context with vm_run_native.
+*/
+int vm_aot_main(int argc, char *argv[], const char *program_path, unsigned long long program_hash, vm_aot_code_t code);
+
+/*
+* Used by the generated code. Longs and doubles go through the value layout,
+* so a long keeps 48 bits and a NaN is the canonical one with compact values,
+* as in every engine.
+*/
+static inline long aot_long(long value)
+{
+    return get_long_value(make_long_value(value));
+}
+
+static inline double aot_double(double value)
+{
+    return get_double_value(make_double_value(value));
+}
+
+/*
+* Opens the frame of the method constant index for the call at ip, with the
+* arguments already stored below osp, like the call handlers do.
+*/
+static inline int aot_open_frame(vm_t *instance, unsigned int osp, unsigned int ip, int index)
+{
+    const vm_method_meta_t *method = get_method_value(instance->program->constant_pool[index]);
+
+    instance->osp = osp;
+    instance->ip = ip + 1;
+
+    if (0 != open_stack_frame(instance, method))
+    {
+        report_error(instance, "[call] failed, could not open stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* like aot_open_frame, for the tailcall at ip, the frame of the caller becomes the callee's */
+static inline int aot_reuse_frame(vm_t *instance, unsigned int osp, unsigned int ip, int index)
+{
+    const vm_method_meta_t *method = get_method_value(instance->program->constant_pool[index]);
+
+    instance->osp = osp;
+    instance->ip = ip + 1;
+
+    if (0 != reuse_stack_frame(instance, method))
+    {
+        report_error(instance, "[tailcall] failed, could not reuse stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* runs the handler of opcode, the instruction at ip, on the operand stack below osp */
+static inline int aot_run_handler(vm_t *instance, unsigned int osp, unsigned int ip, enum opcodes opcode)
+{
+    instance->osp = osp;
+    instance->ip = ip + 1;
+
+    return instance->opcode_handlers[opcode](instance);
+}
+
+#endif // VM_AOT_H
@@ -0,0 +1,54 @@
+#ifndef VM_ARRAY_H
+#define VM_ARRAY_H
+
+#include "vm_impl.h"
+#include "vm_heap.h"
+
+/*
+* Arrays of bytes, integers, longs, floats and doubles live on the heap of
+* the context like objects (vm_heap.h), with their elements packed after the
+* header. The bulk
+* operations run over the elements with SIMD kernels picked once for the
+* processor the program runs on, instead of one dispatched opcode per
+* element.
+* Every function reports its errors for the opcode called name, a null
+* reference, a reference to an object, an element type or an index out of
+* bounds, and returns -1.
+*/
+
+static inline void *get_array_elements(vm_object_t *array)
+{
+    return array->fields;
+}
+
+/* the type of the values the elements of type load as and store from, bytes are integers on the stack */
+static inline enum vm_types get_element_value_type(enum vm_types type)
+{
+    return (VM_TYPE_BYTE == type ? VM_TYPE_INTEGER : type);
+}
+
+/* the array reference points to, with elements of type unless type is 0, NULL on error */
+vm_object_t *get_array(vm_t *instance, const char *name, vm_value_t reference, enum vm_types type);
+
+/* the registers of the instance must be up to date, the allocation can collect */
+int new_array(vm_t *instance, enum vm_types type, int length, vm_value_t *result);
+
+int get_array_length(vm_t *instance, vm_value_t array, vm_value_t *result);
+
+/* the element of an array of type at index, as a value of get_element_value_type */
+int load_element(vm_t *instance, const char *name, enum vm_types type, vm_value_t array, int index, vm_value_t *result);
+
+/* stores value, of get_element_value_type, to an array of type at index, a byte array keeps its low byte */
+int store_element(vm_t *instance, const char *name, enum vm_types type, vm_value_t array, int index, vm_value_t value);
+
+/*
+* bulk operations, fill and copy take arrays of any type, the arithmetic ones
+* integer arrays. Fill converts the integer to the element type.
+*/
+int fill_array(vm_t *instance, vm_value_t array, int value);
+int copy_array(vm_t *instance, vm_value_t source, int source_index, vm_value_t destination, int destination_index, int count);
+int sum_array(vm_t *instance, vm_value_t array, vm_value_t *result);
+int dot_arrays(vm_t *instance, vm_value_t left, vm_value_t right, vm_value_t *result);
+int add_arrays(vm_t *instance, vm_value_t left, vm_value_t right, vm_value_t destination);
+
+#endif // VM_ARRAY_H
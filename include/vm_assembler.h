@@ -0,0 +1,37 @@
+#ifndef VM_ASSEMBLER_H
+#define VM_ASSEMBLER_H
+
+#include <stddef.h> /* size_t */
+#include <stdio.h>  /* FILE   */
+
+/*
+* The assembler of the library: it reads the .bc syntax of the compiler in
+* bytecode_compiler and writes the same v2 files, byte for byte, without
+* starting a JVM. Like the compiler it writes a call followed by a return
+* of what the callee returns as a tailcall, and it has the compiler's -O
+* pass too.
+*/
+
+enum vm_assemble_flags
+{
+    VM_ASSEMBLE_FIXED_WIDTH = 0x01, // the fixed-width CODE section instead of the dense code, like --fixed
+    VM_ASSEMBLE_OPTIMIZE    = 0x02, // the -O pass, its report of every method goes to err, like -O
+};
+
+/*
+* Assembles source_size bytes of source into a v2 file image. The image is
+* allocated with malloc and the caller frees it. Errors name source_name,
+* go to err and leave *image NULL, the result is -1 then.
+*/
+int vm_assemble(const char *source,
+                size_t source_size,
+                const char *source_name,
+                unsigned int flags,
+                FILE *err,
+                unsigned char **image,
+                size_t *image_size);
+
+/* assembles the file at input_path and writes the image to output_path in a single write */
+int vm_assemble_file(const char *input_path, const char *output_path, unsigned int flags, FILE *err);
+
+#endif // VM_ASSEMBLER_H
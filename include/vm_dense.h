@@ -0,0 +1,113 @@
+#ifndef VM_DENSE_H
+#define VM_DENSE_H
+
+#include <stddef.h> /* size_t   */
+#include <stdint.h> /* uint32_t */
+
+#include "opcodes.h" /* opcodes */
+#include "vm_impl.h"
+
+/*
+* The dense encoding of the bytecode: every instruction is its opcode in one
+* byte, followed by its operand as a zigzag LEB128 varint for the opcodes
+* that take one. Operands below 64 in magnitude, which are nearly all local
+* indices, constants and immediates, fit in one byte, so most instructions
+* take 1 or 2 bytes instead of the 8 of a vm_instruction_t.
+*/
+
+#define DENSE_MAX_INSTRUCTION_SIZE 6 // the opcode and a 5-byte varint
+#define DENSE_END 0xFF // ends the dense code, never a valid opcode
+
+static inline int has_dense_operand(enum opcodes opcode)
+{
+    switch (opcode)
+    {
+        case OP_HALT:
+        case OP_CALL:
+        case OP_TAILCALL:
+        case OP_GOTO:
+        case OP_IFEQ:
+        case OP_IFNE:
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+        case OP_TABLESWITCH:
+        case OP_ILOAD:
+        case OP_ISTORE:
+        case OP_IPUSH:
+        case OP_SLOAD:
+        case OP_SSTORE:
+        case OP_RLOAD:
+        case OP_RSTORE:
+        case OP_NEW:
+        case OP_IGETFIELD:
+        case OP_IPUTFIELD:
+        case OP_SGETFIELD:
+        case OP_SPUTFIELD:
+        case OP_RGETFIELD:
+        case OP_RPUTFIELD:
+        case OP_CLOAD:
+        case OP_NEWARRAY:
+        case OP_LLOAD:
+        case OP_LSTORE:
+        case OP_LPUSH:
+        case OP_FLOAD:
+        case OP_FSTORE:
+        case OP_FPUSH:
+        case OP_DLOAD:
+        case OP_DSTORE:
+        case OP_DPUSH:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* reads the operand pc points to and returns what follows it, for code that was already decoded once */
+static inline const unsigned char *read_dense_operand(const unsigned char *pc, int *operand)
+{
+    uint32_t value = *pc & 0x7F;
+
+    for (unsigned int shift = 7; *pc & 0x80; shift += 7)
+    {
+        ++pc;
+        value |= (uint32_t)(*pc & 0x7F) << shift;
+    }
+
+    *operand = (int)(value >> 1) ^ -(int)(value & 1);
+
+    return pc + 1;
+}
+
+/* writes the instruction to out, which has room for DENSE_MAX_INSTRUCTION_SIZE bytes, and returns its size */
+size_t encode_dense_instruction(unsigned char *out, const vm_instruction_t *instruction);
+
+/*
+* Decodes the instruction at *offset of code and moves *offset past it.
+* Returns -1 when it runs past size or its operand takes more than 5 bytes.
+*/
+int decode_dense_instruction(const unsigned char *code, size_t size, size_t *offset, vm_instruction_t *instruction);
+
+/*
+* Decodes the code of a method of a file with dense code into its range of
+* file_instructions, before the method is verified, and records where each
+* of its instructions starts in dense_offsets.
+*/
+int decode_dense_method(vm_program_t *program, vm_method_meta_t *method);
+
+/*
+* Encodes the instructions of a program that came in the fixed-width
+* encoding, the first time a context runs it on the dense engine. Methods
+* are encoded whether they were prepared or not, they are verified on their
+* first call like on every other engine.
+*/
+void prepare_dense_code(vm_program_t *program);
+
+int run_dense_code(vm_t *instance);
+
+void free_dense_code(vm_program_t *program);
+
+#endif // VM_DENSE_H
@@ -0,0 +1,22 @@
+#ifndef VM_FUSION_H
+#define VM_FUSION_H
+
+#include "vm_impl.h"
+
+/*
+* Rewrites the instructions of a verified program, fusing common sequences
+* into superinstructions. Only the first instruction of a sequence is
+* replaced, the rest stay as they are, so every instruction index is still
+* valid and no offset has to be remapped.
+*/
+int fuse_superinstructions(vm_program_t *program);
+
+/* the same for the code range of one method, copied from the file on its first call */
+int fuse_method_superinstructions(vm_program_t *program, const vm_method_meta_t *method);
+
+/* the opcode a superinstruction replaced, other opcodes are returned as is */
+enum opcodes get_unfused_opcode(enum opcodes opcode);
+
+void free_fused_instructions(vm_program_t *program);
+
+#endif // VM_FUSION_H
@@ -0,0 +1,189 @@
+#ifndef VM_HEAP_H
+#define VM_HEAP_H
+
+#include <stdint.h> /* UINT16_MAX */
+#include <string.h> /* memset     */
+
+#include "vm_impl.h"
+
+/*
+* Every context has a heap of its own, allocated on first use. New objects
+* are allocated by bumping nursery_top through a small nursery, and when it
+* is full a minor collection promotes the objects still reachable to the old
+* generation and empties it. Most objects die young, so a minor collection
+* only copies a few of them and its pause stays short.
+* The old generation is split into two semispaces, and when the current one
+* runs low a full collection copies every live object to the other one.
+* The roots are the live slots of the stack frames, found through the saved
+* registers of the frames, so a collection costs time proportional to the
+* live data, not to the heap. A minor collection also treats as roots the
+* old objects the write barrier has remembered, the only ones that can
+* refer to the nursery.
+* The constant pool is shared by every context running the program and is
+* never written to, its reference constants are all null.
+*/
+
+#define MAX_OBJECT_FIELDS UINT16_MAX // larger objects are rejected by the verifier
+
+#define OBJECT_REMEMBERED 0x1 // the object is in the remembered set
+#define OBJECT_ALIGNMENT 8 // of every object on the heap, arrays are rounded up to it
+#define LARGE_OBJECT_SIZE (8 * 1024) // larger objects are allocated old, they would be copied when they survive
+
+/* an object of fields, or an array when element_type is set */
+typedef struct vm_object
+{
+    struct vm_object *forward; // the copy of the object, only set while a collection runs
+    unsigned int num_fields;   // or the length of an array
+    unsigned short flags;
+    unsigned short element_type; // the vm_types of the elements of an array, 0 for an object
+    vm_value_t fields[];         // or the elements of an array, packed
+} vm_object_t;
+
+static inline size_t get_object_size(unsigned int num_fields)
+{
+    return sizeof(vm_object_t) + sizeof(vm_value_t) * num_fields;
+}
+
+/* 0 for the types arrays can not hold */
+static inline size_t get_array_element_size(enum vm_types type)
+{
+    switch (type)
+    {
+        case VM_TYPE_BYTE:
+            return sizeof(char);
+        case VM_TYPE_INTEGER:
+            return sizeof(int);
+        case VM_TYPE_LONG:
+            return sizeof(long);
+        case VM_TYPE_FLOAT:
+            return sizeof(float);
+        case VM_TYPE_DOUBLE:
+            return sizeof(double);
+        default:
+            return 0;
+    }
+}
+
+static inline size_t get_array_size(enum vm_types type, unsigned int length)
+{
+    size_t size = sizeof(vm_object_t) + get_array_element_size(type) * length;
+
+    return (size + OBJECT_ALIGNMENT - 1) / OBJECT_ALIGNMENT * OBJECT_ALIGNMENT;
+}
+
+static inline size_t get_heap_object_size(const vm_object_t *object)
+{
+    return (0 == object->element_type ?
+            get_object_size(object->num_fields) :
+            get_array_size((enum vm_types)object->element_type, object->num_fields));
+}
+
+static inline int is_in_nursery(const vm_t *instance, const void *address)
+{
+    return (const char *)address >= instance->nursery && (const char *)address < instance->nursery_top;
+}
+
+/* the slow path of allocate_heap: maps the heap on first use, collects, or allocates large objects old */
+void *allocate_heap_slow(vm_t *instance, size_t size);
+
+/*
+* Allocates size bytes for an object, and returns NULL when the live
+* objects leave no room for it. The registers of the instance must be up to
+* date, any allocation can collect.
+*/
+static inline void *allocate_heap(vm_t *instance, size_t size)
+{
+    char *memory = instance->nursery_top;
+
+    if ((size_t)(instance->nursery_end - memory) < size || size > LARGE_OBJECT_SIZE)
+    {
+        return allocate_heap_slow(instance, size);
+    }
+
+    instance->nursery_top += size;
+    instance->gc_stats.bytes_allocated += size;
+    ++instance->gc_stats.objects_allocated;
+
+    return memory;
+}
+
+/* an object with its fields set to null references, NULL when the heap is full */
+static inline vm_object_t *allocate_object(vm_t *instance, unsigned int num_fields)
+{
+    vm_object_t *object = (vm_object_t *)allocate_heap(instance, get_object_size(num_fields));
+
+    if (NULL == object)
+    {
+        return NULL;
+    }
+
+    object->forward = NULL;
+    object->num_fields = num_fields;
+    object->flags = 0;
+    object->element_type = 0;
+    for (unsigned int i = 0; i < num_fields; ++i)
+    {
+        object->fields[i] = make_empty_value(VM_TYPE_REFERENCE);
+    }
+
+    return object;
+}
+
+/* an array with its elements set to 0, NULL when the heap is full */
+static inline vm_object_t *allocate_array(vm_t *instance, enum vm_types type, unsigned int length)
+{
+    vm_object_t *array = (vm_object_t *)allocate_heap(instance, get_array_size(type, length));
+
+    if (NULL == array)
+    {
+        return NULL;
+    }
+
+    array->forward = NULL;
+    array->num_fields = length;
+    array->flags = 0;
+    array->element_type = (unsigned short)type;
+    memset(array->fields, 0, get_array_element_size(type) * length);
+
+    return array;
+}
+
+/* the slow path of write_barrier: adds the object to the remembered set */
+void remember_object(vm_t *instance, vm_object_t *object);
+
+/*
+* Must follow every store of value to a field of object. Stores to the stack
+* need none, the stack is scanned by every collection, and neither do stores
+* to arrays, which only hold numbers.
+*/
+static inline void write_barrier(vm_t *instance, vm_object_t *object, vm_value_t value)
+{
+    if (is_value_type(value, VM_TYPE_REFERENCE) &&
+        is_in_nursery(instance, get_reference_value(value)) &&
+        !is_in_nursery(instance, object) &&
+        0 == (object->flags & OBJECT_REMEMBERED))
+    {
+        remember_object(instance, object);
+    }
+}
+
+/*
+* The field index of the object reference points to, for the opcode called
+* name. A null reference, a reference to an array, an index past the fields
+* of the object and, when type is not 0, a field of another type are
+* reported and return NULL.
+*/
+vm_value_t *get_object_field(vm_t *instance, const char *name, vm_value_t reference, int index, enum vm_types type);
+
+/* promotes the objects of the nursery reachable from the stack or the old generation, and empties it */
+void collect_nursery(vm_t *instance);
+
+/* collects now, every object that is not reachable from the stack is freed */
+void collect_garbage(vm_t *instance);
+
+/* drops every object at once, when nothing on the stack can refer to them anymore */
+void reset_heap(vm_t *instance);
+
+void free_heap(vm_t *instance);
+
+#endif // VM_HEAP_H
@@ -1,19 +1,11 @@
 #ifndef VM_IMPL_H
 #define VM_IMPL_H
 
-#include "opcodes.h" /* opcode_handler */
+#include <pthread.h>  /* pthread_mutex_t */
 
-enum vm_types
-{
-    VM_TYPE_BYTE      = 0x01,
-    VM_TYPE_INTEGER   = 0x02,
-    VM_TYPE_FLOAT     = 0x03,
-    VM_TYPE_LONG      = 0x04,
-    VM_TYPE_DOUBLE    = 0x05,
-    VM_TYPE_STRING    = 0x06,
-    VM_TYPE_REFERENCE = 0x07,
-    VM_TYPE_METHOD    = 0x08,
-};
+#include "opcodes.h"  /* opcode_handler */
+#include "vm.h"       /* vm_engine      */
+#include "vm_value.h" /* vm_value_t     */
 
 typedef struct vm_method_meta 
 {
@@ -24,34 +16,92 @@ typedef struct vm_method_meta
     int num_params;
     enum vm_types *param_types;
     unsigned int offset;
-    unsigned int ip;
+    unsigned int code_length; // instructions in the method's code range, for v1 files up to the last one it reaches (set by the verifier)
+    int prepare_state; // enum method_state, v2 methods are verified and translated on their first call
+    enum vm_types result_type; // what its returns leave on the caller's operand stack, 0 for nothing (set by the verifier)
+    unsigned int frame_size; // num_locals + 1, how far a call moves osp past the arguments
+    vm_value_t *local_template; // the empty values of its locals, copied into every frame it opens
+
+    unsigned int num_calls; // counted by the jit until the method is compiled
+    unsigned int num_backedges; // branches back to a loop header, a method with a hot loop is compiled too
+    int jit_state; // enum jit_state, shared by every context running the program
+    void *jit_code; // native code of the method, NULL while it is interpreted
+    size_t jit_code_size;
+
+    unsigned int register_offset; // where the method starts in the program's register code
+    unsigned int dense_offset; // where the method starts in the program's dense code, in bytes
+    int dense_decoded; // its code was decoded from the dense code of its file into file_instructions
 } vm_method_meta_t;
 
-typedef struct vm_value
-{
-    enum vm_types type;
-    union
-    {
-        char byte_value;
-        int integer_value;
-        float float_value;
-        long long_value;
-        double double_value;
-        char *string_value;
-        void *reference_value;
-        vm_method_meta_t *method_value;
-    } value;
-} vm_value_t;
-
+/*
+* One activation. Everything needed to resume the caller lives here, so the
+* constant pool and the instructions are never written to after loading.
+*/
 typedef struct vm_stack_frame
 {
-    vm_method_meta_t *method_meta;
-    struct vm_stack_frame *prev;
+    const vm_method_meta_t *method_meta;
+    unsigned int return_ip; // the caller's ip after the call instruction
+    unsigned int saved_sp;  // the caller's sp
+    unsigned int saved_lap; // the caller's lap
+    unsigned int saved_osp; // the caller's osp, without the arguments of the call
 } vm_stack_frame_t;
 
-struct vm
+/*
+* A loaded program. It is built and verified once by vm_program_load and is
+* read-only afterwards, so any number of contexts, on any number of threads,
+* can run it at the same time. The methods of a v2 file are the exception:
+* each one is verified and translated under prepare_lock on its first call.
+*/
+struct vm_program
 {
     unsigned int magic_num; // magic number
+
+    vm_value_t *constant_pool; // a segment of code that contains constants
+    unsigned int constant_pool_size;
+    const vm_method_meta_t *main_method; // the method every context starts in
+    vm_method_meta_t *method_table; // the methods of a v2 file, decoded in one allocation
+    enum vm_types *method_types; // the param and local types of every method in method_table
+    unsigned int num_methods;
+
+    opcode_handler opcode_handlers[NUM_OPCODES]; // a lookup table for all the op-code handlers
+
+    int verified; // the program passed verify_program and runs without per-instruction checks
+    int *stack_depths; // operand stack depth at every instruction, -1 where no verified method reaches it
+    int lazy; // methods are prepared on their first call, see prepare_method
+    int register_prepared; // prepare_register_code already ran
+    pthread_mutex_t prepare_lock;
+    struct vm_threaded_instruction *threaded_code; // the instructions translated for the threaded engine
+    struct vm_register_instruction *register_code; // the instructions translated for the register engine, NULL if it can't run the program
+    unsigned int register_code_size;
+    int dense_prepared; // the program has its dense code, from the file or from prepare_dense_code
+    const unsigned char *dense_code; // the instructions in the dense encoding, see vm_dense.h
+    unsigned int dense_code_size;
+    unsigned char *encoded_code; // dense_code when it was encoded from the instructions and not mapped from the file
+    unsigned int *dense_offsets; // where every instruction starts in dense_code, for branches, filled as methods are decoded
+    vm_instruction_t *decoded_instructions; // file_instructions of a file with dense code, decoded method by method
+
+    const vm_instruction_t *instructions; // the instructions to run, fused_instructions once loaded
+    const vm_instruction_t *file_instructions; // the instructions as they are in the file
+    vm_instruction_t *fused_instructions; // a copy of the code region with superinstructions
+    unsigned int num_instructions; // the number of instructions in the code region
+    char *code; // a pointer to the memory region where the bytecode file is mapped
+    unsigned int code_size;
+    unsigned int read_offset; // the parsing position in code, only used while loading
+    const struct vm_file_line *debug_lines; // source lines by instruction, sorted by ip, NULL if the file has none
+    unsigned int num_debug_lines;
+
+    FILE *err; // where loading errors are reported
+};
+
+/*
+* One execution of a program: registers, stack, frames and I/O. Nothing here
+* is shared, and a context can be reset and run again.
+*/
+struct vm
+{
+    const vm_program_t *program; // the program this context runs
+    int owns_program; // the program was loaded by vm_create and is freed with the context
+
     unsigned int ip; // program counter
     unsigned int sp; // stack pointer
     unsigned int lap; // points to the local variable array of the current stack frame
@@ -59,24 +109,38 @@ struct vm
 
     vm_value_t *stack; // call stack
     unsigned int stack_size;
+    char *stack_guard; // the inaccessible pages right after the stack, see vm_stack.h
+    size_t stack_guard_size;
 
-    vm_stack_frame_t *stack_trace; // a pointer to a linked-list of method data
+    vm_stack_frame_t *frames; // preallocated call frames, frames[0] belongs to main
+    unsigned int max_frames;
+    vm_stack_frame_t *stack_trace; // the frame of the running method
 
-    char *heap; // contains all objects and arrays
+    char *heap; // contains all objects and arrays, allocated on first use, see vm_heap.h
     size_t heap_size;
-
-    vm_value_t *constant_pool; // a segment of code that contains constants
-    unsigned int constant_pool_size;
-
-    opcode_handler opcode_handlers[NUM_OPCODES]; // a lookup table for all the op-code handlers
-
-    vm_instruction_t *instructions; // a pointer to the code region where the instructions start
-    char *code; // a pointer to the memory region where the bytecode file is mapped
-    unsigned int code_size;
+    char *nursery;     // new objects are allocated here, survivors are promoted to heap_space
+    char *nursery_top; // the next free byte of the nursery
+    char *nursery_end; // no further than the free bytes of heap_space, so promotions always fit
+    char *heap_space;  // the semispace of the old generation
+    char *heap_spare;  // the other one, a full collection copies the live objects to it
+    char *heap_top;    // the next free byte of heap_space
+    char *heap_end;    // the end of heap_space, NULL until the heap is allocated
+    struct vm_object **remembered; // the old objects that may refer to the nursery
+    unsigned int num_remembered;
+    unsigned int remembered_capacity;
+    int remembered_overflow; // the set could not grow, every old object is scanned instead
+    vm_gc_stats_t gc_stats;
+
+    const opcode_handler *opcode_handlers; // the program's handlers table
+    enum vm_engine engine; // the dispatch engine used by vm_run
+    unsigned int jit_threshold; // calls before a method is compiled by the jit engine
 
     FILE *input; // the input file pointer
     FILE *output; // the output file pointer
     FILE *err;   // the error file pointer
+    char *output_buffer; // the prints not written to output yet, see vm_output.h
+    size_t output_used;
+    size_t output_capacity; // 0 writes every print through
 
     enum vm_state state; // the current state of the machine
 };
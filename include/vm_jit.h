@@ -0,0 +1,42 @@
+#ifndef VM_JIT_H
+#define VM_JIT_H
+
+#include "vm_impl.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define HAS_JIT 1 // native code can be generated for this platform
+#else
+#define HAS_JIT 0
+#endif
+
+#define JIT_DEFAULT_THRESHOLD 1000 // calls, or loop back-edges, before a method is compiled
+
+enum jit_state
+{
+    JIT_STATE_NONE,      // interpreted, calls are being counted
+    JIT_STATE_COMPILING, // a thread is compiling the method
+    JIT_STATE_COMPILED,  // jit_code is ready
+    JIT_STATE_FAILED     // the method could not be compiled and stays interpreted
+};
+
+/*
+* Called by the call handlers once the callee's frame is open. Counts the
+* call and, when the method is hot, compiles it and runs it natively until it
+* returns. Returns 0 with the callee's frame still open when the method stays
+* interpreted.
+*/
+int jit_enter_method(vm_t *instance, vm_method_meta_t *method);
+
+/*
+* Called by the branch handlers when a branch goes back to a loop header,
+* with ip already at the header. Counts the back-edge and, when the loop is
+* hot, compiles the method of the current frame and continues the frame in
+* native code from the header until the method returns. Returns 0 with
+* nothing run when the method stays interpreted.
+*/
+int jit_enter_loop(vm_t *instance);
+
+/* unmaps the native code of every method in the program */
+void free_jit_code(vm_program_t *program);
+
+#endif // VM_JIT_H
@@ -0,0 +1,129 @@
+#ifndef VM_LOADER_H
+#define VM_LOADER_H
+
+#include <stdint.h> /* uint32_t */
+
+#include "vm_impl.h"
+
+#define MAGIC_NUM_V2 0xBABEFAC2
+#define BYTECODE_VERSION 2
+
+/*
+* Layout of a v2 file, all fields little-endian:
+*
+*   header           { magic, version, num_sections }
+*   section table    num_sections x { id, offset, size }
+*   sections         each 4-byte aligned, in any order
+*
+* Sections with an unknown id are skipped, so new ones can be added without
+* breaking older machines. Every section is an array of fixed-size entries,
+* the entry count is its size divided by the entry size. The code comes as
+* CODE, or as DENSE_CODE and DENSE_METHODS. Instructions are numbered the
+* same in both encodings, so method ranges and debug lines mean the same.
+*/
+typedef struct vm_file_header
+{
+    uint32_t magic_num;
+    uint16_t version;
+    uint16_t num_sections;
+} vm_file_header_t;
+
+enum vm_file_sections
+{
+    VM_SECTION_CONSTANTS     = 1, // vm_file_constant_t entries
+    VM_SECTION_METHODS       = 2, // vm_file_method_t entries
+    VM_SECTION_STRINGS       = 3, // the string blob, every string is followed by a 0 byte
+    VM_SECTION_CODE          = 4, // vm_instruction_t entries
+    VM_SECTION_DEBUG         = 5, // vm_file_line_t entries, optional
+    VM_SECTION_DENSE_CODE    = 6, // the instructions in the dense encoding of vm_dense.h, used when there is no CODE
+    VM_SECTION_DENSE_METHODS = 7, // a uint32_t per method, the byte of DENSE_CODE its code starts at
+};
+
+typedef struct vm_file_section
+{
+    uint32_t id;
+    uint32_t offset; // from the start of the file
+    uint32_t size;   // in bytes
+} vm_file_section_t;
+
+/*
+* A constant pool entry. Strings are an offset and a length into the string
+* blob, methods an index into the method table. Longs and doubles are split
+* into their low (a) and high (b) words.
+*/
+typedef struct vm_file_constant
+{
+    uint8_t type; // enum vm_types
+    uint8_t pad[3];
+    uint32_t a;
+    uint32_t b;
+} vm_file_constant_t;
+
+typedef struct vm_file_method
+{
+    uint32_t name_offset; // into the string blob
+    uint32_t name_length;
+    uint8_t return_type;
+    uint8_t num_params;
+    uint8_t num_locals;
+    uint8_t pad;
+    uint32_t types_offset; // the param types and then the local types, one byte each, in the string blob
+    uint32_t code_offset;  // the first instruction of the method
+    uint32_t code_length;  // the number of instructions that belong to it
+} vm_file_method_t;
+
+/* the instructions from ip on, up to the next entry, come from line */
+typedef struct vm_file_line
+{
+    uint32_t ip;
+    uint32_t line;
+} vm_file_line_t;
+
+enum method_state
+{
+    METHOD_UNPREPARED, // only the header of the method was decoded
+    METHOD_TYPED,      // its result type is known, callers can be verified
+    METHOD_READY,      // verified and translated, it can run
+    METHOD_FAILED      // failed verification, calls to it fail
+};
+
+/* the mapped file starts with the v2 magic number */
+int is_program_v2(const vm_program_t *program);
+
+/*
+* Decodes the header, the constant pool and the method table of a v2 file.
+* Method bodies are left alone until their first call, only main is
+* prepared here so a broken entry point still fails the load.
+*/
+int load_program_v2(vm_program_t *program);
+
+/*
+* Verifies the method, fuses its superinstructions and translates it for the
+* threaded engine, the first time it is called. Thread safe, and a single
+* atomic load once the method is ready.
+*/
+int prepare_method(vm_program_t *program, vm_method_meta_t *method);
+
+static inline int is_method_prepared(const vm_method_meta_t *method)
+{
+    return METHOD_READY == __atomic_load_n(&method->prepare_state, __ATOMIC_ACQUIRE);
+}
+
+/*
+* Prepares every method main can reach up front, for a program that several
+* contexts run, so what preparing them reports is known before the first run.
+* Returns -1 when one of them fails, the ones after it stay lazy.
+*/
+int prepare_reachable_code(vm_program_t *program);
+
+/*
+* The register engine translates whole programs, so before its first run on
+* a lazily loaded program every method main can reach is prepared. A program
+* it can't run is left without register code, as in translate_register_code.
+*/
+void prepare_register_code(vm_program_t *program);
+
+/* the source line of the instruction, 0 when the file has no debug info */
+unsigned int get_source_line(const vm_program_t *program, unsigned int ip);
+
+#endif // VM_LOADER_H
@@ -0,0 +1,118 @@
+#ifndef VM_NUMERIC_H
+#define VM_NUMERIC_H
+
+#include <limits.h> /* INT_MAX, LONG_MAX */
+
+/*
+* The semantics of the integer, long, float and double operations, shared by
+* every engine so they all compute the same results. Integer and long
+* arithmetic wraps around, so it is done in unsigned ints and longs. Floats
+* are widened to doubles for the comparisons and conversions, which is exact.
+*/
+
+static inline int add_integers(int left, int right)
+{
+    return (int)((unsigned int)left + (unsigned int)right);
+}
+
+static inline int subtract_integers(int left, int right)
+{
+    return (int)((unsigned int)left - (unsigned int)right);
+}
+
+static inline int multiply_integers(int left, int right)
+{
+    return (int)((unsigned int)left * (unsigned int)right);
+}
+
+static inline int negate_integer(int value)
+{
+    return (int)(0 - (unsigned int)value);
+}
+
+/* the divisor is not 0, INT_MIN / -1 wraps around to INT_MIN */
+static inline int divide_integers(int left, int right)
+{
+    return (-1 == right ? negate_integer(left) : left / right);
+}
+
+static inline long add_longs(long left, long right)
+{
+    return (long)((unsigned long)left + (unsigned long)right);
+}
+
+static inline long subtract_longs(long left, long right)
+{
+    return (long)((unsigned long)left - (unsigned long)right);
+}
+
+static inline long multiply_longs(long left, long right)
+{
+    return (long)((unsigned long)left * (unsigned long)right);
+}
+
+static inline long negate_long(long value)
+{
+    return (long)(0 - (unsigned long)value);
+}
+
+/* the divisor is not 0, LONG_MIN / -1 wraps around to LONG_MIN */
+static inline long divide_longs(long left, long right)
+{
+    return (-1 == right ? negate_long(left) : left / right);
+}
+
+static inline int compare_longs(long left, long right)
+{
+    return (left > right) - (left < right);
+}
+
+/* -1 when either is NaN, so a NaN is never greater or equal */
+static inline int compare_doubles(double left, double right)
+{
+    if (left > right)
+    {
+        return 1;
+    }
+
+    return (left == right ? 0 : -1);
+}
+
+static inline int double_to_integer(double value)
+{
+    if (value != value)
+    {
+        return 0;
+    }
+    if (value <= (double)INT_MIN)
+    {
+        return INT_MIN;
+    }
+    if (value >= (double)INT_MAX)
+    {
+        return INT_MAX;
+    }
+
+    return (int)value;
+}
+
+static inline long double_to_long(double value)
+{
+    if (value != value)
+    {
+        return 0;
+    }
+    if (value <= (double)LONG_MIN)
+    {
+        return LONG_MIN;
+    }
+    // LONG_MAX rounds up to 2^63 as a double, which is already out of range
+    if (value >= (double)LONG_MAX)
+    {
+        return LONG_MAX;
+    }
+
+    return (long)value;
+}
+
+#endif // VM_NUMERIC_H
@@ -0,0 +1,39 @@
+#ifndef VM_OUTPUT_H
+#define VM_OUTPUT_H
+
+#include <stddef.h> /* size_t */
+
+#include "vm_impl.h"
+
+/*
+* The print opcodes of a context append their text to its output buffer,
+* which is written to the output file when it fills up, when a run ends,
+* on the flush opcode and before any error is reported, so the output and
+* the errors keep their order. A context with a buffer of 0 bytes writes
+* and flushes every print on its own.
+*/
+
+#define DEFAULT_OUTPUT_BUFFER_SIZE 8192
+
+/* replaces the buffer with one of size bytes, the pending output is flushed first */
+int alloc_output_buffer(vm_t *instance, size_t size);
+
+void free_output_buffer(vm_t *instance);
+
+void write_output(vm_t *instance, const char *data, size_t length);
+
+/* writes the pending output, if any, and flushes the output file */
+void flush_output(vm_t *instance);
+
+/* the print opcodes, each value is followed by a newline */
+void output_integer(vm_t *instance, int value);
+
+void output_long(vm_t *instance, long value);
+
+void output_float(vm_t *instance, float value);
+
+void output_double(vm_t *instance, double value);
+
+void output_string(vm_t *instance, const char *value);
+
+#endif // VM_OUTPUT_H
@@ -0,0 +1,71 @@
+#ifndef VM_REGISTER_H
+#define VM_REGISTER_H
+
+#include "vm_impl.h"
+
+/*
+* Three-address instructions of the register engine. Register r of a method
+* is stack[lap + r]: its params and locals come first, then the separator
+* slot, then one register per operand stack slot.
+*/
+enum register_opcodes
+{
+    R_MOVE,   // r[dst] = r[a]
+    R_LOADI,  // r[dst] = a
+    R_LOADK,  // r[dst] = constant_pool[a]
+    R_ADD,    // r[dst] = r[a] + r[b]
+    R_ADDI,   // r[dst] = r[a] + b
+    R_SUB,    // r[dst] = r[a] - r[b]
+    R_SUBI,   // r[dst] = r[a] - b
+    R_MUL,    // r[dst] = r[a] * r[b]
+    R_MULI,   // r[dst] = r[a] * b
+    R_DIV,    // r[dst] = r[a] / r[b]
+    R_DIVI,   // r[dst] = r[a] / b, b is not 0
+    R_NEG,    // r[dst] = -r[a]
+    R_IPRINT, // prints the integer r[a]
+    R_SPRINT, // prints the string r[a]
+    R_FLUSH,  // writes the buffered output
+    R_CALL,   // calls the method constant a with its arguments in r[b] and on, the result goes to r[b]
+    R_TAILCALL, // tail calls the method constant a with its arguments in r[b] and on, in place of the current frame
+    R_RET,    // returns nothing
+    R_IRET,   // returns the integer r[a]
+    R_SRET,   // returns the string r[a]
+    R_STOP,   // stops the machine
+    R_JUMP,   // continues at dst
+    R_JEQ,    // continues at dst if r[a] == r[b]
+    R_JNE,    // continues at dst if r[a] != r[b]
+    R_JLT,    // continues at dst if r[a] < r[b]
+    R_JGE,    // continues at dst if r[a] >= r[b]
+    R_JGT,    // continues at dst if r[a] > r[b]
+    R_JLE,    // continues at dst if r[a] <= r[b]
+    R_JEQI,   // continues at dst if r[a] == b
+    R_JNEI,   // continues at dst if r[a] != b
+    R_JLTI,   // continues at dst if r[a] < b
+    R_JGEI,   // continues at dst if r[a] >= b
+    R_JGTI,   // continues at dst if r[a] > b
+    R_JLEI,   // continues at dst if r[a] <= b
+    R_SWITCH, // continues at the dst of the R_JUMP r[a] + 1 after it if r[a] is in [0, b), else at dst
+    NUM_REGISTER_OPCODES
+};
+
+typedef struct vm_register_instruction
+{
+    enum register_opcodes opcode;
+    int dst;
+    int a;
+    int b;
+} vm_register_instruction_t;
+
+/*
+* Translates every method of a verified program from the stack bytecode to
+* register instructions, done once when the program is loaded. A program
+* with code the translator doesn't handle gets no register code and runs on
+* the threaded engine instead.
+*/
+int translate_register_code(vm_program_t *program);
+
+int run_register_code(vm_t *instance);
+
+void free_register_code(vm_program_t *program);
+
+#endif // VM_REGISTER_H
@@ -0,0 +1,60 @@
+#ifndef VM_RUNNER_H
+#define VM_RUNNER_H
+
+#include <stddef.h> /* size_t */
+
+#include "vm.h"     /* vm_engine */
+
+typedef struct vm_runner vm_runner_t;
+
+typedef struct vm_job_result
+{
+    int status; // 0 when the program ran to the end of main, -1 otherwise
+    char *output; // everything the job printed, including load and runtime errors
+    size_t output_size;
+    double latency; // seconds from the start of the job to the end of its run
+    unsigned int worker; // the worker that ran the job
+} vm_job_result_t;
+
+typedef struct vm_runner_stats
+{
+    unsigned int num_jobs;
+    unsigned int num_failed;
+    unsigned int num_workers;
+    unsigned int num_stolen; // jobs run by a worker other than the one they were queued on
+    double elapsed; // wall time of the whole batch, in seconds
+    double throughput; // jobs per second
+    double latency_p50;
+    double latency_p99;
+    double latency_max;
+} vm_runner_stats_t;
+
+/*
+* Creates a pool of num_workers threads, 0 means one per online core. Every
+* worker keeps one context whose stack and frames are reused by all the jobs
+* it runs.
+*/
+vm_runner_t *vm_runner_create(unsigned int num_workers,
+                              unsigned int stack_size,
+                              enum vm_engine engine);
+
+/*
+* Runs every .bcc file in paths once and blocks until all of them are done.
+* Every distinct path is loaded once before the jobs start, and the jobs of
+* a path share its program, its load errors go to the output of each one.
+* Jobs are dealt round-robin to the workers' queues, and a worker whose queue
+* runs dry steals from the others. results must have room for num_jobs
+* entries, stats may be NULL.
+*/
+int vm_runner_run(vm_runner_t *runner,
+                  const char *const *paths,
+                  unsigned int num_jobs,
+                  vm_job_result_t *results,
+                  vm_runner_stats_t *stats);
+
+/* frees the output buffers of num_jobs results */
+void vm_runner_free_results(vm_job_result_t *results, unsigned int num_jobs);
+
+void vm_runner_free(vm_runner_t *runner);
+
+#endif // VM_RUNNER_H
@@ -0,0 +1,28 @@
+#ifndef VM_STACK_H
+#define VM_STACK_H
+
+#include "vm_impl.h"
+
+/*
+* The stack of a context is mapped with guard pages right after it, and no
+* engine checks for overflow when it pushes or opens a frame. Every write
+* goes at most one frame past the last one, and no frame is larger than the
+* guard, so the first access past the end of the stack faults on the guard.
+* The fault handler turns that into a stack overflow error of the run.
+* Pages are only committed when they are first touched, so a large stack
+* costs address space until a deep recursion actually uses it.
+*/
+
+/* maps the stack of stack_size bytes and its guard, installs the fault handler on first use */
+int alloc_stack(vm_t *instance);
+
+void free_stack(vm_t *instance);
+
+/*
+* Runs the engine with the stack guard of the instance armed on this thread.
+* A fault on the guard unwinds back here, reports the overflow and returns
+* -1 with the context left in the running state, like any runtime error.
+*/
+int run_guarded(vm_t *instance, int (*engine)(vm_t *instance));
+
+#endif // VM_STACK_H
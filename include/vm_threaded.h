@@ -0,0 +1,32 @@
+#ifndef VM_THREADED_H
+#define VM_THREADED_H
+
+#include "vm_impl.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define HAS_COMPUTED_GOTO 1 // labels as values are available
+#else
+#define HAS_COMPUTED_GOTO 0
+#endif
+
+typedef struct vm_threaded_instruction
+{
+    const void *handler; // address of the inline handler inside run_threaded_code
+    union
+    {
+        int arg;
+        const vm_method_meta_t *method; // the callee of a call in a verified program, resolved when translated
+    };
+} vm_threaded_instruction_t;
+
+int run_threaded_code(vm_t *instance);
+
+/* builds program->threaded_code, done once when the program is loaded */
+int translate_threaded_code(vm_program_t *program);
+
+/* translates one method of a lazily loaded program, on its first call */
+int translate_threaded_method(vm_program_t *program, const vm_method_meta_t *method);
+
+void free_threaded_code(vm_program_t *program);
+
+#endif // VM_THREADED_H
@@ -3,9 +3,9 @@
 
 #include "vm_impl.h"
 
-int validate_magic_number(vm_t *instance);
+int validate_magic_number(vm_program_t *program);
 
-int check_main_method(vm_t *instance, 
+int check_main_method(vm_program_t *program, 
                       const char *main_method_name, 
                       vm_method_meta_t *method_meta);
 
@@ -15,17 +15,23 @@ char *get_type_name(int type);
 
 void print_error(vm_t *instance, const char *message);
 
+/* like fprintf to the err file, after the pending output, see vm_output.h */
+void report_error(vm_t *instance, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void print_load_error(vm_program_t *program, const char *message);
+
 void print_output(vm_t *instance, const char *message);
 
-int read_byte_value(vm_t *instance);
+int read_byte_value(vm_program_t *program);
 
-int read_int_value(vm_t *instance);
+int read_int_value(vm_program_t *program);
 
-char *read_string_value(vm_t *instance);
+/* returns the string in place inside the mapped code, NULL if it runs past the end */
+char *read_string_value(vm_program_t *program);
 
 int get_operand_stack_size(vm_t *instance);
 
-vm_instruction_t *read_next_instruction(vm_t *instance);
+const vm_instruction_t *read_next_instruction(vm_t *instance);
 
 int get_instruction_arg(vm_t *instance);
 
@@ -33,20 +39,38 @@ vm_value_t *get_local_var(vm_t *instance, int index);
 
 vm_value_t *get_constant_var(vm_t *instance, int index);
 
-int open_stack_frame(vm_t *instance, vm_method_meta_t * method_meta);
+int open_main_frame(vm_t *instance);
 
-void pop_stack_frame(vm_t *instance);
+int push_stack_frame(vm_t *instance, const vm_method_meta_t *method_meta);
+
+/*
+* Makes the arguments on top of the operand stack the params of a new frame
+* and sets its locals from the method's local_template. The argument types
+* are only checked for programs that did not pass verification.
+*/
+int open_stack_frame(vm_t *instance, const vm_method_meta_t *method_meta);
 
-int load_bytecode_from_file(const char *file_path, vm_t *instance);
+/*
+* A tail call: the arguments on top of the operand stack replace the params
+* and locals of the current frame, which then belongs to method_meta and
+* returns to the same caller. No frame is pushed and the stack doesn't grow.
+*/
+int reuse_stack_frame(vm_t *instance, const vm_method_meta_t *method_meta);
+
+/* builds local_template and frame_size once the method's local types are known */
+int init_local_template(vm_method_meta_t *method_meta);
+
+void pop_stack_frame(vm_t *instance);
 
-void free_heap(vm_t *instance);
+int load_bytecode_from_file(const char *file_path, vm_program_t *program);
 
-void free_stack(vm_t *instance);
+/* in seconds, for the timings of gc_stats */
+double get_monotonic_time(void);
 
 void free_stack_frames(vm_t *instance);
 
-void free_constant_pool(vm_t *instance);
+void free_constant_pool(vm_program_t *program);
 
-void free_code(vm_t *instance);
+void free_code(vm_program_t *program);
 
 #endif
\ No newline at end of file
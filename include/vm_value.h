@@ -0,0 +1,323 @@
+#ifndef VM_VALUE_H
+#define VM_VALUE_H
+
+#include <stddef.h> /* offsetof  */
+#include <stdint.h> /* uint64_t  */
+#include <string.h> /* memcpy    */
+
+/*
+* Build with VM_COMPACT_VALUES=1 (make COMPACT_VALUES=1) to pack every value
+* into 8 bytes instead of a type and a union in 16. Everything outside this
+* header goes through the functions below and works with either layout.
+*/
+#ifndef VM_COMPACT_VALUES
+#define VM_COMPACT_VALUES 0
+#endif
+
+enum vm_types
+{
+    VM_TYPE_BYTE      = 0x01,
+    VM_TYPE_INTEGER   = 0x02,
+    VM_TYPE_FLOAT     = 0x03,
+    VM_TYPE_LONG      = 0x04,
+    VM_TYPE_DOUBLE    = 0x05,
+    VM_TYPE_STRING    = 0x06,
+    VM_TYPE_REFERENCE = 0x07,
+    VM_TYPE_METHOD    = 0x08,
+};
+
+struct vm_method_meta;
+
+#if VM_COMPACT_VALUES
+
+/*
+* NaN-boxing. A double is stored as its own bits, with every NaN replaced by
+* the one canonical quiet NaN. Any other value is a NaN with the sign bit set
+* whose top 16 bits are 0xFFF0 | type and whose low 48 bits are the payload,
+* so a type check is a shift and a compare. Pointers must fit in 48 bits, as
+* they do on x86-64 and AArch64 user space, and longs are limited to 48 bits.
+*/
+typedef struct vm_value
+{
+    uint64_t bits;
+} vm_value_t;
+
+#define VALUE_TAG_BASE 0xFFF0u
+#define VALUE_PAYLOAD_MASK 0x0000FFFFFFFFFFFFull
+#define VALUE_CANONICAL_NAN 0x7FF8000000000000ull
+
+/* where the jit reads and writes the int of an integer value, and the word that marks it as one */
+#define VALUE_PAYLOAD_OFFSET 0
+#define VALUE_TYPE_OFFSET 4
+#define VALUE_INTEGER_TYPE_WORD ((VALUE_TAG_BASE | VM_TYPE_INTEGER) << 16)
+
+static inline vm_value_t make_tagged_value(enum vm_types type, uint64_t payload)
+{
+    vm_value_t value = { ((uint64_t)(VALUE_TAG_BASE | type) << 48) | (payload & VALUE_PAYLOAD_MASK) };
+
+    return value;
+}
+
+static inline enum vm_types get_value_type(vm_value_t value)
+{
+    unsigned int tag = (unsigned int)(value.bits >> 48);
+
+    return (tag > VALUE_TAG_BASE ? (enum vm_types)(tag & 0xF) : VM_TYPE_DOUBLE);
+}
+
+static inline int is_value_type(vm_value_t value, enum vm_types type)
+{
+    if (VM_TYPE_DOUBLE == type)
+    {
+        return (value.bits >> 48) <= VALUE_TAG_BASE;
+    }
+
+    return (value.bits >> 48) == (VALUE_TAG_BASE | type);
+}
+
+static inline vm_value_t make_empty_value(enum vm_types type)
+{
+    vm_value_t value = {0};
+
+    return (VM_TYPE_DOUBLE == type ? value : make_tagged_value(type, 0));
+}
+
+static inline vm_value_t make_byte_value(char byte)
+{
+    return make_tagged_value(VM_TYPE_BYTE, (unsigned char)byte);
+}
+
+static inline vm_value_t make_integer_value(int integer)
+{
+    return make_tagged_value(VM_TYPE_INTEGER, (uint32_t)integer);
+}
+
+static inline vm_value_t make_float_value(float real)
+{
+    uint32_t bits = 0;
+
+    memcpy(&bits, &real, sizeof(bits));
+
+    return make_tagged_value(VM_TYPE_FLOAT, bits);
+}
+
+static inline vm_value_t make_long_value(long integer)
+{
+    return make_tagged_value(VM_TYPE_LONG, (uint64_t)integer);
+}
+
+static inline vm_value_t make_double_value(double real)
+{
+    vm_value_t value = {0};
+
+    memcpy(&value.bits, &real, sizeof(value.bits));
+    if (real != real)
+    {
+        value.bits = VALUE_CANONICAL_NAN;
+    }
+
+    return value;
+}
+
+static inline vm_value_t make_string_value(char *string)
+{
+    return make_tagged_value(VM_TYPE_STRING, (uintptr_t)string);
+}
+
+static inline vm_value_t make_reference_value(void *reference)
+{
+    return make_tagged_value(VM_TYPE_REFERENCE, (uintptr_t)reference);
+}
+
+static inline vm_value_t make_method_value(struct vm_method_meta *method)
+{
+    return make_tagged_value(VM_TYPE_METHOD, (uintptr_t)method);
+}
+
+static inline char get_byte_value(vm_value_t value)
+{
+    return (char)value.bits;
+}
+
+static inline int get_integer_value(vm_value_t value)
+{
+    return (int)(uint32_t)value.bits;
+}
+
+static inline float get_float_value(vm_value_t value)
+{
+    uint32_t bits = (uint32_t)value.bits;
+    float real = 0;
+
+    memcpy(&real, &bits, sizeof(real));
+
+    return real;
+}
+
+static inline long get_long_value(vm_value_t value)
+{
+    return (long)((int64_t)(value.bits << 16) >> 16);
+}
+
+static inline double get_double_value(vm_value_t value)
+{
+    double real = 0;
+
+    memcpy(&real, &value.bits, sizeof(real));
+
+    return real;
+}
+
+static inline char *get_string_value(vm_value_t value)
+{
+    return (char *)(uintptr_t)(value.bits & VALUE_PAYLOAD_MASK);
+}
+
+static inline void *get_reference_value(vm_value_t value)
+{
+    return (void *)(uintptr_t)(value.bits & VALUE_PAYLOAD_MASK);
+}
+
+static inline struct vm_method_meta *get_method_value(vm_value_t value)
+{
+    return (struct vm_method_meta *)(uintptr_t)(value.bits & VALUE_PAYLOAD_MASK);
+}
+
+#else
+
+typedef struct vm_value
+{
+    enum vm_types type;
+    union
+    {
+        char byte_value;
+        int integer_value;
+        float float_value;
+        long long_value;
+        double double_value;
+        char *string_value;
+        void *reference_value;
+        struct vm_method_meta *method_value;
+    } value;
+} vm_value_t;
+
+#define VALUE_PAYLOAD_OFFSET ((int)offsetof(vm_value_t, value))
+#define VALUE_TYPE_OFFSET ((int)offsetof(vm_value_t, type))
+#define VALUE_INTEGER_TYPE_WORD VM_TYPE_INTEGER
+
+static inline enum vm_types get_value_type(vm_value_t value)
+{
+    return value.type;
+}
+
+static inline int is_value_type(vm_value_t value, enum vm_types type)
+{
+    return value.type == type;
+}
+
+static inline vm_value_t make_empty_value(enum vm_types type)
+{
+    vm_value_t value = { type, { .long_value = 0 } };
+
+    return value;
+}
+
+static inline vm_value_t make_byte_value(char byte)
+{
+    vm_value_t value = { VM_TYPE_BYTE, { .byte_value = byte } };
+
+    return value;
+}
+
+static inline vm_value_t make_integer_value(int integer)
+{
+    vm_value_t value = { VM_TYPE_INTEGER, { .integer_value = integer } };
+
+    return value;
+}
+
+static inline vm_value_t make_float_value(float real)
+{
+    vm_value_t value = { VM_TYPE_FLOAT, { .float_value = real } };
+
+    return value;
+}
+
+static inline vm_value_t make_long_value(long integer)
+{
+    vm_value_t value = { VM_TYPE_LONG, { .long_value = integer } };
+
+    return value;
+}
+
+static inline vm_value_t make_double_value(double real)
+{
+    vm_value_t value = { VM_TYPE_DOUBLE, { .double_value = real } };
+
+    return value;
+}
+
+static inline vm_value_t make_string_value(char *string)
+{
+    vm_value_t value = { VM_TYPE_STRING, { .string_value = string } };
+
+    return value;
+}
+
+static inline vm_value_t make_reference_value(void *reference)
+{
+    vm_value_t value = { VM_TYPE_REFERENCE, { .reference_value = reference } };
+
+    return value;
+}
+
+static inline vm_value_t make_method_value(struct vm_method_meta *method)
+{
+    vm_value_t value = { VM_TYPE_METHOD, { .method_value = method } };
+
+    return value;
+}
+
+static inline char get_byte_value(vm_value_t value)
+{
+    return value.value.byte_value;
+}
+
+static inline int get_integer_value(vm_value_t value)
+{
+    return value.value.integer_value;
+}
+
+static inline float get_float_value(vm_value_t value)
+{
+    return value.value.float_value;
+}
+
+static inline long get_long_value(vm_value_t value)
+{
+    return value.value.long_value;
+}
+
+static inline double get_double_value(vm_value_t value)
+{
+    return value.value.double_value;
+}
+
+static inline char *get_string_value(vm_value_t value)
+{
+    return value.value.string_value;
+}
+
+static inline void *get_reference_value(vm_value_t value)
+{
+    return value.value.reference_value;
+}
+
+static inline struct vm_method_meta *get_method_value(vm_value_t value)
+{
+    return value.value.method_value;
+}
+
+#endif // VM_COMPACT_VALUES
+
+#endif // VM_VALUE_H
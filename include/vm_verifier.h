@@ -0,0 +1,23 @@
+#ifndef VM_VERIFIER_H
+#define VM_VERIFIER_H
+
+#include "vm_impl.h"
+
+#define MAX_OPERAND_DEPTH 0xFFFF // deeper operand stacks are rejected
+
+/*
+* Proves operand stack depths, operand and local types, constant pool indices
+* and method result types for every method in the constant pool. On success
+* the program is marked as verified and can run the unchecked handlers.
+*/
+int verify_program(vm_program_t *program);
+
+/*
+* Verifies one method of a v2 file within its own code range, after finding
+* the result types of the methods it calls. Used by prepare_method.
+*/
+int verify_lazy_method(vm_program_t *program, vm_method_meta_t *method);
+
+void free_stack_depths(vm_program_t *program);
+
+#endif // VM_VERIFIER_H
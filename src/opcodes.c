@@ -1,9 +1,15 @@
 #include <assert.h> /* assert */
+#include <math.h>   /* sqrt   */
 #include <stdio.h> /* TODO: remove */
 #include <string.h> /* memcpy */
 
 #include "vm_impl.h" /* to access vm fields  */
 #include "vm_util.h" /* vm utility functions */
+#include "vm_jit.h"  /* jit entry on calls   */
+#include "vm_heap.h" /* objects              */
+#include "vm_array.h" /* arrays              */
+#include "vm_numeric.h" /* integer, long, float and double semantics */
+#include "vm_output.h" /* print buffer */
 
 #include "opcodes.h"
 
@@ -14,7 +20,9 @@ int opcode_halt(vm_t *instance);
 int opcode_stop(vm_t *instance);
 int opcode_pop(vm_t *instance);
 int opcode_call(vm_t *instance);
+int opcode_tailcall(vm_t *instance);
 int opcode_ret(vm_t *instance);
+int opcode_flush(vm_t *instance);
 
 /* integer operations */
 int opcode_iload(vm_t *instance);
@@ -28,15 +36,125 @@ int opcode_ineg(vm_t *instance);
 int opcode_iprint(vm_t *instance);
 int opcode_iret(vm_t *instance);
 
+/* control flow */
+int opcode_goto(vm_t *instance);
+int opcode_ifeq(vm_t *instance);
+int opcode_ifne(vm_t *instance);
+int opcode_if_icmpeq(vm_t *instance);
+int opcode_if_icmpne(vm_t *instance);
+int opcode_if_icmplt(vm_t *instance);
+int opcode_if_icmpge(vm_t *instance);
+int opcode_if_icmpgt(vm_t *instance);
+int opcode_if_icmple(vm_t *instance);
+int opcode_tableswitch(vm_t *instance);
+
 /* string operations */
 int opcode_sload(vm_t *instance);
 int opcode_sstore(vm_t *instance);
 int opcode_sprint(vm_t *instance);
 int opcode_sret(vm_t *instance);
 
+/* reference operations */
+int opcode_rload(vm_t *instance);
+int opcode_rstore(vm_t *instance);
+int opcode_rnull(vm_t *instance);
+int opcode_rret(vm_t *instance);
+int opcode_new(vm_t *instance);
+int opcode_igetfield(vm_t *instance);
+int opcode_iputfield(vm_t *instance);
+int opcode_sgetfield(vm_t *instance);
+int opcode_sputfield(vm_t *instance);
+int opcode_rgetfield(vm_t *instance);
+int opcode_rputfield(vm_t *instance);
+
 /* constant pool operatios */
 int opcode_cload(vm_t *instance);
 
+/* array operations */
+int opcode_newarray(vm_t *instance);
+int opcode_alen(vm_t *instance);
+int opcode_baload(vm_t *instance);
+int opcode_bastore(vm_t *instance);
+int opcode_iaload(vm_t *instance);
+int opcode_iastore(vm_t *instance);
+int opcode_afill(vm_t *instance);
+int opcode_acopy(vm_t *instance);
+int opcode_asum(vm_t *instance);
+int opcode_adot(vm_t *instance);
+int opcode_aadd(vm_t *instance);
+
+/* long operations */
+int opcode_lload(vm_t *instance);
+int opcode_lstore(vm_t *instance);
+int opcode_lpush(vm_t *instance);
+int opcode_ladd(vm_t *instance);
+int opcode_lsub(vm_t *instance);
+int opcode_lmult(vm_t *instance);
+int opcode_ldiv(vm_t *instance);
+int opcode_lneg(vm_t *instance);
+int opcode_lprint(vm_t *instance);
+int opcode_lret(vm_t *instance);
+int opcode_lcmp(vm_t *instance);
+int opcode_laload(vm_t *instance);
+int opcode_lastore(vm_t *instance);
+
+/* float operations */
+int opcode_fload(vm_t *instance);
+int opcode_fstore(vm_t *instance);
+int opcode_fpush(vm_t *instance);
+int opcode_fadd(vm_t *instance);
+int opcode_fsub(vm_t *instance);
+int opcode_fmult(vm_t *instance);
+int opcode_fdiv(vm_t *instance);
+int opcode_fneg(vm_t *instance);
+int opcode_fprint(vm_t *instance);
+int opcode_fret(vm_t *instance);
+int opcode_fcmp(vm_t *instance);
+int opcode_faload(vm_t *instance);
+int opcode_fastore(vm_t *instance);
+
+/* double operations */
+int opcode_dload(vm_t *instance);
+int opcode_dstore(vm_t *instance);
+int opcode_dpush(vm_t *instance);
+int opcode_dadd(vm_t *instance);
+int opcode_dsub(vm_t *instance);
+int opcode_dmult(vm_t *instance);
+int opcode_ddiv(vm_t *instance);
+int opcode_dneg(vm_t *instance);
+int opcode_dprint(vm_t *instance);
+int opcode_dret(vm_t *instance);
+int opcode_dcmp(vm_t *instance);
+int opcode_daload(vm_t *instance);
+int opcode_dastore(vm_t *instance);
+int opcode_dsqrt(vm_t *instance);
+
+/* conversions */
+int opcode_i2l(vm_t *instance);
+int opcode_i2f(vm_t *instance);
+int opcode_i2d(vm_t *instance);
+int opcode_l2i(vm_t *instance);
+int opcode_l2f(vm_t *instance);
+int opcode_l2d(vm_t *instance);
+int opcode_f2i(vm_t *instance);
+int opcode_f2l(vm_t *instance);
+int opcode_f2d(vm_t *instance);
+int opcode_d2i(vm_t *instance);
+int opcode_d2l(vm_t *instance);
+int opcode_d2f(vm_t *instance);
+
+static int get_field(vm_t *instance, const char *name, enum vm_types type);
+static int put_field(vm_t *instance, const char *name, enum vm_types type);
+static vm_value_t *get_operands(vm_t *instance, const char *name, const enum vm_types *types, int count);
+static vm_value_t *get_operand(vm_t *instance, const char *name, enum vm_types type);
+static int load_local(vm_t *instance, const char *name, enum vm_types type);
+static int store_local(vm_t *instance, const char *name, enum vm_types type);
+static int return_value(vm_t *instance, const char *name, enum vm_types type);
+static int compare_and_branch(vm_t *instance, const char *name, enum opcodes opcode);
+static int branch(vm_t *instance, const char *name, int target);
+static int load_array_element(vm_t *instance, const char *name, enum vm_types type);
+static int store_array_element(vm_t *instance, const char *name, enum vm_types type);
+
 void init_opcode_handlers(opcode_handler *handlers) 
 {
     for (int i = 0; i < NUM_OPCODES; ++i)
@@ -50,7 +168,9 @@ void init_opcode_handlers(opcode_handler *handlers)
     handlers[OP_STOP] = opcode_stop;
     handlers[OP_POP] = opcode_pop;
     handlers[OP_CALL] = opcode_call;
+    handlers[OP_TAILCALL] = opcode_tailcall;
     handlers[OP_RET] = opcode_ret;
+    handlers[OP_FLUSH] = opcode_flush;
 
     /* integer operations */
     handlers[OP_ILOAD] = opcode_iload;
@@ -64,14 +184,112 @@ void init_opcode_handlers(opcode_handler *handlers)
     handlers[OP_IPRINT] = opcode_iprint;
     handlers[OP_IRET] = opcode_iret;
 
+    /* control flow */
+    handlers[OP_GOTO] = opcode_goto;
+    handlers[OP_IFEQ] = opcode_ifeq;
+    handlers[OP_IFNE] = opcode_ifne;
+    handlers[OP_IF_ICMPEQ] = opcode_if_icmpeq;
+    handlers[OP_IF_ICMPNE] = opcode_if_icmpne;
+    handlers[OP_IF_ICMPLT] = opcode_if_icmplt;
+    handlers[OP_IF_ICMPGE] = opcode_if_icmpge;
+    handlers[OP_IF_ICMPGT] = opcode_if_icmpgt;
+    handlers[OP_IF_ICMPLE] = opcode_if_icmple;
+    handlers[OP_TABLESWITCH] = opcode_tableswitch;
+
     /* string operations */
     handlers[OP_SLOAD] = opcode_sload;
     handlers[OP_SSTORE] = opcode_sstore;
     handlers[OP_SPRINT] = opcode_sprint;
     handlers[OP_SRET] = opcode_sret;
 
+    /* reference operations */
+    handlers[OP_RLOAD] = opcode_rload;
+    handlers[OP_RSTORE] = opcode_rstore;
+    handlers[OP_RNULL] = opcode_rnull;
+    handlers[OP_RRET] = opcode_rret;
+    handlers[OP_NEW] = opcode_new;
+    handlers[OP_IGETFIELD] = opcode_igetfield;
+    handlers[OP_IPUTFIELD] = opcode_iputfield;
+    handlers[OP_SGETFIELD] = opcode_sgetfield;
+    handlers[OP_SPUTFIELD] = opcode_sputfield;
+    handlers[OP_RGETFIELD] = opcode_rgetfield;
+    handlers[OP_RPUTFIELD] = opcode_rputfield;
+
     /* constant pool operatios */
     handlers[OP_CLOAD] = opcode_cload;
+
+    /* array operations */
+    handlers[OP_NEWARRAY] = opcode_newarray;
+    handlers[OP_ALEN] = opcode_alen;
+    handlers[OP_BALOAD] = opcode_baload;
+    handlers[OP_BASTORE] = opcode_bastore;
+    handlers[OP_IALOAD] = opcode_iaload;
+    handlers[OP_IASTORE] = opcode_iastore;
+    handlers[OP_AFILL] = opcode_afill;
+    handlers[OP_ACOPY] = opcode_acopy;
+    handlers[OP_ASUM] = opcode_asum;
+    handlers[OP_ADOT] = opcode_adot;
+    handlers[OP_AADD] = opcode_aadd;
+
+    /* long operations */
+    handlers[OP_LLOAD] = opcode_lload;
+    handlers[OP_LSTORE] = opcode_lstore;
+    handlers[OP_LPUSH] = opcode_lpush;
+    handlers[OP_LADD] = opcode_ladd;
+    handlers[OP_LSUB] = opcode_lsub;
+    handlers[OP_LMULT] = opcode_lmult;
+    handlers[OP_LDIV] = opcode_ldiv;
+    handlers[OP_LNEG] = opcode_lneg;
+    handlers[OP_LPRINT] = opcode_lprint;
+    handlers[OP_LRET] = opcode_lret;
+    handlers[OP_LCMP] = opcode_lcmp;
+    handlers[OP_LALOAD] = opcode_laload;
+    handlers[OP_LASTORE] = opcode_lastore;
+
+    /* float operations */
+    handlers[OP_FLOAD] = opcode_fload;
+    handlers[OP_FSTORE] = opcode_fstore;
+    handlers[OP_FPUSH] = opcode_fpush;
+    handlers[OP_FADD] = opcode_fadd;
+    handlers[OP_FSUB] = opcode_fsub;
+    handlers[OP_FMULT] = opcode_fmult;
+    handlers[OP_FDIV] = opcode_fdiv;
+    handlers[OP_FNEG] = opcode_fneg;
+    handlers[OP_FPRINT] = opcode_fprint;
+    handlers[OP_FRET] = opcode_fret;
+    handlers[OP_FCMP] = opcode_fcmp;
+    handlers[OP_FALOAD] = opcode_faload;
+    handlers[OP_FASTORE] = opcode_fastore;
+
+    /* double operations */
+    handlers[OP_DLOAD] = opcode_dload;
+    handlers[OP_DSTORE] = opcode_dstore;
+    handlers[OP_DPUSH] = opcode_dpush;
+    handlers[OP_DADD] = opcode_dadd;
+    handlers[OP_DSUB] = opcode_dsub;
+    handlers[OP_DMULT] = opcode_dmult;
+    handlers[OP_DDIV] = opcode_ddiv;
+    handlers[OP_DNEG] = opcode_dneg;
+    handlers[OP_DPRINT] = opcode_dprint;
+    handlers[OP_DRET] = opcode_dret;
+    handlers[OP_DCMP] = opcode_dcmp;
+    handlers[OP_DALOAD] = opcode_daload;
+    handlers[OP_DASTORE] = opcode_dastore;
+    handlers[OP_DSQRT] = opcode_dsqrt;
+
+    /* conversions */
+    handlers[OP_I2L] = opcode_i2l;
+    handlers[OP_I2F] = opcode_i2f;
+    handlers[OP_I2D] = opcode_i2d;
+    handlers[OP_L2I] = opcode_l2i;
+    handlers[OP_L2F] = opcode_l2f;
+    handlers[OP_L2D] = opcode_l2d;
+    handlers[OP_F2I] = opcode_f2i;
+    handlers[OP_F2L] = opcode_f2l;
+    handlers[OP_F2D] = opcode_f2d;
+    handlers[OP_D2I] = opcode_d2i;
+    handlers[OP_D2L] = opcode_d2l;
+    handlers[OP_D2F] = opcode_d2f;
 }
 
 /* special operations */
@@ -92,11 +310,26 @@ int opcode_halt(vm_t *instance)
 
 int opcode_stop(vm_t *instance)
 {
+    assert(instance);
+
+    instance->state = VM_FINISHED;
+
     return 0;
 }
 
 int opcode_pop(vm_t *instance)
 {
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) <= 0)
+    {
+        report_error(instance, "[pop] failed, operand stack is empty!\n");
+
+        return -1;
+    }
+
+    --instance->osp;
+
     return 0;
 }
 
@@ -105,38 +338,99 @@ int opcode_call(vm_t *instance)
     int index = 0, res = 0;
     vm_value_t *value = NULL;
 
-    assert(instance && instance->stack && instance->constant_pool);
+    assert(instance && instance->stack && instance->program->constant_pool);
 
     index = get_instruction_arg(instance);
 
-    if (index >= instance->constant_pool_size)
+    if (index >= instance->program->constant_pool_size)
     {
-        fprintf(instance->err, "[call] failed, index %d is out of constant pool bounds!\n",
+        report_error(instance, "[call] failed, index %d is out of constant pool bounds!\n",
             index);
 
         return -1;
     }
 
-    value = &instance->constant_pool[index];
+    value = &instance->program->constant_pool[index];
 
-    if (VM_TYPE_METHOD != value->type)
+    if (!is_value_type(*value, VM_TYPE_METHOD))
     {
-        fprintf(instance->err, "[call] failed, constant is of type: %s!\n",
-            get_type_name(value->type));
+        report_error(instance, "[call] failed, constant is of type: %s!\n",
+            get_type_name(get_value_type(*value)));
 
         return -1;
     }
 
-    res = open_stack_frame(instance, value->value.method_value);
+    res = open_stack_frame(instance, get_method_value(*value));
     if (0 != res)
     {  
-        fprintf(instance->err, "[call] failed, could not open stack frame for method: %s!\n",
-            value->value.method_value->name);
+        report_error(instance, "[call] failed, could not open stack frame for method: %s!\n",
+            get_method_value(*value)->name);
+
+        return -1;
+    }
+
+    instance->ip = get_method_value(*value)->offset;
+
+    if (VM_ENGINE_JIT == instance->engine)
+    {
+        return jit_enter_method(instance, get_method_value(*value));
+    }
+
+    return 0;
+}
+
+/*
+* Not handed to the jit like a call: the frame stays the same, and a method
+* running in native code goes on in the interpreter once its frame belongs
+* to another method, see run_native_frame.
+*/
+int opcode_tailcall(vm_t *instance)
+{
+    const vm_method_meta_t *method = NULL;
+    vm_value_t *value = NULL;
+    int index = 0;
+
+    assert(instance && instance->stack && instance->program->constant_pool);
+
+    index = get_instruction_arg(instance);
+
+    if (index >= instance->program->constant_pool_size)
+    {
+        report_error(instance, "[tailcall] failed, index %d is out of constant pool bounds!\n",
+            index);
+
+        return -1;
+    }
+
+    value = &instance->program->constant_pool[index];
+
+    if (!is_value_type(*value, VM_TYPE_METHOD))
+    {
+        report_error(instance, "[tailcall] failed, constant is of type: %s!\n",
+            get_type_name(get_value_type(*value)));
+
+        return -1;
+    }
+
+    method = get_method_value(*value);
+
+    if (get_operand_stack_size(instance) < method->num_params)
+    {
+        report_error(instance, "[tailcall] failed, operand stack has fewer values than the params of method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    if (0 != reuse_stack_frame(instance, method))
+    {
+        report_error(instance, "[tailcall] failed, could not reuse stack frame for method: %s!\n",
+            method->name);
 
         return -1;
     }
 
-    instance->ip = value->value.method_value->offset;
+    instance->ip = method->offset;
 
     return 0;
 }
@@ -150,6 +444,15 @@ int opcode_ret(vm_t *instance)
     return 0;
 }
 
+int opcode_flush(vm_t *instance)
+{
+    assert(instance);
+
+    flush_output(instance);
+
+    return 0;
+}
+
 /* integer operations */
 int opcode_iload(vm_t *instance)
 {
@@ -161,17 +464,15 @@ int opcode_iload(vm_t *instance)
     index = get_instruction_arg(instance);
     value = &instance->stack[instance->lap + index];
 
-    if (VM_TYPE_INTEGER != value->type)
+    if (!is_value_type(*value, VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[iload] failed, local variable %d is of type: %s\n",
-            index, get_type_name(value->type));
+        report_error(instance, "[iload] failed, local variable %d is of type: %s\n",
+            index, get_type_name(get_value_type(*value)));
 
         return -1;
     }
 
-    // TODO: check for stack overflow
-    instance->stack[instance->osp].type = VM_TYPE_INTEGER;
-    instance->stack[instance->osp].value.integer_value = value->value.integer_value;
+    instance->stack[instance->osp] = *value;
     ++instance->osp;
 
     return 0;
@@ -189,31 +490,31 @@ int opcode_istore(vm_t *instance)
 
     if (get_operand_stack_size(instance) <= 0)
     {
-        fprintf(instance->err, "[istore] failed, operand stack is empty!\n");
+        report_error(instance, "[istore] failed, operand stack is empty!\n");
 
         return -1;
     }
 
     value = &instance->stack[instance->osp - 1];
 
-    if (VM_TYPE_INTEGER != value->type)
+    if (!is_value_type(*value, VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[istore] failed, operand stack top is of type: %s\n",
-            get_type_name(value->type));
+        report_error(instance, "[istore] failed, operand stack top is of type: %s\n",
+            get_type_name(get_value_type(*value)));
 
         return -1;
     }
 
-    if (VM_TYPE_INTEGER != instance->stack[instance->lap + arg].type)
+    if (!is_value_type(instance->stack[instance->lap + arg], VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[istore] failed, trying to store int to local "
+        report_error(instance, "[istore] failed, trying to store int to local "
             "variable of type: %s\n",
-            get_type_name(instance->stack[instance->lap + arg].type));
+            get_type_name(get_value_type(instance->stack[instance->lap + arg])));
 
         return -1;
     }
 
-    instance->stack[instance->lap + arg].value.integer_value = value->value.integer_value;
+    instance->stack[instance->lap + arg] = *value;
     --instance->osp;
 
     return 0;
@@ -226,12 +527,9 @@ int opcode_ipush(vm_t *instance)
 
     assert(instance && instance->stack);
 
-    // TODO: check stack overflow
-
     intVal = get_instruction_arg(instance);
     value = &instance->stack[instance->osp];
-    value->type = VM_TYPE_INTEGER;
-    value->value.integer_value = intVal;
+    *value = make_integer_value(intVal);
     ++instance->osp;
 
     return 0;
@@ -245,7 +543,7 @@ int opcode_iadd(vm_t *instance)
 
     if (get_operand_stack_size(instance) < 2)
     {
-        fprintf(instance->err, "[iadd] failed, operand stack does not have enough operands\n");
+        report_error(instance, "[iadd] failed, operand stack does not have enough operands\n");
 
         return -1;
     }
@@ -253,23 +551,23 @@ int opcode_iadd(vm_t *instance)
     op1 = &instance->stack[instance->osp - 2];
     op2 = &instance->stack[instance->osp - 1];
 
-    if (VM_TYPE_INTEGER != op1->type)
+    if (!is_value_type(*op1, VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[iadd] failed, operand1 is of type: %s\n",
-            get_type_name(op1->type));
+        report_error(instance, "[iadd] failed, operand1 is of type: %s\n",
+            get_type_name(get_value_type(*op1)));
 
         return -1;
     }
 
-    if (VM_TYPE_INTEGER != op2->type)
+    if (!is_value_type(*op2, VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[iadd] failed, operand2 is of type: %s\n",
-            get_type_name(op2->type));
+        report_error(instance, "[iadd] failed, operand2 is of type: %s\n",
+            get_type_name(get_value_type(*op2)));
 
         return -1;
     }
     
-    op1->value.integer_value += op2->value.integer_value;
+    *op1 = make_integer_value(add_integers(get_integer_value(*op1), get_integer_value(*op2)));
     --instance->osp;
 
     return 0;
@@ -277,21 +575,149 @@ int opcode_iadd(vm_t *instance)
 
 int opcode_isub(vm_t *instance)
 {
+    vm_value_t *op1 = NULL, *op2 = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) < 2)
+    {
+        report_error(instance, "[isub] failed, operand stack does not have enough operands\n");
+
+        return -1;
+    }
+
+    op1 = &instance->stack[instance->osp - 2];
+    op2 = &instance->stack[instance->osp - 1];
+
+    if (!is_value_type(*op1, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[isub] failed, operand1 is of type: %s\n",
+            get_type_name(get_value_type(*op1)));
+
+        return -1;
+    }
+
+    if (!is_value_type(*op2, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[isub] failed, operand2 is of type: %s\n",
+            get_type_name(get_value_type(*op2)));
+
+        return -1;
+    }
+    
+    *op1 = make_integer_value(subtract_integers(get_integer_value(*op1), get_integer_value(*op2)));
+    --instance->osp;
+
     return 0;
 }
 
 int opcode_imult(vm_t *instance)
 {
+    vm_value_t *op1 = NULL, *op2 = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) < 2)
+    {
+        report_error(instance, "[imult] failed, operand stack does not have enough operands\n");
+
+        return -1;
+    }
+
+    op1 = &instance->stack[instance->osp - 2];
+    op2 = &instance->stack[instance->osp - 1];
+
+    if (!is_value_type(*op1, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[imult] failed, operand1 is of type: %s\n",
+            get_type_name(get_value_type(*op1)));
+
+        return -1;
+    }
+
+    if (!is_value_type(*op2, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[imult] failed, operand2 is of type: %s\n",
+            get_type_name(get_value_type(*op2)));
+
+        return -1;
+    }
+    
+    *op1 = make_integer_value(multiply_integers(get_integer_value(*op1), get_integer_value(*op2)));
+    --instance->osp;
+
     return 0;
 }
 
 int opcode_idiv(vm_t *instance)
 {
+    vm_value_t *op1 = NULL, *op2 = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) < 2)
+    {
+        report_error(instance, "[idiv] failed, operand stack does not have enough operands\n");
+
+        return -1;
+    }
+
+    op1 = &instance->stack[instance->osp - 2];
+    op2 = &instance->stack[instance->osp - 1];
+
+    if (!is_value_type(*op1, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[idiv] failed, operand1 is of type: %s\n",
+            get_type_name(get_value_type(*op1)));
+
+        return -1;
+    }
+
+    if (!is_value_type(*op2, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[idiv] failed, operand2 is of type: %s\n",
+            get_type_name(get_value_type(*op2)));
+
+        return -1;
+    }
+
+    if (0 == get_integer_value(*op2))
+    {
+        report_error(instance, "[idiv] failed, division by zero\n");
+
+        return -1;
+    }
+    
+    *op1 = make_integer_value(divide_integers(get_integer_value(*op1), get_integer_value(*op2)));
+    --instance->osp;
+
     return 0;
 }
 
 int opcode_ineg(vm_t *instance)
 {
+    vm_value_t *value = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) <= 0)
+    {
+        report_error(instance, "[ineg] failed, operand stack is empty!\n");
+
+        return -1;
+    }
+
+    value = &instance->stack[instance->osp - 1];
+    if (!is_value_type(*value, VM_TYPE_INTEGER))
+    {
+        report_error(instance, "[ineg] failed, operand stack top is of type: %s\n",
+            get_type_name(get_value_type(*value)));
+
+        return -1;
+    }
+
+    *value = make_integer_value(negate_integer(get_integer_value(*value)));
+
     return 0;
 }
 
@@ -303,23 +729,22 @@ int opcode_iprint(vm_t *instance)
 
     if (get_operand_stack_size(instance) <= 0)
     {
-        fprintf(instance->err, "[iprint] failed, operand stack is empty!\n");
+        report_error(instance, "[iprint] failed, operand stack is empty!\n");
 
         return -1;
     }
 
     value = &instance->stack[instance->osp - 1];
-    if (VM_TYPE_INTEGER != value->type)
+    if (!is_value_type(*value, VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[iprint] failed, operand stack top is of type: %s\n",
-            get_type_name(value->type));
+        report_error(instance, "[iprint] failed, operand stack top is of type: %s\n",
+            get_type_name(get_value_type(*value)));
 
         return -1;
     }
     --instance->osp;
 
-    fprintf(instance->output, "%d\n", value->value.integer_value);
-    fflush(instance->output);
+    output_integer(instance, get_integer_value(*value));
 
     return 0;
 }
@@ -327,24 +752,22 @@ int opcode_iprint(vm_t *instance)
 int opcode_iret(vm_t *instance)
 {
     vm_value_t *result = NULL;
-    int prev_osp = 0, prev_lap = 0, prev_sp = 0;
-    int prev_num_locals = 0, prev_num_params = 0;
 
     assert(instance && instance->stack);
 
     if (get_operand_stack_size(instance) <= 0)
     {
-        fprintf(instance->err, "[iret] failed, operand stack is empty\n");
+        report_error(instance, "[iret] failed, operand stack is empty\n");
 
         return -1;
     }
 
     result = &instance->stack[instance->osp - 1];
 
-    if (VM_TYPE_INTEGER != result->type)
+    if (!is_value_type(*result, VM_TYPE_INTEGER))
     {
-        fprintf(instance->err, "[iret] failed, result is of type: %s\n",
-            get_type_name(result->type));
+        report_error(instance, "[iret] failed, result is of type: %s\n",
+            get_type_name(get_value_type(*result)));
 
         return -1;
     }
@@ -357,6 +780,118 @@ int opcode_iret(vm_t *instance)
     return 0;
 }
 
+/* control flow */
+int opcode_goto(vm_t *instance)
+{
+    return branch(instance, "goto", get_instruction_arg(instance));
+}
+
+int opcode_ifeq(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "ifeq", VM_TYPE_INTEGER);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    --instance->osp;
+
+    return (0 == get_integer_value(*operand) ? branch(instance, "ifeq", get_instruction_arg(instance)) : 0);
+}
+
+int opcode_ifne(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "ifne", VM_TYPE_INTEGER);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    --instance->osp;
+
+    return (0 != get_integer_value(*operand) ? branch(instance, "ifne", get_instruction_arg(instance)) : 0);
+}
+
+int opcode_if_icmpeq(vm_t *instance)
+{
+    return compare_and_branch(instance, "if_icmpeq", OP_IF_ICMPEQ);
+}
+
+int opcode_if_icmpne(vm_t *instance)
+{
+    return compare_and_branch(instance, "if_icmpne", OP_IF_ICMPNE);
+}
+
+int opcode_if_icmplt(vm_t *instance)
+{
+    return compare_and_branch(instance, "if_icmplt", OP_IF_ICMPLT);
+}
+
+int opcode_if_icmpge(vm_t *instance)
+{
+    return compare_and_branch(instance, "if_icmpge", OP_IF_ICMPGE);
+}
+
+int opcode_if_icmpgt(vm_t *instance)
+{
+    return compare_and_branch(instance, "if_icmpgt", OP_IF_ICMPGT);
+}
+
+int opcode_if_icmple(vm_t *instance)
+{
+    return compare_and_branch(instance, "if_icmple", OP_IF_ICMPLE);
+}
+
+/* an index in range continues at the target of its goto in the table, any other after the table */
+int opcode_tableswitch(vm_t *instance)
+{
+    const vm_instruction_t *table = &instance->program->instructions[instance->ip];
+    vm_value_t *operand = get_operand(instance, "tableswitch", VM_TYPE_INTEGER);
+    int count = get_instruction_arg(instance), index = 0;
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    if (count < 0 || (unsigned int)count > instance->program->num_instructions - instance->ip)
+    {
+        report_error(instance, "[tableswitch] failed, table of %d entries is out of code bounds\n", count);
+
+        return -1;
+    }
+
+    index = get_integer_value(*operand);
+    --instance->osp;
+
+    if (index < 0 || index >= count)
+    {
+        instance->ip += (unsigned int)count;
+
+        return 0;
+    }
+
+    if (OP_GOTO != table[index].opcode)
+    {
+        report_error(instance, "[tableswitch] failed, entry %d is not a goto\n", index);
+
+        return -1;
+    }
+
+    // not a back-edge even when it goes backwards, loops close with goto and the ifs
+    if (table[index].arg < 0 || (unsigned int)table[index].arg >= instance->program->num_instructions)
+    {
+        report_error(instance, "[tableswitch] failed, target %d is out of code bounds\n", table[index].arg);
+
+        return -1;
+    }
+
+    instance->ip = (unsigned int)table[index].arg;
+
+    return 0;
+}
 
 /* string operations */
 int opcode_sload(vm_t *instance)
@@ -369,17 +904,15 @@ int opcode_sload(vm_t *instance)
     index = get_instruction_arg(instance);
     value = &instance->stack[instance->lap + index];
 
-    if (VM_TYPE_STRING != value->type)
+    if (!is_value_type(*value, VM_TYPE_STRING))
     {
-        fprintf(instance->err, "[sload] failed, local variable %d is of type: %s\n",
-            index, get_type_name(value->type));
+        report_error(instance, "[sload] failed, local variable %d is of type: %s\n",
+            index, get_type_name(get_value_type(*value)));
 
         return -1;
     }
 
-    // TODO: check for stack overflow
-    instance->stack[instance->osp].type = VM_TYPE_STRING;
-    instance->stack[instance->osp].value.string_value = value->value.string_value;
+    instance->stack[instance->osp] = *value;
     ++instance->osp;
 
     return 0;
@@ -397,31 +930,31 @@ int opcode_sstore(vm_t *instance)
 
     if (get_operand_stack_size(instance) <= 0)
     {
-        fprintf(instance->err, "[sstore] failed, operand stack is empty!\n");
+        report_error(instance, "[sstore] failed, operand stack is empty!\n");
 
         return -1;
     }
 
     value = &instance->stack[instance->osp - 1];
 
-    if (VM_TYPE_STRING != value->type)
+    if (!is_value_type(*value, VM_TYPE_STRING))
     {
-        fprintf(instance->err, "[sstore] failed, operand stack top is of type: %s\n",
-            get_type_name(value->type));
+        report_error(instance, "[sstore] failed, operand stack top is of type: %s\n",
+            get_type_name(get_value_type(*value)));
 
         return -1;
     }
 
-    if (VM_TYPE_STRING != instance->stack[instance->lap + arg].type)
+    if (!is_value_type(instance->stack[instance->lap + arg], VM_TYPE_STRING))
     {
-        fprintf(instance->err, "[sstore] failed, trying to store string to local "
+        report_error(instance, "[sstore] failed, trying to store string to local "
             "variable of type: %s\n",
-            get_type_name(instance->stack[instance->lap + arg].type));
+            get_type_name(get_value_type(instance->stack[instance->lap + arg])));
 
         return -1;
     }
 
-    instance->stack[instance->lap + arg].value.string_value = value->value.string_value;
+    instance->stack[instance->lap + arg] = *value;
     --instance->osp;
 
     return 0;
@@ -435,56 +968,1287 @@ int opcode_sprint(vm_t *instance)
 
     if (get_operand_stack_size(instance) <= 0)
     {
-        fprintf(instance->err, "[sprint] failed, operand stack is empty!\n");
+        report_error(instance, "[sprint] failed, operand stack is empty!\n");
 
         return -1;
     }
 
     value = &instance->stack[instance->osp - 1];
-    if (VM_TYPE_STRING != value->type)
+    if (!is_value_type(*value, VM_TYPE_STRING))
     {
-        fprintf(instance->err, "[sprint] failed, operand stack top is of type: %s\n",
-            get_type_name(value->type));
+        report_error(instance, "[sprint] failed, operand stack top is of type: %s\n",
+            get_type_name(get_value_type(*value)));
 
         return -1;
     }
     --instance->osp;
 
-    fprintf(instance->output, "%s\n", value->value.string_value);
-    fflush(instance->output);
+    output_string(instance, get_string_value(*value));
 
     return 0;
 }
 
 int opcode_sret(vm_t *instance)
 {
-    return 0;
-}
+    vm_value_t *result = NULL;
 
-/* constant pool operations */
-int opcode_cload(vm_t *instance)
-{
-    int index = 0;
-    vm_value_t *value = NULL;
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) <= 0)
+    {
+        report_error(instance, "[sret] failed, operand stack is empty\n");
 
-    assert(instance && instance->constant_pool && instance->stack);
+        return -1;
+    }
 
-    index = get_instruction_arg(instance);
+    result = &instance->stack[instance->osp - 1];
 
-    if (index >= instance->constant_pool_size)
+    if (!is_value_type(*result, VM_TYPE_STRING))
     {
-        fprintf(instance->err, "[cload] failed, index %d is out of constant pool bounds!\n",
-            index);
+        report_error(instance, "[sret] failed, result is of type: %s\n",
+            get_type_name(get_value_type(*result)));
 
         return -1;
     }
 
-    // TODO: check stack overflow
-    memcpy(&instance->stack[instance->osp],
-           &instance->constant_pool[index],
-           sizeof(vm_value_t));
+    pop_stack_frame(instance);
 
+    memcpy(&instance->stack[instance->osp], result, sizeof(vm_value_t));
     ++instance->osp;
 
     return 0;
-}
\ No newline at end of file
+}
+
+/* reference operations */
+int opcode_rload(vm_t *instance)
+{
+    int index = 0;
+    vm_value_t *value = NULL;
+
+    assert(instance && instance->stack);
+
+    index = get_instruction_arg(instance);
+    value = &instance->stack[instance->lap + index];
+
+    if (!is_value_type(*value, VM_TYPE_REFERENCE))
+    {
+        report_error(instance, "[rload] failed, local variable %d is of type: %s\n",
+            index, get_type_name(get_value_type(*value)));
+
+        return -1;
+    }
+
+    instance->stack[instance->osp] = *value;
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_rstore(vm_t *instance)
+{
+    int arg = 0;
+    vm_value_t *value = NULL;
+
+    assert(instance && instance->stack);
+
+    arg = get_instruction_arg(instance);
+
+    if (get_operand_stack_size(instance) <= 0)
+    {
+        report_error(instance, "[rstore] failed, operand stack is empty!\n");
+
+        return -1;
+    }
+
+    value = &instance->stack[instance->osp - 1];
+
+    if (!is_value_type(*value, VM_TYPE_REFERENCE))
+    {
+        report_error(instance, "[rstore] failed, operand stack top is of type: %s\n",
+            get_type_name(get_value_type(*value)));
+
+        return -1;
+    }
+
+    if (!is_value_type(instance->stack[instance->lap + arg], VM_TYPE_REFERENCE))
+    {
+        report_error(instance, "[rstore] failed, trying to store reference to local "
+            "variable of type: %s\n",
+            get_type_name(get_value_type(instance->stack[instance->lap + arg])));
+
+        return -1;
+    }
+
+    instance->stack[instance->lap + arg] = *value;
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_rnull(vm_t *instance)
+{
+    assert(instance && instance->stack);
+
+    instance->stack[instance->osp] = make_empty_value(VM_TYPE_REFERENCE);
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_rret(vm_t *instance)
+{
+    vm_value_t *result = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) <= 0)
+    {
+        report_error(instance, "[rret] failed, operand stack is empty\n");
+
+        return -1;
+    }
+
+    result = &instance->stack[instance->osp - 1];
+
+    if (!is_value_type(*result, VM_TYPE_REFERENCE))
+    {
+        report_error(instance, "[rret] failed, result is of type: %s\n",
+            get_type_name(get_value_type(*result)));
+
+        return -1;
+    }
+
+    pop_stack_frame(instance);
+
+    memcpy(&instance->stack[instance->osp], result, sizeof(vm_value_t));
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_new(vm_t *instance)
+{
+    int num_fields = 0;
+    vm_object_t *object = NULL;
+
+    assert(instance && instance->stack);
+
+    num_fields = get_instruction_arg(instance);
+
+    if (num_fields < 0 || num_fields > MAX_OBJECT_FIELDS)
+    {
+        report_error(instance, "[new] failed, an object can not have %d fields!\n", num_fields);
+
+        return -1;
+    }
+
+    object = allocate_object(instance, (unsigned int)num_fields);
+    if (NULL == object)
+    {
+        report_error(instance, "[new] failed, out of heap memory!\n");
+
+        return -1;
+    }
+
+    instance->stack[instance->osp] = make_reference_value(object);
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_igetfield(vm_t *instance)
+{
+    return get_field(instance, "igetfield", VM_TYPE_INTEGER);
+}
+
+int opcode_iputfield(vm_t *instance)
+{
+    return put_field(instance, "iputfield", VM_TYPE_INTEGER);
+}
+
+int opcode_sgetfield(vm_t *instance)
+{
+    return get_field(instance, "sgetfield", VM_TYPE_STRING);
+}
+
+int opcode_sputfield(vm_t *instance)
+{
+    return put_field(instance, "sputfield", VM_TYPE_STRING);
+}
+
+int opcode_rgetfield(vm_t *instance)
+{
+    return get_field(instance, "rgetfield", VM_TYPE_REFERENCE);
+}
+
+int opcode_rputfield(vm_t *instance)
+{
+    return put_field(instance, "rputfield", VM_TYPE_REFERENCE);
+}
+
+/* constant pool operations */
+int opcode_cload(vm_t *instance)
+{
+    int index = 0;
+    vm_value_t *value = NULL;
+
+    assert(instance && instance->program->constant_pool && instance->stack);
+
+    index = get_instruction_arg(instance);
+
+    if (index >= instance->program->constant_pool_size)
+    {
+        report_error(instance, "[cload] failed, index %d is out of constant pool bounds!\n",
+            index);
+
+        return -1;
+    }
+
+    memcpy(&instance->stack[instance->osp],
+           &instance->program->constant_pool[index],
+           sizeof(vm_value_t));
+
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_newarray(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_INTEGER };
+    vm_value_t *operands = get_operands(instance, "newarray", types, 1);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    return new_array(instance, (enum vm_types)get_instruction_arg(instance), get_integer_value(operands[0]), &operands[0]);
+}
+
+int opcode_alen(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_REFERENCE };
+    vm_value_t *operands = get_operands(instance, "alen", types, 1);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    return get_array_length(instance, operands[0], &operands[0]);
+}
+
+int opcode_baload(vm_t *instance)
+{
+    return load_array_element(instance, "baload", VM_TYPE_BYTE);
+}
+
+int opcode_bastore(vm_t *instance)
+{
+    return store_array_element(instance, "bastore", VM_TYPE_BYTE);
+}
+
+int opcode_iaload(vm_t *instance)
+{
+    return load_array_element(instance, "iaload", VM_TYPE_INTEGER);
+}
+
+int opcode_iastore(vm_t *instance)
+{
+    return store_array_element(instance, "iastore", VM_TYPE_INTEGER);
+}
+
+int opcode_afill(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_REFERENCE, VM_TYPE_INTEGER };
+    vm_value_t *operands = get_operands(instance, "afill", types, 2);
+
+    if (NULL == operands || 0 != fill_array(instance, operands[0], get_integer_value(operands[1])))
+    {
+        return -1;
+    }
+
+    instance->osp -= 2;
+
+    return 0;
+}
+
+int opcode_acopy(vm_t *instance)
+{
+    static const enum vm_types types[] = {
+        VM_TYPE_REFERENCE, VM_TYPE_INTEGER, VM_TYPE_REFERENCE, VM_TYPE_INTEGER, VM_TYPE_INTEGER
+    };
+    vm_value_t *operands = get_operands(instance, "acopy", types, 5);
+
+    if (NULL == operands ||
+        0 != copy_array(instance,
+                        operands[0], get_integer_value(operands[1]),
+                        operands[2], get_integer_value(operands[3]),
+                        get_integer_value(operands[4])))
+    {
+        return -1;
+    }
+
+    instance->osp -= 5;
+
+    return 0;
+}
+
+int opcode_asum(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_REFERENCE };
+    vm_value_t *operands = get_operands(instance, "asum", types, 1);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    return sum_array(instance, operands[0], &operands[0]);
+}
+
+int opcode_adot(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_REFERENCE, VM_TYPE_REFERENCE };
+    vm_value_t *operands = get_operands(instance, "adot", types, 2);
+
+    if (NULL == operands || 0 != dot_arrays(instance, operands[0], operands[1], &operands[0]))
+    {
+        return -1;
+    }
+
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_aadd(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_REFERENCE, VM_TYPE_REFERENCE, VM_TYPE_REFERENCE };
+    vm_value_t *operands = get_operands(instance, "aadd", types, 3);
+
+    if (NULL == operands || 0 != add_arrays(instance, operands[0], operands[1], operands[2]))
+    {
+        return -1;
+    }
+
+    instance->osp -= 3;
+
+    return 0;
+}
+
+/* long operations */
+int opcode_lload(vm_t *instance)
+{
+    return load_local(instance, "lload", VM_TYPE_LONG);
+}
+
+int opcode_lstore(vm_t *instance)
+{
+    return store_local(instance, "lstore", VM_TYPE_LONG);
+}
+
+int opcode_lpush(vm_t *instance)
+{
+    assert(instance && instance->stack);
+
+    instance->stack[instance->osp] = make_long_value(get_instruction_arg(instance));
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_ladd(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_LONG, VM_TYPE_LONG };
+    vm_value_t *operands = get_operands(instance, "ladd", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_long_value(add_longs(get_long_value(operands[0]), get_long_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_lsub(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_LONG, VM_TYPE_LONG };
+    vm_value_t *operands = get_operands(instance, "lsub", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_long_value(subtract_longs(get_long_value(operands[0]), get_long_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_lmult(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_LONG, VM_TYPE_LONG };
+    vm_value_t *operands = get_operands(instance, "lmult", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_long_value(multiply_longs(get_long_value(operands[0]), get_long_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_ldiv(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_LONG, VM_TYPE_LONG };
+    vm_value_t *operands = get_operands(instance, "ldiv", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    if (0 == get_long_value(operands[1]))
+    {
+        report_error(instance, "[ldiv] failed, division by zero\n");
+
+        return -1;
+    }
+
+    operands[0] = make_long_value(divide_longs(get_long_value(operands[0]), get_long_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_lneg(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "lneg", VM_TYPE_LONG);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_long_value(negate_long(get_long_value(*operand)));
+
+    return 0;
+}
+
+int opcode_lprint(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "lprint", VM_TYPE_LONG);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+    --instance->osp;
+
+    output_long(instance, get_long_value(*operand));
+
+    return 0;
+}
+
+int opcode_lret(vm_t *instance)
+{
+    return return_value(instance, "lret", VM_TYPE_LONG);
+}
+
+int opcode_lcmp(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_LONG, VM_TYPE_LONG };
+    vm_value_t *operands = get_operands(instance, "lcmp", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_integer_value(compare_longs(get_long_value(operands[0]), get_long_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_laload(vm_t *instance)
+{
+    return load_array_element(instance, "laload", VM_TYPE_LONG);
+}
+
+int opcode_lastore(vm_t *instance)
+{
+    return store_array_element(instance, "lastore", VM_TYPE_LONG);
+}
+
+/* float operations */
+int opcode_fload(vm_t *instance)
+{
+    return load_local(instance, "fload", VM_TYPE_FLOAT);
+}
+
+int opcode_fstore(vm_t *instance)
+{
+    return store_local(instance, "fstore", VM_TYPE_FLOAT);
+}
+
+int opcode_fpush(vm_t *instance)
+{
+    assert(instance && instance->stack);
+
+    instance->stack[instance->osp] = make_float_value(get_instruction_arg(instance));
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_fadd(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_FLOAT, VM_TYPE_FLOAT };
+    vm_value_t *operands = get_operands(instance, "fadd", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_float_value(get_float_value(operands[0]) + get_float_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_fsub(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_FLOAT, VM_TYPE_FLOAT };
+    vm_value_t *operands = get_operands(instance, "fsub", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_float_value(get_float_value(operands[0]) - get_float_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_fmult(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_FLOAT, VM_TYPE_FLOAT };
+    vm_value_t *operands = get_operands(instance, "fmult", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_float_value(get_float_value(operands[0]) * get_float_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_fdiv(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_FLOAT, VM_TYPE_FLOAT };
+    vm_value_t *operands = get_operands(instance, "fdiv", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_float_value(get_float_value(operands[0]) / get_float_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_fneg(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "fneg", VM_TYPE_FLOAT);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_float_value(-get_float_value(*operand));
+
+    return 0;
+}
+
+int opcode_fprint(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "fprint", VM_TYPE_FLOAT);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+    --instance->osp;
+
+    output_float(instance, get_float_value(*operand));
+
+    return 0;
+}
+
+int opcode_fret(vm_t *instance)
+{
+    return return_value(instance, "fret", VM_TYPE_FLOAT);
+}
+
+int opcode_fcmp(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_FLOAT, VM_TYPE_FLOAT };
+    vm_value_t *operands = get_operands(instance, "fcmp", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_integer_value(compare_doubles(get_float_value(operands[0]), get_float_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_faload(vm_t *instance)
+{
+    return load_array_element(instance, "faload", VM_TYPE_FLOAT);
+}
+
+int opcode_fastore(vm_t *instance)
+{
+    return store_array_element(instance, "fastore", VM_TYPE_FLOAT);
+}
+
+/* double operations */
+int opcode_dload(vm_t *instance)
+{
+    return load_local(instance, "dload", VM_TYPE_DOUBLE);
+}
+
+int opcode_dstore(vm_t *instance)
+{
+    return store_local(instance, "dstore", VM_TYPE_DOUBLE);
+}
+
+int opcode_dpush(vm_t *instance)
+{
+    assert(instance && instance->stack);
+
+    instance->stack[instance->osp] = make_double_value(get_instruction_arg(instance));
+    ++instance->osp;
+
+    return 0;
+}
+
+int opcode_dadd(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_DOUBLE, VM_TYPE_DOUBLE };
+    vm_value_t *operands = get_operands(instance, "dadd", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_double_value(get_double_value(operands[0]) + get_double_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_dsub(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_DOUBLE, VM_TYPE_DOUBLE };
+    vm_value_t *operands = get_operands(instance, "dsub", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_double_value(get_double_value(operands[0]) - get_double_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_dmult(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_DOUBLE, VM_TYPE_DOUBLE };
+    vm_value_t *operands = get_operands(instance, "dmult", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_double_value(get_double_value(operands[0]) * get_double_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_ddiv(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_DOUBLE, VM_TYPE_DOUBLE };
+    vm_value_t *operands = get_operands(instance, "ddiv", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_double_value(get_double_value(operands[0]) / get_double_value(operands[1]));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_dneg(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "dneg", VM_TYPE_DOUBLE);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_double_value(-get_double_value(*operand));
+
+    return 0;
+}
+
+int opcode_dprint(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "dprint", VM_TYPE_DOUBLE);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+    --instance->osp;
+
+    output_double(instance, get_double_value(*operand));
+
+    return 0;
+}
+
+int opcode_dret(vm_t *instance)
+{
+    return return_value(instance, "dret", VM_TYPE_DOUBLE);
+}
+
+int opcode_dcmp(vm_t *instance)
+{
+    static const enum vm_types types[] = { VM_TYPE_DOUBLE, VM_TYPE_DOUBLE };
+    vm_value_t *operands = get_operands(instance, "dcmp", types, 2);
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    operands[0] = make_integer_value(compare_doubles(get_double_value(operands[0]), get_double_value(operands[1])));
+    --instance->osp;
+
+    return 0;
+}
+
+int opcode_daload(vm_t *instance)
+{
+    return load_array_element(instance, "daload", VM_TYPE_DOUBLE);
+}
+
+int opcode_dastore(vm_t *instance)
+{
+    return store_array_element(instance, "dastore", VM_TYPE_DOUBLE);
+}
+
+int opcode_dsqrt(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "dsqrt", VM_TYPE_DOUBLE);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_double_value(sqrt(get_double_value(*operand)));
+
+    return 0;
+}
+
+/* conversions */
+int opcode_i2l(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "i2l", VM_TYPE_INTEGER);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_long_value(get_integer_value(*operand));
+
+    return 0;
+}
+
+int opcode_i2f(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "i2f", VM_TYPE_INTEGER);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_float_value((float)get_integer_value(*operand));
+
+    return 0;
+}
+
+int opcode_i2d(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "i2d", VM_TYPE_INTEGER);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_double_value(get_integer_value(*operand));
+
+    return 0;
+}
+
+int opcode_l2i(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "l2i", VM_TYPE_LONG);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_integer_value((int)get_long_value(*operand));
+
+    return 0;
+}
+
+int opcode_l2f(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "l2f", VM_TYPE_LONG);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_float_value((float)get_long_value(*operand));
+
+    return 0;
+}
+
+int opcode_l2d(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "l2d", VM_TYPE_LONG);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_double_value(get_long_value(*operand));
+
+    return 0;
+}
+
+int opcode_f2i(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "f2i", VM_TYPE_FLOAT);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_integer_value(double_to_integer(get_float_value(*operand)));
+
+    return 0;
+}
+
+int opcode_f2l(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "f2l", VM_TYPE_FLOAT);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_long_value(double_to_long(get_float_value(*operand)));
+
+    return 0;
+}
+
+int opcode_f2d(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "f2d", VM_TYPE_FLOAT);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_double_value(get_float_value(*operand));
+
+    return 0;
+}
+
+int opcode_d2i(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "d2i", VM_TYPE_DOUBLE);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_integer_value(double_to_integer(get_double_value(*operand)));
+
+    return 0;
+}
+
+int opcode_d2l(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "d2l", VM_TYPE_DOUBLE);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_long_value(double_to_long(get_double_value(*operand)));
+
+    return 0;
+}
+
+int opcode_d2f(vm_t *instance)
+{
+    vm_value_t *operand = get_operand(instance, "d2f", VM_TYPE_DOUBLE);
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    *operand = make_float_value((float)get_double_value(*operand));
+
+    return 0;
+}
+
+
+/* STATIC FUNCTIONS */
+/* replaces the object at the top of the operand stack with its field of the given type */
+static int get_field(vm_t *instance, const char *name, enum vm_types type)
+{
+    vm_value_t *object = NULL, *field = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) <= 0)
+    {
+        report_error(instance, "[%s] failed, operand stack is empty!\n", name);
+
+        return -1;
+    }
+
+    object = &instance->stack[instance->osp - 1];
+    if (!is_value_type(*object, VM_TYPE_REFERENCE))
+    {
+        report_error(instance, "[%s] failed, operand stack top is of type: %s\n",
+            name, get_type_name(get_value_type(*object)));
+
+        return -1;
+    }
+
+    field = get_object_field(instance, name, *object, get_instruction_arg(instance), type);
+    if (NULL == field)
+    {
+        return -1;
+    }
+
+    *object = *field;
+
+    return 0;
+}
+
+/* pops a value of the given type and the object under it, and stores the value to its field */
+static int put_field(vm_t *instance, const char *name, enum vm_types type)
+{
+    vm_value_t *object = NULL, *value = NULL, *field = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) < 2)
+    {
+        report_error(instance, "[%s] failed, operand stack does not have enough operands\n", name);
+
+        return -1;
+    }
+
+    object = &instance->stack[instance->osp - 2];
+    value = &instance->stack[instance->osp - 1];
+
+    if (!is_value_type(*object, VM_TYPE_REFERENCE))
+    {
+        report_error(instance, "[%s] failed, operand1 is of type: %s\n",
+            name, get_type_name(get_value_type(*object)));
+
+        return -1;
+    }
+
+    if (!is_value_type(*value, type))
+    {
+        report_error(instance, "[%s] failed, operand2 is of type: %s\n",
+            name, get_type_name(get_value_type(*value)));
+
+        return -1;
+    }
+
+    field = get_object_field(instance, name, *object, get_instruction_arg(instance), 0);
+    if (NULL == field)
+    {
+        return -1;
+    }
+
+    *field = *value;
+    write_barrier(instance, (vm_object_t *)get_reference_value(*object), *value);
+    instance->osp -= 2;
+
+    return 0;
+}
+
+/* the count operands at the top of the operand stack, the first one deepest, when they are of the given types */
+static vm_value_t *get_operands(vm_t *instance, const char *name, const enum vm_types *types, int count)
+{
+    vm_value_t *operands = NULL;
+
+    assert(instance && instance->stack);
+
+    if (get_operand_stack_size(instance) < count)
+    {
+        report_error(instance, "[%s] failed, operand stack does not have enough operands\n", name);
+
+        return NULL;
+    }
+
+    operands = &instance->stack[instance->osp - count];
+
+    for (int i = 0; i < count; ++i)
+    {
+        if (!is_value_type(operands[i], types[i]))
+        {
+            report_error(instance, "[%s] failed, operand%d is of type: %s\n",
+                name, i + 1, get_type_name(get_value_type(operands[i])));
+
+            return NULL;
+        }
+    }
+
+    return operands;
+}
+
+/* the operand at the top of the operand stack when it is of the given type */
+static vm_value_t *get_operand(vm_t *instance, const char *name, enum vm_types type)
+{
+    return get_operands(instance, name, &type, 1);
+}
+
+/* pushes the local of the instruction arg when it is of the given type */
+static int load_local(vm_t *instance, const char *name, enum vm_types type)
+{
+    int index = 0;
+    vm_value_t *value = NULL;
+
+    assert(instance && instance->stack);
+
+    index = get_instruction_arg(instance);
+    value = &instance->stack[instance->lap + index];
+
+    if (!is_value_type(*value, type))
+    {
+        report_error(instance, "[%s] failed, local variable %d is of type: %s\n",
+            name, index, get_type_name(get_value_type(*value)));
+
+        return -1;
+    }
+
+    instance->stack[instance->osp] = *value;
+    ++instance->osp;
+
+    return 0;
+}
+
+/* pops a value of the given type to the local of the instruction arg, which has to be of the type too */
+static int store_local(vm_t *instance, const char *name, enum vm_types type)
+{
+    int index = 0;
+    vm_value_t *value = get_operand(instance, name, type);
+
+    if (NULL == value)
+    {
+        return -1;
+    }
+
+    index = get_instruction_arg(instance);
+
+    if (!is_value_type(instance->stack[instance->lap + index], type))
+    {
+        report_error(instance, "[%s] failed, trying to store %s to local variable of type: %s\n",
+            name, get_type_name(type), get_type_name(get_value_type(instance->stack[instance->lap + index])));
+
+        return -1;
+    }
+
+    instance->stack[instance->lap + index] = *value;
+    --instance->osp;
+
+    return 0;
+}
+
+/* returns the value of the given type at the top of the operand stack to the calling method */
+static int return_value(vm_t *instance, const char *name, enum vm_types type)
+{
+    vm_value_t *operand = get_operand(instance, name, type);
+    vm_value_t result = {0};
+
+    if (NULL == operand)
+    {
+        return -1;
+    }
+
+    result = *operand;
+    pop_stack_frame(instance);
+
+    instance->stack[instance->osp] = result;
+    ++instance->osp;
+
+    return 0;
+}
+
+/* replaces an array and an index at the top of the operand stack with the element at the index */
+static int load_array_element(vm_t *instance, const char *name, enum vm_types type)
+{
+    static const enum vm_types types[] = { VM_TYPE_REFERENCE, VM_TYPE_INTEGER };
+    vm_value_t *operands = get_operands(instance, name, types, 2);
+
+    if (NULL == operands || 0 != load_element(instance, name, type, operands[0], get_integer_value(operands[1]), &operands[0]))
+    {
+        return -1;
+    }
+
+    --instance->osp;
+
+    return 0;
+}
+
+/* pops a value, an index and an array, and stores the value to the index */
+static int store_array_element(vm_t *instance, const char *name, enum vm_types type)
+{
+    const enum vm_types types[] = { VM_TYPE_REFERENCE, VM_TYPE_INTEGER, get_element_value_type(type) };
+    vm_value_t *operands = get_operands(instance, name, types, 3);
+
+    if (NULL == operands ||
+        0 != store_element(instance, name, type, operands[0], get_integer_value(operands[1]), operands[2]))
+    {
+        return -1;
+    }
+
+    instance->osp -= 3;
+
+    return 0;
+}
+
+/* pops two integers and branches when they compare like the opcode says */
+static int compare_and_branch(vm_t *instance, const char *name, enum opcodes opcode)
+{
+    static const enum vm_types types[] = { VM_TYPE_INTEGER, VM_TYPE_INTEGER };
+    vm_value_t *operands = get_operands(instance, name, types, 2);
+    int left = 0, right = 0, taken = 0;
+
+    if (NULL == operands)
+    {
+        return -1;
+    }
+
+    left = get_integer_value(operands[0]);
+    right = get_integer_value(operands[1]);
+    instance->osp -= 2;
+
+    switch (opcode)
+    {
+        case OP_IF_ICMPEQ:
+            taken = (left == right);
+            break;
+        case OP_IF_ICMPNE:
+            taken = (left != right);
+            break;
+        case OP_IF_ICMPLT:
+            taken = (left < right);
+            break;
+        case OP_IF_ICMPGE:
+            taken = (left >= right);
+            break;
+        case OP_IF_ICMPGT:
+            taken = (left > right);
+            break;
+        default:
+            taken = (left <= right);
+            break;
+    }
+
+    return (taken ? branch(instance, name, get_instruction_arg(instance)) : 0);
+}
+
+/*
+* Continues at target. A branch to the instruction itself or an earlier one
+* closes a loop, and on the jit engine the back-edge is counted so a hot
+* loop moves to native code.
+*/
+static int branch(vm_t *instance, const char *name, int target)
+{
+    unsigned int from = instance->ip - 1;
+
+    if (target < 0 || (unsigned int)target >= instance->program->num_instructions)
+    {
+        report_error(instance, "[%s] failed, target %d is out of code bounds\n", name, target);
+
+        return -1;
+    }
+
+    instance->ip = (unsigned int)target;
+
+    if (VM_ENGINE_JIT == instance->engine && (unsigned int)target <= from)
+    {
+        return jit_enter_loop(instance);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1044 @@
+#include <assert.h> /* assert */
+#include <math.h>   /* sqrt    */
+#include <stdio.h>  /* fprintf */
+
+#include "vm_impl.h" /* to access vm fields  */
+#include "vm_util.h" /* vm utility functions */
+#include "vm_jit.h"  /* jit entry on calls   */
+#include "vm_numeric.h" /* integer, long, float and double semantics */
+#include "vm_output.h" /* print buffer */
+
+#include "opcodes.h"
+
+/*
+* Handlers for programs that passed verify_program. Stack depths, local and
+* operand types and constant pool indices were all proven at load time, so
+* these handlers only do the work. Opcodes without an entry here keep their
+* checked handler from init_opcode_handlers.
+*/
+
+/* special operations */
+static int opcode_pop_unchecked(vm_t *instance);
+static int opcode_call_unchecked(vm_t *instance);
+static int opcode_tailcall_unchecked(vm_t *instance);
+
+/* integer operations */
+static int opcode_iload_unchecked(vm_t *instance);
+static int opcode_istore_unchecked(vm_t *instance);
+static int opcode_iadd_unchecked(vm_t *instance);
+static int opcode_isub_unchecked(vm_t *instance);
+static int opcode_imult_unchecked(vm_t *instance);
+static int opcode_idiv_unchecked(vm_t *instance);
+static int opcode_ineg_unchecked(vm_t *instance);
+static int opcode_iprint_unchecked(vm_t *instance);
+static int opcode_iret_unchecked(vm_t *instance);
+
+/* control flow */
+static int opcode_goto_unchecked(vm_t *instance);
+static int opcode_ifeq_unchecked(vm_t *instance);
+static int opcode_ifne_unchecked(vm_t *instance);
+static int opcode_if_icmpeq_unchecked(vm_t *instance);
+static int opcode_if_icmpne_unchecked(vm_t *instance);
+static int opcode_if_icmplt_unchecked(vm_t *instance);
+static int opcode_if_icmpge_unchecked(vm_t *instance);
+static int opcode_if_icmpgt_unchecked(vm_t *instance);
+static int opcode_if_icmple_unchecked(vm_t *instance);
+static int opcode_tableswitch_unchecked(vm_t *instance);
+
+/* string operations */
+static int opcode_sload_unchecked(vm_t *instance);
+static int opcode_sstore_unchecked(vm_t *instance);
+static int opcode_sprint_unchecked(vm_t *instance);
+static int opcode_sret_unchecked(vm_t *instance);
+
+/* reference operations */
+static int opcode_rload_unchecked(vm_t *instance);
+static int opcode_rstore_unchecked(vm_t *instance);
+static int opcode_rret_unchecked(vm_t *instance);
+
+/* constant pool operations */
+static int opcode_cload_unchecked(vm_t *instance);
+
+/* long operations */
+static int opcode_lload_unchecked(vm_t *instance);
+static int opcode_lstore_unchecked(vm_t *instance);
+static int opcode_lpush_unchecked(vm_t *instance);
+static int opcode_ladd_unchecked(vm_t *instance);
+static int opcode_lsub_unchecked(vm_t *instance);
+static int opcode_lmult_unchecked(vm_t *instance);
+static int opcode_ldiv_unchecked(vm_t *instance);
+static int opcode_lneg_unchecked(vm_t *instance);
+static int opcode_lprint_unchecked(vm_t *instance);
+static int opcode_lret_unchecked(vm_t *instance);
+static int opcode_lcmp_unchecked(vm_t *instance);
+
+/* float operations */
+static int opcode_fload_unchecked(vm_t *instance);
+static int opcode_fstore_unchecked(vm_t *instance);
+static int opcode_fpush_unchecked(vm_t *instance);
+static int opcode_fadd_unchecked(vm_t *instance);
+static int opcode_fsub_unchecked(vm_t *instance);
+static int opcode_fmult_unchecked(vm_t *instance);
+static int opcode_fdiv_unchecked(vm_t *instance);
+static int opcode_fneg_unchecked(vm_t *instance);
+static int opcode_fprint_unchecked(vm_t *instance);
+static int opcode_fret_unchecked(vm_t *instance);
+static int opcode_fcmp_unchecked(vm_t *instance);
+
+/* double operations */
+static int opcode_dload_unchecked(vm_t *instance);
+static int opcode_dstore_unchecked(vm_t *instance);
+static int opcode_dpush_unchecked(vm_t *instance);
+static int opcode_dadd_unchecked(vm_t *instance);
+static int opcode_dsub_unchecked(vm_t *instance);
+static int opcode_dmult_unchecked(vm_t *instance);
+static int opcode_ddiv_unchecked(vm_t *instance);
+static int opcode_dneg_unchecked(vm_t *instance);
+static int opcode_dprint_unchecked(vm_t *instance);
+static int opcode_dret_unchecked(vm_t *instance);
+static int opcode_dcmp_unchecked(vm_t *instance);
+static int opcode_dsqrt_unchecked(vm_t *instance);
+
+/* conversions */
+static int opcode_i2l_unchecked(vm_t *instance);
+static int opcode_i2f_unchecked(vm_t *instance);
+static int opcode_i2d_unchecked(vm_t *instance);
+static int opcode_l2i_unchecked(vm_t *instance);
+static int opcode_l2f_unchecked(vm_t *instance);
+static int opcode_l2d_unchecked(vm_t *instance);
+static int opcode_f2i_unchecked(vm_t *instance);
+static int opcode_f2l_unchecked(vm_t *instance);
+static int opcode_f2d_unchecked(vm_t *instance);
+static int opcode_d2i_unchecked(vm_t *instance);
+static int opcode_d2l_unchecked(vm_t *instance);
+static int opcode_d2f_unchecked(vm_t *instance);
+
+/* superinstructions */
+static int opcode_iadd_ll(vm_t *instance);
+static int opcode_isub_ll(vm_t *instance);
+static int opcode_imult_ll(vm_t *instance);
+static int opcode_iadd_li(vm_t *instance);
+static int opcode_isub_li(vm_t *instance);
+static int opcode_imult_li(vm_t *instance);
+static int opcode_iadd_lls(vm_t *instance);
+static int opcode_isub_lls(vm_t *instance);
+static int opcode_istore_imm(vm_t *instance);
+static int opcode_iload2(vm_t *instance);
+
+static int get_fused_arg(vm_t *instance, int index);
+static int get_fused_local(vm_t *instance, int index);
+static void push_fused_result(vm_t *instance, int result, unsigned int length);
+static int pop_compared(vm_t *instance, int *left);
+static int branch_unchecked(vm_t *instance);
+
+void init_unchecked_opcode_handlers(opcode_handler *handlers)
+{
+    init_opcode_handlers(handlers);
+
+    /* special operations */
+    handlers[OP_POP] = opcode_pop_unchecked;
+    handlers[OP_CALL] = opcode_call_unchecked;
+    handlers[OP_TAILCALL] = opcode_tailcall_unchecked;
+
+    /* integer operations */
+    handlers[OP_ILOAD] = opcode_iload_unchecked;
+    handlers[OP_ISTORE] = opcode_istore_unchecked;
+    handlers[OP_IADD] = opcode_iadd_unchecked;
+    handlers[OP_ISUB] = opcode_isub_unchecked;
+    handlers[OP_IMULT] = opcode_imult_unchecked;
+    handlers[OP_IDIV] = opcode_idiv_unchecked;
+    handlers[OP_INEG] = opcode_ineg_unchecked;
+    handlers[OP_IPRINT] = opcode_iprint_unchecked;
+    handlers[OP_IRET] = opcode_iret_unchecked;
+
+    /* control flow */
+    handlers[OP_GOTO] = opcode_goto_unchecked;
+    handlers[OP_IFEQ] = opcode_ifeq_unchecked;
+    handlers[OP_IFNE] = opcode_ifne_unchecked;
+    handlers[OP_IF_ICMPEQ] = opcode_if_icmpeq_unchecked;
+    handlers[OP_IF_ICMPNE] = opcode_if_icmpne_unchecked;
+    handlers[OP_IF_ICMPLT] = opcode_if_icmplt_unchecked;
+    handlers[OP_IF_ICMPGE] = opcode_if_icmpge_unchecked;
+    handlers[OP_IF_ICMPGT] = opcode_if_icmpgt_unchecked;
+    handlers[OP_IF_ICMPLE] = opcode_if_icmple_unchecked;
+    handlers[OP_TABLESWITCH] = opcode_tableswitch_unchecked;
+
+    /* string operations */
+    handlers[OP_SLOAD] = opcode_sload_unchecked;
+    handlers[OP_SSTORE] = opcode_sstore_unchecked;
+    handlers[OP_SPRINT] = opcode_sprint_unchecked;
+    handlers[OP_SRET] = opcode_sret_unchecked;
+
+    /* reference operations, objects are still checked for null and their field types */
+    handlers[OP_RLOAD] = opcode_rload_unchecked;
+    handlers[OP_RSTORE] = opcode_rstore_unchecked;
+    handlers[OP_RRET] = opcode_rret_unchecked;
+
+    /* constant pool operations */
+    handlers[OP_CLOAD] = opcode_cload_unchecked;
+
+    /* long operations */
+    handlers[OP_LLOAD] = opcode_lload_unchecked;
+    handlers[OP_LSTORE] = opcode_lstore_unchecked;
+    handlers[OP_LPUSH] = opcode_lpush_unchecked;
+    handlers[OP_LADD] = opcode_ladd_unchecked;
+    handlers[OP_LSUB] = opcode_lsub_unchecked;
+    handlers[OP_LMULT] = opcode_lmult_unchecked;
+    handlers[OP_LDIV] = opcode_ldiv_unchecked;
+    handlers[OP_LNEG] = opcode_lneg_unchecked;
+    handlers[OP_LPRINT] = opcode_lprint_unchecked;
+    handlers[OP_LRET] = opcode_lret_unchecked;
+    handlers[OP_LCMP] = opcode_lcmp_unchecked;
+
+    /* float operations */
+    handlers[OP_FLOAD] = opcode_fload_unchecked;
+    handlers[OP_FSTORE] = opcode_fstore_unchecked;
+    handlers[OP_FPUSH] = opcode_fpush_unchecked;
+    handlers[OP_FADD] = opcode_fadd_unchecked;
+    handlers[OP_FSUB] = opcode_fsub_unchecked;
+    handlers[OP_FMULT] = opcode_fmult_unchecked;
+    handlers[OP_FDIV] = opcode_fdiv_unchecked;
+    handlers[OP_FNEG] = opcode_fneg_unchecked;
+    handlers[OP_FPRINT] = opcode_fprint_unchecked;
+    handlers[OP_FRET] = opcode_fret_unchecked;
+    handlers[OP_FCMP] = opcode_fcmp_unchecked;
+
+    /* double operations */
+    handlers[OP_DLOAD] = opcode_dload_unchecked;
+    handlers[OP_DSTORE] = opcode_dstore_unchecked;
+    handlers[OP_DPUSH] = opcode_dpush_unchecked;
+    handlers[OP_DADD] = opcode_dadd_unchecked;
+    handlers[OP_DSUB] = opcode_dsub_unchecked;
+    handlers[OP_DMULT] = opcode_dmult_unchecked;
+    handlers[OP_DDIV] = opcode_ddiv_unchecked;
+    handlers[OP_DNEG] = opcode_dneg_unchecked;
+    handlers[OP_DPRINT] = opcode_dprint_unchecked;
+    handlers[OP_DRET] = opcode_dret_unchecked;
+    handlers[OP_DCMP] = opcode_dcmp_unchecked;
+    handlers[OP_DSQRT] = opcode_dsqrt_unchecked;
+
+    /* conversions */
+    handlers[OP_I2L] = opcode_i2l_unchecked;
+    handlers[OP_I2F] = opcode_i2f_unchecked;
+    handlers[OP_I2D] = opcode_i2d_unchecked;
+    handlers[OP_L2I] = opcode_l2i_unchecked;
+    handlers[OP_L2F] = opcode_l2f_unchecked;
+    handlers[OP_L2D] = opcode_l2d_unchecked;
+    handlers[OP_F2I] = opcode_f2i_unchecked;
+    handlers[OP_F2L] = opcode_f2l_unchecked;
+    handlers[OP_F2D] = opcode_f2d_unchecked;
+    handlers[OP_D2I] = opcode_d2i_unchecked;
+    handlers[OP_D2L] = opcode_d2l_unchecked;
+    handlers[OP_D2F] = opcode_d2f_unchecked;
+
+    /* superinstructions */
+    handlers[OP_IADD_LL] = opcode_iadd_ll;
+    handlers[OP_ISUB_LL] = opcode_isub_ll;
+    handlers[OP_IMULT_LL] = opcode_imult_ll;
+    handlers[OP_IADD_LI] = opcode_iadd_li;
+    handlers[OP_ISUB_LI] = opcode_isub_li;
+    handlers[OP_IMULT_LI] = opcode_imult_li;
+    handlers[OP_IADD_LLS] = opcode_iadd_lls;
+    handlers[OP_ISUB_LLS] = opcode_isub_lls;
+    handlers[OP_ISTORE_IMM] = opcode_istore_imm;
+    handlers[OP_ILOAD2] = opcode_iload2;
+}
+
+/* special operations */
+static int opcode_pop_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    return 0;
+}
+
+static int opcode_call_unchecked(vm_t *instance)
+{
+    vm_method_meta_t *method = NULL;
+
+    method = get_method_value(instance->program->constant_pool[get_instruction_arg(instance)]);
+
+    if (0 != open_stack_frame(instance, method))
+    {
+        report_error(instance, "[call] failed, could not open stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    instance->ip = method->offset;
+
+    if (VM_ENGINE_JIT == instance->engine)
+    {
+        return jit_enter_method(instance, method);
+    }
+
+    return 0;
+}
+
+static int opcode_tailcall_unchecked(vm_t *instance)
+{
+    vm_method_meta_t *method = NULL;
+
+    method = get_method_value(instance->program->constant_pool[get_instruction_arg(instance)]);
+
+    if (0 != reuse_stack_frame(instance, method))
+    {
+        report_error(instance, "[tailcall] failed, could not reuse stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    instance->ip = method->offset;
+
+    return 0;
+}
+
+/* integer operations */
+static int opcode_iload_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp];
+
+    *top = instance->stack[instance->lap + get_instruction_arg(instance)];
+    ++instance->osp;
+
+    return 0;
+}
+
+static int opcode_istore_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->lap + get_instruction_arg(instance)] = instance->stack[instance->osp];
+
+    return 0;
+}
+
+static int opcode_iadd_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_integer_value(
+        add_integers(get_integer_value(instance->stack[instance->osp - 1]), get_integer_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_isub_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_integer_value(
+        subtract_integers(get_integer_value(instance->stack[instance->osp - 1]), get_integer_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_imult_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_integer_value(
+        multiply_integers(get_integer_value(instance->stack[instance->osp - 1]), get_integer_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_idiv_unchecked(vm_t *instance)
+{
+    int divisor = get_integer_value(instance->stack[instance->osp - 1]);
+
+    // the verifier proves types, not values
+    if (0 == divisor)
+    {
+        report_error(instance, "[idiv] failed, division by zero\n");
+
+        return -1;
+    }
+
+    --instance->osp;
+    instance->stack[instance->osp - 1] =
+        make_integer_value(divide_integers(get_integer_value(instance->stack[instance->osp - 1]), divisor));
+
+    return 0;
+}
+
+static int opcode_ineg_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_integer_value(negate_integer(get_integer_value(*top)));
+
+    return 0;
+}
+
+static int opcode_iprint_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    output_integer(instance, get_integer_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_iret_unchecked(vm_t *instance)
+{
+    vm_value_t result = instance->stack[instance->osp - 1];
+
+    pop_stack_frame(instance);
+
+    instance->stack[instance->osp] = result;
+    ++instance->osp;
+
+    return 0;
+}
+
+/* control flow */
+static int opcode_goto_unchecked(vm_t *instance)
+{
+    return branch_unchecked(instance);
+}
+
+static int opcode_ifeq_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    return (0 == get_integer_value(instance->stack[instance->osp]) ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_ifne_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    return (0 != get_integer_value(instance->stack[instance->osp]) ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_if_icmpeq_unchecked(vm_t *instance)
+{
+    int left = 0, right = pop_compared(instance, &left);
+
+    return (left == right ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_if_icmpne_unchecked(vm_t *instance)
+{
+    int left = 0, right = pop_compared(instance, &left);
+
+    return (left != right ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_if_icmplt_unchecked(vm_t *instance)
+{
+    int left = 0, right = pop_compared(instance, &left);
+
+    return (left < right ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_if_icmpge_unchecked(vm_t *instance)
+{
+    int left = 0, right = pop_compared(instance, &left);
+
+    return (left >= right ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_if_icmpgt_unchecked(vm_t *instance)
+{
+    int left = 0, right = pop_compared(instance, &left);
+
+    return (left > right ? branch_unchecked(instance) : 0);
+}
+
+static int opcode_if_icmple_unchecked(vm_t *instance)
+{
+    int left = 0, right = pop_compared(instance, &left);
+
+    return (left <= right ? branch_unchecked(instance) : 0);
+}
+
+/* the verifier proved the table is all gotos, so the target of the goto is taken directly */
+static int opcode_tableswitch_unchecked(vm_t *instance)
+{
+    unsigned int count = (unsigned int)get_instruction_arg(instance);
+    unsigned int index = 0;
+
+    --instance->osp;
+    index = (unsigned int)get_integer_value(instance->stack[instance->osp]);
+
+    instance->ip = (index < count ?
+                    (unsigned int)instance->program->instructions[instance->ip + index].arg :
+                    instance->ip + count);
+
+    return 0;
+}
+
+/* string operations */
+static int opcode_sload_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp];
+
+    *top = instance->stack[instance->lap + get_instruction_arg(instance)];
+    ++instance->osp;
+
+    return 0;
+}
+
+static int opcode_sstore_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->lap + get_instruction_arg(instance)] = instance->stack[instance->osp];
+
+    return 0;
+}
+
+static int opcode_sprint_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    output_string(instance, get_string_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_sret_unchecked(vm_t *instance)
+{
+    return opcode_iret_unchecked(instance);
+}
+
+/* reference operations */
+static int opcode_rload_unchecked(vm_t *instance)
+{
+    return opcode_iload_unchecked(instance);
+}
+
+static int opcode_rstore_unchecked(vm_t *instance)
+{
+    return opcode_istore_unchecked(instance);
+}
+
+static int opcode_rret_unchecked(vm_t *instance)
+{
+    return opcode_iret_unchecked(instance);
+}
+
+/* constant pool operations */
+static int opcode_cload_unchecked(vm_t *instance)
+{
+    instance->stack[instance->osp] = instance->program->constant_pool[get_instruction_arg(instance)];
+    ++instance->osp;
+
+    return 0;
+}
+
+/* long operations */
+static int opcode_lload_unchecked(vm_t *instance)
+{
+    return opcode_iload_unchecked(instance);
+}
+
+static int opcode_lstore_unchecked(vm_t *instance)
+{
+    return opcode_istore_unchecked(instance);
+}
+
+static int opcode_lpush_unchecked(vm_t *instance)
+{
+    instance->stack[instance->osp] = make_long_value(get_instruction_arg(instance));
+    ++instance->osp;
+
+    return 0;
+}
+
+static int opcode_ladd_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_long_value(add_longs(
+        get_long_value(instance->stack[instance->osp - 1]), get_long_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_lsub_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_long_value(subtract_longs(
+        get_long_value(instance->stack[instance->osp - 1]), get_long_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_lmult_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_long_value(multiply_longs(
+        get_long_value(instance->stack[instance->osp - 1]), get_long_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_ldiv_unchecked(vm_t *instance)
+{
+    long divisor = get_long_value(instance->stack[instance->osp - 1]);
+
+    // the verifier proves types, not values
+    if (0 == divisor)
+    {
+        report_error(instance, "[ldiv] failed, division by zero\n");
+
+        return -1;
+    }
+
+    --instance->osp;
+    instance->stack[instance->osp - 1] =
+        make_long_value(divide_longs(get_long_value(instance->stack[instance->osp - 1]), divisor));
+
+    return 0;
+}
+
+static int opcode_lneg_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_long_value(negate_long(get_long_value(*top)));
+
+    return 0;
+}
+
+static int opcode_lprint_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    output_long(instance, get_long_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_lret_unchecked(vm_t *instance)
+{
+    return opcode_iret_unchecked(instance);
+}
+
+static int opcode_lcmp_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_integer_value(compare_longs(
+        get_long_value(instance->stack[instance->osp - 1]), get_long_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+/* float operations */
+static int opcode_fload_unchecked(vm_t *instance)
+{
+    return opcode_iload_unchecked(instance);
+}
+
+static int opcode_fstore_unchecked(vm_t *instance)
+{
+    return opcode_istore_unchecked(instance);
+}
+
+static int opcode_fpush_unchecked(vm_t *instance)
+{
+    instance->stack[instance->osp] = make_float_value(get_instruction_arg(instance));
+    ++instance->osp;
+
+    return 0;
+}
+
+static int opcode_fadd_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_float_value(
+        get_float_value(instance->stack[instance->osp - 1]) + get_float_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_fsub_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_float_value(
+        get_float_value(instance->stack[instance->osp - 1]) - get_float_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_fmult_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_float_value(
+        get_float_value(instance->stack[instance->osp - 1]) * get_float_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_fdiv_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_float_value(
+        get_float_value(instance->stack[instance->osp - 1]) / get_float_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_fneg_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_float_value(-get_float_value(*top));
+
+    return 0;
+}
+
+static int opcode_fprint_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    output_float(instance, get_float_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_fret_unchecked(vm_t *instance)
+{
+    return opcode_iret_unchecked(instance);
+}
+
+static int opcode_fcmp_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_integer_value(compare_doubles(
+        get_float_value(instance->stack[instance->osp - 1]), get_float_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+/* double operations */
+static int opcode_dload_unchecked(vm_t *instance)
+{
+    return opcode_iload_unchecked(instance);
+}
+
+static int opcode_dstore_unchecked(vm_t *instance)
+{
+    return opcode_istore_unchecked(instance);
+}
+
+static int opcode_dpush_unchecked(vm_t *instance)
+{
+    instance->stack[instance->osp] = make_double_value(get_instruction_arg(instance));
+    ++instance->osp;
+
+    return 0;
+}
+
+static int opcode_dadd_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_double_value(
+        get_double_value(instance->stack[instance->osp - 1]) + get_double_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_dsub_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_double_value(
+        get_double_value(instance->stack[instance->osp - 1]) - get_double_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_dmult_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_double_value(
+        get_double_value(instance->stack[instance->osp - 1]) * get_double_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_ddiv_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_double_value(
+        get_double_value(instance->stack[instance->osp - 1]) / get_double_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_dneg_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_double_value(-get_double_value(*top));
+
+    return 0;
+}
+
+static int opcode_dprint_unchecked(vm_t *instance)
+{
+    --instance->osp;
+
+    output_double(instance, get_double_value(instance->stack[instance->osp]));
+
+    return 0;
+}
+
+static int opcode_dret_unchecked(vm_t *instance)
+{
+    return opcode_iret_unchecked(instance);
+}
+
+static int opcode_dcmp_unchecked(vm_t *instance)
+{
+    --instance->osp;
+    instance->stack[instance->osp - 1] = make_integer_value(compare_doubles(
+        get_double_value(instance->stack[instance->osp - 1]), get_double_value(instance->stack[instance->osp])));
+
+    return 0;
+}
+
+static int opcode_dsqrt_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_double_value(sqrt(get_double_value(*top)));
+
+    return 0;
+}
+
+/* conversions */
+static int opcode_i2l_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_long_value(get_integer_value(*top));
+
+    return 0;
+}
+
+static int opcode_i2f_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_float_value((float)get_integer_value(*top));
+
+    return 0;
+}
+
+static int opcode_i2d_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_double_value(get_integer_value(*top));
+
+    return 0;
+}
+
+static int opcode_l2i_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_integer_value((int)get_long_value(*top));
+
+    return 0;
+}
+
+static int opcode_l2f_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_float_value((float)get_long_value(*top));
+
+    return 0;
+}
+
+static int opcode_l2d_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_double_value(get_long_value(*top));
+
+    return 0;
+}
+
+static int opcode_f2i_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_integer_value(double_to_integer(get_float_value(*top)));
+
+    return 0;
+}
+
+static int opcode_f2l_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_long_value(double_to_long(get_float_value(*top)));
+
+    return 0;
+}
+
+static int opcode_f2d_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_double_value(get_float_value(*top));
+
+    return 0;
+}
+
+static int opcode_d2i_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_integer_value(double_to_integer(get_double_value(*top)));
+
+    return 0;
+}
+
+static int opcode_d2l_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_long_value(double_to_long(get_double_value(*top)));
+
+    return 0;
+}
+
+static int opcode_d2f_unchecked(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp - 1];
+
+    *top = make_float_value((float)get_double_value(*top));
+
+    return 0;
+}
+
+/* superinstructions */
+static int opcode_iadd_ll(vm_t *instance)
+{
+    push_fused_result(instance, add_integers(get_fused_local(instance, 0), get_fused_local(instance, 1)), 3);
+
+    return 0;
+}
+
+static int opcode_isub_ll(vm_t *instance)
+{
+    push_fused_result(instance, subtract_integers(get_fused_local(instance, 0), get_fused_local(instance, 1)), 3);
+
+    return 0;
+}
+
+static int opcode_imult_ll(vm_t *instance)
+{
+    push_fused_result(instance, multiply_integers(get_fused_local(instance, 0), get_fused_local(instance, 1)), 3);
+
+    return 0;
+}
+
+static int opcode_iadd_li(vm_t *instance)
+{
+    push_fused_result(instance, add_integers(get_fused_local(instance, 0), get_fused_arg(instance, 1)), 3);
+
+    return 0;
+}
+
+static int opcode_isub_li(vm_t *instance)
+{
+    push_fused_result(instance, subtract_integers(get_fused_local(instance, 0), get_fused_arg(instance, 1)), 3);
+
+    return 0;
+}
+
+static int opcode_imult_li(vm_t *instance)
+{
+    push_fused_result(instance, multiply_integers(get_fused_local(instance, 0), get_fused_arg(instance, 1)), 3);
+
+    return 0;
+}
+
+static int opcode_iadd_lls(vm_t *instance)
+{
+    instance->stack[instance->lap + get_fused_arg(instance, 3)] =
+        make_integer_value(add_integers(get_fused_local(instance, 0), get_fused_local(instance, 1)));
+    instance->ip += 3;
+
+    return 0;
+}
+
+static int opcode_isub_lls(vm_t *instance)
+{
+    instance->stack[instance->lap + get_fused_arg(instance, 3)] =
+        make_integer_value(subtract_integers(get_fused_local(instance, 0), get_fused_local(instance, 1)));
+    instance->ip += 3;
+
+    return 0;
+}
+
+static int opcode_istore_imm(vm_t *instance)
+{
+    instance->stack[instance->lap + get_fused_arg(instance, 1)] =
+        make_integer_value(get_fused_arg(instance, 0));
+    instance->ip += 1;
+
+    return 0;
+}
+
+static int opcode_iload2(vm_t *instance)
+{
+    vm_value_t *top = &instance->stack[instance->osp];
+
+    top[0] = make_integer_value(get_fused_local(instance, 0));
+    top[1] = make_integer_value(get_fused_local(instance, 1));
+    instance->osp += 2;
+    instance->ip += 1;
+
+    return 0;
+}
+
+/* the arg of the index-th instruction of the running superinstruction */
+static int get_fused_arg(vm_t *instance, int index)
+{
+    return instance->program->instructions[instance->ip - 1 + index].arg;
+}
+
+static int get_fused_local(vm_t *instance, int index)
+{
+    return get_integer_value(instance->stack[instance->lap + get_fused_arg(instance, index)]);
+}
+
+/* pushes the result and continues after the sequence of length instructions */
+static void push_fused_result(vm_t *instance, int result, unsigned int length)
+{
+    vm_value_t *top = &instance->stack[instance->osp];
+
+    *top = make_integer_value(result);
+    ++instance->osp;
+    instance->ip += length - 1;
+}
+
+/* pops the two integers of an if_icmp, returns the second */
+static int pop_compared(vm_t *instance, int *left)
+{
+    instance->osp -= 2;
+    *left = get_integer_value(instance->stack[instance->osp]);
+
+    return get_integer_value(instance->stack[instance->osp + 1]);
+}
+
+/* like branch in opcodes.c, a back-edge on the jit engine can move the loop to native code */
+static int branch_unchecked(vm_t *instance)
+{
+    unsigned int target = (unsigned int)get_instruction_arg(instance);
+    unsigned int from = instance->ip - 1;
+
+    instance->ip = target;
+
+    if (VM_ENGINE_JIT == instance->engine && target <= from)
+    {
+        return jit_enter_loop(instance);
+    }
+
+    return 0;
+}
@@ -6,289 +6,328 @@
 #include "opcodes.h"   /* opcodes */
 #include "vm_impl.h"   /* private vm header */
 #include "vm_util.h"   /* utility functions */
+#include "vm_threaded.h" /* threaded engine */
+#include "vm_jit.h"      /* jit             */
+#include "vm_register.h" /* register engine */
+#include "vm_dense.h"    /* dense engine    */
+#include "vm_stack.h"    /* stack guard     */
+#include "vm_heap.h"     /* heap            */
+#include "vm_output.h"   /* output buffer   */
 
 #include "vm.h"        /* public vm header */
 
 #define DEFAULT_ERR_HANDLER default_err_handler
-#define MAGIC_NUM 0xBABEFACE
 #define DEFAULT_HEAP_SIZE 1000000 // 1mb
 #define DEFAULT_STACK_SIZE 100000 // 100kb 
-#define MAIN_METHOD_NAME "main"
 
 #define DEFAULT_OUTPUT stdout
 #define DEFAULT_INPUT stdin
 #define DEFAULT_ERR stderr
 
 static int init_vm_fields(vm_t *instance, 
+                          const vm_program_t *program,
                           unsigned int stack_size,
                           size_t heap_size,
-                          FILE *input, 
                           FILE *output, 
+                          FILE *input, 
                           FILE *err);
-static int build_constant_pool(vm_t *instance);
-
-vm_t *vm_create(const char *file_path,
-                unsigned int stack_size,
-                size_t heap_size,
-                FILE *output,
-                FILE *input,
-                FILE *err)
+static enum vm_engine resolve_engine(enum vm_engine engine);
+static int run_handlers(vm_t *instance);
+
+vm_context_t *vm_context_create(const vm_program_t *program,
+                                unsigned int stack_size,
+                                size_t heap_size,
+                                FILE *output,
+                                FILE *input,
+                                FILE *err,
+                                enum vm_engine engine)
 {
     int res = 0;
     vm_t *new_instance = NULL;
 
-    assert(NULL != file_path);
-    
+    assert(NULL != program);
+
     new_instance = (vm_t *)malloc(sizeof(vm_t));
     if (NULL == new_instance)
     {
         return NULL;
     }
 
-    res = init_vm_fields(new_instance, stack_size, heap_size, output, input, err);
+    res = init_vm_fields(new_instance, program, stack_size, heap_size, output, input, err);
     if (0 != res)
     {
-        vm_free(new_instance);
+        vm_context_free(new_instance);
 
         return NULL;
     }
+    new_instance->engine = resolve_engine(engine);
 
-    res = load_bytecode_from_file(file_path, new_instance);
+    res = open_main_frame(new_instance);
     if (0 != res)
     {
-        vm_free(new_instance);
+        vm_context_free(new_instance);
 
         return NULL;
     }
+    new_instance->state = VM_READY;
 
-    res = validate_magic_number(new_instance);
-    if (0 != res)
-    {
-        print_error(new_instance, "file with wrong magic number!");
-        print_error(new_instance, file_path);
-        vm_free(new_instance);
+    return new_instance;
+}
+
+void vm_context_reset(vm_context_t *context)
+{
+    assert(context);
+
+    // the objects of the last run are all unreachable now
+    reset_heap(context);
+
+    // a context that cannot fit main stays in the init state and will not run
+    context->state = (0 == open_main_frame(context) ? VM_READY : VM_INIT);
+}
+
+void vm_context_set_jit_threshold(vm_context_t *context, unsigned int threshold)
+{
+    assert(context);
+
+    context->jit_threshold = threshold;
+}
+
+int vm_context_set_output_buffer(vm_context_t *context, size_t size)
+{
+    assert(context);
+
+    return alloc_output_buffer(context, size);
+}
+
+void vm_context_set_io(vm_context_t *context, FILE *output, FILE *input, FILE *err)
+{
+    assert(context);
+
+    // what was printed so far belongs to the old file
+    flush_output(context);
+
+    context->output = (NULL == output ? context->output : output);
+    context->input = (NULL == input ? context->input : input);
+    context->err = (NULL == err ? context->err : err);
+}
+
+void vm_context_set_program(vm_context_t *context, const vm_program_t *program)
+{
+    assert(context && program && !context->owns_program);
+
+    context->program = program;
+    context->opcode_handlers = program->opcode_handlers;
+
+    vm_context_reset(context);
+}
+
+void vm_context_get_gc_stats(const vm_context_t *context, vm_gc_stats_t *stats)
+{
+    assert(context && stats);
+
+    *stats = context->gc_stats;
+}
+
+void vm_context_free(vm_context_t *context)
+{
+    assert(context);
+
+    free_output_buffer(context);
+    free_heap(context);
+    free_stack(context);
+    free_stack_frames(context);
+
+    free(context);
+}
+
+vm_t *vm_create(const char *file_path,
+                unsigned int stack_size,
+                size_t heap_size,
+                FILE *output,
+                FILE *input,
+                FILE *err,
+                enum vm_engine engine)
+{
+    vm_program_t *program = NULL;
+    vm_t *new_instance = NULL;
+
+    assert(NULL != file_path);
 
+    program = vm_program_load(file_path, (NULL == err ? DEFAULT_ERR : err));
+    if (NULL == program)
+    {
         return NULL;
     }
 
-    res = build_constant_pool(new_instance);
-    if (0 != res) 
+    new_instance = vm_context_create(program, stack_size, heap_size, output, input, err, engine);
+    if (NULL == new_instance)
     {
-        vm_free(new_instance);
+        vm_program_free(program);
 
         return NULL;
     }
-
-    new_instance->state = VM_READY;
+    new_instance->owns_program = 1;
 
     return new_instance;
 }
 
 void vm_free(vm_t *instance)
 {   
+    const vm_program_t *program = NULL;
+    int owns_program = 0;
+
     assert(instance);
 
-    free_heap(instance);
-    free_stack(instance);
-    free_constant_pool(instance);
-    free_stack_frames(instance);
-    free_code(instance);
+    program = instance->program;
+    owns_program = instance->owns_program;
+
+    vm_context_free(instance);
 
-    free(instance);
-    instance = NULL;
+    if (owns_program)
+    {
+        vm_program_free((vm_program_t *)program);
+    }
 }
 
 int vm_run(vm_t *instance)
 {
-    vm_instruction_t *instruction = NULL;
-    int res = 0;
-
     assert(instance);
 
+    switch (instance->engine)
+    {
+        case VM_ENGINE_THREADED:
+        case VM_ENGINE_JIT:
+            return vm_run_native(instance, run_threaded_code);
+
+        case VM_ENGINE_REGISTER:
+            if (NULL != instance->program->register_code)
+            {
+                return vm_run_native(instance, run_register_code);
+            }
+            return vm_run_native(instance, run_handlers);
+
+        case VM_ENGINE_DENSE:
+            if (NULL != instance->program->dense_code)
+            {
+                return vm_run_native(instance, run_dense_code);
+            }
+            return vm_run_native(instance, run_handlers);
+
+        default:
+            return vm_run_native(instance, run_handlers);
+    }
+}
+
+int vm_run_native(vm_t *instance, int (*code)(vm_t *instance))
+{
+    double start = 0;
+
+    assert(instance && code);
+
     if (VM_READY != instance->state)
     {
         print_error(instance, "vm is not at ready state");
+
+        return -1;
     }
     instance->state = VM_RUNNING;
+    start = get_monotonic_time();
 
-    while (VM_RUNNING == instance->state && 0 == res)
-    {
-        //printf("function: %s\n", instance->stack_trace->method_meta->name);
-        instruction = read_next_instruction(instance);
-        res = instance->opcode_handlers[instruction->opcode](instance);
-        //printf("[+] operand stack size: %d, instruction: %x\n", get_operand_stack_size(instance), instruction->opcode);
-    }
+    run_guarded(instance, code);
+
+    // however the run ended, with stop, an error or the return of main
+    flush_output(instance);
+
+    instance->gc_stats.run_time += get_monotonic_time() - start;
 
     return 0;
 }
 
 
 /* STATIC FUNCTIONS */
-static int build_constant_pool(vm_t *instance)
+static enum vm_engine resolve_engine(enum vm_engine engine)
 {
-    char cur_opcode = 0;
-    int cur_type = 0;
-    vm_value_t *cur_value = NULL;
-    vm_method_meta_t *cur_method = NULL;
-    int str_len = 0;
-    int size = 0;
-
-    assert(instance);
-
-    instance->constant_pool_size = read_byte_value(instance);
+    if (VM_ENGINE_DEFAULT == engine)
+    {
+        engine = VM_ENGINE_JIT;
+    }
 
-    instance->constant_pool = (vm_value_t *)malloc(instance->constant_pool_size * sizeof(vm_value_t));
-    if (NULL == instance->constant_pool)
+    if (VM_ENGINE_JIT == engine && !HAS_JIT)
     {
-        return -1;
+        engine = VM_ENGINE_THREADED;
     }
 
-    for (int i = 0; i < instance->constant_pool_size; ++i)
+    if (VM_ENGINE_THREADED == engine && !HAS_COMPUTED_GOTO)
     {
-        cur_type = read_byte_value(instance);
-        cur_value = &instance->constant_pool[i];
-        
-        switch (cur_type)
-        {
-            case VM_TYPE_BYTE:
-                cur_value->type = VM_TYPE_BYTE;
-                cur_value->value.byte_value = read_byte_value(instance);
-                break;
-            case VM_TYPE_INTEGER:
-                cur_value->type = VM_TYPE_INTEGER;
-                cur_value->value.integer_value = read_int_value(instance);
-                break;
-            case VM_TYPE_FLOAT:
-                cur_value->type = VM_TYPE_FLOAT;
-                // TODO: add support for float
-                break;
-            case VM_TYPE_LONG:
-                cur_value->type = VM_TYPE_LONG;
-                // TODO: add support for long
-                break;
-            case VM_TYPE_DOUBLE:
-                cur_value->type = VM_TYPE_DOUBLE;
-                // TODO: add support for double
-                break;
-            case VM_TYPE_STRING:
-                cur_value->type = VM_TYPE_STRING;
-                cur_value->value.string_value = read_string_value(instance);
-                if (NULL == cur_value->value.string_value)
-                {
-                    return -1;
-                }
-                break;
-            case VM_TYPE_REFERENCE:
-                cur_value->type = VM_TYPE_REFERENCE;
-                // TODO: add support for reference types
-                break;
-            case VM_TYPE_METHOD:
-                cur_value->type = VM_TYPE_METHOD;
-                cur_method = (vm_method_meta_t *)malloc(sizeof(vm_method_meta_t));
-                if (NULL == cur_method) 
-                {
-                    return -1;
-                }
-
-                cur_method->name = read_string_value(instance);
-                if (NULL == cur_method->name)
-                {
-                    return -1;
-                }
-
-                cur_method->return_type = read_byte_value(instance);
-
-                cur_method->num_locals = read_byte_value(instance);
-                cur_method->local_types = (enum vm_types *)malloc(sizeof(int) * cur_method->num_locals);
-                if (NULL == cur_method->local_types) 
-                {
-                    return -1;
-                }
-                for (int i = 0; i < cur_method->num_locals; ++i)
-                {
-                    cur_method->local_types[i] = read_byte_value(instance);
-                }
-
-                cur_method->num_params = read_byte_value(instance);
-                cur_method->param_types = (enum vm_types *)malloc(sizeof(int) * cur_method->num_params);
-                if (NULL == cur_method->param_types) 
-                {
-                    return -1;
-                }
-                for (int i = 0; i < cur_method->num_params; ++i)
-                {
-                    cur_method->param_types[i] = read_byte_value(instance);
-                }
-
-                cur_method->offset = read_int_value(instance);
-
-                cur_value->value.method_value = cur_method;
-
-                if (-1 == check_main_method(instance, MAIN_METHOD_NAME, cur_method))
-                {
-                    return -1;
-                }
-
-                break;
-        }
+        engine = VM_ENGINE_HANDLERS;
     }
 
-    if (NULL == instance->stack_trace) 
+    return engine;
+}
+
+static int run_handlers(vm_t *instance)
+{
+    const vm_instruction_t *instruction = NULL;
+    int res = 0;
+
+    assert(instance);
+
+    while (VM_RUNNING == instance->state && 0 == res)
     {
-        print_error(instance, "no main method was found!");
-        
-        return -1;
+        //printf("function: %s\n", instance->stack_trace->method_meta->name);
+        instruction = read_next_instruction(instance);
+        res = instance->opcode_handlers[instruction->opcode](instance);
+        //printf("[+] operand stack size: %d, instruction: %x\n", get_operand_stack_size(instance), instruction->opcode);
     }
-    // move to point to first instruction
-    instance->instructions = (vm_instruction_t *)&instance->code[instance->ip];
-    // reset to read instructions
-    instance->ip = 0; 
-    
-    return 0;
+
+    return res;
 }
 
 static int init_vm_fields(vm_t *instance, 
+                          const vm_program_t *program,
                           unsigned int stack_size,
                           size_t heap_size,
-                          FILE *input, 
                           FILE *output, 
+                          FILE *input, 
                           FILE *err)
 {
-    assert(instance);
+    assert(instance && program);
 
     memset(instance, 0, sizeof(vm_t));
 
     instance->state = VM_INIT;
-    instance->magic_num = MAGIC_NUM;
+    instance->program = program;
+    instance->opcode_handlers = program->opcode_handlers;
     instance->heap_size = (0 == heap_size ? DEFAULT_HEAP_SIZE : heap_size);
     instance->stack_size = (0 == stack_size ? DEFAULT_STACK_SIZE : stack_size);
+    instance->jit_threshold = JIT_DEFAULT_THRESHOLD;
+
+    // nothing allocates from the heap yet, it is created on first use
+    instance->heap = NULL;
 
-    instance->heap = (char *)malloc(sizeof(char) * instance->heap_size);
-    if (NULL == instance->heap)
+    if (0 != alloc_stack(instance))
     {
         return -1;
     }
 
-    instance->stack = (vm_value_t *)malloc(sizeof(char) * instance->stack_size);
-    if (NULL == instance->stack)
+    // every activation takes at least the stack slot that separates its locals
+    instance->max_frames = instance->stack_size / sizeof(vm_value_t);
+    instance->frames = (vm_stack_frame_t *)malloc(sizeof(vm_stack_frame_t) * instance->max_frames);
+    if (NULL == instance->frames)
     {
         return -1;
     }
 
     instance->stack_trace = NULL;
-    instance->instructions = NULL;
 
     instance->sp = 0;
     instance->ip = 0;
     instance->lap = 0;
     instance->osp = 0;
 
-    init_opcode_handlers(instance->opcode_handlers);
-
     instance->output = (NULL == output ? DEFAULT_OUTPUT : output);
     instance->input = (NULL == input ? DEFAULT_INPUT : input);
     instance->err = (NULL == err ? DEFAULT_ERR : err);
 
-    return 0;
+    return alloc_output_buffer(instance, DEFAULT_OUTPUT_BUFFER_SIZE);
 }
-
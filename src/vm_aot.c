@@ -0,0 +1,1567 @@
+#include <assert.h>    /* assert   */
+#include <ctype.h>     /* isalnum  */
+#include <limits.h>    /* INT_MIN  */
+#include <stdarg.h>    /* va_list  */
+#include <stdlib.h>    /* malloc   */
+#include <string.h>    /* memset   */
+
+#include "opcodes.h"   /* opcodes           */
+#include "vm_impl.h"   /* private vm header */
+#include "vm_util.h"   /* utility functions */
+#include "vm_loader.h" /* prepare_method    */
+#include "vm_aot.h"    /* aot               */
+
+/*
+* The translation works on the instructions as they are in the file, one
+* method at a time, over the instructions of its code range it reaches. The
+* verifier recorded the operand stack depth at each of them, and the types
+* of the slots follow from the instructions that pushed them, so a worklist
+* pass over the method gives every slot one C type at every instruction:
+* operand slot k of type t is the variable s<k>_<t>, local k is l<k>.
+*
+* The variables live in the C frame of the function, so the vm stack only
+* holds them where something else reads it: the arguments of a call, the
+* operands of an instruction run by its handler and every value the
+* garbage collector has to see while a call or a handler runs. Before those
+* the operand stack and the reference locals are stored to the frame, and
+* afterwards the references are loaded back, the collector may have moved
+* their objects.
+*/
+
+#define AOT_UNREACHED 0xFF // a type byte of an instruction the method does not reach
+#define AOT_SUFFIXES "ilfdv" // of the variables of int, long, float, double and value slots
+
+typedef struct aot_translator
+{
+    vm_program_t *program;
+    const vm_instruction_t *instructions; // the instructions as they are in the file
+    FILE *out;
+    FILE *err;
+
+    vm_method_meta_t **methods; // main first, then the callees as they are found
+    unsigned int num_methods;
+    unsigned int methods_capacity;
+
+    /* the method being translated */
+    const vm_method_meta_t *method;
+    unsigned int start; // its first instruction
+    unsigned int count; // the instructions of its code range
+    int max_depth;      // of its operand stack, with one more slot for a push
+    unsigned char *types;     // count x max_depth slot types, the first one AOT_UNREACHED where not reached
+    unsigned char *is_target; // of a branch, a label is emitted
+    unsigned int *worklist;
+    unsigned char *used_slots; // max_depth bit sets of the variables used, by the index of their suffix in AOT_SUFFIXES
+    int num_locals; // params and locals
+    unsigned char *used_locals; // loaded by a reached instruction, the others get no variable and their stores are dropped
+    FILE *statements; // of the method, written after the declarations of the variables they use
+    char *statements_text;
+    size_t statements_size;
+    FILE *body; // the functions of the methods translated so far
+    char *body_text;
+    size_t body_size;
+    int uses_constants;
+    int uses_frame; // runs a handler or a call
+    int uses_operands; // stores to or loads from the operand stack of the frame
+    int uses_res;
+} aot_translator_t;
+
+static int translate_methods(aot_translator_t *translator, const char *program_path);
+static int add_method(aot_translator_t *translator, vm_method_meta_t *method);
+static int find_method(const aot_translator_t *translator, const vm_method_meta_t *method);
+static int translate_method(aot_translator_t *translator, unsigned int index);
+static int type_method(aot_translator_t *translator);
+static int get_successors(const aot_translator_t *translator, unsigned int ip, unsigned int *successors);
+static int get_push_type(const aot_translator_t *translator, const vm_instruction_t *instruction);
+static int translate_instruction(aot_translator_t *translator, unsigned int ip);
+static int translate_call(aot_translator_t *translator, unsigned int ip, int depth);
+static int translate_tailcall(aot_translator_t *translator, unsigned int ip, int depth);
+static void translate_handler(aot_translator_t *translator, unsigned int ip, int depth);
+static void translate_binary(aot_translator_t *translator, int depth, int type, const char *format);
+static void translate_unary(aot_translator_t *translator, int depth, int from, int to, const char *format);
+static void translate_division(aot_translator_t *translator, int depth, int type, const char *name, const char *format);
+static void store_frame(aot_translator_t *translator, const unsigned char *types, int depth);
+static void load_references(aot_translator_t *translator, const unsigned char *types, int depth);
+static void drop_unread_slots(aot_translator_t *translator);
+static int is_slot_read(const char *text, size_t size, const char *name);
+static void write_prologue(aot_translator_t *translator, unsigned int index);
+static void write_signature(const aot_translator_t *translator, unsigned int index, FILE *out);
+static void write_trampoline(const aot_translator_t *translator, FILE *out);
+static void write_name(FILE *out, const char *name);
+static void write_string(FILE *out, const char *string);
+static void emit(aot_translator_t *translator, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static char use_slot(aot_translator_t *translator, int slot, int type);
+static const unsigned char *get_types(const aot_translator_t *translator, unsigned int ip);
+static int get_local_type(const vm_method_meta_t *method, int index);
+static int is_local_load(enum opcodes opcode);
+static const char *get_c_type(int type);
+static char get_type_suffix(int type);
+static const char *get_make_value(int type);
+static const char *get_value_getter(int type);
+static void free_translator(aot_translator_t *translator);
+
+int vm_aot_translate(vm_program_t *program, const char *program_path, FILE *out, FILE *err)
+{
+    aot_translator_t translator = {0};
+    int res = 0;
+
+    assert(program && program_path && out && err);
+
+    translator.program = program;
+    translator.out = out;
+    translator.err = err;
+
+    res = translate_methods(&translator, program_path);
+
+    free_translator(&translator);
+
+    return res;
+}
+
+int vm_aot_translate_file(const char *input_path, const char *output_path, FILE *err)
+{
+    vm_program_t *program = NULL;
+    FILE *out = NULL;
+    int res = 0;
+
+    assert(input_path && output_path && err);
+
+    program = vm_program_load(input_path, err);
+    if (NULL == program)
+    {
+        return -1;
+    }
+
+    out = fopen(output_path, "w");
+    if (NULL == out)
+    {
+        fprintf(err, "[-] can not open %s for writing\n", output_path);
+        vm_program_free(program);
+
+        return -1;
+    }
+
+    res = vm_aot_translate(program, input_path, out, err);
+
+    if (0 != fclose(out) && 0 == res)
+    {
+        fprintf(err, "[-] can not write %s\n", output_path);
+        res = -1;
+    }
+    if (0 != res)
+    {
+        remove(output_path);
+    }
+    vm_program_free(program);
+
+    return res;
+}
+
+/* FNV-1a over the whole file */
+unsigned long long vm_aot_program_hash(const vm_program_t *program)
+{
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+
+    assert(program && program->code);
+
+    for (unsigned int i = 0; i < program->code_size; ++i)
+    {
+        hash = (hash ^ (unsigned char)program->code[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+int vm_aot_main(int argc, char *argv[], const char *program_path, unsigned long long program_hash, vm_aot_code_t code)
+{
+    const char *path = (argc > 1 ? argv[1] : program_path);
+    vm_t *instance = NULL;
+
+    assert(program_path && code);
+
+    instance = vm_create(path, 0, 0, stdout, stdin, stderr, VM_ENGINE_HANDLERS);
+    if (NULL == instance)
+    {
+        printf("[!] vm is null\n");
+
+        return 1;
+    }
+
+    if (vm_aot_program_hash(instance->program) != program_hash)
+    {
+        fprintf(stderr, "[-] %s is not the program this executable was translated from\n", path);
+        vm_free(instance);
+
+        return 1;
+    }
+
+    vm_run_native(instance, code);
+    vm_free(instance);
+
+    return 0;
+}
+
+
+/* STATIC FUNCTIONS */
+/*
+* main and every method it can call, directly or not, like the ones a run
+* prepares. The functions are declared first, so they can call each other
+* in any order.
+*/
+static int translate_methods(aot_translator_t *translator, const char *program_path)
+{
+    vm_program_t *program = translator->program;
+    int res = 0;
+
+    if (0 != add_method(translator, (vm_method_meta_t *)program->main_method))
+    {
+        return -1;
+    }
+
+    translator->body = open_memstream(&translator->body_text, &translator->body_size);
+    if (NULL == translator->body)
+    {
+        fprintf(translator->err, "[-] out of memory\n");
+
+        return -1;
+    }
+
+    // translating a method adds its callees, so the list grows while it is walked
+    for (unsigned int i = 0; i < translator->num_methods && 0 == res; ++i)
+    {
+        res = translate_method(translator, i);
+    }
+
+    if (0 != fflush(translator->body))
+    {
+        fprintf(translator->err, "[-] out of memory\n");
+        res = -1;
+    }
+    if (0 != res)
+    {
+        return -1;
+    }
+
+    fprintf(translator->out, "/*\n* ");
+    write_name(translator->out, program_path);
+    fprintf(translator->out, " translated to C by vm_aot, one function per method. Build it\n");
+    fprintf(translator->out, "* against the library with the same value layout (vm_aot.h).\n*/\n");
+    fprintf(translator->out, "#include <math.h> /* sqrt */\n\n#include \"vm_aot.h\"\n\n");
+    fprintf(translator->out, "#if VM_COMPACT_VALUES != %d\n", VM_COMPACT_VALUES);
+    fprintf(translator->out, "#error \"translated for VM_COMPACT_VALUES=%d\"\n#endif\n\n", VM_COMPACT_VALUES);
+    fprintf(translator->out, "#define AOT_PROGRAM_PATH ");
+    write_string(translator->out, program_path);
+    fprintf(translator->out, "\n#define AOT_PROGRAM_HASH 0x%016llxULL\n\n", vm_aot_program_hash(program));
+
+    for (unsigned int i = 0; i < translator->num_methods; ++i)
+    {
+        write_signature(translator, i, translator->out);
+        fprintf(translator->out, ";\n");
+    }
+    fprintf(translator->out, "static int aot_trampoline(vm_t *instance, int res, void *result);\n");
+    fprintf(translator->out, "int aot_run(vm_t *instance);\n");
+
+    fwrite(translator->body_text, 1, translator->body_size, translator->out);
+
+    write_trampoline(translator, translator->out);
+
+    fprintf(translator->out, "/* the code of the run, its main frame is open */\nint aot_run(vm_t *instance)\n{\n");
+    if (0 < translator->methods[0]->result_type)
+    {
+        fprintf(translator->out, "    %s result;\n", get_c_type(translator->methods[0]->result_type));
+        fprintf(translator->out, "    int res = aot_method_0(instance, &result);\n\n");
+        fprintf(translator->out, "    if (AOT_TAIL_CALL <= res) res = aot_trampoline(instance, res, &result);\n");
+    }
+    else
+    {
+        fprintf(translator->out, "    int res = aot_method_0(instance);\n\n");
+        fprintf(translator->out, "    if (AOT_TAIL_CALL <= res) res = aot_trampoline(instance, res, NULL);\n");
+    }
+    fprintf(translator->out, "    return (0 > res ? -1 : 0);\n}\n\n");
+
+    fprintf(translator->out, "int main(int argc, char *argv[])\n{\n");
+    fprintf(translator->out, "    return vm_aot_main(argc, argv, AOT_PROGRAM_PATH, AOT_PROGRAM_HASH, aot_run);\n}\n");
+
+    return (ferror(translator->out) ? -1 : 0);
+}
+
+static int add_method(aot_translator_t *translator, vm_method_meta_t *method)
+{
+    vm_method_meta_t **methods = NULL;
+    unsigned int capacity = 0;
+
+    if (0 <= find_method(translator, method))
+    {
+        return 0;
+    }
+
+    if (translator->num_methods == translator->methods_capacity)
+    {
+        capacity = (0 == translator->methods_capacity ? 16 : translator->methods_capacity * 2);
+        methods = (vm_method_meta_t **)realloc(translator->methods, sizeof(vm_method_meta_t *) * capacity);
+        if (NULL == methods)
+        {
+            fprintf(translator->err, "[-] out of memory\n");
+
+            return -1;
+        }
+        translator->methods = methods;
+        translator->methods_capacity = capacity;
+    }
+
+    translator->methods[translator->num_methods++] = method;
+
+    return 0;
+}
+
+static int find_method(const aot_translator_t *translator, const vm_method_meta_t *method)
+{
+    for (unsigned int i = 0; i < translator->num_methods; ++i)
+    {
+        if (translator->methods[i] == method)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+static int translate_method(aot_translator_t *translator, unsigned int index)
+{
+    vm_program_t *program = translator->program;
+    vm_method_meta_t *method = translator->methods[index];
+    int res = 0;
+
+    if (0 != prepare_method(program, method))
+    {
+        fprintf(translator->err, "[-] method %s does not verify, the program can not be translated\n", method->name);
+
+        return -1;
+    }
+
+    translator->instructions = program->file_instructions;
+    translator->method = method;
+    translator->start = method->offset;
+    translator->count = method->code_length;
+    translator->num_locals = method->num_params + method->num_locals;
+    translator->max_depth = 1;
+    for (unsigned int ip = method->offset; ip < method->offset + method->code_length; ++ip)
+    {
+        if (program->stack_depths[ip] + 1 > translator->max_depth)
+        {
+            translator->max_depth = program->stack_depths[ip] + 1;
+        }
+    }
+
+    free(translator->types);
+    free(translator->is_target);
+    free(translator->worklist);
+    free(translator->used_slots);
+    free(translator->used_locals);
+    translator->types = (unsigned char *)malloc((size_t)translator->count * translator->max_depth);
+    translator->is_target = (unsigned char *)calloc(translator->count, sizeof(unsigned char));
+    translator->worklist = (unsigned int *)malloc(sizeof(unsigned int) * translator->count);
+    translator->used_slots = (unsigned char *)calloc(translator->max_depth, sizeof(unsigned char));
+    translator->used_locals = (unsigned char *)malloc(translator->num_locals + 1);
+    if (NULL == translator->types || NULL == translator->is_target ||
+        NULL == translator->worklist || NULL == translator->used_slots || NULL == translator->used_locals)
+    {
+        fprintf(translator->err, "[-] out of memory\n");
+
+        return -1;
+    }
+
+    if (0 != type_method(translator))
+    {
+        return -1;
+    }
+
+    // a variable for every type a slot holds somewhere, every push is seen by the instruction after it
+    memset(translator->used_locals, 0, translator->num_locals);
+    for (unsigned int ip = translator->start; ip < translator->start + translator->count; ++ip)
+    {
+        if (AOT_UNREACHED == get_types(translator, ip)[0])
+        {
+            continue;
+        }
+
+        for (int k = 0; k < program->stack_depths[ip]; ++k)
+        {
+            use_slot(translator, k, get_types(translator, ip)[k]);
+        }
+        if (is_local_load(translator->instructions[ip].opcode))
+        {
+            translator->used_locals[translator->instructions[ip].arg] = 1;
+        }
+    }
+
+    translator->uses_constants = 0;
+    translator->uses_frame = 0;
+    translator->uses_operands = 0;
+    translator->uses_res = 0;
+
+    // the statements first, the variables they use are declared above them
+    translator->statements = open_memstream(&translator->statements_text, &translator->statements_size);
+    if (NULL == translator->statements)
+    {
+        fprintf(translator->err, "[-] out of memory\n");
+
+        return -1;
+    }
+
+    for (unsigned int ip = translator->start; ip < translator->start + translator->count && 0 == res; ++ip)
+    {
+        if (AOT_UNREACHED != get_types(translator, ip)[0])
+        {
+            res = translate_instruction(translator, ip);
+        }
+    }
+
+    fclose(translator->statements);
+    translator->statements = NULL;
+
+    if (0 == res)
+    {
+        drop_unread_slots(translator);
+        write_prologue(translator, index);
+        fwrite(translator->statements_text, 1, translator->statements_size, translator->body);
+        fprintf(translator->body, "}\n\n");
+    }
+    free(translator->statements_text);
+    translator->statements_text = NULL;
+
+    return res;
+}
+
+/*
+* Follows the method from its first instruction like the verifier, which
+* already proved the types match wherever paths meet, so the first path to
+* an instruction gives its types.
+*/
+static int type_method(aot_translator_t *translator)
+{
+    const int *stack_depths = translator->program->stack_depths;
+    const unsigned char *types = NULL;
+    unsigned char *successor_types = NULL;
+    unsigned int successors[2];
+    unsigned int num_pending = 0, ip = 0, next = 0;
+    int push_type = 0, num_successors = 0, depth = 0;
+
+    for (unsigned int i = 0; i < translator->count; ++i)
+    {
+        translator->types[(size_t)i * translator->max_depth] = AOT_UNREACHED;
+    }
+
+    translator->types[0] = 0;
+    translator->worklist[num_pending++] = translator->start;
+
+    while (0 < num_pending)
+    {
+        ip = translator->worklist[--num_pending];
+        types = get_types(translator, ip);
+        push_type = get_push_type(translator, &translator->instructions[ip]);
+
+        // a tableswitch reaches every goto of its table and jumps to the instruction after it
+        if (OP_TABLESWITCH == translator->instructions[ip].opcode)
+        {
+            num_successors = translator->instructions[ip].arg + 1;
+            if (ip + num_successors - translator->start < translator->count)
+            {
+                translator->is_target[ip + num_successors - translator->start] = 1;
+            }
+        }
+        else
+        {
+            num_successors = get_successors(translator, ip, successors);
+        }
+
+        for (int i = 0; i < num_successors; ++i)
+        {
+            next = (OP_TABLESWITCH == translator->instructions[ip].opcode ? ip + 1 + i : successors[i]);
+            if (next < translator->start || next >= translator->start + translator->count)
+            {
+                fprintf(translator->err, "[-] %s: instruction %u continues outside the method\n",
+                    translator->method->name, ip);
+
+                return -1;
+            }
+
+            successor_types = (unsigned char *)get_types(translator, next);
+            if (AOT_UNREACHED != successor_types[0])
+            {
+                continue;
+            }
+
+            depth = stack_depths[next];
+            for (int k = 0; k < depth; ++k)
+            {
+                successor_types[k] = (0 != push_type && k == depth - 1 ? push_type : types[k]);
+            }
+            if (0 == depth)
+            {
+                successor_types[0] = 0;
+            }
+            translator->worklist[num_pending++] = next;
+        }
+    }
+
+    return 0;
+}
+
+/* the successors of an instruction that is not a tableswitch, branches are targets */
+static int get_successors(const aot_translator_t *translator, unsigned int ip, unsigned int *successors)
+{
+    const vm_instruction_t *instruction = &translator->instructions[ip];
+    unsigned char *is_target = translator->is_target;
+
+    switch (instruction->opcode)
+    {
+        case OP_STOP:
+        case OP_RET:
+        case OP_IRET:
+        case OP_SRET:
+        case OP_RRET:
+        case OP_LRET:
+        case OP_FRET:
+        case OP_DRET:
+            return 0;
+
+        case OP_GOTO:
+            successors[0] = (unsigned int)instruction->arg;
+            if (successors[0] - translator->start < translator->count)
+            {
+                is_target[successors[0] - translator->start] = 1;
+            }
+
+            return 1;
+
+        case OP_IFEQ:
+        case OP_IFNE:
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+            successors[0] = ip + 1;
+            successors[1] = (unsigned int)instruction->arg;
+            if (successors[1] - translator->start < translator->count)
+            {
+                is_target[successors[1] - translator->start] = 1;
+            }
+
+            return 2;
+
+        // a tail call never comes back, the return after it is only reached when it is a branch target
+        case OP_TAILCALL:
+            if (get_method_value(translator->program->constant_pool[instruction->arg]) == translator->method)
+            {
+                is_target[0] = 1;
+            }
+
+            return 0;
+
+        default:
+            successors[0] = ip + 1;
+
+            return 1;
+    }
+}
+
+/* the type of the value an instruction pushes, 0 for none */
+static int get_push_type(const aot_translator_t *translator, const vm_instruction_t *instruction)
+{
+    const vm_value_t *constants = translator->program->constant_pool;
+
+    switch (instruction->opcode)
+    {
+        case OP_CALL:
+            return (0 < get_method_value(constants[instruction->arg])->result_type ?
+                    get_method_value(constants[instruction->arg])->result_type : 0);
+
+        case OP_CLOAD:
+            return get_value_type(constants[instruction->arg]);
+
+        case OP_ILOAD:
+        case OP_IPUSH:
+        case OP_IADD:
+        case OP_ISUB:
+        case OP_IMULT:
+        case OP_IDIV:
+        case OP_INEG:
+        case OP_IGETFIELD:
+        case OP_ALEN:
+        case OP_BALOAD:
+        case OP_IALOAD:
+        case OP_ASUM:
+        case OP_ADOT:
+        case OP_LCMP:
+        case OP_FCMP:
+        case OP_DCMP:
+        case OP_L2I:
+        case OP_F2I:
+        case OP_D2I:
+            return VM_TYPE_INTEGER;
+
+        case OP_SLOAD:
+        case OP_SGETFIELD:
+            return VM_TYPE_STRING;
+
+        case OP_RLOAD:
+        case OP_RNULL:
+        case OP_NEW:
+        case OP_RGETFIELD:
+        case OP_NEWARRAY:
+            return VM_TYPE_REFERENCE;
+
+        case OP_LLOAD:
+        case OP_LPUSH:
+        case OP_LADD:
+        case OP_LSUB:
+        case OP_LMULT:
+        case OP_LDIV:
+        case OP_LNEG:
+        case OP_LALOAD:
+        case OP_I2L:
+        case OP_F2L:
+        case OP_D2L:
+            return VM_TYPE_LONG;
+
+        case OP_FLOAD:
+        case OP_FPUSH:
+        case OP_FADD:
+        case OP_FSUB:
+        case OP_FMULT:
+        case OP_FDIV:
+        case OP_FNEG:
+        case OP_FALOAD:
+        case OP_I2F:
+        case OP_L2F:
+        case OP_D2F:
+            return VM_TYPE_FLOAT;
+
+        case OP_DLOAD:
+        case OP_DPUSH:
+        case OP_DADD:
+        case OP_DSUB:
+        case OP_DMULT:
+        case OP_DDIV:
+        case OP_DNEG:
+        case OP_DSQRT:
+        case OP_DALOAD:
+        case OP_I2D:
+        case OP_L2D:
+        case OP_F2D:
+            return VM_TYPE_DOUBLE;
+
+        default:
+            return 0;
+    }
+}
+
+static int translate_instruction(aot_translator_t *translator, unsigned int ip)
+{
+    const vm_instruction_t *instruction = &translator->instructions[ip];
+    const vm_value_t *constants = translator->program->constant_pool;
+    const unsigned char *types = get_types(translator, ip);
+    int depth = translator->program->stack_depths[ip];
+    int arg = instruction->arg, type = 0;
+
+    if (translator->is_target[ip - translator->start])
+    {
+        emit(translator, "ip_%u:\n", ip);
+    }
+
+    switch (instruction->opcode)
+    {
+        case OP_NOOP:
+        case OP_POP:
+            return 0;
+
+        case OP_STOP:
+            emit(translator, "    instance->state = VM_FINISHED;\n    return AOT_STOPPED;\n");
+            return 0;
+
+        case OP_CALL:
+            return translate_call(translator, ip, depth);
+
+        case OP_TAILCALL:
+            return translate_tailcall(translator, ip, depth);
+
+        case OP_RET:
+            emit(translator, "    pop_stack_frame(instance);\n    return 0;\n");
+            return 0;
+
+        case OP_IRET:
+        case OP_SRET:
+        case OP_RRET:
+        case OP_LRET:
+        case OP_FRET:
+        case OP_DRET:
+            type = types[depth - 1];
+            emit(translator, "    *result = s%d_%c;\n", depth - 1, use_slot(translator, depth - 1, type));
+            emit(translator, "    pop_stack_frame(instance);\n    return 0;\n");
+            return 0;
+
+        case OP_FLUSH:
+            emit(translator, "    flush_output(instance);\n");
+            return 0;
+
+        /* locals */
+        case OP_ILOAD:
+        case OP_SLOAD:
+        case OP_RLOAD:
+        case OP_LLOAD:
+        case OP_FLOAD:
+        case OP_DLOAD:
+            type = get_local_type(translator->method, arg);
+            emit(translator, "    s%d_%c = l%d;\n", depth, use_slot(translator, depth, type), arg);
+            return 0;
+
+        case OP_ISTORE:
+        case OP_SSTORE:
+        case OP_RSTORE:
+        case OP_LSTORE:
+        case OP_FSTORE:
+        case OP_DSTORE:
+            type = get_local_type(translator->method, arg);
+            if (translator->used_locals[arg])
+            {
+                emit(translator, "    l%d = s%d_%c;\n", arg, depth - 1, use_slot(translator, depth - 1, type));
+            }
+            return 0;
+
+        /* constants */
+        case OP_IPUSH:
+            if (INT_MIN == arg)
+            {
+                emit(translator, "    s%d_i = INT_MIN;\n", depth);
+            }
+            else
+            {
+                emit(translator, "    s%d_i = %d;\n", depth, arg);
+            }
+            use_slot(translator, depth, VM_TYPE_INTEGER);
+            return 0;
+
+        case OP_LPUSH:
+            emit(translator, "    s%d_l = %ldL;\n", depth, (long)arg);
+            use_slot(translator, depth, VM_TYPE_LONG);
+            return 0;
+
+        case OP_FPUSH:
+            emit(translator, "    s%d_f = (float)%ld;\n", depth, (long)arg);
+            use_slot(translator, depth, VM_TYPE_FLOAT);
+            return 0;
+
+        case OP_DPUSH:
+            emit(translator, "    s%d_d = (double)%ld;\n", depth, (long)arg);
+            use_slot(translator, depth, VM_TYPE_DOUBLE);
+            return 0;
+
+        case OP_RNULL:
+            emit(translator, "    s%d_v = make_empty_value(VM_TYPE_REFERENCE);\n", depth);
+            use_slot(translator, depth, VM_TYPE_REFERENCE);
+            return 0;
+
+        case OP_CLOAD:
+            type = get_value_type(constants[arg]);
+            if (VM_TYPE_INTEGER == type && INT_MIN != get_integer_value(constants[arg]))
+            {
+                emit(translator, "    s%d_i = %d;\n", depth, get_integer_value(constants[arg]));
+            }
+            else if (VM_TYPE_LONG == type && LONG_MIN != get_long_value(constants[arg]))
+            {
+                emit(translator, "    s%d_l = %ldL;\n", depth, get_long_value(constants[arg]));
+            }
+            else if ('v' == get_type_suffix(type))
+            {
+                emit(translator, "    s%d_v = constants[%d];\n", depth, arg);
+                translator->uses_constants = 1;
+            }
+            else
+            {
+                emit(translator, "    s%d_%c = %s(constants[%d]);\n",
+                    depth, get_type_suffix(type), get_value_getter(type), arg);
+                translator->uses_constants = 1;
+            }
+            use_slot(translator, depth, type);
+            return 0;
+
+        /* integer operations */
+        case OP_IADD:
+            translate_binary(translator, depth, VM_TYPE_INTEGER, "add_integers(%s, %s)");
+            return 0;
+
+        case OP_ISUB:
+            translate_binary(translator, depth, VM_TYPE_INTEGER, "subtract_integers(%s, %s)");
+            return 0;
+
+        case OP_IMULT:
+            translate_binary(translator, depth, VM_TYPE_INTEGER, "multiply_integers(%s, %s)");
+            return 0;
+
+        case OP_IDIV:
+            translate_division(translator, depth, VM_TYPE_INTEGER, "idiv", "divide_integers(%s, %s)");
+            return 0;
+
+        case OP_INEG:
+            translate_unary(translator, depth, VM_TYPE_INTEGER, VM_TYPE_INTEGER, "negate_integer(%s)");
+            return 0;
+
+        case OP_IPRINT:
+            emit(translator, "    output_integer(instance, s%d_i);\n", depth - 1);
+            return 0;
+
+        /* control flow */
+        case OP_GOTO:
+            emit(translator, "    goto ip_%d;\n", arg);
+            return 0;
+
+        case OP_IFEQ:
+            emit(translator, "    if (0 == s%d_i) goto ip_%d;\n", depth - 1, arg);
+            return 0;
+
+        case OP_IFNE:
+            emit(translator, "    if (0 != s%d_i) goto ip_%d;\n", depth - 1, arg);
+            return 0;
+
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+        {
+            static const char *comparisons[] = { "==", "!=", "<", ">=", ">", "<=" };
+
+            emit(translator, "    if (s%d_i %s s%d_i) goto ip_%d;\n",
+                depth - 2, comparisons[instruction->opcode - OP_IF_ICMPEQ], depth - 1, arg);
+            return 0;
+        }
+
+        case OP_TABLESWITCH:
+            emit(translator, "    switch ((unsigned int)s%d_i)\n    {\n", depth - 1);
+            for (int i = 0; i < arg; ++i)
+            {
+                emit(translator, "        case %d: goto ip_%d;\n", i, translator->instructions[ip + 1 + i].arg);
+            }
+            emit(translator, "        default: goto ip_%u;\n    }\n", ip + 1 + arg);
+            return 0;
+
+        /* strings */
+        case OP_SPRINT:
+            emit(translator, "    output_string(instance, get_string_value(s%d_v));\n", depth - 1);
+            return 0;
+
+        /* long operations */
+        case OP_LADD:
+            translate_binary(translator, depth, VM_TYPE_LONG, "aot_long(add_longs(%s, %s))");
+            return 0;
+
+        case OP_LSUB:
+            translate_binary(translator, depth, VM_TYPE_LONG, "aot_long(subtract_longs(%s, %s))");
+            return 0;
+
+        case OP_LMULT:
+            translate_binary(translator, depth, VM_TYPE_LONG, "aot_long(multiply_longs(%s, %s))");
+            return 0;
+
+        case OP_LDIV:
+            translate_division(translator, depth, VM_TYPE_LONG, "ldiv", "aot_long(divide_longs(%s, %s))");
+            return 0;
+
+        case OP_LNEG:
+            translate_unary(translator, depth, VM_TYPE_LONG, VM_TYPE_LONG, "aot_long(negate_long(%s))");
+            return 0;
+
+        case OP_LPRINT:
+            emit(translator, "    output_long(instance, s%d_l);\n", depth - 1);
+            return 0;
+
+        case OP_LCMP:
+            emit(translator, "    s%d_%c = compare_longs(s%d_l, s%d_l);\n",
+                depth - 2, use_slot(translator, depth - 2, VM_TYPE_INTEGER), depth - 2, depth - 1);
+            return 0;
+
+        /* float operations */
+        case OP_FADD:
+            translate_binary(translator, depth, VM_TYPE_FLOAT, "%s + %s");
+            return 0;
+
+        case OP_FSUB:
+            translate_binary(translator, depth, VM_TYPE_FLOAT, "%s - %s");
+            return 0;
+
+        case OP_FMULT:
+            translate_binary(translator, depth, VM_TYPE_FLOAT, "%s * %s");
+            return 0;
+
+        case OP_FDIV:
+            translate_binary(translator, depth, VM_TYPE_FLOAT, "%s / %s");
+            return 0;
+
+        case OP_FNEG:
+            translate_unary(translator, depth, VM_TYPE_FLOAT, VM_TYPE_FLOAT, "-%s");
+            return 0;
+
+        case OP_FPRINT:
+            emit(translator, "    output_float(instance, s%d_f);\n", depth - 1);
+            return 0;
+
+        case OP_FCMP:
+            emit(translator, "    s%d_%c = compare_doubles(s%d_f, s%d_f);\n",
+                depth - 2, use_slot(translator, depth - 2, VM_TYPE_INTEGER), depth - 2, depth - 1);
+            return 0;
+
+        /* double operations */
+        case OP_DADD:
+            translate_binary(translator, depth, VM_TYPE_DOUBLE, "aot_double(%s + %s)");
+            return 0;
+
+        case OP_DSUB:
+            translate_binary(translator, depth, VM_TYPE_DOUBLE, "aot_double(%s - %s)");
+            return 0;
+
+        case OP_DMULT:
+            translate_binary(translator, depth, VM_TYPE_DOUBLE, "aot_double(%s * %s)");
+            return 0;
+
+        case OP_DDIV:
+            translate_binary(translator, depth, VM_TYPE_DOUBLE, "aot_double(%s / %s)");
+            return 0;
+
+        case OP_DNEG:
+            translate_unary(translator, depth, VM_TYPE_DOUBLE, VM_TYPE_DOUBLE, "aot_double(-%s)");
+            return 0;
+
+        case OP_DSQRT:
+            translate_unary(translator, depth, VM_TYPE_DOUBLE, VM_TYPE_DOUBLE, "aot_double(sqrt(%s))");
+            return 0;
+
+        case OP_DPRINT:
+            emit(translator, "    output_double(instance, s%d_d);\n", depth - 1);
+            return 0;
+
+        case OP_DCMP:
+            emit(translator, "    s%d_%c = compare_doubles(s%d_d, s%d_d);\n",
+                depth - 2, use_slot(translator, depth - 2, VM_TYPE_INTEGER), depth - 2, depth - 1);
+            return 0;
+
+        /* conversions */
+        case OP_I2L:
+            translate_unary(translator, depth, VM_TYPE_INTEGER, VM_TYPE_LONG, "(long)%s");
+            return 0;
+
+        case OP_I2F:
+            translate_unary(translator, depth, VM_TYPE_INTEGER, VM_TYPE_FLOAT, "(float)%s");
+            return 0;
+
+        case OP_I2D:
+            translate_unary(translator, depth, VM_TYPE_INTEGER, VM_TYPE_DOUBLE, "(double)%s");
+            return 0;
+
+        case OP_L2I:
+            translate_unary(translator, depth, VM_TYPE_LONG, VM_TYPE_INTEGER, "(int)%s");
+            return 0;
+
+        case OP_L2F:
+            translate_unary(translator, depth, VM_TYPE_LONG, VM_TYPE_FLOAT, "(float)%s");
+            return 0;
+
+        case OP_L2D:
+            translate_unary(translator, depth, VM_TYPE_LONG, VM_TYPE_DOUBLE, "(double)%s");
+            return 0;
+
+        case OP_F2I:
+            translate_unary(translator, depth, VM_TYPE_FLOAT, VM_TYPE_INTEGER, "double_to_integer(%s)");
+            return 0;
+
+        case OP_F2L:
+            translate_unary(translator, depth, VM_TYPE_FLOAT, VM_TYPE_LONG, "aot_long(double_to_long(%s))");
+            return 0;
+
+        case OP_F2D:
+            translate_unary(translator, depth, VM_TYPE_FLOAT, VM_TYPE_DOUBLE, "aot_double(%s)");
+            return 0;
+
+        case OP_D2I:
+            translate_unary(translator, depth, VM_TYPE_DOUBLE, VM_TYPE_INTEGER, "double_to_integer(%s)");
+            return 0;
+
+        case OP_D2L:
+            translate_unary(translator, depth, VM_TYPE_DOUBLE, VM_TYPE_LONG, "aot_long(double_to_long(%s))");
+            return 0;
+
+        case OP_D2F:
+            translate_unary(translator, depth, VM_TYPE_DOUBLE, VM_TYPE_FLOAT, "(float)%s");
+            return 0;
+
+        // objects, fields, arrays and halt
+        default:
+            translate_handler(translator, ip, depth);
+            return 0;
+    }
+}
+
+/*
+* The arguments go to the vm stack, where open_stack_frame makes them the
+* callee's params, and the callee stores its result straight into the slot
+* they started at.
+*/
+static int translate_call(aot_translator_t *translator, unsigned int ip, int depth)
+{
+    const vm_instruction_t *instruction = &translator->instructions[ip];
+    vm_method_meta_t *callee = get_method_value(translator->program->constant_pool[instruction->arg]);
+    int below = depth - callee->num_params, index = 0;
+    char slot = 0;
+
+    if (0 != add_method(translator, callee))
+    {
+        return -1;
+    }
+    index = find_method(translator, callee);
+
+    emit(translator, "    /* call ");
+    write_name(translator->statements, callee->name);
+    emit(translator, " */\n");
+    store_frame(translator, get_types(translator, ip), depth);
+    emit(translator, "    if (0 != aot_open_frame(instance, base + %d, %u, %d)) return -1;\n", depth, ip, instruction->arg);
+
+    if (0 < callee->result_type)
+    {
+        slot = use_slot(translator, below, callee->result_type);
+        emit(translator, "    res = aot_method_%d(instance, &s%d_%c);\n", index, below, slot);
+        emit(translator, "    if (AOT_TAIL_CALL <= res) res = aot_trampoline(instance, res, &s%d_%c);\n", below, slot);
+    }
+    else
+    {
+        emit(translator, "    res = aot_method_%d(instance);\n", index);
+        emit(translator, "    if (AOT_TAIL_CALL <= res) res = aot_trampoline(instance, res, NULL);\n");
+    }
+    emit(translator, "    if (0 != res) return res;\n");
+    translator->uses_res = 1;
+
+    load_references(translator, get_types(translator, ip), below);
+
+    return 0;
+}
+
+/*
+* The arguments go to the vm stack and reuse_stack_frame moves them to the
+* params of the frame. A method calling itself loads its locals from there
+* again and jumps to its start. For any other callee the method returns
+* AOT_TAIL_CALL plus the callee's index, and aot_trampoline in its caller
+* runs the callee in the reused frame, so the C stack does not grow either.
+*/
+static int translate_tailcall(aot_translator_t *translator, unsigned int ip, int depth)
+{
+    const vm_instruction_t *instruction = &translator->instructions[ip];
+    vm_method_meta_t *callee = get_method_value(translator->program->constant_pool[instruction->arg]);
+    int type = 0, index = 0;
+
+    if (0 != add_method(translator, callee))
+    {
+        return -1;
+    }
+    index = find_method(translator, callee);
+
+    emit(translator, "    /* tailcall ");
+    write_name(translator->statements, callee->name);
+    emit(translator, " */\n");
+    store_frame(translator, get_types(translator, ip), depth);
+    emit(translator, "    if (0 != aot_reuse_frame(instance, base + %d, %u, %d)) return -1;\n", depth, ip, instruction->arg);
+
+    if (callee == translator->method)
+    {
+        for (int k = 0; k < translator->num_locals; ++k)
+        {
+            if (!translator->used_locals[k])
+            {
+                continue;
+            }
+
+            type = get_local_type(translator->method, k);
+            if ('v' == get_type_suffix(type))
+            {
+                emit(translator, "    l%d = locals[%d];\n", k, k);
+            }
+            else
+            {
+                emit(translator, "    l%d = %s(locals[%d]);\n", k, get_value_getter(type), k);
+            }
+        }
+        emit(translator, "    goto ip_%u;\n", translator->start);
+    }
+    else
+    {
+        emit(translator, "    return AOT_TAIL_CALL + %d;\n", index);
+    }
+
+    return 0;
+}
+
+/* the handler finds its operands on the vm stack and leaves its result there */
+static void translate_handler(aot_translator_t *translator, unsigned int ip, int depth)
+{
+    const unsigned char *types = get_types(translator, ip);
+    int push_type = get_push_type(translator, &translator->instructions[ip]);
+    int next_depth = translator->program->stack_depths[ip + 1];
+
+    store_frame(translator, types, depth);
+    emit(translator, "    if (0 != aot_run_handler(instance, base + %d, %u, (enum opcodes)0x%02X)) return -1;\n",
+        depth, ip, translator->instructions[ip].opcode);
+
+    if (0 == push_type)
+    {
+        load_references(translator, types, next_depth);
+
+        return;
+    }
+
+    load_references(translator, types, next_depth - 1);
+    translator->uses_operands = 1;
+    emit(translator, "    s%d_%c = ", next_depth - 1, use_slot(translator, next_depth - 1, push_type));
+    if ('v' == get_type_suffix(push_type))
+    {
+        emit(translator, "operands[%d];\n", next_depth - 1);
+    }
+    else
+    {
+        emit(translator, "%s(operands[%d]);\n", get_value_getter(push_type), next_depth - 1);
+    }
+}
+
+/* pops two operands of type and pushes the result of format */
+static void translate_binary(aot_translator_t *translator, int depth, int type, const char *format)
+{
+    char left[32], right[32];
+    char suffix = use_slot(translator, depth - 2, type);
+
+    snprintf(left, sizeof(left), "s%d_%c", depth - 2, suffix);
+    snprintf(right, sizeof(right), "s%d_%c", depth - 1, suffix);
+
+    emit(translator, "    %s = ", left);
+    emit(translator, format, left, right);
+    emit(translator, ";\n");
+}
+
+static void translate_unary(aot_translator_t *translator, int depth, int from, int to, const char *format)
+{
+    char operand[32];
+
+    snprintf(operand, sizeof(operand), "s%d_%c", depth - 1, use_slot(translator, depth - 1, from));
+
+    emit(translator, "    s%d_%c = ", depth - 1, use_slot(translator, depth - 1, to));
+    emit(translator, format, operand);
+    emit(translator, ";\n");
+}
+
+/* the verifier proves types, not values, the divisor is checked like the handlers do */
+static void translate_division(aot_translator_t *translator, int depth, int type, const char *name, const char *format)
+{
+    emit(translator, "    if (0 == s%d_%c)\n    {\n", depth - 1, get_type_suffix(type));
+    emit(translator, "        report_error(instance, \"[%s] failed, division by zero\\n\");\n\n", name);
+    emit(translator, "        return -1;\n    }\n");
+    translate_binary(translator, depth, type, format);
+}
+
+/*
+* Writes the operand stack up to depth and the reference locals to the vm
+* stack: the collector scans every slot of the frame below osp, and a
+* handler or a callee reads its operands from there.
+*/
+static void store_frame(aot_translator_t *translator, const unsigned char *types, int depth)
+{
+    translator->uses_frame = 1;
+    translator->uses_operands |= (0 < depth);
+
+    for (int k = 0; k < translator->num_locals; ++k)
+    {
+        if (translator->used_locals[k] && VM_TYPE_REFERENCE == get_local_type(translator->method, k))
+        {
+            emit(translator, "    locals[%d] = l%d;\n", k, k);
+        }
+    }
+
+    for (int k = 0; k < depth; ++k)
+    {
+        if ('v' == get_type_suffix(types[k]))
+        {
+            emit(translator, "    operands[%d] = s%d_%c;\n", k, k, use_slot(translator, k, types[k]));
+        }
+        else
+        {
+            emit(translator, "    operands[%d] = %s(s%d_%c);\n",
+                k, get_make_value(types[k]), k, use_slot(translator, k, types[k]));
+        }
+    }
+}
+
+/* the objects of the references may have been moved by a collection */
+static void load_references(aot_translator_t *translator, const unsigned char *types, int depth)
+{
+    for (int k = 0; k < translator->num_locals; ++k)
+    {
+        if (translator->used_locals[k] && VM_TYPE_REFERENCE == get_local_type(translator->method, k))
+        {
+            emit(translator, "    l%d = locals[%d];\n", k, k);
+        }
+    }
+
+    for (int k = 0; k < depth; ++k)
+    {
+        if (VM_TYPE_REFERENCE == types[k])
+        {
+            emit(translator, "    s%d_v = operands[%d];\n", k, k);
+        }
+    }
+}
+
+/*
+* A slot whose value is only ever stored, like the array of a newarray that
+* is popped, would be a variable that is set and never used. It gets no
+* variable, and its stores are taken out of the statements, none of which
+* has side effects: a call stores its result through the slot's address,
+* which reads it.
+*/
+static void drop_unread_slots(aot_translator_t *translator)
+{
+    char name[32], store[40];
+    char *text = translator->statements_text;
+    size_t size = translator->statements_size, line_size = 0, kept = 0;
+
+    for (int k = 0; k < translator->max_depth; ++k)
+    {
+        for (int i = 0; i < 5; ++i)
+        {
+            if (0 == (translator->used_slots[k] & (1 << i)))
+            {
+                continue;
+            }
+
+            snprintf(name, sizeof(name), "s%d_%c", k, AOT_SUFFIXES[i]);
+            if (is_slot_read(text, size, name))
+            {
+                continue;
+            }
+
+            translator->used_slots[k] &= (unsigned char)~(1 << i);
+            snprintf(store, sizeof(store), "    %s = ", name);
+            kept = 0;
+            for (size_t at = 0; at < size; at += line_size)
+            {
+                line_size = (size_t)((char *)memchr(text + at, '\n', size - at) - (text + at)) + 1;
+                if (line_size <= strlen(store) || 0 != strncmp(text + at, store, strlen(store)))
+                {
+                    memmove(text + kept, text + at, line_size);
+                    kept += line_size;
+                }
+            }
+            size = kept;
+        }
+    }
+
+    translator->statements_size = size;
+}
+
+/* any use of the variable name but as the target of a statement's store */
+static int is_slot_read(const char *text, size_t size, const char *name)
+{
+    size_t length = strlen(name);
+    const char *end = text + size;
+
+    for (const char *at = text; at + length <= end; ++at)
+    {
+        if (0 != strncmp(at, name, length) ||
+            (at > text && (isalnum((unsigned char)at[-1]) || '_' == at[-1])) ||
+            (at + length < end && (isalnum((unsigned char)at[length]) || '_' == at[length])))
+        {
+            continue;
+        }
+
+        if (at - text >= 4 && (at - text == 4 || '\n' == at[-5]) && 0 == strncmp(at - 4, "    ", 4) &&
+            at + length + 3 <= end && 0 == strncmp(at + length, " = ", 3))
+        {
+            continue;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/* the function header and the variables, the params and locals start with their values in the frame */
+static void write_prologue(aot_translator_t *translator, unsigned int index)
+{
+    static const int number_types[] = { VM_TYPE_INTEGER, VM_TYPE_LONG, VM_TYPE_FLOAT, VM_TYPE_DOUBLE };
+    const vm_method_meta_t *method = translator->method;
+    FILE *body = translator->body;
+    int type = 0;
+
+    fprintf(body, "/* ");
+    write_name(body, method->name);
+    fprintf(body, " */\n");
+    write_signature(translator, index, body);
+    fprintf(body, "\n{\n");
+
+    if (translator->uses_constants)
+    {
+        fprintf(body, "    const vm_value_t *constants = instance->program->constant_pool;\n");
+    }
+    if (NULL != memchr(translator->used_locals, 1, translator->num_locals))
+    {
+        fprintf(body, "    vm_value_t *locals = &instance->stack[instance->lap];\n");
+    }
+    if (translator->uses_frame)
+    {
+        fprintf(body, "    unsigned int base = instance->sp + 1; // of the operand stack\n");
+    }
+    if (translator->uses_operands)
+    {
+        fprintf(body, "    vm_value_t *operands = &instance->stack[instance->sp + 1];\n");
+    }
+    if (translator->uses_res)
+    {
+        fprintf(body, "    int res = 0;\n");
+    }
+
+    for (int k = 0; k < translator->num_locals; ++k)
+    {
+        if (!translator->used_locals[k])
+        {
+            continue;
+        }
+
+        type = get_local_type(method, k);
+        if ('v' == get_type_suffix(type))
+        {
+            fprintf(body, "    vm_value_t l%d = locals[%d];\n", k, k);
+        }
+        else
+        {
+            fprintf(body, "    %s l%d = %s(locals[%d]);\n", get_c_type(type), k, get_value_getter(type), k);
+        }
+    }
+
+    for (int k = 0; k < translator->max_depth; ++k)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if (0 != (translator->used_slots[k] & (1 << i)))
+            {
+                fprintf(body, "    %s s%d_%c = 0;\n", get_c_type(number_types[i]), k, AOT_SUFFIXES[i]);
+            }
+        }
+        if (0 != (translator->used_slots[k] & (1 << 4)))
+        {
+            fprintf(body, "    vm_value_t s%d_v = { 0 };\n", k);
+        }
+    }
+    fprintf(body, "\n");
+}
+
+static void write_signature(const aot_translator_t *translator, unsigned int index, FILE *out)
+{
+    const vm_method_meta_t *method = translator->methods[index];
+
+    if (0 < method->result_type)
+    {
+        fprintf(out, "static int aot_method_%u(vm_t *instance, %s *result)", index, get_c_type(method->result_type));
+    }
+    else
+    {
+        fprintf(out, "static int aot_method_%u(vm_t *instance)", index);
+    }
+}
+
+/* a method name or a path inside a comment, anything that could end it is replaced */
+/*
+* Runs the method a tail call continues in, the frame is already its own,
+* until one returns anything but a tail call. A tail call keeps the
+* result type, so result is the slot of the first call for all of them.
+*/
+static void write_trampoline(const aot_translator_t *translator, FILE *out)
+{
+    const vm_method_meta_t *method = NULL;
+    int uses_result = 0;
+
+    for (unsigned int i = 0; i < translator->num_methods; ++i)
+    {
+        uses_result |= (0 < translator->methods[i]->result_type);
+    }
+
+    fprintf(out, "static int aot_trampoline(vm_t *instance, int res, void *result)\n{\n");
+    if (!uses_result)
+    {
+        fprintf(out, "    (void)result; // every method of the translation is void\n\n");
+    }
+    fprintf(out, "    while (AOT_TAIL_CALL <= res)\n    {\n        switch (res - AOT_TAIL_CALL)\n        {\n");
+    for (unsigned int i = 0; i < translator->num_methods; ++i)
+    {
+        method = translator->methods[i];
+        if (0 < method->result_type)
+        {
+            fprintf(out, "            case %u: res = aot_method_%u(instance, (%s *)result); break;\n",
+                i, i, get_c_type(method->result_type));
+        }
+        else
+        {
+            fprintf(out, "            case %u: res = aot_method_%u(instance); break;\n", i, i);
+        }
+    }
+    fprintf(out, "            default: return -1;\n        }\n    }\n\n    return res;\n}\n\n");
+}
+
+static void write_name(FILE *out, const char *name)
+{
+    for (; '\0' != *name; ++name)
+    {
+        fputc((isalnum((unsigned char)*name) || NULL != strchr("_-./ ", *name) ? *name : '?'), out);
+    }
+}
+
+static void write_string(FILE *out, const char *string)
+{
+    fputc('"', out);
+    for (; '\0' != *string; ++string)
+    {
+        if ('"' == *string || '\\' == *string)
+        {
+            fprintf(out, "\\%c", *string);
+        }
+        else if (isprint((unsigned char)*string) && '?' != *string)
+        {
+            fputc(*string, out);
+        }
+        else
+        {
+            fprintf(out, "\\%03o", (unsigned char)*string);
+        }
+    }
+    fputc('"', out);
+}
+
+static void emit(aot_translator_t *translator, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    vfprintf(translator->statements, format, args);
+    va_end(args);
+}
+
+/* the suffix of the variable of slot for a value of type, which is then declared */
+static char use_slot(aot_translator_t *translator, int slot, int type)
+{
+    translator->used_slots[slot] |= (unsigned char)(1 << (strchr(AOT_SUFFIXES, get_type_suffix(type)) - AOT_SUFFIXES));
+
+    return get_type_suffix(type);
+}
+
+static const unsigned char *get_types(const aot_translator_t *translator, unsigned int ip)
+{
+    return &translator->types[(size_t)(ip - translator->start) * translator->max_depth];
+}
+
+static int get_local_type(const vm_method_meta_t *method, int index)
+{
+    return (index < method->num_params ? method->param_types[index] : method->local_types[index - method->num_params]);
+}
+
+static int is_local_load(enum opcodes opcode)
+{
+    switch (opcode)
+    {
+        case OP_ILOAD:
+        case OP_SLOAD:
+        case OP_RLOAD:
+        case OP_LLOAD:
+        case OP_FLOAD:
+        case OP_DLOAD:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static const char *get_c_type(int type)
+{
+    switch (type)
+    {
+        case VM_TYPE_INTEGER:
+            return "int";
+        case VM_TYPE_LONG:
+            return "long";
+        case VM_TYPE_FLOAT:
+            return "float";
+        case VM_TYPE_DOUBLE:
+            return "double";
+        default:
+            return "vm_value_t";
+    }
+}
+
+/* strings, references and the other types stay values */
+static char get_type_suffix(int type)
+{
+    switch (type)
+    {
+        case VM_TYPE_INTEGER:
+            return 'i';
+        case VM_TYPE_LONG:
+            return 'l';
+        case VM_TYPE_FLOAT:
+            return 'f';
+        case VM_TYPE_DOUBLE:
+            return 'd';
+        default:
+            return 'v';
+    }
+}
+
+static const char *get_make_value(int type)
+{
+    switch (type)
+    {
+        case VM_TYPE_INTEGER:
+            return "make_integer_value";
+        case VM_TYPE_LONG:
+            return "make_long_value";
+        case VM_TYPE_FLOAT:
+            return "make_float_value";
+        default:
+            return "make_double_value";
+    }
+}
+
+static const char *get_value_getter(int type)
+{
+    switch (type)
+    {
+        case VM_TYPE_INTEGER:
+            return "get_integer_value";
+        case VM_TYPE_LONG:
+            return "get_long_value";
+        case VM_TYPE_FLOAT:
+            return "get_float_value";
+        default:
+            return "get_double_value";
+    }
+}
+
+static void free_translator(aot_translator_t *translator)
+{
+    if (NULL != translator->body)
+    {
+        fclose(translator->body);
+    }
+    free(translator->body_text);
+    free(translator->methods);
+    free(translator->types);
+    free(translator->is_target);
+    free(translator->worklist);
+    free(translator->used_slots);
+    free(translator->used_locals);
+}
@@ -0,0 +1,559 @@
+#include <assert.h>    /* assert       */
+#include <pthread.h>   /* pthread_once */
+#include <stdio.h>     /* fprintf      */
+#include <string.h>    /* memset       */
+
+#include "vm_impl.h"   /* private vm header */
+#include "vm_util.h"   /* utility functions */
+#include "vm_array.h"  /* arrays            */
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#include <immintrin.h> /* sse2 and avx2 intrinsics */
+#define HAS_X86_KERNELS 1 // sse2 is part of x86-64, avx2 is detected when the kernels are picked
+#else
+#define HAS_X86_KERNELS 0
+#endif
+
+/*
+* The kernels of the arithmetic bulk operations. Integer arithmetic wraps
+* around like iadd and imult, so the kernels compute in unsigned integers.
+* Fill and copy need no kernels, memset and memmove are vectorized already.
+*/
+typedef struct array_kernels
+{
+    int (*sum)(const int *elements, size_t length);
+    int (*dot)(const int *left, const int *right, size_t length);
+    void (*add)(int *destination, const int *left, const int *right, size_t length);
+} array_kernels_t;
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+static array_kernels_t kernels;
+
+static void pick_kernels(void);
+static vm_object_t *get_element(vm_t *instance, const char *name, enum vm_types type, vm_value_t array, int index);
+static int check_range(vm_t *instance, const char *name, const vm_object_t *array, int index, int count);
+static int get_same_length(vm_t *instance, const char *name, const vm_object_t *left, const vm_object_t *right);
+
+static int sum_scalar(const int *elements, size_t length);
+static int dot_scalar(const int *left, const int *right, size_t length);
+static void add_scalar(int *destination, const int *left, const int *right, size_t length);
+
+#if HAS_X86_KERNELS
+static int sum_sse2(const int *elements, size_t length);
+static int dot_sse2(const int *left, const int *right, size_t length);
+static void add_sse2(int *destination, const int *left, const int *right, size_t length);
+static int sum_avx2(const int *elements, size_t length);
+static int dot_avx2(const int *left, const int *right, size_t length);
+static void add_avx2(int *destination, const int *left, const int *right, size_t length);
+#endif
+
+vm_object_t *get_array(vm_t *instance, const char *name, vm_value_t reference, enum vm_types type)
+{
+    vm_object_t *array = NULL;
+
+    assert(instance && name);
+
+    array = (vm_object_t *)get_reference_value(reference);
+    if (NULL == array)
+    {
+        report_error(instance, "[%s] failed, null reference!\n", name);
+
+        return NULL;
+    }
+
+    if (0 == array->element_type)
+    {
+        report_error(instance, "[%s] failed, the reference is to an object!\n", name);
+
+        return NULL;
+    }
+
+    if (0 != type && type != array->element_type)
+    {
+        report_error(instance, "[%s] failed, the array is of type: %s\n",
+            name, get_type_name((enum vm_types)array->element_type));
+
+        return NULL;
+    }
+
+    return array;
+}
+
+int new_array(vm_t *instance, enum vm_types type, int length, vm_value_t *result)
+{
+    vm_object_t *array = NULL;
+
+    assert(instance && result);
+
+    if (0 == get_array_element_size(type))
+    {
+        report_error(instance, "[newarray] failed, an array can not hold elements of type: %d\n", type);
+
+        return -1;
+    }
+
+    if (length < 0)
+    {
+        report_error(instance, "[newarray] failed, negative length: %d\n", length);
+
+        return -1;
+    }
+
+    array = allocate_array(instance, type, (unsigned int)length);
+    if (NULL == array)
+    {
+        report_error(instance, "[newarray] failed, out of heap memory!\n");
+
+        return -1;
+    }
+
+    *result = make_reference_value(array);
+
+    return 0;
+}
+
+int get_array_length(vm_t *instance, vm_value_t array, vm_value_t *result)
+{
+    vm_object_t *object = get_array(instance, "alen", array, 0);
+
+    assert(result);
+
+    if (NULL == object)
+    {
+        return -1;
+    }
+
+    *result = make_integer_value((int)object->num_fields);
+
+    return 0;
+}
+
+int load_element(vm_t *instance, const char *name, enum vm_types type, vm_value_t array, int index, vm_value_t *result)
+{
+    vm_object_t *object = get_element(instance, name, type, array, index);
+    void *elements = NULL;
+
+    assert(result);
+
+    if (NULL == object)
+    {
+        return -1;
+    }
+
+    elements = get_array_elements(object);
+
+    switch (type)
+    {
+        case VM_TYPE_BYTE:
+            *result = make_integer_value(((signed char *)elements)[index]);
+            break;
+        case VM_TYPE_INTEGER:
+            *result = make_integer_value(((int *)elements)[index]);
+            break;
+        case VM_TYPE_LONG:
+            *result = make_long_value(((long *)elements)[index]);
+            break;
+        case VM_TYPE_FLOAT:
+            *result = make_float_value(((float *)elements)[index]);
+            break;
+        default:
+            *result = make_double_value(((double *)elements)[index]);
+            break;
+    }
+
+    return 0;
+}
+
+int store_element(vm_t *instance, const char *name, enum vm_types type, vm_value_t array, int index, vm_value_t value)
+{
+    vm_object_t *object = get_element(instance, name, type, array, index);
+    void *elements = NULL;
+
+    if (NULL == object)
+    {
+        return -1;
+    }
+
+    elements = get_array_elements(object);
+
+    switch (type)
+    {
+        case VM_TYPE_BYTE:
+            ((signed char *)elements)[index] = (signed char)get_integer_value(value);
+            break;
+        case VM_TYPE_INTEGER:
+            ((int *)elements)[index] = get_integer_value(value);
+            break;
+        case VM_TYPE_LONG:
+            ((long *)elements)[index] = get_long_value(value);
+            break;
+        case VM_TYPE_FLOAT:
+            ((float *)elements)[index] = get_float_value(value);
+            break;
+        default:
+            ((double *)elements)[index] = get_double_value(value);
+            break;
+    }
+
+    return 0;
+}
+
+int fill_array(vm_t *instance, vm_value_t array, int value)
+{
+    vm_object_t *object = get_array(instance, "afill", array, 0);
+    void *elements = NULL;
+
+    if (NULL == object)
+    {
+        return -1;
+    }
+
+    elements = get_array_elements(object);
+
+    switch (object->element_type)
+    {
+        case VM_TYPE_BYTE:
+            memset(elements, (unsigned char)value, object->num_fields);
+            break;
+        case VM_TYPE_INTEGER:
+            for (unsigned int i = 0; i < object->num_fields; ++i)
+            {
+                ((int *)elements)[i] = value;
+            }
+            break;
+        case VM_TYPE_LONG:
+            for (unsigned int i = 0; i < object->num_fields; ++i)
+            {
+                ((long *)elements)[i] = value;
+            }
+            break;
+        case VM_TYPE_FLOAT:
+            for (unsigned int i = 0; i < object->num_fields; ++i)
+            {
+                ((float *)elements)[i] = (float)value;
+            }
+            break;
+        default:
+            for (unsigned int i = 0; i < object->num_fields; ++i)
+            {
+                ((double *)elements)[i] = value;
+            }
+            break;
+    }
+
+    return 0;
+}
+
+/* the ranges may overlap when both are in the same array */
+int copy_array(vm_t *instance, vm_value_t source, int source_index, vm_value_t destination, int destination_index, int count)
+{
+    vm_object_t *from = get_array(instance, "acopy", source, 0);
+    vm_object_t *to = NULL;
+    size_t element_size = 0;
+
+    if (NULL == from)
+    {
+        return -1;
+    }
+
+    to = get_array(instance, "acopy", destination, (enum vm_types)from->element_type);
+    if (NULL == to)
+    {
+        return -1;
+    }
+
+    if (0 != check_range(instance, "acopy", from, source_index, count) ||
+        0 != check_range(instance, "acopy", to, destination_index, count))
+    {
+        return -1;
+    }
+
+    element_size = get_array_element_size((enum vm_types)from->element_type);
+    memmove((char *)get_array_elements(to) + element_size * destination_index,
+            (char *)get_array_elements(from) + element_size * source_index,
+            element_size * count);
+
+    return 0;
+}
+
+int sum_array(vm_t *instance, vm_value_t array, vm_value_t *result)
+{
+    vm_object_t *object = get_array(instance, "asum", array, VM_TYPE_INTEGER);
+
+    assert(result);
+
+    if (NULL == object)
+    {
+        return -1;
+    }
+
+    pthread_once(&kernels_once, pick_kernels);
+    *result = make_integer_value(kernels.sum((const int *)get_array_elements(object), object->num_fields));
+
+    return 0;
+}
+
+int dot_arrays(vm_t *instance, vm_value_t left, vm_value_t right, vm_value_t *result)
+{
+    vm_object_t *first = NULL, *second = NULL;
+
+    assert(instance && result);
+
+    if (NULL == (first = get_array(instance, "adot", left, VM_TYPE_INTEGER)) ||
+        NULL == (second = get_array(instance, "adot", right, VM_TYPE_INTEGER)) ||
+        0 != get_same_length(instance, "adot", first, second))
+    {
+        return -1;
+    }
+
+    pthread_once(&kernels_once, pick_kernels);
+    *result = make_integer_value(kernels.dot((const int *)get_array_elements(first),
+                                             (const int *)get_array_elements(second),
+                                             first->num_fields));
+
+    return 0;
+}
+
+/* destination may be one of the operands */
+int add_arrays(vm_t *instance, vm_value_t left, vm_value_t right, vm_value_t destination)
+{
+    vm_object_t *first = NULL, *second = NULL, *sum = NULL;
+
+    assert(instance);
+
+    if (NULL == (first = get_array(instance, "aadd", left, VM_TYPE_INTEGER)) ||
+        NULL == (second = get_array(instance, "aadd", right, VM_TYPE_INTEGER)) ||
+        NULL == (sum = get_array(instance, "aadd", destination, VM_TYPE_INTEGER)) ||
+        0 != get_same_length(instance, "aadd", first, second) ||
+        0 != get_same_length(instance, "aadd", first, sum))
+    {
+        return -1;
+    }
+
+    pthread_once(&kernels_once, pick_kernels);
+    kernels.add((int *)get_array_elements(sum),
+                (const int *)get_array_elements(first),
+                (const int *)get_array_elements(second),
+                first->num_fields);
+
+    return 0;
+}
+
+/* STATIC FUNCTIONS */
+static void pick_kernels(void)
+{
+    kernels.sum = sum_scalar;
+    kernels.dot = dot_scalar;
+    kernels.add = add_scalar;
+
+#if HAS_X86_KERNELS
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernels.sum = sum_avx2;
+        kernels.dot = dot_avx2;
+        kernels.add = add_avx2;
+    }
+    else
+    {
+        kernels.sum = sum_sse2;
+        kernels.dot = dot_sse2;
+        kernels.add = add_sse2;
+    }
+#endif
+}
+
+static vm_object_t *get_element(vm_t *instance, const char *name, enum vm_types type, vm_value_t array, int index)
+{
+    vm_object_t *object = get_array(instance, name, array, type);
+
+    if (NULL == object)
+    {
+        return NULL;
+    }
+
+    if (index < 0 || (unsigned int)index >= object->num_fields)
+    {
+        report_error(instance, "[%s] failed, index %d is out of bounds of an array of %u elements!\n",
+            name, index, object->num_fields);
+
+        return NULL;
+    }
+
+    return object;
+}
+
+static int check_range(vm_t *instance, const char *name, const vm_object_t *array, int index, int count)
+{
+    if (index < 0 || count < 0 || (unsigned long)index + (unsigned long)count > array->num_fields)
+    {
+        report_error(instance, "[%s] failed, %d elements from index %d are out of bounds of an array of %u elements!\n",
+            name, count, index, array->num_fields);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int get_same_length(vm_t *instance, const char *name, const vm_object_t *left, const vm_object_t *right)
+{
+    if (left->num_fields != right->num_fields)
+    {
+        report_error(instance, "[%s] failed, the arrays have different lengths: %u and %u\n",
+            name, left->num_fields, right->num_fields);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int sum_scalar(const int *elements, size_t length)
+{
+    unsigned int sum = 0;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        sum += (unsigned int)elements[i];
+    }
+
+    return (int)sum;
+}
+
+static int dot_scalar(const int *left, const int *right, size_t length)
+{
+    unsigned int dot = 0;
+
+    for (size_t i = 0; i < length; ++i)
+    {
+        dot += (unsigned int)left[i] * (unsigned int)right[i];
+    }
+
+    return (int)dot;
+}
+
+static void add_scalar(int *destination, const int *left, const int *right, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        destination[i] = (int)((unsigned int)left[i] + (unsigned int)right[i]);
+    }
+}
+
+#if HAS_X86_KERNELS
+/* the elements are only aligned to OBJECT_ALIGNMENT, every load and store is unaligned */
+static int sum_sse2(const int *elements, size_t length)
+{
+    __m128i sum = _mm_setzero_si128();
+    unsigned int lanes[4];
+    size_t i = 0;
+
+    for (; i + 4 <= length; i += 4)
+    {
+        sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i *)(elements + i)));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, sum);
+
+    return (int)((unsigned int)sum_scalar(elements + i, length - i) + lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+}
+
+/* sse2 has no 32-bit multiply, the even and the odd lanes are multiplied to 64 bits, whose low halves are the products */
+static int dot_sse2(const int *left, const int *right, size_t length)
+{
+    __m128i dot = _mm_setzero_si128();
+    unsigned long long lanes[2];
+    size_t i = 0;
+
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(left + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(right + i));
+
+        dot = _mm_add_epi64(dot, _mm_mul_epu32(a, b));
+        dot = _mm_add_epi64(dot, _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)));
+    }
+
+    _mm_storeu_si128((__m128i *)lanes, dot);
+
+    return (int)((unsigned int)dot_scalar(left + i, right + i, length - i) + (unsigned int)(lanes[0] + lanes[1]));
+}
+
+static void add_sse2(int *destination, const int *left, const int *right, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 4 <= length; i += 4)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(left + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(right + i));
+
+        _mm_storeu_si128((__m128i *)(destination + i), _mm_add_epi32(a, b));
+    }
+
+    add_scalar(destination + i, left + i, right + i, length - i);
+}
+
+/* two accumulators, so consecutive additions do not wait on each other */
+__attribute__((target("avx2")))
+static int sum_avx2(const int *elements, size_t length)
+{
+    __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+    unsigned int lanes[8], sum = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        sum0 = _mm256_add_epi32(sum0, _mm256_loadu_si256((const __m256i *)(elements + i)));
+        sum1 = _mm256_add_epi32(sum1, _mm256_loadu_si256((const __m256i *)(elements + i + 8)));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(sum0, sum1));
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        sum += lanes[lane];
+    }
+
+    return (int)(sum + (unsigned int)sum_scalar(elements + i, length - i));
+}
+
+__attribute__((target("avx2")))
+static int dot_avx2(const int *left, const int *right, size_t length)
+{
+    __m256i dot0 = _mm256_setzero_si256(), dot1 = _mm256_setzero_si256();
+    unsigned int lanes[8], dot = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16)
+    {
+        dot0 = _mm256_add_epi32(dot0, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(left + i)),
+                                                         _mm256_loadu_si256((const __m256i *)(right + i))));
+        dot1 = _mm256_add_epi32(dot1, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(left + i + 8)),
+                                                         _mm256_loadu_si256((const __m256i *)(right + i + 8))));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(dot0, dot1));
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        dot += lanes[lane];
+    }
+
+    return (int)(dot + (unsigned int)dot_scalar(left + i, right + i, length - i));
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(int *destination, const int *left, const int *right, size_t length)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(left + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(right + i));
+
+        _mm256_storeu_si256((__m256i *)(destination + i), _mm256_add_epi32(a, b));
+    }
+
+    add_scalar(destination + i, left + i, right + i, length - i);
+}
+#endif
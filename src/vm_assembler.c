@@ -0,0 +1,2235 @@
+#include <assert.h>    /* assert       */
+#include <fcntl.h>     /* open         */
+#include <math.h>      /* isnan        */
+#include <pthread.h>   /* pthread_once */
+#include <stdarg.h>    /* va_list      */
+#include <stdint.h>    /* uint32_t     */
+#include <stdlib.h>    /* malloc       */
+#include <string.h>    /* memcpy       */
+#include <sys/stat.h>  /* fstat        */
+#include <unistd.h>    /* read         */
+
+#include "opcodes.h"    /* opcodes         */
+#include "vm_value.h"   /* vm_types        */
+#include "vm_numeric.h" /* integer folding */
+#include "vm_loader.h"  /* v2 file layout  */
+#include "vm_dense.h"   /* dense encoding  */
+
+#include "vm_assembler.h" /* public assembler header */
+
+/*
+* A port of bytecode_compiler/src/Compiler.java. The source is split into
+* whitespace separated tokens like the compiler's SourceScanner does, with
+* the lines counted the same way, so the debug lines and the error messages
+* match too. Tokens point into the source, nothing is copied while parsing.
+* The code of a method is kept until its end, when all of its labels are
+* known, and the sections are laid out in a single image at the end.
+* A call followed by a return of what the callee returns is written as a
+* tailcall once every method's returns are known, see mark_tail_calls.
+* With VM_ASSEMBLE_OPTIMIZE a method's code goes through the port of
+* Optimizer.java before it's written, see optimize_method.
+*/
+
+#define ASM_MAX_TYPES 9 // a type list is a digit and that many type identifiers
+
+typedef struct asm_token
+{
+    const char *text;
+    size_t length;
+} asm_token_t;
+
+typedef struct asm_buffer
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    int failed; // an append could not grow it, reported once the source is read
+} asm_buffer_t;
+
+enum asm_operand
+{
+    ASM_NO_OPERAND,
+    ASM_INTEGER, // a decimal int
+    ASM_BRANCH,  // a label or the index of an instruction
+    ASM_TABLE,   // the targets up to the end of the line, each one becomes a goto
+    ASM_COMMENT  // @, the rest of the line is skipped
+};
+
+typedef struct asm_mnemonic
+{
+    const char *name;
+    int opcode;
+    enum asm_operand operand;
+} asm_mnemonic_t;
+
+typedef struct asm_instruction
+{
+    int opcode;
+    int arg;
+    asm_token_t label; // of a branch to a label, a NULL text when arg is the target
+    unsigned int line; // in the source, for the debug section
+    int target;        // of a branch, the pending index it continues at, -1 if it leaves the method
+    int replaced_by;   // what stands in its place once the optimizer removed it, -1 while it's in the code
+    int is_target;     // some branch continues here
+    unsigned int index; // in the code section, set when the method is written
+} asm_instruction_t;
+
+typedef struct asm_method
+{
+    asm_token_t name;
+    vm_file_method_t entry;
+    uint32_t dense_offset;
+    int has_code; // its label was found
+    unsigned int returns; // the kinds of return in its code, see get_return_bit
+} asm_method_t;
+
+/* a call followed by a return, a tailcall if the callee returns the same */
+typedef struct asm_tail_call
+{
+    size_t position; // of its opcode in the code
+    int constant;
+    int return_opcode;
+} asm_tail_call_t;
+
+/* the -O pass over the code of one method, see optimize_method */
+typedef struct asm_optimizer
+{
+    asm_instruction_t *instructions; // the pending ones, a branch target is an index of them
+    int end;                         // the index that stands for the first instruction after the method
+    unsigned int *code;              // the indices of the instructions left, in order
+    unsigned int size;
+    int *positions;                  // in code of every instruction, -1 once it's removed
+    uint64_t *live_in;               // num_words per instruction left, the locals read from it on
+    uint64_t *live_out;              // the locals read after it, on some path
+    unsigned int num_words;          // of a set of locals
+} asm_optimizer_t;
+
+/* open addressing, a slot with a NULL name is free */
+typedef struct asm_name
+{
+    asm_token_t name;
+    int value;
+} asm_name_t;
+
+typedef struct asm_names
+{
+    asm_name_t *slots;
+    unsigned int capacity; // a power of 2
+    unsigned int count;
+} asm_names_t;
+
+typedef struct assembler
+{
+    const char *source_name;
+    unsigned int flags;
+    FILE *err;
+
+    const char *cur; // the next character of the source
+    const char *end;
+    unsigned int line; // of cur, from 1
+
+    vm_file_constant_t *constants;
+    unsigned int num_constants;
+    asm_method_t *methods; // in the order of the method table
+    unsigned int num_methods;
+    asm_names_t method_names; // the index of the last method of every name
+    asm_method_t *current_method;
+
+    asm_names_t labels; // of the current method, to the index of their instruction in pending
+    asm_instruction_t *pending;
+    unsigned int *order; // the pending instructions written, in order, see optimize_method
+    unsigned int num_pending;
+    unsigned int pending_capacity;
+    unsigned int num_instructions; // read so far, written ones included
+    unsigned int num_written; // the same as num_instructions unless the optimizer removed some
+    unsigned int current_line;
+    unsigned int last_line; // of the last debug line entry
+
+    asm_buffer_t strings;
+    asm_buffer_t code; // fixed-width or dense, see VM_ASSEMBLE_FIXED_WIDTH
+    asm_buffer_t debug_lines;
+    asm_buffer_t tail_calls; // asm_tail_call_t entries
+    asm_buffer_t report; // a line per optimized method, see VM_ASSEMBLE_OPTIMIZE
+} assembler_t;
+
+/* the opcodes of the compiler's initOpcodes, sorted by name once for lookups */
+static const asm_mnemonic_t mnemonics[] =
+{
+    { "@",           0xFF,            ASM_COMMENT },
+
+    /* special operations */
+    { "noop",        OP_NOOP,         ASM_NO_OPERAND },
+    { "halt",        OP_HALT,         ASM_INTEGER },
+    { "stop",        OP_STOP,         ASM_NO_OPERAND },
+    { "pop",         OP_POP,          ASM_NO_OPERAND },
+    { "call",        OP_CALL,         ASM_INTEGER },
+    { "tailcall",    OP_TAILCALL,     ASM_INTEGER },
+    { "ret",         OP_RET,          ASM_NO_OPERAND },
+    { "flush",       OP_FLUSH,        ASM_NO_OPERAND },
+
+    /* integer operations */
+    { "iload",       OP_ILOAD,        ASM_INTEGER },
+    { "istore",      OP_ISTORE,       ASM_INTEGER },
+    { "ipush",       OP_IPUSH,        ASM_INTEGER },
+    { "iadd",        OP_IADD,         ASM_NO_OPERAND },
+    { "isub",        OP_ISUB,         ASM_NO_OPERAND },
+    { "imult",       OP_IMULT,        ASM_NO_OPERAND },
+    { "idiv",        OP_IDIV,         ASM_NO_OPERAND },
+    { "ineg",        OP_INEG,         ASM_NO_OPERAND },
+    { "iprint",      OP_IPRINT,       ASM_NO_OPERAND },
+    { "iret",        OP_IRET,         ASM_NO_OPERAND },
+
+    /* control flow */
+    { "goto",        OP_GOTO,         ASM_BRANCH },
+    { "ifeq",        OP_IFEQ,         ASM_BRANCH },
+    { "ifne",        OP_IFNE,         ASM_BRANCH },
+    { "if_icmpeq",   OP_IF_ICMPEQ,    ASM_BRANCH },
+    { "if_icmpne",   OP_IF_ICMPNE,    ASM_BRANCH },
+    { "if_icmplt",   OP_IF_ICMPLT,    ASM_BRANCH },
+    { "if_icmpge",   OP_IF_ICMPGE,    ASM_BRANCH },
+    { "if_icmpgt",   OP_IF_ICMPGT,    ASM_BRANCH },
+    { "if_icmple",   OP_IF_ICMPLE,    ASM_BRANCH },
+    { "tableswitch", OP_TABLESWITCH,  ASM_TABLE },
+
+    /* string operations */
+    { "sload",       OP_SLOAD,        ASM_INTEGER },
+    { "sstore",      OP_SSTORE,       ASM_INTEGER },
+    { "sprint",      OP_SPRINT,       ASM_NO_OPERAND },
+    { "sret",        OP_SRET,         ASM_NO_OPERAND },
+
+    /* reference operations */
+    { "rload",       OP_RLOAD,        ASM_INTEGER },
+    { "rstore",      OP_RSTORE,       ASM_INTEGER },
+    { "rnull",       OP_RNULL,        ASM_NO_OPERAND },
+    { "rret",        OP_RRET,         ASM_NO_OPERAND },
+    { "new",         OP_NEW,          ASM_INTEGER },
+    { "igetfield",   OP_IGETFIELD,    ASM_INTEGER },
+    { "iputfield",   OP_IPUTFIELD,    ASM_INTEGER },
+    { "sgetfield",   OP_SGETFIELD,    ASM_INTEGER },
+    { "sputfield",   OP_SPUTFIELD,    ASM_INTEGER },
+    { "rgetfield",   OP_RGETFIELD,    ASM_INTEGER },
+    { "rputfield",   OP_RPUTFIELD,    ASM_INTEGER },
+
+    /* constant pool operations */
+    { "cload",       OP_CLOAD,        ASM_INTEGER },
+
+    /* array operations */
+    { "newarray",    OP_NEWARRAY,     ASM_INTEGER },
+    { "alen",        OP_ALEN,         ASM_NO_OPERAND },
+    { "baload",      OP_BALOAD,       ASM_NO_OPERAND },
+    { "bastore",     OP_BASTORE,      ASM_NO_OPERAND },
+    { "iaload",      OP_IALOAD,       ASM_NO_OPERAND },
+    { "iastore",     OP_IASTORE,      ASM_NO_OPERAND },
+    { "afill",       OP_AFILL,        ASM_NO_OPERAND },
+    { "acopy",       OP_ACOPY,        ASM_NO_OPERAND },
+    { "asum",        OP_ASUM,         ASM_NO_OPERAND },
+    { "adot",        OP_ADOT,         ASM_NO_OPERAND },
+    { "aadd",        OP_AADD,         ASM_NO_OPERAND },
+
+    /* long operations */
+    { "lload",       OP_LLOAD,        ASM_INTEGER },
+    { "lstore",      OP_LSTORE,       ASM_INTEGER },
+    { "lpush",       OP_LPUSH,        ASM_INTEGER },
+    { "ladd",        OP_LADD,         ASM_NO_OPERAND },
+    { "lsub",        OP_LSUB,         ASM_NO_OPERAND },
+    { "lmult",       OP_LMULT,        ASM_NO_OPERAND },
+    { "ldiv",        OP_LDIV,         ASM_NO_OPERAND },
+    { "lneg",        OP_LNEG,         ASM_NO_OPERAND },
+    { "lprint",      OP_LPRINT,       ASM_NO_OPERAND },
+    { "lret",        OP_LRET,         ASM_NO_OPERAND },
+    { "lcmp",        OP_LCMP,         ASM_NO_OPERAND },
+    { "laload",      OP_LALOAD,       ASM_NO_OPERAND },
+    { "lastore",     OP_LASTORE,      ASM_NO_OPERAND },
+
+    /* float operations */
+    { "fload",       OP_FLOAD,        ASM_INTEGER },
+    { "fstore",      OP_FSTORE,       ASM_INTEGER },
+    { "fpush",       OP_FPUSH,        ASM_INTEGER },
+    { "fadd",        OP_FADD,         ASM_NO_OPERAND },
+    { "fsub",        OP_FSUB,         ASM_NO_OPERAND },
+    { "fmult",       OP_FMULT,        ASM_NO_OPERAND },
+    { "fdiv",        OP_FDIV,         ASM_NO_OPERAND },
+    { "fneg",        OP_FNEG,         ASM_NO_OPERAND },
+    { "fprint",      OP_FPRINT,       ASM_NO_OPERAND },
+    { "fret",        OP_FRET,         ASM_NO_OPERAND },
+    { "fcmp",        OP_FCMP,         ASM_NO_OPERAND },
+    { "faload",      OP_FALOAD,       ASM_NO_OPERAND },
+    { "fastore",     OP_FASTORE,      ASM_NO_OPERAND },
+
+    /* double operations */
+    { "dload",       OP_DLOAD,        ASM_INTEGER },
+    { "dstore",      OP_DSTORE,       ASM_INTEGER },
+    { "dpush",       OP_DPUSH,        ASM_INTEGER },
+    { "dadd",        OP_DADD,         ASM_NO_OPERAND },
+    { "dsub",        OP_DSUB,         ASM_NO_OPERAND },
+    { "dmult",       OP_DMULT,        ASM_NO_OPERAND },
+    { "ddiv",        OP_DDIV,         ASM_NO_OPERAND },
+    { "dneg",        OP_DNEG,         ASM_NO_OPERAND },
+    { "dprint",      OP_DPRINT,       ASM_NO_OPERAND },
+    { "dret",        OP_DRET,         ASM_NO_OPERAND },
+    { "dcmp",        OP_DCMP,         ASM_NO_OPERAND },
+    { "daload",      OP_DALOAD,       ASM_NO_OPERAND },
+    { "dastore",     OP_DASTORE,      ASM_NO_OPERAND },
+    { "dsqrt",       OP_DSQRT,        ASM_NO_OPERAND },
+
+    /* conversions */
+    { "i2l",         OP_I2L,          ASM_NO_OPERAND },
+    { "i2f",         OP_I2F,          ASM_NO_OPERAND },
+    { "i2d",         OP_I2D,          ASM_NO_OPERAND },
+    { "l2i",         OP_L2I,          ASM_NO_OPERAND },
+    { "l2f",         OP_L2F,          ASM_NO_OPERAND },
+    { "l2d",         OP_L2D,          ASM_NO_OPERAND },
+    { "f2i",         OP_F2I,          ASM_NO_OPERAND },
+    { "f2l",         OP_F2L,          ASM_NO_OPERAND },
+    { "f2d",         OP_F2D,          ASM_NO_OPERAND },
+    { "d2i",         OP_D2I,          ASM_NO_OPERAND },
+    { "d2l",         OP_D2L,          ASM_NO_OPERAND },
+    { "d2f",         OP_D2F,          ASM_NO_OPERAND },
+};
+
+#define NUM_MNEMONICS (sizeof(mnemonics) / sizeof(mnemonics[0]))
+
+static const asm_mnemonic_t *sorted_mnemonics[NUM_MNEMONICS];
+static pthread_once_t sort_mnemonics_once = PTHREAD_ONCE_INIT;
+
+static void report_asm_error(assembler_t *assembler, const char *format, ...) __attribute__((format(printf, 2, 3)));
+static int assemble_source(assembler_t *assembler);
+static int build_constant_pool(assembler_t *assembler);
+static int read_method_constant(assembler_t *assembler, vm_file_constant_t *constant);
+static int read_type_list(assembler_t *assembler, asm_token_t list, unsigned char *types, unsigned int *count);
+static int resolve_type(assembler_t *assembler, asm_token_t name);
+static int assemble_instruction(assembler_t *assembler, const asm_mnemonic_t *mnemonic);
+static int start_method(assembler_t *assembler, asm_method_t *method);
+static int end_method(assembler_t *assembler);
+static int add_label(assembler_t *assembler, asm_token_t label);
+static int add_instruction(assembler_t *assembler, int opcode, int arg, asm_token_t label);
+static int add_branch(assembler_t *assembler, int opcode, asm_token_t target);
+static int write_method_code(assembler_t *assembler);
+static int resolve_branches(assembler_t *assembler, unsigned int first);
+static void mark_tail_calls(assembler_t *assembler);
+static unsigned int get_return_bit(int opcode);
+static int optimize_method(assembler_t *assembler, unsigned int *count);
+static int fold_constants(asm_optimizer_t *optimizer);
+static int fold_binary(asm_optimizer_t *optimizer, unsigned int i, int a, int b, int opcode);
+static void fold_branch(asm_optimizer_t *optimizer, unsigned int i, unsigned int count, int taken);
+static int remove_dead_stores(asm_optimizer_t *optimizer);
+static int remove_neutral_code(asm_optimizer_t *optimizer);
+static int remove_neutral_code_at(asm_optimizer_t *optimizer, unsigned int i);
+static void compute_liveness(asm_optimizer_t *optimizer);
+static int merge_live(uint64_t *into, const uint64_t *from, unsigned int words);
+static int is_live_after(const asm_optimizer_t *optimizer, unsigned int i, int local);
+static void remove_code(asm_optimizer_t *optimizer, unsigned int i, unsigned int count);
+static int can_rewrite(const asm_optimizer_t *optimizer, unsigned int i, unsigned int count);
+static int is_in_table(const asm_optimizer_t *optimizer, unsigned int i);
+static unsigned int next_rewrite(const asm_optimizer_t *optimizer, unsigned int i);
+static asm_instruction_t *get_code(const asm_optimizer_t *optimizer, unsigned int i);
+static int resolve_target(const asm_instruction_t *instructions, int end, int index);
+static int is_branch(int opcode);
+static int is_load(int opcode);
+static int is_store(int opcode);
+static int is_push(int opcode);
+static int is_return(int opcode);
+static int write_image(assembler_t *assembler, unsigned char **image, size_t *image_size);
+static void free_assembler(assembler_t *assembler);
+static int has_next_token(assembler_t *assembler);
+static int next_token(assembler_t *assembler, asm_token_t *token);
+static int next_int(assembler_t *assembler, int *value);
+static asm_token_t next_line(assembler_t *assembler);
+static asm_token_t trim_token(asm_token_t token);
+static int parse_integer(asm_token_t token, int64_t min, int64_t max, int64_t *value);
+static int parse_floating(asm_token_t token, int is_float, double *value);
+static int is_java_floating(const char *text);
+static const asm_mnemonic_t *find_mnemonic(asm_token_t name);
+static void sort_mnemonics(void);
+static int compare_mnemonics(const void *a, const void *b);
+static int compare_token(asm_token_t token, const char *name);
+static unsigned int hash_name(asm_token_t name);
+static asm_name_t *find_slot(const asm_names_t *names, asm_token_t name);
+static int *find_name(const asm_names_t *names, asm_token_t name);
+static int put_name(asm_names_t *names, asm_token_t name, int value, int *replaced);
+static void clear_names(asm_names_t *names);
+static void append_bytes(asm_buffer_t *buffer, const void *data, size_t size);
+static void append_int(asm_buffer_t *buffer, uint32_t value);
+static int is_line_space(int c);
+static size_t align_size(size_t size);
+
+int vm_assemble(const char *source,
+                size_t source_size,
+                const char *source_name,
+                unsigned int flags,
+                FILE *err,
+                unsigned char **image,
+                size_t *image_size)
+{
+    assembler_t assembler = {0};
+    int res = 0;
+
+    assert(source && source_name && err && image && image_size);
+
+    pthread_once(&sort_mnemonics_once, sort_mnemonics);
+
+    *image = NULL;
+    *image_size = 0;
+
+    assembler.source_name = source_name;
+    assembler.flags = flags;
+    assembler.err = err;
+    assembler.cur = source;
+    assembler.end = source + source_size;
+    assembler.line = 1;
+
+    res = assemble_source(&assembler);
+    if (0 == res)
+    {
+        res = write_image(&assembler, image, image_size);
+    }
+    if (0 == res && 0 != assembler.report.size)
+    {
+        fwrite(assembler.report.data, 1, assembler.report.size, err);
+    }
+    free_assembler(&assembler);
+
+    return res;
+}
+
+int vm_assemble_file(const char *input_path, const char *output_path, unsigned int flags, FILE *err)
+{
+    struct stat file_stat = {0};
+    unsigned char *image = NULL;
+    char *source = NULL;
+    size_t image_size = 0, size = 0;
+    ssize_t count = 0;
+    int fd = -1, res = 0;
+
+    assert(input_path && output_path && err);
+
+    fd = open(input_path, O_RDONLY);
+    if (-1 == fd || 0 != fstat(fd, &file_stat))
+    {
+        fprintf(err, "file not found: %s\n", input_path);
+        if (-1 != fd)
+        {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    source = (char *)malloc(file_stat.st_size + 1);
+    while (NULL != source && size < (size_t)file_stat.st_size &&
+           0 < (count = read(fd, source + size, file_stat.st_size - size)))
+    {
+        size += count;
+    }
+    close(fd);
+
+    if (NULL == source || size < (size_t)file_stat.st_size)
+    {
+        fprintf(err, "could not read file: %s\n", input_path);
+        free(source);
+
+        return -1;
+    }
+
+    res = vm_assemble(source, size, input_path, flags, err, &image, &image_size);
+    free(source);
+    if (0 != res)
+    {
+        return -1;
+    }
+
+    fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (-1 == fd)
+    {
+        fprintf(err, "invalid file name: %s\n", output_path);
+        free(image);
+
+        return -1;
+    }
+
+    // the whole image at once, the loop only runs again on a short write
+    for (size = 0; size < image_size; size += count)
+    {
+        count = write(fd, image + size, image_size - size);
+        if (count <= 0)
+        {
+            fprintf(err, "could not write file: %s\n", output_path);
+            res = -1;
+            break;
+        }
+    }
+
+    close(fd);
+    free(image);
+
+    return res;
+}
+
+/* STATIC FUNCTIONS */
+
+static void report_asm_error(assembler_t *assembler, const char *format, ...)
+{
+    va_list args;
+
+    assert(assembler && assembler->err);
+
+    va_start(args, format);
+    vfprintf(assembler->err, format, args);
+    va_end(args);
+    fputc('\n', assembler->err);
+}
+
+static int assemble_source(assembler_t *assembler)
+{
+    asm_token_t token = {0}, name = {0};
+    const asm_mnemonic_t *mnemonic = NULL;
+    int *method_index = NULL;
+
+    assert(assembler);
+
+    if (0 != build_constant_pool(assembler))
+    {
+        return -1;
+    }
+
+    while (has_next_token(assembler))
+    {
+        next_token(assembler, &token);
+
+        mnemonic = find_mnemonic(token);
+        if (NULL != mnemonic)
+        {
+            assembler->current_line = assembler->line;
+            if (0 != assemble_instruction(assembler, mnemonic))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        // a method or a branch label, anything else is an unknown opcode
+        if (NULL == memchr(token.text, ':', token.length))
+        {
+            report_asm_error(assembler, "unknown opcode: %.*s at line %u",
+                (int)token.length, token.text, assembler->line);
+
+            return -1;
+        }
+
+        name.text = token.text;
+        name.length = token.length - 1;
+
+        method_index = find_name(&assembler->method_names, name);
+        if (0 != (NULL != method_index ?
+                  start_method(assembler, &assembler->methods[*method_index]) :
+                  add_label(assembler, name)))
+        {
+            return -1;
+        }
+    }
+
+    if (0 != end_method(assembler))
+    {
+        return -1;
+    }
+
+    mark_tail_calls(assembler);
+
+    for (unsigned int i = 0; i < assembler->num_methods; ++i)
+    {
+        if (!assembler->methods[i].has_code)
+        {
+            report_asm_error(assembler, "method: '%.*s' has no code, file: %s",
+                (int)assembler->methods[i].name.length, assembler->methods[i].name.text, assembler->source_name);
+
+            return -1;
+        }
+    }
+
+    if (assembler->strings.failed || assembler->code.failed || assembler->debug_lines.failed ||
+        assembler->tail_calls.failed || assembler->report.failed)
+    {
+        report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int build_constant_pool(assembler_t *assembler)
+{
+    asm_token_t token = { "", 0 };
+    vm_file_constant_t *constant = NULL;
+    unsigned int line = 0;
+    int64_t size = 0, integer = 0;
+    double number = 0;
+    float single = 0;
+    int type = 0, value = 0;
+
+    assert(assembler);
+
+    if (has_next_token(assembler))
+    {
+        next_token(assembler, &token);
+    }
+
+    if (0 != compare_token(token, "const"))
+    {
+        report_asm_error(assembler, "no constant pool was found in: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    if (!has_next_token(assembler) || 0 != next_token(assembler, &token) ||
+        0 != parse_integer(token, INT32_MIN, INT32_MAX, &size))
+    {
+        report_asm_error(assembler, "missing constant pool size in: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    if (size > 0)
+    {
+        assembler->constants = (vm_file_constant_t *)calloc(size, sizeof(vm_file_constant_t));
+        assembler->methods = (asm_method_t *)calloc(size, sizeof(asm_method_t));
+        if (NULL == assembler->constants || NULL == assembler->methods)
+        {
+            report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+
+            return -1;
+        }
+    }
+
+    for (int64_t i = 0; i < size; ++i)
+    {
+        constant = &assembler->constants[assembler->num_constants++];
+
+        if (0 != next_token(assembler, &token) || -1 == (type = resolve_type(assembler, token)))
+        {
+            return -1;
+        }
+        constant->type = (uint8_t)type;
+
+        switch (type)
+        {
+            case VM_TYPE_BYTE:
+            case VM_TYPE_INTEGER:
+                if (0 != next_int(assembler, &value))
+                {
+                    return -1;
+                }
+                constant->a = (VM_TYPE_BYTE == type ? (uint32_t)value & 0xFF : (uint32_t)value);
+                break;
+            case VM_TYPE_FLOAT:
+            case VM_TYPE_DOUBLE:
+                if (0 != next_token(assembler, &token) || 0 != parse_floating(token, VM_TYPE_FLOAT == type, &number))
+                {
+                    report_asm_error(assembler, "invalid number: '%.*s' at line %u, file: %s",
+                        (int)token.length, token.text, assembler->line, assembler->source_name);
+
+                    return -1;
+                }
+
+                // the bits of the value, every NaN is the one of floatToIntBits and doubleToLongBits
+                if (VM_TYPE_FLOAT == type)
+                {
+                    single = (float)number;
+                    memcpy(&constant->a, &single, sizeof(single));
+                    constant->a = (isnan(number) ? 0x7FC00000 : constant->a);
+                }
+                else
+                {
+                    memcpy(&integer, &number, sizeof(number));
+                    integer = (isnan(number) ? 0x7FF8000000000000LL : integer);
+                    constant->a = (uint32_t)integer;
+                    constant->b = (uint32_t)((uint64_t)integer >> 32);
+                }
+                break;
+            case VM_TYPE_LONG:
+                if (0 != next_token(assembler, &token) || 0 != parse_integer(token, INT64_MIN, INT64_MAX, &integer))
+                {
+                    report_asm_error(assembler, "invalid number: '%.*s' at line %u, file: %s",
+                        (int)token.length, token.text, assembler->line, assembler->source_name);
+
+                    return -1;
+                }
+                constant->a = (uint32_t)integer;
+                constant->b = (uint32_t)((uint64_t)integer >> 32);
+                break;
+            case VM_TYPE_STRING:
+                line = assembler->line;
+                token = trim_token(next_line(assembler));
+                if (token.length < 2)
+                {
+                    report_asm_error(assembler, "invalid string constant at line %u, file: %s",
+                        line, assembler->source_name);
+
+                    return -1;
+                }
+
+                // the text between the quotes, followed by a 0 so the VM can use it in place
+                constant->a = (uint32_t)assembler->strings.size;
+                constant->b = (uint32_t)(token.length - 2);
+                append_bytes(&assembler->strings, token.text + 1, token.length - 2);
+                append_bytes(&assembler->strings, "", 1);
+                break;
+            case VM_TYPE_METHOD:
+                if (0 != read_method_constant(assembler, constant))
+                {
+                    return -1;
+                }
+                break;
+            default:
+                break; // a reference, null
+        }
+    }
+
+    return 0;
+}
+
+/* M "name" return-type locals params, the params and then the locals go to the string blob */
+static int read_method_constant(assembler_t *assembler, vm_file_constant_t *constant)
+{
+    asm_method_t *method = NULL;
+    asm_token_t name = {0}, type = {0}, locals = {0}, params = {0};
+    unsigned char local_types[ASM_MAX_TYPES], param_types[ASM_MAX_TYPES];
+    unsigned int num_locals = 0, num_params = 0;
+    int return_type = 0, replaced = 0;
+
+    assert(assembler && constant);
+
+    if (0 != next_token(assembler, &name))
+    {
+        return -1;
+    }
+
+    if (name.length < 2)
+    {
+        report_asm_error(assembler, "invalid method name: %.*s at line %u, file: %s",
+            (int)name.length, name.text, assembler->line, assembler->source_name);
+
+        return -1;
+    }
+
+    method = &assembler->methods[assembler->num_methods];
+    method->name.text = name.text + 1; // clear ""
+    method->name.length = name.length - 2;
+    method->entry.name_offset = (uint32_t)assembler->strings.size;
+    method->entry.name_length = (uint32_t)method->name.length;
+    append_bytes(&assembler->strings, method->name.text, method->name.length);
+    append_bytes(&assembler->strings, "", 1);
+
+    if (0 != next_token(assembler, &type) || -1 == (return_type = resolve_type(assembler, type)) ||
+        0 != next_token(assembler, &locals) || 0 != next_token(assembler, &params) ||
+        0 != read_type_list(assembler, locals, local_types, &num_locals) ||
+        0 != read_type_list(assembler, params, param_types, &num_params))
+    {
+        return -1;
+    }
+
+    method->entry.return_type = (uint8_t)return_type;
+    method->entry.num_locals = (uint8_t)num_locals;
+    method->entry.num_params = (uint8_t)num_params;
+
+    // params first, then locals, the order of the frame
+    method->entry.types_offset = (uint32_t)assembler->strings.size;
+    append_bytes(&assembler->strings, param_types, num_params);
+    append_bytes(&assembler->strings, local_types, num_locals);
+
+    if (0 != put_name(&assembler->method_names, method->name, (int)assembler->num_methods, &replaced))
+    {
+        report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    constant->a = assembler->num_methods++;
+
+    return 0;
+}
+
+/* a count followed by that many type identifiers, "2IS" for an int and a string */
+static int read_type_list(assembler_t *assembler, asm_token_t list, unsigned char *types, unsigned int *count)
+{
+    asm_token_t name = {0};
+    int type = 0;
+
+    assert(assembler && types && count);
+
+    if (0 == list.length || list.text[0] < '0' || list.text[0] > '9' ||
+        list.length <= (size_t)(list.text[0] - '0'))
+    {
+        report_asm_error(assembler, "invalid type list: '%.*s' at line %u, file: %s",
+            (int)list.length, list.text, assembler->line, assembler->source_name);
+
+        return -1;
+    }
+
+    *count = list.text[0] - '0';
+    for (unsigned int i = 0; i < *count; ++i)
+    {
+        name.text = list.text + i + 1;
+        name.length = 1;
+        if (-1 == (type = resolve_type(assembler, name)))
+        {
+            return -1;
+        }
+        types[i] = (unsigned char)type;
+    }
+
+    return 0;
+}
+
+static int resolve_type(assembler_t *assembler, asm_token_t name)
+{
+    static const char identifiers[] = "BIFLDSRM"; // in the order of enum vm_types, from VM_TYPE_BYTE
+    const char *found = NULL;
+
+    assert(assembler);
+
+    if (1 == name.length && '\0' != name.text[0] && NULL != (found = strchr(identifiers, name.text[0])))
+    {
+        return (int)(found - identifiers) + VM_TYPE_BYTE;
+    }
+
+    report_asm_error(assembler, "unknown type: '%.*s' in file: %s",
+        (int)name.length, name.text, assembler->source_name);
+
+    return -1;
+}
+
+static int assemble_instruction(assembler_t *assembler, const asm_mnemonic_t *mnemonic)
+{
+    asm_token_t operand = {0}, targets = {0}, none = {0};
+    const char *comment = NULL;
+    int arg = 0, count = 0;
+
+    assert(assembler && mnemonic);
+
+    switch (mnemonic->operand)
+    {
+        case ASM_NO_OPERAND:
+            return add_instruction(assembler, mnemonic->opcode, 0, none);
+        case ASM_INTEGER:
+            if (0 != next_int(assembler, &arg))
+            {
+                return -1;
+            }
+
+            return add_instruction(assembler, mnemonic->opcode, arg, none);
+        case ASM_BRANCH:
+            if (0 != next_token(assembler, &operand))
+            {
+                return -1;
+            }
+
+            return add_branch(assembler, mnemonic->opcode, operand);
+        case ASM_TABLE:
+            // "tableswitch L0 L1 L2" becomes a tableswitch 3 followed by a goto to each target
+            targets = next_line(assembler);
+            comment = (const char *)memchr(targets.text, '@', targets.length);
+            if (NULL != comment)
+            {
+                targets.length = comment - targets.text;
+            }
+            targets = trim_token(targets);
+
+            for (size_t i = 0; i < targets.length; ++count)
+            {
+                while (i < targets.length && !is_line_space(targets.text[i]))
+                {
+                    ++i;
+                }
+                while (i < targets.length && is_line_space(targets.text[i]))
+                {
+                    ++i;
+                }
+            }
+
+            if (0 != add_instruction(assembler, mnemonic->opcode, count, none))
+            {
+                return -1;
+            }
+
+            while (0 < targets.length)
+            {
+                operand.text = targets.text;
+                for (operand.length = 0; operand.length < targets.length && !is_line_space(operand.text[operand.length]);)
+                {
+                    ++operand.length;
+                }
+                if (0 != add_branch(assembler, OP_GOTO, operand))
+                {
+                    return -1;
+                }
+                targets = trim_token((asm_token_t){ operand.text + operand.length, targets.length - operand.length });
+            }
+
+            return 0;
+        default:
+            next_line(assembler); // a comment
+
+            return 0;
+    }
+}
+
+static int start_method(assembler_t *assembler, asm_method_t *method)
+{
+    assert(assembler && method);
+
+    if (0 != end_method(assembler))
+    {
+        return -1;
+    }
+
+    method->has_code = 1;
+    method->entry.code_offset = assembler->num_written;
+    method->dense_offset = (uint32_t)assembler->code.size;
+    assembler->current_method = method;
+
+    return 0;
+}
+
+/* a method's code runs up to the next method label or the end of the source */
+static int end_method(assembler_t *assembler)
+{
+    asm_method_t *method = NULL;
+
+    assert(assembler);
+
+    method = assembler->current_method;
+    if (NULL != method && 0 == assembler->num_pending)
+    {
+        report_asm_error(assembler, "method: '%.*s' has no code, file: %s",
+            (int)method->name.length, method->name.text, assembler->source_name);
+
+        return -1;
+    }
+
+    // code before the first method is written too, it has no labels
+    return write_method_code(assembler);
+}
+
+/* a branch label names the index of the next instruction, in the method it's in */
+static int add_label(assembler_t *assembler, asm_token_t label)
+{
+    int replaced = 0;
+
+    assert(assembler);
+
+    if (NULL == assembler->current_method)
+    {
+        report_asm_error(assembler, "label: '%.*s' outside a method at line %u",
+            (int)label.length, label.text, assembler->line);
+
+        return -1;
+    }
+
+    if (0 != put_name(&assembler->labels, label, (int)assembler->num_pending, &replaced))
+    {
+        report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    if (replaced)
+    {
+        report_asm_error(assembler, "label: '%.*s' defined twice in method: '%.*s' at line %u",
+            (int)label.length, label.text, (int)assembler->current_method->name.length,
+            assembler->current_method->name.text, assembler->line);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* the code is written when the method ends, see write_method_code */
+static int add_instruction(assembler_t *assembler, int opcode, int arg, asm_token_t label)
+{
+    asm_instruction_t *pending = NULL;
+    unsigned int *order = NULL;
+    unsigned int capacity = 0;
+
+    assert(assembler);
+
+    if (assembler->num_pending == assembler->pending_capacity)
+    {
+        capacity = (assembler->pending_capacity + 32) * 2;
+        pending = (asm_instruction_t *)realloc(assembler->pending, sizeof(asm_instruction_t) * capacity);
+        if (NULL != pending)
+        {
+            assembler->pending = pending;
+            order = (unsigned int *)realloc(assembler->order, sizeof(unsigned int) * capacity);
+        }
+        if (NULL == order)
+        {
+            report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+
+            return -1;
+        }
+        assembler->order = order;
+        assembler->pending_capacity = capacity;
+    }
+
+    pending = &assembler->pending[assembler->num_pending++];
+    pending->opcode = opcode;
+    pending->arg = arg;
+    pending->label = label;
+    pending->line = assembler->current_line;
+    pending->target = -1;
+    pending->replaced_by = -1;
+    pending->is_target = 0;
+    ++assembler->num_instructions;
+
+    return 0;
+}
+
+/* the target is the index of an instruction when it's a number, or else a label */
+static int add_branch(assembler_t *assembler, int opcode, asm_token_t target)
+{
+    asm_token_t none = {0};
+    int64_t index = 0;
+
+    assert(assembler);
+
+    if (0 == parse_integer(target, INT32_MIN, INT32_MAX, &index))
+    {
+        return add_instruction(assembler, opcode, (int)index, none);
+    }
+
+    return add_instruction(assembler, opcode, 0, target);
+}
+
+/*
+* Writes the instructions of the current method once all of its labels are
+* known, a forward branch can't be written in the dense code before the
+* width of its target's varint is known. The method's code offset and
+* length are the ones of the code written, after the optimizer.
+*/
+static int write_method_code(assembler_t *assembler)
+{
+    asm_method_t *method = NULL;
+    asm_instruction_t *pending = NULL;
+    asm_tail_call_t tail_call = {0};
+    vm_instruction_t instruction = {0};
+    unsigned char dense[DENSE_MAX_INSTRUCTION_SIZE];
+    char report[64];
+    unsigned int count = 0;
+    int target = 0, length = 0;
+
+    assert(assembler);
+
+    method = assembler->current_method;
+    if (0 != resolve_branches(assembler, assembler->num_instructions - assembler->num_pending))
+    {
+        return -1;
+    }
+
+    count = assembler->num_pending;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        assembler->order[i] = i;
+    }
+
+    if ((assembler->flags & VM_ASSEMBLE_OPTIMIZE) && NULL != method && 0 != count)
+    {
+        if (0 != optimize_method(assembler, &count))
+        {
+            return -1;
+        }
+        // the line of the compiler's report, written once the whole source is assembled
+        length = snprintf(report, sizeof(report), ", %u -> %u instructions, %u removed\n",
+            assembler->num_pending, count, assembler->num_pending - count);
+        append_bytes(&assembler->report, "method: ", sizeof("method: ") - 1);
+        append_bytes(&assembler->report, method->name.text, method->name.length);
+        append_bytes(&assembler->report, report, (size_t)length);
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        assembler->pending[assembler->order[i]].index = assembler->num_written + i;
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        pending = &assembler->pending[assembler->order[i]];
+        instruction.opcode = (enum opcodes)pending->opcode;
+        instruction.arg = pending->arg;
+
+        if (-1 != pending->target)
+        {
+            target = resolve_target(assembler->pending, (int)assembler->num_pending, pending->target);
+            instruction.arg = (int)(target == (int)assembler->num_pending ?
+                                    assembler->num_written + count : assembler->pending[target].index);
+        }
+
+        // one debug entry per run of instructions from the same source line
+        if (pending->line != assembler->last_line)
+        {
+            append_int(&assembler->debug_lines, assembler->num_written + i);
+            append_int(&assembler->debug_lines, pending->line);
+            assembler->last_line = pending->line;
+        }
+
+        if (OP_CALL == instruction.opcode && i + 1 < count &&
+            0 != get_return_bit(assembler->pending[assembler->order[i + 1]].opcode))
+        {
+            tail_call.position = assembler->code.size;
+            tail_call.constant = instruction.arg;
+            tail_call.return_opcode = assembler->pending[assembler->order[i + 1]].opcode;
+            append_bytes(&assembler->tail_calls, &tail_call, sizeof(tail_call));
+        }
+        if (NULL != method)
+        {
+            method->returns |= get_return_bit(instruction.opcode);
+        }
+
+        if (assembler->flags & VM_ASSEMBLE_FIXED_WIDTH)
+        {
+            append_int(&assembler->code, (uint32_t)instruction.opcode);
+            append_int(&assembler->code, (uint32_t)instruction.arg);
+        }
+        else
+        {
+            append_bytes(&assembler->code, dense, encode_dense_instruction(dense, &instruction));
+        }
+    }
+
+    if (NULL != method)
+    {
+        method->entry.code_length = count;
+    }
+
+    assembler->num_written += count;
+    assembler->num_pending = 0;
+    clear_names(&assembler->labels);
+
+    return 0;
+}
+
+/*
+* Points every branch at the instruction it continues at, a label or an
+* index counted like the instructions read so far, first is the index of
+* the method's first instruction. A numeric target outside the method
+* stays as it is, for the verifier to report.
+*/
+static int resolve_branches(assembler_t *assembler, unsigned int first)
+{
+    asm_method_t *method = assembler->current_method;
+    asm_instruction_t *pending = NULL;
+    int64_t target = 0;
+    int *label = NULL;
+
+    for (unsigned int i = 0; i < assembler->num_pending; ++i)
+    {
+        pending = &assembler->pending[i];
+        target = (int64_t)pending->arg - first;
+
+        if (NULL != pending->label.text)
+        {
+            label = find_name(&assembler->labels, pending->label);
+            if (NULL == label)
+            {
+                report_asm_error(assembler, "unknown label: '%.*s' in method: '%.*s', file: %s",
+                    (int)pending->label.length, pending->label.text,
+                    (int)(NULL == method ? 0 : method->name.length), (NULL == method ? "" : method->name.text),
+                    assembler->source_name);
+
+                return -1;
+            }
+            target = *label;
+        }
+        else if (!is_branch(pending->opcode))
+        {
+            continue;
+        }
+
+        if (0 <= target && target <= assembler->num_pending)
+        {
+            pending->target = (int)target;
+        }
+        if (0 <= target && target < assembler->num_pending)
+        {
+            assembler->pending[target].is_target = 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+* The opcode is the first byte of an instruction in both encodings, so a
+* call becomes a tailcall in place. Only when every return of the callee is
+* the one after the call, which the verifier requires of a tailcall.
+*/
+static void mark_tail_calls(assembler_t *assembler)
+{
+    const asm_tail_call_t *tail_call = (const asm_tail_call_t *)assembler->tail_calls.data;
+    const vm_file_constant_t *constant = NULL;
+    size_t count = assembler->tail_calls.size / sizeof(asm_tail_call_t);
+
+    if (assembler->code.failed)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; ++i, ++tail_call)
+    {
+        if (tail_call->constant < 0 || (unsigned int)tail_call->constant >= assembler->num_constants)
+        {
+            continue;
+        }
+
+        constant = &assembler->constants[tail_call->constant];
+        if (VM_TYPE_METHOD == constant->type &&
+            get_return_bit(tail_call->return_opcode) == assembler->methods[constant->a].returns)
+        {
+            assembler->code.data[tail_call->position] = OP_TAILCALL;
+        }
+    }
+}
+
+/* one bit per kind of return, 0 for any other opcode */
+static unsigned int get_return_bit(int opcode)
+{
+    switch (opcode)
+    {
+        case OP_RET:  return 0x01;
+        case OP_IRET: return 0x02;
+        case OP_SRET: return 0x04;
+        case OP_RRET: return 0x08;
+        case OP_LRET: return 0x10;
+        case OP_FRET: return 0x20;
+        case OP_DRET: return 0x40;
+        default:      return 0;
+    }
+}
+
+/*
+* The -O pass of the compiler, see bytecode_compiler/src/Optimizer.java, run
+* on the code of the current method until none of its rewrites applies.
+* order holds the pending instructions left, count of them. A removed
+* instruction is replaced_by the one that now stands in its place, so the
+* branches need no renumbering.
+*/
+static int optimize_method(assembler_t *assembler, unsigned int *count)
+{
+    asm_optimizer_t optimizer = {0};
+    const asm_instruction_t *instruction = NULL;
+    int max_local = 0, changed = 1, res = 0;
+
+    assert(assembler && count);
+
+    for (unsigned int i = 0; i < *count; ++i)
+    {
+        instruction = &assembler->pending[i];
+        if (is_load(instruction->opcode) || is_store(instruction->opcode))
+        {
+            if (instruction->arg < 0)
+            {
+                return 0; // left as it is for the verifier to report
+            }
+            max_local = (instruction->arg > max_local ? instruction->arg : max_local);
+        }
+    }
+
+    optimizer.instructions = assembler->pending;
+    optimizer.end = (int)*count;
+    optimizer.code = assembler->order;
+    optimizer.size = *count;
+    optimizer.num_words = (unsigned int)max_local / 64 + 1;
+    optimizer.positions = (int *)malloc(sizeof(int) * *count);
+    optimizer.live_in = (uint64_t *)malloc(sizeof(uint64_t) * optimizer.num_words * *count);
+    optimizer.live_out = (uint64_t *)malloc(sizeof(uint64_t) * optimizer.num_words * *count);
+    if (NULL == optimizer.positions || NULL == optimizer.live_in || NULL == optimizer.live_out)
+    {
+        report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+        res = -1;
+    }
+
+    while (0 == res && changed)
+    {
+        changed = fold_constants(&optimizer);
+        changed |= remove_dead_stores(&optimizer);
+        changed |= remove_neutral_code(&optimizer);
+    }
+    *count = optimizer.size;
+
+    free(optimizer.live_out);
+    free(optimizer.live_in);
+    free(optimizer.positions);
+
+    return res;
+}
+
+static int fold_constants(asm_optimizer_t *optimizer)
+{
+    asm_instruction_t *first = NULL, *second = NULL;
+    int changed = 0;
+
+    for (unsigned int i = 0; i + 1 < optimizer->size; i = next_rewrite(optimizer, i))
+    {
+        first = get_code(optimizer, i);
+        second = get_code(optimizer, i + 1);
+
+        if (OP_IPUSH != first->opcode)
+        {
+            continue;
+        }
+
+        if (OP_INEG == second->opcode && can_rewrite(optimizer, i, 2))
+        {
+            first->arg = negate_integer(first->arg);
+            remove_code(optimizer, i + 1, 1);
+            changed = 1;
+        }
+        else if ((OP_IFEQ == second->opcode || OP_IFNE == second->opcode) && can_rewrite(optimizer, i, 2))
+        {
+            fold_branch(optimizer, i, 2, (0 == first->arg) == (OP_IFEQ == second->opcode));
+            changed = 1;
+        }
+        else if (OP_IPUSH == second->opcode && i + 2 < optimizer->size && can_rewrite(optimizer, i, 3))
+        {
+            changed |= fold_binary(optimizer, i, first->arg, second->arg, get_code(optimizer, i + 2)->opcode);
+        }
+    }
+
+    return changed;
+}
+
+/* ipush a; ipush b; followed by an arithmetic or a compare and branch */
+static int fold_binary(asm_optimizer_t *optimizer, unsigned int i, int a, int b, int opcode)
+{
+    asm_instruction_t *result = get_code(optimizer, i);
+
+    switch (opcode)
+    {
+        case OP_IADD:
+            result->arg = add_integers(a, b);
+            break;
+        case OP_ISUB:
+            result->arg = subtract_integers(a, b);
+            break;
+        case OP_IMULT:
+            result->arg = multiply_integers(a, b);
+            break;
+        case OP_IDIV:
+            if (0 == b)
+            {
+                return 0; // left to the VM, which reports the division by zero
+            }
+            result->arg = divide_integers(a, b);
+            break;
+        case OP_IF_ICMPEQ:
+            fold_branch(optimizer, i, 3, a == b);
+            return 1;
+        case OP_IF_ICMPNE:
+            fold_branch(optimizer, i, 3, a != b);
+            return 1;
+        case OP_IF_ICMPLT:
+            fold_branch(optimizer, i, 3, a < b);
+            return 1;
+        case OP_IF_ICMPGE:
+            fold_branch(optimizer, i, 3, a >= b);
+            return 1;
+        case OP_IF_ICMPGT:
+            fold_branch(optimizer, i, 3, a > b);
+            return 1;
+        case OP_IF_ICMPLE:
+            fold_branch(optimizer, i, 3, a <= b);
+            return 1;
+        default:
+            return 0;
+    }
+
+    remove_code(optimizer, i + 1, 2);
+
+    return 1;
+}
+
+/* the count instructions from i end with a branch on constants, taken or not */
+static void fold_branch(asm_optimizer_t *optimizer, unsigned int i, unsigned int count, int taken)
+{
+    const asm_instruction_t *branch = get_code(optimizer, i + count - 1);
+    asm_instruction_t *jump = NULL;
+
+    if (!taken)
+    {
+        remove_code(optimizer, i, count);
+        return;
+    }
+
+    jump = get_code(optimizer, i);
+    jump->opcode = OP_GOTO;
+    jump->arg = branch->arg;
+    jump->target = branch->target;
+    remove_code(optimizer, i + 1, count - 1);
+}
+
+/*
+* A store is dead when no path from it loads the local before storing it
+* again or leaving the method.
+*/
+static int remove_dead_stores(asm_optimizer_t *optimizer)
+{
+    asm_instruction_t *store = NULL;
+    int changed = 0;
+
+    compute_liveness(optimizer);
+
+    // backwards, so removals don't move what is left to visit
+    for (unsigned int i = optimizer->size; i-- > 0;)
+    {
+        store = get_code(optimizer, i);
+        if (!is_store(store->opcode))
+        {
+            continue;
+        }
+
+        if (i + 1 < optimizer->size && get_code(optimizer, i + 1)->opcode == store->opcode - 1 &&
+            get_code(optimizer, i + 1)->arg == store->arg && can_rewrite(optimizer, i, 2) &&
+            !is_live_after(optimizer, i + 1, store->arg))
+        {
+            // the value stays on the stack instead of going through the local
+            remove_code(optimizer, i, 2);
+        }
+        else if (!is_live_after(optimizer, i, store->arg))
+        {
+            store->opcode = OP_POP;
+            store->arg = 0;
+        }
+        else
+        {
+            continue;
+        }
+        changed = 1;
+    }
+
+    return changed;
+}
+
+static int remove_neutral_code(asm_optimizer_t *optimizer)
+{
+    unsigned int i = 0;
+    int changed = 0;
+
+    while (i < optimizer->size)
+    {
+        if (is_in_table(optimizer, i) || !remove_neutral_code_at(optimizer, i))
+        {
+            i = next_rewrite(optimizer, i);
+            continue;
+        }
+
+        // the code before may pair with what follows the removed code now
+        i = (0 == i ? 0 : i - 1);
+        changed = 1;
+    }
+
+    return changed;
+}
+
+static int remove_neutral_code_at(asm_optimizer_t *optimizer, unsigned int i)
+{
+    const asm_instruction_t *first = get_code(optimizer, i);
+    const asm_instruction_t *second = (i + 1 < optimizer->size ? get_code(optimizer, i + 1) : NULL);
+    int next = (NULL == second ? optimizer->end : (int)optimizer->code[i + 1]);
+
+    if (OP_NOOP == first->opcode)
+    {
+        remove_code(optimizer, i, 1);
+    }
+    else if (OP_GOTO == first->opcode && -1 != first->target &&
+             resolve_target(optimizer->instructions, optimizer->end, first->target) == next)
+    {
+        remove_code(optimizer, i, 1);
+    }
+    else if (NULL != second && OP_POP == second->opcode && is_push(first->opcode) && can_rewrite(optimizer, i, 2))
+    {
+        remove_code(optimizer, i, 2);
+    }
+    else if (NULL != second && is_load(first->opcode) && second->opcode == first->opcode + 1 &&
+             second->arg == first->arg && can_rewrite(optimizer, i, 2))
+    {
+        remove_code(optimizer, i, 2);
+    }
+    else
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* the locals read after each instruction on some path, a backward dataflow up to a fixed point */
+static void compute_liveness(asm_optimizer_t *optimizer)
+{
+    const asm_instruction_t *instruction = NULL;
+    uint64_t *in = NULL, *out = NULL;
+    unsigned int words = optimizer->num_words;
+    int changed = 1, target = 0;
+
+    for (int i = 0; i < optimizer->end; ++i)
+    {
+        optimizer->positions[i] = -1;
+    }
+    for (unsigned int i = 0; i < optimizer->size; ++i)
+    {
+        optimizer->positions[optimizer->code[i]] = (int)i;
+    }
+    memset(optimizer->live_in, 0, sizeof(uint64_t) * words * optimizer->size);
+    memset(optimizer->live_out, 0, sizeof(uint64_t) * words * optimizer->size);
+
+    while (changed)
+    {
+        changed = 0;
+
+        for (unsigned int i = optimizer->size; i-- > 0;)
+        {
+            instruction = get_code(optimizer, i);
+            in = &optimizer->live_in[i * words];
+            out = &optimizer->live_out[i * words];
+
+            // the sets only grow, so a bit set for the first time is the only change
+            if (is_branch(instruction->opcode) && -1 != instruction->target)
+            {
+                target = resolve_target(optimizer->instructions, optimizer->end, instruction->target);
+                if (target != optimizer->end && -1 != optimizer->positions[target])
+                {
+                    changed |= merge_live(out, &optimizer->live_in[optimizer->positions[target] * words], words);
+                }
+            }
+
+            if (OP_TABLESWITCH == instruction->opcode)
+            {
+                // the gotos of the table and the instruction after it
+                for (int64_t k = i + 1; k <= (int64_t)i + instruction->arg + 1 && k < optimizer->size; ++k)
+                {
+                    changed |= merge_live(out, &optimizer->live_in[k * words], words);
+                }
+            }
+            else if (OP_GOTO != instruction->opcode && !is_return(instruction->opcode) && i + 1 < optimizer->size)
+            {
+                changed |= merge_live(out, &optimizer->live_in[(i + 1) * words], words);
+            }
+
+            for (unsigned int w = 0; w < words; ++w)
+            {
+                uint64_t live = out[w];
+
+                if (is_store(instruction->opcode) && (unsigned int)instruction->arg / 64 == w)
+                {
+                    live &= ~((uint64_t)1 << instruction->arg % 64);
+                }
+                else if (is_load(instruction->opcode) && (unsigned int)instruction->arg / 64 == w)
+                {
+                    live |= (uint64_t)1 << instruction->arg % 64;
+                }
+                changed |= (0 != (live & ~in[w]));
+                in[w] |= live;
+            }
+        }
+    }
+}
+
+/* ors from into into, 1 if a bit was not set in into yet */
+static int merge_live(uint64_t *into, const uint64_t *from, unsigned int words)
+{
+    int changed = 0;
+
+    for (unsigned int w = 0; w < words; ++w)
+    {
+        changed |= (0 != (from[w] & ~into[w]));
+        into[w] |= from[w];
+    }
+
+    return changed;
+}
+
+static int is_live_after(const asm_optimizer_t *optimizer, unsigned int i, int local)
+{
+    return 0 != (optimizer->live_out[i * optimizer->num_words + (unsigned int)local / 64] &
+                 ((uint64_t)1 << local % 64));
+}
+
+/*
+* Removes count instructions from i, a branch to any of them continues at
+* the instruction that follows them.
+*/
+static void remove_code(asm_optimizer_t *optimizer, unsigned int i, unsigned int count)
+{
+    int successor = (i + count < optimizer->size ? (int)optimizer->code[i + count] : optimizer->end);
+    asm_instruction_t *removed = NULL;
+
+    for (unsigned int k = i; k < i + count; ++k)
+    {
+        removed = &optimizer->instructions[optimizer->code[k]];
+        removed->replaced_by = successor;
+        if (successor != optimizer->end)
+        {
+            optimizer->instructions[successor].is_target |= removed->is_target;
+        }
+    }
+
+    memmove(&optimizer->code[i], &optimizer->code[i + count], sizeof(unsigned int) * (optimizer->size - i - count));
+    optimizer->size -= count;
+}
+
+/* only the first of the count instructions from i may be a branch target */
+static int can_rewrite(const asm_optimizer_t *optimizer, unsigned int i, unsigned int count)
+{
+    for (unsigned int k = i + 1; k < i + count; ++k)
+    {
+        if (get_code(optimizer, k)->is_target || is_in_table(optimizer, k))
+        {
+            return 0;
+        }
+    }
+
+    return !is_in_table(optimizer, i);
+}
+
+/* the gotos after a tableswitch are its table, they stay as they are */
+static int is_in_table(const asm_optimizer_t *optimizer, unsigned int i)
+{
+    const asm_instruction_t *instruction = NULL;
+
+    for (unsigned int k = i; k-- > 0;)
+    {
+        instruction = get_code(optimizer, k);
+        if (OP_TABLESWITCH == instruction->opcode)
+        {
+            return instruction->arg >= (int)(i - k);
+        }
+
+        if (OP_GOTO != instruction->opcode)
+        {
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+/* skips the table of a tableswitch, i may be past the end after a removal */
+static unsigned int next_rewrite(const asm_optimizer_t *optimizer, unsigned int i)
+{
+    if (i >= optimizer->size || OP_TABLESWITCH != get_code(optimizer, i)->opcode)
+    {
+        return i + 1;
+    }
+
+    return i + 1 + (unsigned int)get_code(optimizer, i)->arg;
+}
+
+static asm_instruction_t *get_code(const asm_optimizer_t *optimizer, unsigned int i)
+{
+    return &optimizer->instructions[optimizer->code[i]];
+}
+
+/* follows the replacements, a branch to a removed instruction continues at what replaced it */
+static int resolve_target(const asm_instruction_t *instructions, int end, int index)
+{
+    while (index != end && -1 != instructions[index].replaced_by)
+    {
+        index = instructions[index].replaced_by;
+    }
+
+    return index;
+}
+
+/* goto and the conditional branches, their arg is an instruction index */
+static int is_branch(int opcode)
+{
+    return OP_GOTO <= opcode && OP_IF_ICMPLE >= opcode;
+}
+
+/* every load of a local, the store of the same type is the next opcode */
+static int is_load(int opcode)
+{
+    switch (opcode)
+    {
+        case OP_ILOAD:
+        case OP_SLOAD:
+        case OP_RLOAD:
+        case OP_LLOAD:
+        case OP_FLOAD:
+        case OP_DLOAD:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_store(int opcode)
+{
+    return is_load(opcode - 1);
+}
+
+static int is_push(int opcode)
+{
+    switch (opcode)
+    {
+        case OP_IPUSH:
+        case OP_LPUSH:
+        case OP_FPUSH:
+        case OP_DPUSH:
+        case OP_CLOAD:
+        case OP_RNULL:
+            return 1;
+        default:
+            return is_load(opcode);
+    }
+}
+
+static int is_return(int opcode)
+{
+    return OP_STOP == opcode || 0 != get_return_bit(opcode);
+}
+
+/*
+* Lays out the header, the section table and then every section, each one
+* aligned to 4 bytes so the VM can use it in place, in the order the
+* compiler writes them.
+*/
+static int write_image(assembler_t *assembler, unsigned char **image, size_t *image_size)
+{
+    vm_file_header_t header = { MAGIC_NUM_V2, BYTECODE_VERSION, 0 };
+    vm_file_section_t sections[6];
+    const void *data[6];
+    uint32_t *dense_offsets = NULL;
+    vm_file_method_t *methods = NULL;
+    unsigned char *file = NULL;
+    size_t offset = 0, size = 0;
+    unsigned int num_sections = 0;
+    int dense = !(assembler->flags & VM_ASSEMBLE_FIXED_WIDTH);
+
+    assert(assembler && image && image_size);
+
+    methods = (vm_file_method_t *)malloc(sizeof(vm_file_method_t) * assembler->num_methods + 1);
+    dense_offsets = (uint32_t *)malloc(sizeof(uint32_t) * assembler->num_methods + 1);
+    if (NULL == methods || NULL == dense_offsets)
+    {
+        report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+        free(dense_offsets);
+        free(methods);
+
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < assembler->num_methods; ++i)
+    {
+        methods[i] = assembler->methods[i].entry;
+        dense_offsets[i] = assembler->methods[i].dense_offset;
+    }
+
+#define ADD_SECTION(section_id, section_data, section_size)   \
+    do                                                         \
+    {                                                          \
+        sections[num_sections].id = (section_id);              \
+        sections[num_sections].size = (uint32_t)(section_size); \
+        data[num_sections++] = (section_data);                 \
+    } while (0)
+
+    ADD_SECTION(VM_SECTION_CONSTANTS, assembler->constants, sizeof(vm_file_constant_t) * assembler->num_constants);
+    ADD_SECTION(VM_SECTION_METHODS, methods, sizeof(vm_file_method_t) * assembler->num_methods);
+    ADD_SECTION(VM_SECTION_STRINGS, assembler->strings.data, assembler->strings.size);
+    if (dense)
+    {
+        ADD_SECTION(VM_SECTION_DENSE_CODE, assembler->code.data, assembler->code.size);
+        ADD_SECTION(VM_SECTION_DENSE_METHODS, dense_offsets, sizeof(uint32_t) * assembler->num_methods);
+    }
+    else
+    {
+        ADD_SECTION(VM_SECTION_CODE, assembler->code.data, assembler->code.size);
+    }
+    ADD_SECTION(VM_SECTION_DEBUG, assembler->debug_lines.data, assembler->debug_lines.size);
+
+#undef ADD_SECTION
+
+    header.num_sections = (uint16_t)num_sections;
+    offset = sizeof(vm_file_header_t) + sizeof(vm_file_section_t) * num_sections;
+    for (unsigned int i = 0; i < num_sections; ++i)
+    {
+        sections[i].offset = (uint32_t)offset;
+        offset = align_size(offset + sections[i].size);
+    }
+    size = offset;
+
+    file = (unsigned char *)calloc(1, size); // the padding is 0
+    if (NULL != file)
+    {
+        memcpy(file, &header, sizeof(header));
+        memcpy(file + sizeof(header), sections, sizeof(vm_file_section_t) * num_sections);
+        for (unsigned int i = 0; i < num_sections; ++i)
+        {
+            if (0 != sections[i].size)
+            {
+                memcpy(file + sections[i].offset, data[i], sections[i].size);
+            }
+        }
+    }
+
+    free(dense_offsets);
+    free(methods);
+
+    if (NULL == file)
+    {
+        report_asm_error(assembler, "out of memory, file: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    *image = file;
+    *image_size = size;
+
+    return 0;
+}
+
+static void free_assembler(assembler_t *assembler)
+{
+    assert(assembler);
+
+    free(assembler->constants);
+    free(assembler->methods);
+    free(assembler->method_names.slots);
+    free(assembler->labels.slots);
+    free(assembler->pending);
+    free(assembler->order);
+    free(assembler->strings.data);
+    free(assembler->code.data);
+    free(assembler->debug_lines.data);
+    free(assembler->tail_calls.data);
+    free(assembler->report.data);
+}
+
+/* skips whitespace and line breaks up to the next token, counting the lines */
+static int has_next_token(assembler_t *assembler)
+{
+    const char *cur = NULL;
+
+    assert(assembler);
+
+    for (cur = assembler->cur; cur < assembler->end; ++cur)
+    {
+        if ('\n' == *cur || '\r' == *cur)
+        {
+            // \n, \r and \r\n all end a line
+            if ('\r' == *cur && cur + 1 < assembler->end && '\n' == cur[1])
+            {
+                ++cur;
+            }
+            ++assembler->line;
+        }
+        else if (!is_line_space(*cur))
+        {
+            break;
+        }
+    }
+    assembler->cur = cur;
+
+    return cur < assembler->end;
+}
+
+static int next_token(assembler_t *assembler, asm_token_t *token)
+{
+    const char *cur = NULL;
+
+    assert(assembler && token);
+
+    if (!has_next_token(assembler))
+    {
+        token->text = assembler->end;
+        token->length = 0;
+        report_asm_error(assembler, "unexpected end of file: %s", assembler->source_name);
+
+        return -1;
+    }
+
+    for (cur = assembler->cur; cur < assembler->end && '\n' != *cur && '\r' != *cur && !is_line_space(*cur);)
+    {
+        ++cur;
+    }
+
+    token->text = assembler->cur;
+    token->length = cur - assembler->cur;
+    assembler->cur = cur;
+
+    return 0;
+}
+
+static int next_int(assembler_t *assembler, int *value)
+{
+    asm_token_t token = {0};
+    int64_t number = 0;
+
+    assert(assembler && value);
+
+    if (0 != next_token(assembler, &token))
+    {
+        return -1;
+    }
+
+    if (0 != parse_integer(token, INT32_MIN, INT32_MAX, &number))
+    {
+        report_asm_error(assembler, "invalid number: '%.*s' at line %u, file: %s",
+            (int)token.length, token.text, assembler->line, assembler->source_name);
+
+        return -1;
+    }
+    *value = (int)number;
+
+    return 0;
+}
+
+/* the rest of the current line, the next token is read from the line after it */
+static asm_token_t next_line(assembler_t *assembler)
+{
+    asm_token_t rest = {0};
+    const char *cur = NULL;
+
+    assert(assembler);
+
+    for (cur = assembler->cur; cur < assembler->end && '\n' != *cur && '\r' != *cur;)
+    {
+        ++cur;
+    }
+
+    rest.text = assembler->cur;
+    rest.length = cur - assembler->cur;
+
+    if (cur < assembler->end)
+    {
+        cur += ('\r' == *cur && cur + 1 < assembler->end && '\n' == cur[1] ? 2 : 1);
+        ++assembler->line;
+    }
+    assembler->cur = cur;
+
+    return rest;
+}
+
+/* drops the control characters and spaces of both ends, like String.trim */
+static asm_token_t trim_token(asm_token_t token)
+{
+    while (0 < token.length && (unsigned char)token.text[0] <= ' ')
+    {
+        ++token.text;
+        --token.length;
+    }
+
+    while (0 < token.length && (unsigned char)token.text[token.length - 1] <= ' ')
+    {
+        --token.length;
+    }
+
+    return token;
+}
+
+/* a decimal with an optional sign, like Integer.parseInt and Long.parseLong */
+static int parse_integer(asm_token_t token, int64_t min, int64_t max, int64_t *value)
+{
+    const char *cur = token.text, *end = token.text + token.length;
+    uint64_t result = 0, limit = (uint64_t)max;
+    int negative = 0, digit = 0;
+
+    assert(value);
+
+    // only a minus sign reaches the magnitude of min, +2147483648 is out of range like in Java
+    if (cur < end && ('-' == *cur || '+' == *cur))
+    {
+        negative = ('-' == *cur++);
+        limit = (negative ? (uint64_t)(-(min + 1)) + 1 : limit);
+    }
+
+    if (cur == end)
+    {
+        return -1;
+    }
+
+    for (; cur < end; ++cur)
+    {
+        if (*cur < '0' || *cur > '9')
+        {
+            return -1;
+        }
+
+        digit = *cur - '0';
+        if (result > (limit - digit) / 10)
+        {
+            return -1;
+        }
+        result = result * 10 + digit;
+    }
+
+    *value = (negative ? (int64_t)(0 - result) : (int64_t)result);
+
+    return 0;
+}
+
+/* a float or double literal, with the f or d suffix Java allows */
+static int parse_floating(asm_token_t token, int is_float, double *value)
+{
+    char buffer[64];
+    char *text = buffer, *end = NULL;
+    size_t length = token.length;
+
+    assert(value);
+
+    if (0 < length && NULL != strchr("fFdD", token.text[length - 1]) &&
+        1 < length && (('0' <= token.text[length - 2] && '9' >= token.text[length - 2]) || '.' == token.text[length - 2]))
+    {
+        --length;
+    }
+
+    if (0 == length)
+    {
+        return -1;
+    }
+
+    if (length >= sizeof(buffer) && NULL == (text = (char *)malloc(length + 1)))
+    {
+        return -1;
+    }
+    memcpy(text, token.text, length);
+    text[length] = '\0';
+
+    // strtof rounds once, a float read as a double and then narrowed could round twice
+    *value = (is_float ? (double)strtof(text, &end) : strtod(text, &end));
+    length = (is_java_floating(text) ? (size_t)(end - text) - length : 1);
+
+    if (text != buffer)
+    {
+        free(text);
+    }
+
+    return (0 == length ? 0 : -1);
+}
+
+/*
+* strtod reads more than Float.parseFloat and Double.parseDouble: inf, nan
+* in any case, nan(...) and hex without a binary exponent, these are not
+* numbers to the compiler.
+*/
+static int is_java_floating(const char *text)
+{
+    const char *cur = text + ('-' == *text || '+' == *text);
+
+    if ('a' <= (*cur | 0x20) && 'z' >= (*cur | 0x20))
+    {
+        return 0 == strcmp(cur, "Infinity") || 0 == strcmp(cur, "NaN");
+    }
+
+    if ('0' == cur[0] && 'x' == (cur[1] | 0x20))
+    {
+        return NULL != strpbrk(cur, "pP");
+    }
+
+    return 1;
+}
+
+static const asm_mnemonic_t *find_mnemonic(asm_token_t name)
+{
+    size_t low = 0, high = NUM_MNEMONICS;
+    int res = 0;
+
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+
+        res = compare_token(name, sorted_mnemonics[middle]->name);
+        if (0 == res)
+        {
+            return sorted_mnemonics[middle];
+        }
+
+        if (res < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+
+    return NULL;
+}
+
+static void sort_mnemonics(void)
+{
+    for (size_t i = 0; i < NUM_MNEMONICS; ++i)
+    {
+        sorted_mnemonics[i] = &mnemonics[i];
+    }
+
+    qsort(sorted_mnemonics, NUM_MNEMONICS, sizeof(sorted_mnemonics[0]), compare_mnemonics);
+}
+
+static int compare_mnemonics(const void *a, const void *b)
+{
+    return strcmp((*(const asm_mnemonic_t *const *)a)->name, (*(const asm_mnemonic_t *const *)b)->name);
+}
+
+/* orders like strcmp, the token is not 0 terminated */
+static int compare_token(asm_token_t token, const char *name)
+{
+    size_t length = strlen(name);
+    int res = memcmp(token.text, name, (token.length < length ? token.length : length));
+
+    if (0 != res)
+    {
+        return res;
+    }
+
+    return (token.length == length ? 0 : (token.length < length ? -1 : 1));
+}
+
+static unsigned int hash_name(asm_token_t name)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+
+    for (size_t i = 0; i < name.length; ++i)
+    {
+        hash = (hash ^ (unsigned char)name.text[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static asm_name_t *find_slot(const asm_names_t *names, asm_token_t name)
+{
+    unsigned int slot = hash_name(name) & (names->capacity - 1);
+
+    while (NULL != names->slots[slot].name.text &&
+           (names->slots[slot].name.length != name.length ||
+            0 != memcmp(names->slots[slot].name.text, name.text, name.length)))
+    {
+        slot = (slot + 1) & (names->capacity - 1);
+    }
+
+    return &names->slots[slot];
+}
+
+static int *find_name(const asm_names_t *names, asm_token_t name)
+{
+    asm_name_t *slot = NULL;
+
+    assert(names);
+
+    if (0 == names->count)
+    {
+        return NULL;
+    }
+
+    slot = find_slot(names, name);
+
+    return (NULL == slot->name.text ? NULL : &slot->value);
+}
+
+/* maps name to value, *replaced tells whether it had one already */
+static int put_name(asm_names_t *names, asm_token_t name, int value, int *replaced)
+{
+    asm_names_t grown = {0};
+    asm_name_t *slot = NULL;
+
+    assert(names && replaced);
+
+    // at most half full, so the probes stay short
+    if (2 * (names->count + 1) > names->capacity)
+    {
+        grown.capacity = (0 == names->capacity ? 16 : names->capacity * 2);
+        grown.slots = (asm_name_t *)calloc(grown.capacity, sizeof(asm_name_t));
+        if (NULL == grown.slots)
+        {
+            return -1;
+        }
+
+        for (unsigned int i = 0; i < names->capacity; ++i)
+        {
+            if (NULL != names->slots[i].name.text)
+            {
+                *find_slot(&grown, names->slots[i].name) = names->slots[i];
+            }
+        }
+        grown.count = names->count;
+
+        free(names->slots);
+        *names = grown;
+    }
+
+    slot = find_slot(names, name);
+    *replaced = (NULL != slot->name.text);
+    if (!*replaced)
+    {
+        slot->name = name;
+        ++names->count;
+    }
+    slot->value = value;
+
+    return 0;
+}
+
+static void clear_names(asm_names_t *names)
+{
+    assert(names);
+
+    if (0 != names->count)
+    {
+        memset(names->slots, 0, sizeof(asm_name_t) * names->capacity);
+        names->count = 0;
+    }
+}
+
+static void append_bytes(asm_buffer_t *buffer, const void *data, size_t size)
+{
+    unsigned char *grown = NULL;
+    size_t capacity = 0;
+
+    assert(buffer);
+
+    if (buffer->failed)
+    {
+        return;
+    }
+
+    if (buffer->size + size > buffer->capacity)
+    {
+        capacity = (buffer->capacity + size + 256) * 2;
+        grown = (unsigned char *)realloc(buffer->data, capacity);
+        if (NULL == grown)
+        {
+            buffer->failed = 1;
+
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    if (0 != size)
+    {
+        memcpy(buffer->data + buffer->size, data, size);
+    }
+    buffer->size += size;
+}
+
+/* little-endian, like every field of the file */
+static void append_int(asm_buffer_t *buffer, uint32_t value)
+{
+    unsigned char bytes[4] = { value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF };
+
+    append_bytes(buffer, bytes, sizeof(bytes));
+}
+
+/* the whitespace of Character.isWhitespace inside a line */
+static int is_line_space(int c)
+{
+    return ' ' == c || '\t' == c || '\v' == c || '\f' == c || (c >= 0x1C && c <= 0x1F);
+}
+
+static size_t align_size(size_t size)
+{
+    return (size + 3) & ~(size_t)3;
+}
@@ -0,0 +1,1094 @@
+#include <assert.h>    /* assert    */
+#include <math.h>      /* sqrt      */
+#include <pthread.h>   /* pthread_mutex_lock */
+#include <stdio.h>     /* fprintf   */
+#include <stdlib.h>    /* malloc    */
+
+#include "opcodes.h"     /* opcodes           */
+#include "vm_impl.h"     /* private vm header */
+#include "vm_util.h"     /* utility functions */
+#include "vm_threaded.h" /* HAS_COMPUTED_GOTO */
+#include "vm_dense.h"    /* dense encoding    */
+#include "vm_heap.h"     /* objects           */
+#include "vm_array.h"    /* arrays            */
+#include "vm_numeric.h"  /* integer, long, float and double semantics */
+#include "vm_output.h"   /* print buffer      */
+
+static int encode_program(vm_program_t *program);
+static void set_dense_offset(vm_method_meta_t *method, const unsigned int *offsets, unsigned int num_instructions);
+static unsigned int find_dense_instruction(const vm_program_t *program, const vm_method_meta_t *method,
+                                           unsigned int offset);
+
+size_t encode_dense_instruction(unsigned char *out, const vm_instruction_t *instruction)
+{
+    uint32_t value = 0;
+    size_t size = 0;
+
+    assert(out && instruction);
+
+    out[size++] = (unsigned char)instruction->opcode;
+    if (!has_dense_operand(instruction->opcode))
+    {
+        return size;
+    }
+
+    // zigzag, so small negative immediates stay short too
+    value = ((uint32_t)instruction->arg << 1) ^ (uint32_t)(instruction->arg >> 31);
+    while (value >= 0x80)
+    {
+        out[size++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[size++] = (unsigned char)value;
+
+    return size;
+}
+
+int decode_dense_instruction(const unsigned char *code, size_t size, size_t *offset, vm_instruction_t *instruction)
+{
+    size_t cur = 0;
+
+    assert(code && offset && instruction);
+
+    cur = *offset;
+    if (cur >= size)
+    {
+        return -1;
+    }
+
+    instruction->opcode = (enum opcodes)code[cur++];
+    instruction->arg = 0;
+
+    if (has_dense_operand(instruction->opcode))
+    {
+        // the operand has to end inside the code, within 5 bytes
+        for (unsigned int i = 0; ; ++i)
+        {
+            if (cur + i >= size || DENSE_MAX_INSTRUCTION_SIZE - 1 == i)
+            {
+                return -1;
+            }
+            if (0 == (code[cur + i] & 0x80))
+            {
+                break;
+            }
+        }
+
+        cur = read_dense_operand(&code[cur], &instruction->arg) - code;
+    }
+
+    *offset = cur;
+
+    return 0;
+}
+
+int decode_dense_method(vm_program_t *program, vm_method_meta_t *method)
+{
+    vm_instruction_t *instructions = NULL;
+    size_t offset = 0;
+
+    assert(program && method && program->decoded_instructions);
+
+    if (method->dense_decoded)
+    {
+        return 0;
+    }
+
+    instructions = &program->decoded_instructions[method->offset];
+    offset = method->dense_offset;
+
+    for (unsigned int i = 0; i < method->code_length; ++i)
+    {
+        program->dense_offsets[method->offset + i] = (unsigned int)offset;
+        if (0 != decode_dense_instruction(program->dense_code, program->dense_code_size, &offset, &instructions[i]))
+        {
+            fprintf(program->err, "code of method: %s is not valid dense code!\n", method->name);
+
+            return -1;
+        }
+    }
+
+    method->dense_decoded = 1;
+
+    return 0;
+}
+
+void prepare_dense_code(vm_program_t *program)
+{
+    assert(program);
+
+    pthread_mutex_lock(&program->prepare_lock);
+
+    if (!program->dense_prepared)
+    {
+        program->dense_prepared = 1;
+
+        // out of memory leaves the program without dense code, it runs on the handlers instead
+        encode_program(program);
+    }
+
+    pthread_mutex_unlock(&program->prepare_lock);
+}
+
+/*
+* Like the register engine, the dense engine is a loop of its own with the
+* frame kept in locals. Instructions are decoded as they run: an opcode
+* byte picks the handler, and the handlers that take an operand read its
+* varint and leave pc on the next opcode. Only verified methods ever run,
+* so there are no checks beyond the division by zero.
+*/
+int run_dense_code(vm_t *instance)
+{
+#if HAS_COMPUTED_GOTO
+    static const void *labels[256] = {
+        [0 ... 255] = &&op_end,
+
+        [OP_NOOP]   = &&op_noop,
+        [OP_HALT]   = &&op_halt,
+        [OP_STOP]   = &&op_stop,
+        [OP_POP]    = &&op_pop,
+        [OP_CALL]   = &&op_call,
+        [OP_TAILCALL] = &&op_tailcall,
+        [OP_RET]    = &&op_ret,
+        [OP_FLUSH]  = &&op_flush,
+
+        [OP_ILOAD]  = &&op_iload,
+        [OP_ISTORE] = &&op_istore,
+        [OP_IPUSH]  = &&op_ipush,
+        [OP_IADD]   = &&op_iadd,
+        [OP_ISUB]   = &&op_isub,
+        [OP_IMULT]  = &&op_imult,
+        [OP_IDIV]   = &&op_idiv,
+        [OP_INEG]   = &&op_ineg,
+        [OP_IPRINT] = &&op_iprint,
+        [OP_IRET]   = &&op_iret,
+
+        [OP_GOTO]        = &&op_goto,
+        [OP_IFEQ]        = &&op_ifeq,
+        [OP_IFNE]        = &&op_ifne,
+        [OP_IF_ICMPEQ]   = &&op_if_icmpeq,
+        [OP_IF_ICMPNE]   = &&op_if_icmpne,
+        [OP_IF_ICMPLT]   = &&op_if_icmplt,
+        [OP_IF_ICMPGE]   = &&op_if_icmpge,
+        [OP_IF_ICMPGT]   = &&op_if_icmpgt,
+        [OP_IF_ICMPLE]   = &&op_if_icmple,
+        [OP_TABLESWITCH] = &&op_tableswitch,
+
+        [OP_SLOAD]  = &&op_sload,
+        [OP_SSTORE] = &&op_sstore,
+        [OP_SPRINT] = &&op_sprint,
+        [OP_SRET]   = &&op_sret,
+
+        [OP_RLOAD]     = &&op_rload,
+        [OP_RSTORE]    = &&op_rstore,
+        [OP_RNULL]     = &&op_rnull,
+        [OP_RRET]      = &&op_rret,
+        [OP_NEW]       = &&op_new,
+        [OP_IGETFIELD] = &&op_igetfield,
+        [OP_IPUTFIELD] = &&op_iputfield,
+        [OP_SGETFIELD] = &&op_sgetfield,
+        [OP_SPUTFIELD] = &&op_sputfield,
+        [OP_RGETFIELD] = &&op_rgetfield,
+        [OP_RPUTFIELD] = &&op_rputfield,
+
+        [OP_CLOAD]  = &&op_cload,
+
+        [OP_NEWARRAY] = &&op_newarray,
+        [OP_ALEN]     = &&op_alen,
+        [OP_BALOAD]   = &&op_baload,
+        [OP_BASTORE]  = &&op_bastore,
+        [OP_IALOAD]   = &&op_iaload,
+        [OP_IASTORE]  = &&op_iastore,
+        [OP_AFILL]    = &&op_afill,
+        [OP_ACOPY]    = &&op_acopy,
+        [OP_ASUM]     = &&op_asum,
+        [OP_ADOT]     = &&op_adot,
+        [OP_AADD]     = &&op_aadd,
+
+        [OP_LLOAD]   = &&op_lload,
+        [OP_LSTORE]  = &&op_lstore,
+        [OP_LPUSH]   = &&op_lpush,
+        [OP_LADD]    = &&op_ladd,
+        [OP_LSUB]    = &&op_lsub,
+        [OP_LMULT]   = &&op_lmult,
+        [OP_LDIV]    = &&op_ldiv,
+        [OP_LNEG]    = &&op_lneg,
+        [OP_LPRINT]  = &&op_lprint,
+        [OP_LRET]    = &&op_lret,
+        [OP_LCMP]    = &&op_lcmp,
+        [OP_LALOAD]  = &&op_laload,
+        [OP_LASTORE] = &&op_lastore,
+
+        [OP_FLOAD]   = &&op_fload,
+        [OP_FSTORE]  = &&op_fstore,
+        [OP_FPUSH]   = &&op_fpush,
+        [OP_FADD]    = &&op_fadd,
+        [OP_FSUB]    = &&op_fsub,
+        [OP_FMULT]   = &&op_fmult,
+        [OP_FDIV]    = &&op_fdiv,
+        [OP_FNEG]    = &&op_fneg,
+        [OP_FPRINT]  = &&op_fprint,
+        [OP_FRET]    = &&op_fret,
+        [OP_FCMP]    = &&op_fcmp,
+        [OP_FALOAD]  = &&op_faload,
+        [OP_FASTORE] = &&op_fastore,
+
+        [OP_DLOAD]   = &&op_dload,
+        [OP_DSTORE]  = &&op_dstore,
+        [OP_DPUSH]   = &&op_dpush,
+        [OP_DADD]    = &&op_dadd,
+        [OP_DSUB]    = &&op_dsub,
+        [OP_DMULT]   = &&op_dmult,
+        [OP_DDIV]    = &&op_ddiv,
+        [OP_DNEG]    = &&op_dneg,
+        [OP_DPRINT]  = &&op_dprint,
+        [OP_DRET]    = &&op_dret,
+        [OP_DCMP]    = &&op_dcmp,
+        [OP_DALOAD]  = &&op_daload,
+        [OP_DASTORE] = &&op_dastore,
+        [OP_DSQRT]   = &&op_dsqrt,
+
+        [OP_I2L] = &&op_i2l,
+        [OP_I2F] = &&op_i2f,
+        [OP_I2D] = &&op_i2d,
+        [OP_L2I] = &&op_l2i,
+        [OP_L2F] = &&op_l2f,
+        [OP_L2D] = &&op_l2d,
+        [OP_F2I] = &&op_f2i,
+        [OP_F2L] = &&op_f2l,
+        [OP_F2D] = &&op_f2d,
+        [OP_D2I] = &&op_d2i,
+        [OP_D2L] = &&op_d2l,
+        [OP_D2F] = &&op_d2f,
+    };
+#define TARGET(name, opcode) name:
+#define DISPATCH() goto *labels[*pc]
+#define END_DISPATCH()
+#else
+#define TARGET(name, opcode) case opcode:
+#define DISPATCH() goto dispatch
+#define END_DISPATCH() }
+#endif
+
+    const unsigned char *code = NULL;
+    const unsigned char *pc = NULL;
+    const unsigned int *dense_offsets = NULL;
+    const vm_value_t *constant_pool = NULL;
+    const vm_method_meta_t *method = NULL;
+    vm_value_t *stack = NULL, *field = NULL;
+    vm_value_t result = {0};
+    vm_object_t *object = NULL;
+    const char *field_opcode = NULL, *array_opcode = NULL;
+    enum vm_types field_type = 0, array_type = 0;
+    unsigned int lap = 0, osp = 0, index = 0;
+    int arg = 0;
+
+    assert(instance && instance->program && instance->program->dense_code);
+
+    code = instance->program->dense_code;
+    dense_offsets = instance->program->dense_offsets;
+    constant_pool = instance->program->constant_pool;
+    stack = instance->stack;
+    pc = code + instance->ip;
+    lap = instance->lap;
+    osp = instance->osp;
+
+#define SAVE_STATE()                  \
+    do {                              \
+        instance->ip = pc - code;     \
+        instance->lap = lap;          \
+        instance->osp = osp;          \
+    } while (0)
+
+#define LOAD_STATE()                  \
+    do {                              \
+        pc = code + instance->ip;     \
+        lap = instance->lap;          \
+        osp = instance->osp;          \
+    } while (0)
+
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+#define OPERAND() (pc = read_dense_operand(pc + 1, &arg))
+#define INTEGER(i) get_integer_value(stack[i])
+#define LONG(i) get_long_value(stack[i])
+#define FLOAT(i) get_float_value(stack[i])
+#define DOUBLE(i) get_double_value(stack[i])
+
+#if HAS_COMPUTED_GOTO
+    DISPATCH();
+#else
+dispatch:
+    switch (*pc)
+    {
+#endif
+
+TARGET(op_noop, OP_NOOP)
+    NEXT();
+
+TARGET(op_halt, OP_HALT)
+    OPERAND();
+    DISPATCH();
+
+TARGET(op_stop, OP_STOP)
+    ++pc;
+    SAVE_STATE();
+    instance->state = VM_FINISHED;
+
+    return 0;
+
+TARGET(op_pop, OP_POP)
+    --osp;
+    NEXT();
+
+TARGET(op_call, OP_CALL)
+    OPERAND();
+    method = get_method_value(constant_pool[arg]);
+
+    SAVE_STATE();
+    if (0 != open_stack_frame(instance, method))
+    {
+        report_error(instance, "[call] failed, could not open stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    instance->ip = method->dense_offset;
+    LOAD_STATE();
+    DISPATCH();
+
+TARGET(op_tailcall, OP_TAILCALL)
+    OPERAND();
+    method = get_method_value(constant_pool[arg]);
+
+    SAVE_STATE();
+    if (0 != reuse_stack_frame(instance, method))
+    {
+        report_error(instance, "[tailcall] failed, could not reuse stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    instance->ip = method->dense_offset;
+    LOAD_STATE();
+    DISPATCH();
+
+TARGET(op_ret, OP_RET)
+    ++pc;
+    SAVE_STATE();
+    pop_stack_frame(instance);
+    if (VM_RUNNING != instance->state)
+    {
+        return 0;
+    }
+
+    LOAD_STATE();
+    DISPATCH();
+
+TARGET(op_flush, OP_FLUSH)
+    flush_output(instance);
+    NEXT();
+
+/* the operand of a branch is an instruction index, dense_offsets has its byte offset */
+#define BRANCH_IF(condition)                        \
+    do {                                            \
+        if (condition)                              \
+        {                                           \
+            pc = code + dense_offsets[arg];         \
+        }                                           \
+        DISPATCH();                                 \
+    } while (0)
+
+TARGET(op_goto, OP_GOTO)
+    OPERAND();
+    BRANCH_IF(1);
+
+TARGET(op_ifeq, OP_IFEQ)
+    OPERAND();
+    --osp;
+    BRANCH_IF(0 == INTEGER(osp));
+
+TARGET(op_ifne, OP_IFNE)
+    OPERAND();
+    --osp;
+    BRANCH_IF(0 != INTEGER(osp));
+
+TARGET(op_if_icmpeq, OP_IF_ICMPEQ)
+    OPERAND();
+    osp -= 2;
+    BRANCH_IF(INTEGER(osp) == INTEGER(osp + 1));
+
+TARGET(op_if_icmpne, OP_IF_ICMPNE)
+    OPERAND();
+    osp -= 2;
+    BRANCH_IF(INTEGER(osp) != INTEGER(osp + 1));
+
+TARGET(op_if_icmplt, OP_IF_ICMPLT)
+    OPERAND();
+    osp -= 2;
+    BRANCH_IF(INTEGER(osp) < INTEGER(osp + 1));
+
+TARGET(op_if_icmpge, OP_IF_ICMPGE)
+    OPERAND();
+    osp -= 2;
+    BRANCH_IF(INTEGER(osp) >= INTEGER(osp + 1));
+
+TARGET(op_if_icmpgt, OP_IF_ICMPGT)
+    OPERAND();
+    osp -= 2;
+    BRANCH_IF(INTEGER(osp) > INTEGER(osp + 1));
+
+TARGET(op_if_icmple, OP_IF_ICMPLE)
+    OPERAND();
+    osp -= 2;
+    BRANCH_IF(INTEGER(osp) <= INTEGER(osp + 1));
+
+#undef BRANCH_IF
+
+TARGET(op_tableswitch, OP_TABLESWITCH)
+    // the gotos of the table are found by the index of the tableswitch itself
+    index = find_dense_instruction(instance->program, instance->stack_trace->method_meta, pc - code);
+    OPERAND();
+    --osp;
+    if ((unsigned int)INTEGER(osp) < (unsigned int)arg)
+    {
+        read_dense_operand(code + dense_offsets[index + 1 + INTEGER(osp)] + 1, &arg);
+        pc = code + dense_offsets[arg];
+    }
+    else
+    {
+        pc = code + dense_offsets[index + 1 + arg];
+    }
+    DISPATCH();
+
+TARGET(op_iload, OP_ILOAD)
+TARGET(op_sload, OP_SLOAD)
+TARGET(op_rload, OP_RLOAD)
+TARGET(op_lload, OP_LLOAD)
+TARGET(op_fload, OP_FLOAD)
+TARGET(op_dload, OP_DLOAD)
+    OPERAND();
+    stack[osp] = stack[lap + arg];
+    ++osp;
+    DISPATCH();
+
+TARGET(op_istore, OP_ISTORE)
+TARGET(op_sstore, OP_SSTORE)
+TARGET(op_rstore, OP_RSTORE)
+TARGET(op_lstore, OP_LSTORE)
+TARGET(op_fstore, OP_FSTORE)
+TARGET(op_dstore, OP_DSTORE)
+    OPERAND();
+    --osp;
+    stack[lap + arg] = stack[osp];
+    DISPATCH();
+
+TARGET(op_ipush, OP_IPUSH)
+    OPERAND();
+    stack[osp] = make_integer_value(arg);
+    ++osp;
+    DISPATCH();
+
+TARGET(op_iadd, OP_IADD)
+    --osp;
+    stack[osp - 1] = make_integer_value(add_integers(INTEGER(osp - 1), INTEGER(osp)));
+    NEXT();
+
+TARGET(op_isub, OP_ISUB)
+    --osp;
+    stack[osp - 1] = make_integer_value(subtract_integers(INTEGER(osp - 1), INTEGER(osp)));
+    NEXT();
+
+TARGET(op_imult, OP_IMULT)
+    --osp;
+    stack[osp - 1] = make_integer_value(multiply_integers(INTEGER(osp - 1), INTEGER(osp)));
+    NEXT();
+
+TARGET(op_idiv, OP_IDIV)
+    if (0 == INTEGER(osp - 1))
+    {
+        report_error(instance, "[idiv] failed, division by zero\n");
+        ++pc;
+        SAVE_STATE();
+
+        return -1;
+    }
+    --osp;
+    stack[osp - 1] = make_integer_value(divide_integers(INTEGER(osp - 1), INTEGER(osp)));
+    NEXT();
+
+TARGET(op_ineg, OP_INEG)
+    stack[osp - 1] = make_integer_value(negate_integer(INTEGER(osp - 1)));
+    NEXT();
+
+TARGET(op_iprint, OP_IPRINT)
+    --osp;
+    output_integer(instance, INTEGER(osp));
+    NEXT();
+
+TARGET(op_sprint, OP_SPRINT)
+    --osp;
+    output_string(instance, get_string_value(stack[osp]));
+    NEXT();
+
+TARGET(op_iret, OP_IRET)
+TARGET(op_sret, OP_SRET)
+TARGET(op_rret, OP_RRET)
+TARGET(op_lret, OP_LRET)
+TARGET(op_fret, OP_FRET)
+TARGET(op_dret, OP_DRET)
+    result = stack[osp - 1];
+
+    ++pc;
+    SAVE_STATE();
+    pop_stack_frame(instance);
+    if (VM_RUNNING != instance->state)
+    {
+        return 0;
+    }
+
+    LOAD_STATE();
+    stack[osp] = result;
+    ++osp;
+    DISPATCH();
+
+TARGET(op_cload, OP_CLOAD)
+    OPERAND();
+    stack[osp] = constant_pool[arg];
+    ++osp;
+    DISPATCH();
+
+TARGET(op_rnull, OP_RNULL)
+    stack[osp] = make_empty_value(VM_TYPE_REFERENCE);
+    ++osp;
+    NEXT();
+
+TARGET(op_new, OP_NEW)
+    OPERAND();
+
+    // the collector finds the roots through the registers of the instance
+    SAVE_STATE();
+    object = allocate_object(instance, (unsigned int)arg);
+    if (NULL == object)
+    {
+        report_error(instance, "[new] failed, out of heap memory!\n");
+
+        return -1;
+    }
+
+    stack[osp] = make_reference_value(object);
+    ++osp;
+    DISPATCH();
+
+/*
+* Objects are not typed, so even verified code has its field accesses
+* checked: the null reference, the field index and the type of a field read.
+*/
+TARGET(op_igetfield, OP_IGETFIELD)
+    field_opcode = "igetfield";
+    field_type = VM_TYPE_INTEGER;
+    goto get_field;
+
+TARGET(op_sgetfield, OP_SGETFIELD)
+    field_opcode = "sgetfield";
+    field_type = VM_TYPE_STRING;
+    goto get_field;
+
+TARGET(op_rgetfield, OP_RGETFIELD)
+    field_opcode = "rgetfield";
+    field_type = VM_TYPE_REFERENCE;
+
+get_field:
+    OPERAND();
+    field = get_object_field(instance, field_opcode, stack[osp - 1], arg, field_type);
+    if (NULL == field)
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    stack[osp - 1] = *field;
+    DISPATCH();
+
+TARGET(op_iputfield, OP_IPUTFIELD)
+    field_opcode = "iputfield";
+    goto put_field;
+
+TARGET(op_sputfield, OP_SPUTFIELD)
+    field_opcode = "sputfield";
+    goto put_field;
+
+TARGET(op_rputfield, OP_RPUTFIELD)
+    field_opcode = "rputfield";
+
+put_field:
+    OPERAND();
+    field = get_object_field(instance, field_opcode, stack[osp - 2], arg, 0);
+    if (NULL == field)
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    *field = stack[osp - 1];
+    write_barrier(instance, (vm_object_t *)get_reference_value(stack[osp - 2]), stack[osp - 1]);
+    osp -= 2;
+    DISPATCH();
+
+/*
+* The element types of arrays are only known when they run, the array
+* functions check them with the references and the indices.
+*/
+TARGET(op_newarray, OP_NEWARRAY)
+    OPERAND();
+
+    // the collector finds the roots through the registers of the instance
+    SAVE_STATE();
+    if (0 != new_array(instance, (enum vm_types)arg, INTEGER(osp - 1), &stack[osp - 1]))
+    {
+        return -1;
+    }
+
+    DISPATCH();
+
+TARGET(op_alen, OP_ALEN)
+    if (0 != get_array_length(instance, stack[osp - 1], &stack[osp - 1]))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    NEXT();
+
+TARGET(op_baload, OP_BALOAD)
+    array_opcode = "baload";
+    array_type = VM_TYPE_BYTE;
+    goto load_element;
+
+TARGET(op_iaload, OP_IALOAD)
+    array_opcode = "iaload";
+    array_type = VM_TYPE_INTEGER;
+    goto load_element;
+
+TARGET(op_laload, OP_LALOAD)
+    array_opcode = "laload";
+    array_type = VM_TYPE_LONG;
+    goto load_element;
+
+TARGET(op_faload, OP_FALOAD)
+    array_opcode = "faload";
+    array_type = VM_TYPE_FLOAT;
+    goto load_element;
+
+TARGET(op_daload, OP_DALOAD)
+    array_opcode = "daload";
+    array_type = VM_TYPE_DOUBLE;
+
+load_element:
+    if (0 != load_element(instance, array_opcode, array_type, stack[osp - 2], INTEGER(osp - 1), &stack[osp - 2]))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    --osp;
+    NEXT();
+
+TARGET(op_bastore, OP_BASTORE)
+    array_opcode = "bastore";
+    array_type = VM_TYPE_BYTE;
+    goto store_element;
+
+TARGET(op_iastore, OP_IASTORE)
+    array_opcode = "iastore";
+    array_type = VM_TYPE_INTEGER;
+    goto store_element;
+
+TARGET(op_lastore, OP_LASTORE)
+    array_opcode = "lastore";
+    array_type = VM_TYPE_LONG;
+    goto store_element;
+
+TARGET(op_fastore, OP_FASTORE)
+    array_opcode = "fastore";
+    array_type = VM_TYPE_FLOAT;
+    goto store_element;
+
+TARGET(op_dastore, OP_DASTORE)
+    array_opcode = "dastore";
+    array_type = VM_TYPE_DOUBLE;
+
+store_element:
+    if (0 != store_element(instance, array_opcode, array_type, stack[osp - 3], INTEGER(osp - 2), stack[osp - 1]))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    osp -= 3;
+    NEXT();
+
+TARGET(op_afill, OP_AFILL)
+    if (0 != fill_array(instance, stack[osp - 2], INTEGER(osp - 1)))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    osp -= 2;
+    NEXT();
+
+TARGET(op_acopy, OP_ACOPY)
+    if (0 != copy_array(instance, stack[osp - 5], INTEGER(osp - 4), stack[osp - 3], INTEGER(osp - 2), INTEGER(osp - 1)))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    osp -= 5;
+    NEXT();
+
+TARGET(op_asum, OP_ASUM)
+    if (0 != sum_array(instance, stack[osp - 1], &stack[osp - 1]))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    NEXT();
+
+TARGET(op_adot, OP_ADOT)
+    if (0 != dot_arrays(instance, stack[osp - 2], stack[osp - 1], &stack[osp - 2]))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    --osp;
+    NEXT();
+
+TARGET(op_aadd, OP_AADD)
+    if (0 != add_arrays(instance, stack[osp - 3], stack[osp - 2], stack[osp - 1]))
+    {
+        SAVE_STATE();
+
+        return -1;
+    }
+
+    osp -= 3;
+    NEXT();
+
+/*
+* The long, float and double operations, the loads, stores and returns are
+* with the integer ones above and the array accesses with the other arrays.
+*/
+TARGET(op_lpush, OP_LPUSH)
+    OPERAND();
+    stack[osp] = make_long_value(arg);
+    ++osp;
+    DISPATCH();
+
+TARGET(op_ladd, OP_LADD)
+    --osp;
+    stack[osp - 1] = make_long_value(add_longs(LONG(osp - 1), LONG(osp)));
+    NEXT();
+
+TARGET(op_lsub, OP_LSUB)
+    --osp;
+    stack[osp - 1] = make_long_value(subtract_longs(LONG(osp - 1), LONG(osp)));
+    NEXT();
+
+TARGET(op_lmult, OP_LMULT)
+    --osp;
+    stack[osp - 1] = make_long_value(multiply_longs(LONG(osp - 1), LONG(osp)));
+    NEXT();
+
+TARGET(op_ldiv, OP_LDIV)
+    if (0 == LONG(osp - 1))
+    {
+        report_error(instance, "[ldiv] failed, division by zero\n");
+        ++pc;
+        SAVE_STATE();
+
+        return -1;
+    }
+    --osp;
+    stack[osp - 1] = make_long_value(divide_longs(LONG(osp - 1), LONG(osp)));
+    NEXT();
+
+TARGET(op_lneg, OP_LNEG)
+    stack[osp - 1] = make_long_value(negate_long(LONG(osp - 1)));
+    NEXT();
+
+TARGET(op_lprint, OP_LPRINT)
+    --osp;
+    output_long(instance, LONG(osp));
+    NEXT();
+
+TARGET(op_lcmp, OP_LCMP)
+    --osp;
+    stack[osp - 1] = make_integer_value(compare_longs(LONG(osp - 1), LONG(osp)));
+    NEXT();
+
+TARGET(op_fpush, OP_FPUSH)
+    OPERAND();
+    stack[osp] = make_float_value(arg);
+    ++osp;
+    DISPATCH();
+
+TARGET(op_fadd, OP_FADD)
+    --osp;
+    stack[osp - 1] = make_float_value(FLOAT(osp - 1) + FLOAT(osp));
+    NEXT();
+
+TARGET(op_fsub, OP_FSUB)
+    --osp;
+    stack[osp - 1] = make_float_value(FLOAT(osp - 1) - FLOAT(osp));
+    NEXT();
+
+TARGET(op_fmult, OP_FMULT)
+    --osp;
+    stack[osp - 1] = make_float_value(FLOAT(osp - 1) * FLOAT(osp));
+    NEXT();
+
+TARGET(op_fdiv, OP_FDIV)
+    --osp;
+    stack[osp - 1] = make_float_value(FLOAT(osp - 1) / FLOAT(osp));
+    NEXT();
+
+TARGET(op_fneg, OP_FNEG)
+    stack[osp - 1] = make_float_value(-FLOAT(osp - 1));
+    NEXT();
+
+TARGET(op_fprint, OP_FPRINT)
+    --osp;
+    output_float(instance, FLOAT(osp));
+    NEXT();
+
+TARGET(op_fcmp, OP_FCMP)
+    --osp;
+    stack[osp - 1] = make_integer_value(compare_doubles(FLOAT(osp - 1), FLOAT(osp)));
+    NEXT();
+
+TARGET(op_dpush, OP_DPUSH)
+    OPERAND();
+    stack[osp] = make_double_value(arg);
+    ++osp;
+    DISPATCH();
+
+TARGET(op_dadd, OP_DADD)
+    --osp;
+    stack[osp - 1] = make_double_value(DOUBLE(osp - 1) + DOUBLE(osp));
+    NEXT();
+
+TARGET(op_dsub, OP_DSUB)
+    --osp;
+    stack[osp - 1] = make_double_value(DOUBLE(osp - 1) - DOUBLE(osp));
+    NEXT();
+
+TARGET(op_dmult, OP_DMULT)
+    --osp;
+    stack[osp - 1] = make_double_value(DOUBLE(osp - 1) * DOUBLE(osp));
+    NEXT();
+
+TARGET(op_ddiv, OP_DDIV)
+    --osp;
+    stack[osp - 1] = make_double_value(DOUBLE(osp - 1) / DOUBLE(osp));
+    NEXT();
+
+TARGET(op_dneg, OP_DNEG)
+    stack[osp - 1] = make_double_value(-DOUBLE(osp - 1));
+    NEXT();
+
+TARGET(op_dprint, OP_DPRINT)
+    --osp;
+    output_double(instance, DOUBLE(osp));
+    NEXT();
+
+TARGET(op_dcmp, OP_DCMP)
+    --osp;
+    stack[osp - 1] = make_integer_value(compare_doubles(DOUBLE(osp - 1), DOUBLE(osp)));
+    NEXT();
+
+TARGET(op_dsqrt, OP_DSQRT)
+    stack[osp - 1] = make_double_value(sqrt(DOUBLE(osp - 1)));
+    NEXT();
+
+TARGET(op_i2l, OP_I2L)
+    stack[osp - 1] = make_long_value(INTEGER(osp - 1));
+    NEXT();
+
+TARGET(op_i2f, OP_I2F)
+    stack[osp - 1] = make_float_value((float)INTEGER(osp - 1));
+    NEXT();
+
+TARGET(op_i2d, OP_I2D)
+    stack[osp - 1] = make_double_value(INTEGER(osp - 1));
+    NEXT();
+
+TARGET(op_l2i, OP_L2I)
+    stack[osp - 1] = make_integer_value((int)LONG(osp - 1));
+    NEXT();
+
+TARGET(op_l2f, OP_L2F)
+    stack[osp - 1] = make_float_value((float)LONG(osp - 1));
+    NEXT();
+
+TARGET(op_l2d, OP_L2D)
+    stack[osp - 1] = make_double_value(LONG(osp - 1));
+    NEXT();
+
+TARGET(op_f2i, OP_F2I)
+    stack[osp - 1] = make_integer_value(double_to_integer(FLOAT(osp - 1)));
+    NEXT();
+
+TARGET(op_f2l, OP_F2L)
+    stack[osp - 1] = make_long_value(double_to_long(FLOAT(osp - 1)));
+    NEXT();
+
+TARGET(op_f2d, OP_F2D)
+    stack[osp - 1] = make_double_value(FLOAT(osp - 1));
+    NEXT();
+
+TARGET(op_d2i, OP_D2I)
+    stack[osp - 1] = make_integer_value(double_to_integer(DOUBLE(osp - 1)));
+    NEXT();
+
+TARGET(op_d2l, OP_D2L)
+    stack[osp - 1] = make_long_value(double_to_long(DOUBLE(osp - 1)));
+    NEXT();
+
+TARGET(op_d2f, OP_D2F)
+    stack[osp - 1] = make_float_value((float)DOUBLE(osp - 1));
+    NEXT();
+
+#if !HAS_COMPUTED_GOTO
+    default:
+#endif
+TARGET(op_end, DENSE_END)
+    print_error(instance, "reached the end of the code region");
+    SAVE_STATE();
+
+    return -1;
+
+END_DISPATCH()
+
+#undef TARGET
+#undef DISPATCH
+#undef END_DISPATCH
+#undef SAVE_STATE
+#undef LOAD_STATE
+#undef NEXT
+#undef OPERAND
+#undef INTEGER
+#undef LONG
+#undef FLOAT
+#undef DOUBLE
+}
+
+void free_dense_code(vm_program_t *program)
+{
+    assert(program);
+
+    free(program->encoded_code);
+    program->encoded_code = NULL;
+    free(program->decoded_instructions);
+    program->decoded_instructions = NULL;
+    free(program->dense_offsets);
+    program->dense_offsets = NULL;
+    program->dense_code = NULL;
+    program->dense_code_size = 0;
+}
+
+
+/* STATIC FUNCTIONS */
+/*
+* Encodes the whole code region, followed by DENSE_END, and points every
+* method at its first byte. Called with prepare_lock held.
+*/
+static int encode_program(vm_program_t *program)
+{
+    unsigned int *offsets = NULL;
+    unsigned char *code = NULL, *shrunk = NULL;
+    size_t size = 0;
+
+    offsets = (unsigned int *)malloc(sizeof(unsigned int) * (program->num_instructions + 1));
+    code = (unsigned char *)malloc((size_t)program->num_instructions * DENSE_MAX_INSTRUCTION_SIZE + 1);
+    if (NULL == offsets || NULL == code)
+    {
+        free(offsets);
+        free(code);
+
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < program->num_instructions; ++i)
+    {
+        offsets[i] = size;
+        size += encode_dense_instruction(&code[size], &program->file_instructions[i]);
+    }
+    offsets[program->num_instructions] = size;
+    code[size++] = DENSE_END;
+
+    shrunk = (unsigned char *)realloc(code, size);
+    code = (NULL == shrunk ? code : shrunk);
+
+    // a v2 file has methods no constant refers to, main among them
+    for (unsigned int i = 0; NULL != program->method_table && i < program->num_methods; ++i)
+    {
+        set_dense_offset(&program->method_table[i], offsets, program->num_instructions);
+    }
+    for (unsigned int i = 0; NULL == program->method_table && i < program->constant_pool_size; ++i)
+    {
+        if (is_value_type(program->constant_pool[i], VM_TYPE_METHOD))
+        {
+            set_dense_offset(get_method_value(program->constant_pool[i]), offsets, program->num_instructions);
+        }
+    }
+
+    // kept for the branches, which jump by instruction index
+    program->dense_offsets = offsets;
+    program->encoded_code = code;
+    program->dense_code = code;
+    program->dense_code_size = size;
+
+    return 0;
+}
+
+static void set_dense_offset(vm_method_meta_t *method, const unsigned int *offsets, unsigned int num_instructions)
+{
+    // a method outside the code region fails verification before it can run
+    method->dense_offset = offsets[(method->offset <= num_instructions ? method->offset : num_instructions)];
+}
+
+/* the index of the instruction at offset, the offsets of a method grow with the index */
+static unsigned int find_dense_instruction(const vm_program_t *program, const vm_method_meta_t *method,
+                                           unsigned int offset)
+{
+    unsigned int low = method->offset, high = method->offset + method->code_length - 1, middle = 0;
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (program->dense_offsets[middle] < offset)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
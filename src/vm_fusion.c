@@ -0,0 +1,163 @@
+#include <assert.h>    /* assert    */
+#include <stdlib.h>    /* malloc    */
+#include <string.h>    /* memcpy    */
+
+#include "opcodes.h"   /* opcodes           */
+#include "vm_impl.h"   /* private vm header */
+#include "vm_fusion.h" /* superinstructions */
+
+#define MAX_SEQUENCE_LENGTH 4
+
+typedef struct superinstruction
+{
+    enum opcodes opcode;
+    unsigned int length;
+    enum opcodes sequence[MAX_SEQUENCE_LENGTH];
+} superinstruction_t;
+
+/* longer sequences first, the first match wins */
+static const superinstruction_t superinstructions[] = {
+    { OP_IADD_LLS,   4, { OP_ILOAD, OP_ILOAD, OP_IADD, OP_ISTORE } },
+    { OP_ISUB_LLS,   4, { OP_ILOAD, OP_ILOAD, OP_ISUB, OP_ISTORE } },
+    { OP_IADD_LL,    3, { OP_ILOAD, OP_ILOAD, OP_IADD } },
+    { OP_ISUB_LL,    3, { OP_ILOAD, OP_ILOAD, OP_ISUB } },
+    { OP_IMULT_LL,   3, { OP_ILOAD, OP_ILOAD, OP_IMULT } },
+    { OP_IADD_LI,    3, { OP_ILOAD, OP_IPUSH, OP_IADD } },
+    { OP_ISUB_LI,    3, { OP_ILOAD, OP_IPUSH, OP_ISUB } },
+    { OP_IMULT_LI,   3, { OP_ILOAD, OP_IPUSH, OP_IMULT } },
+    { OP_ISTORE_IMM, 2, { OP_IPUSH, OP_ISTORE } },
+    { OP_ILOAD2,     2, { OP_ILOAD, OP_ILOAD } },
+};
+
+#define NUM_SUPERINSTRUCTIONS (sizeof(superinstructions) / sizeof(superinstructions[0]))
+
+static void fuse_range(vm_instruction_t *instructions, unsigned int first, unsigned int end);
+static const superinstruction_t *match_superinstruction(const vm_instruction_t *instructions,
+                                                        unsigned int remaining);
+
+int fuse_superinstructions(vm_program_t *program)
+{
+    vm_instruction_t *instructions = NULL;
+
+    assert(program && program->instructions && program->verified);
+
+    instructions = (vm_instruction_t *)malloc(sizeof(vm_instruction_t) * program->num_instructions);
+    if (NULL == instructions)
+    {
+        return -1;
+    }
+    memcpy(instructions, program->instructions, sizeof(vm_instruction_t) * program->num_instructions);
+
+    fuse_range(instructions, 0, program->num_instructions);
+
+    program->fused_instructions = instructions;
+    program->instructions = instructions;
+
+    return 0;
+}
+
+int fuse_method_superinstructions(vm_program_t *program, const vm_method_meta_t *method)
+{
+    vm_instruction_t *instructions = NULL;
+
+    assert(program && method && program->file_instructions && program->verified);
+
+    // the methods that were not prepared yet stay zeroed, nothing jumps there before they are
+    if (NULL == program->fused_instructions)
+    {
+        instructions = (vm_instruction_t *)calloc(program->num_instructions, sizeof(vm_instruction_t));
+        if (NULL == instructions)
+        {
+            return -1;
+        }
+
+        program->fused_instructions = instructions;
+        program->instructions = instructions;
+    }
+
+    memcpy(&program->fused_instructions[method->offset], &program->file_instructions[method->offset],
+           sizeof(vm_instruction_t) * method->code_length);
+
+    fuse_range(program->fused_instructions, method->offset, method->offset + method->code_length);
+
+    return 0;
+}
+
+enum opcodes get_unfused_opcode(enum opcodes opcode)
+{
+    for (unsigned int i = 0; i < NUM_SUPERINSTRUCTIONS; ++i)
+    {
+        if (superinstructions[i].opcode == opcode)
+        {
+            return superinstructions[i].sequence[0];
+        }
+    }
+
+    return opcode;
+}
+
+void free_fused_instructions(vm_program_t *program)
+{
+    assert(program);
+
+    if (program->instructions == program->fused_instructions)
+    {
+        program->instructions = NULL;
+    }
+
+    free(program->fused_instructions);
+    program->fused_instructions = NULL;
+}
+
+
+/* STATIC FUNCTIONS */
+static void fuse_range(vm_instruction_t *instructions, unsigned int first, unsigned int end)
+{
+    const superinstruction_t *match = NULL;
+    unsigned int ip = first;
+
+    while (ip < end)
+    {
+        match = match_superinstruction(&instructions[ip], end - ip);
+        if (NULL == match)
+        {
+            ++ip;
+            continue;
+        }
+
+        // the arg of the first instruction stays, the others are read from their slots
+        instructions[ip].opcode = match->opcode;
+        ip += match->length;
+    }
+}
+
+static const superinstruction_t *match_superinstruction(const vm_instruction_t *instructions,
+                                                        unsigned int remaining)
+{
+    const superinstruction_t *candidate = NULL;
+    unsigned int i = 0;
+
+    for (unsigned int j = 0; j < NUM_SUPERINSTRUCTIONS; ++j)
+    {
+        candidate = &superinstructions[j];
+        if (candidate->length > remaining)
+        {
+            continue;
+        }
+
+        for (i = 0; i < candidate->length; ++i)
+        {
+            if (candidate->sequence[i] != instructions[i].opcode)
+            {
+                break;
+            }
+        }
+
+        if (i == candidate->length)
+        {
+            return candidate;
+        }
+    }
+
+    return NULL;
+}
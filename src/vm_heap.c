@@ -0,0 +1,439 @@
+#include <assert.h>    /* assert        */
+#include <stdio.h>     /* fprintf       */
+#include <stdlib.h>    /* malloc        */
+#include <string.h>    /* memcpy        */
+
+#include "vm_impl.h"   /* private vm header */
+#include "vm_util.h"   /* utility functions */
+#include "vm_heap.h"   /* heap              */
+
+#define HEAP_ALIGNMENT 16
+#define NURSERY_FRACTION 8 // of the heap, up to MAX_NURSERY_SIZE
+#define MAX_NURSERY_SIZE (256 * 1024) // small enough to stay in the cache
+#define INITIAL_REMEMBERED_CAPACITY 64
+
+static int alloc_heap(vm_t *instance);
+static void *allocate_old(vm_t *instance, size_t size);
+static size_t get_nursery_size(const vm_t *instance);
+static size_t get_semispace_size(const vm_t *instance);
+static size_t get_old_free(const vm_t *instance);
+static void update_nursery_end(vm_t *instance);
+static void scan_stack(vm_t *instance, char **copy_end, int full);
+static void scan_slots(vm_t *instance, vm_value_t *first, vm_value_t *end, char **copy_end, int full);
+static void scan_fields(vm_t *instance, vm_object_t *object, char **copy_end, int full);
+static void scan_objects(vm_t *instance, char *scan, char **copy_end, int full);
+static void evacuate(vm_t *instance, vm_value_t *slot, char **copy_end);
+static void record_pause(vm_t *instance, double start, int full);
+static int is_in_heap_space(const vm_t *instance, const void *address);
+
+void *allocate_heap_slow(vm_t *instance, size_t size)
+{
+    assert(instance);
+
+    if (NULL == instance->heap && 0 != alloc_heap(instance))
+    {
+        return NULL;
+    }
+
+    if (size > LARGE_OBJECT_SIZE || size > get_nursery_size(instance))
+    {
+        return allocate_old(instance, size);
+    }
+
+    if ((size_t)(instance->nursery_end - instance->nursery_top) < size)
+    {
+        collect_nursery(instance);
+
+        // the nursery shrinks with what is left of the old generation, collect it before
+        if (get_old_free(instance) < get_nursery_size(instance))
+        {
+            collect_garbage(instance);
+        }
+    }
+
+    if ((size_t)(instance->nursery_end - instance->nursery_top) < size)
+    {
+        return NULL;
+    }
+
+    return allocate_heap(instance, size);
+}
+
+void remember_object(vm_t *instance, vm_object_t *object)
+{
+    vm_object_t **remembered = NULL;
+    unsigned int capacity = 0;
+
+    assert(instance && object);
+
+    // set even on overflow, the next minor collection clears the flags of every old object
+    object->flags |= OBJECT_REMEMBERED;
+
+    if (instance->remembered_overflow)
+    {
+        return;
+    }
+
+    if (instance->num_remembered == instance->remembered_capacity)
+    {
+        capacity = (0 == instance->remembered_capacity ? INITIAL_REMEMBERED_CAPACITY : instance->remembered_capacity * 2);
+        remembered = (vm_object_t **)realloc(instance->remembered, sizeof(vm_object_t *) * capacity);
+        if (NULL == remembered)
+        {
+            instance->remembered_overflow = 1;
+
+            return;
+        }
+
+        instance->remembered = remembered;
+        instance->remembered_capacity = capacity;
+    }
+
+    instance->remembered[instance->num_remembered++] = object;
+}
+
+vm_value_t *get_object_field(vm_t *instance, const char *name, vm_value_t reference, int index, enum vm_types type)
+{
+    vm_object_t *object = NULL;
+
+    assert(instance && name);
+
+    object = (vm_object_t *)get_reference_value(reference);
+    if (NULL == object)
+    {
+        report_error(instance, "[%s] failed, null reference!\n", name);
+
+        return NULL;
+    }
+
+    if (0 != object->element_type)
+    {
+        report_error(instance, "[%s] failed, the reference is to an array!\n", name);
+
+        return NULL;
+    }
+
+    if (index < 0 || (unsigned int)index >= object->num_fields)
+    {
+        report_error(instance, "[%s] failed, field %d is out of bounds of an object of %u fields!\n",
+            name, index, object->num_fields);
+
+        return NULL;
+    }
+
+    if (0 != type && !is_value_type(object->fields[index], type))
+    {
+        report_error(instance, "[%s] failed, field %d is of type: %s\n",
+            name, index, get_type_name(get_value_type(object->fields[index])));
+
+        return NULL;
+    }
+
+    return &object->fields[index];
+}
+
+/*
+* Every object of the nursery still reachable is promoted: copied to the end
+* of the old generation, where Cheney's algorithm scans the copies in order
+* and promotes what their fields refer to after them, until the scan catches
+* up with the end of the copies. The forward pointer left in every old copy
+* keeps shared objects shared. nursery_end guarantees there is room for the
+* whole nursery.
+*/
+void collect_nursery(vm_t *instance)
+{
+    char *first_promoted = NULL, *copy_end = NULL, *object = NULL;
+    double start = 0;
+
+    assert(instance);
+
+    if (NULL == instance->heap)
+    {
+        return;
+    }
+
+    start = get_monotonic_time();
+    first_promoted = copy_end = instance->heap_top;
+
+    scan_stack(instance, &copy_end, 0);
+
+    if (instance->remembered_overflow)
+    {
+        object = instance->heap_space;
+        while (object < first_promoted)
+        {
+            vm_object_t *old = (vm_object_t *)object;
+
+            old->flags &= ~OBJECT_REMEMBERED;
+            scan_fields(instance, old, &copy_end, 0);
+            object += get_heap_object_size(old);
+        }
+    }
+    else
+    {
+        for (unsigned int i = 0; i < instance->num_remembered; ++i)
+        {
+            vm_object_t *remembered = instance->remembered[i];
+
+            remembered->flags &= ~OBJECT_REMEMBERED;
+            scan_fields(instance, remembered, &copy_end, 0);
+        }
+    }
+
+    scan_objects(instance, first_promoted, &copy_end, 0);
+
+    instance->heap_top = copy_end;
+    instance->nursery_top = instance->nursery;
+    instance->num_remembered = 0;
+    instance->remembered_overflow = 0;
+    update_nursery_end(instance);
+
+    instance->gc_stats.promoted_bytes += (size_t)(copy_end - first_promoted);
+    record_pause(instance, start, 0);
+}
+
+/*
+* The same copying, from the nursery and the old generation to the spare
+* semispace, which then becomes the old generation. What was in the nursery
+* fits, the nursery is never larger than the free part of the old generation.
+*/
+void collect_garbage(vm_t *instance)
+{
+    char *space = NULL, *copy_end = NULL;
+    double start = 0;
+
+    assert(instance);
+
+    if (NULL == instance->heap)
+    {
+        return;
+    }
+
+    start = get_monotonic_time();
+    copy_end = instance->heap_spare;
+
+    scan_stack(instance, &copy_end, 1);
+    scan_objects(instance, instance->heap_spare, &copy_end, 1);
+
+    space = instance->heap_space;
+    instance->heap_space = instance->heap_spare;
+    instance->heap_spare = space;
+    instance->heap_top = copy_end;
+    instance->heap_end = instance->heap_space + get_semispace_size(instance);
+    instance->nursery_top = instance->nursery;
+    instance->num_remembered = 0;
+    instance->remembered_overflow = 0;
+    update_nursery_end(instance);
+
+    record_pause(instance, start, 1);
+}
+
+void reset_heap(vm_t *instance)
+{
+    assert(instance);
+
+    if (NULL == instance->heap)
+    {
+        return;
+    }
+
+    instance->nursery_top = instance->nursery;
+    instance->heap_top = instance->heap_space;
+    instance->num_remembered = 0;
+    instance->remembered_overflow = 0;
+    update_nursery_end(instance);
+}
+
+void free_heap(vm_t *instance)
+{
+    assert(instance);
+
+    free(instance->heap);
+    free(instance->remembered);
+    instance->heap = NULL;
+    instance->nursery = NULL;
+    instance->nursery_top = NULL;
+    instance->nursery_end = NULL;
+    instance->heap_space = NULL;
+    instance->heap_spare = NULL;
+    instance->heap_top = NULL;
+    instance->heap_end = NULL;
+    instance->remembered = NULL;
+    instance->num_remembered = 0;
+    instance->remembered_capacity = 0;
+    instance->remembered_overflow = 0;
+}
+
+
+/* STATIC FUNCTIONS */
+static int alloc_heap(vm_t *instance)
+{
+    size_t nursery_size = get_nursery_size(instance);
+    size_t semispace_size = get_semispace_size(instance);
+
+    instance->heap = (char *)malloc(nursery_size + semispace_size * 2);
+    if (NULL == instance->heap)
+    {
+        return -1;
+    }
+
+    instance->nursery = instance->heap;
+    instance->nursery_top = instance->nursery;
+    instance->heap_space = instance->nursery + nursery_size;
+    instance->heap_spare = instance->heap_space + semispace_size;
+    instance->heap_top = instance->heap_space;
+    instance->heap_end = instance->heap_space + semispace_size;
+    instance->gc_stats.heap_size = nursery_size + semispace_size;
+    update_nursery_end(instance);
+
+    return 0;
+}
+
+/* large objects start old, they would fill the nursery and be copied when they survive */
+static void *allocate_old(vm_t *instance, size_t size)
+{
+    size_t nursery_used = (size_t)(instance->nursery_top - instance->nursery);
+    char *memory = NULL;
+
+    // what is in the nursery must still fit in the old generation
+    if (get_old_free(instance) < size + nursery_used)
+    {
+        collect_garbage(instance);
+        nursery_used = 0;
+    }
+
+    if (get_old_free(instance) < size + nursery_used)
+    {
+        return NULL;
+    }
+
+    memory = instance->heap_top;
+    instance->heap_top += size;
+    instance->gc_stats.bytes_allocated += size;
+    ++instance->gc_stats.objects_allocated;
+    update_nursery_end(instance);
+
+    return memory;
+}
+
+static size_t get_nursery_size(const vm_t *instance)
+{
+    size_t size = instance->heap_size / NURSERY_FRACTION;
+
+    return (size > MAX_NURSERY_SIZE ? MAX_NURSERY_SIZE : size) / HEAP_ALIGNMENT * HEAP_ALIGNMENT;
+}
+
+static size_t get_semispace_size(const vm_t *instance)
+{
+    return (instance->heap_size - get_nursery_size(instance)) / 2 / HEAP_ALIGNMENT * HEAP_ALIGNMENT;
+}
+
+static size_t get_old_free(const vm_t *instance)
+{
+    return (size_t)(instance->heap_end - instance->heap_top);
+}
+
+/* the nursery is never larger than the free part of the old generation, so it can always be promoted */
+static void update_nursery_end(vm_t *instance)
+{
+    size_t size = get_nursery_size(instance);
+    size_t old_free = get_old_free(instance);
+
+    instance->nursery_end = instance->nursery + (old_free < size ? old_free : size);
+}
+
+/* the frames of the callers are described by the registers saved in their callees */
+static void scan_stack(vm_t *instance, char **copy_end, int full)
+{
+    vm_stack_frame_t *frame = NULL;
+    unsigned int lap = instance->lap, sp = instance->sp, osp = instance->osp;
+
+    for (frame = instance->stack_trace; NULL != frame && frame >= instance->frames; --frame)
+    {
+        // stack[sp] only separates the locals from the operand stack
+        scan_slots(instance, &instance->stack[lap], &instance->stack[sp], copy_end, full);
+        scan_slots(instance, &instance->stack[sp + 1], &instance->stack[osp], copy_end, full);
+
+        lap = frame->saved_lap;
+        sp = frame->saved_sp;
+        osp = frame->saved_osp;
+    }
+}
+
+/* a minor collection only copies the objects of the nursery, a full one every object */
+static void scan_slots(vm_t *instance, vm_value_t *first, vm_value_t *end, char **copy_end, int full)
+{
+    for (vm_value_t *slot = first; slot < end; ++slot)
+    {
+        if (is_value_type(*slot, VM_TYPE_REFERENCE) && NULL != get_reference_value(*slot) &&
+            (full || is_in_nursery(instance, get_reference_value(*slot))))
+        {
+            evacuate(instance, slot, copy_end);
+        }
+    }
+}
+
+/* the elements of arrays are numbers, only the fields of objects can refer to others */
+static void scan_fields(vm_t *instance, vm_object_t *object, char **copy_end, int full)
+{
+    if (0 == object->element_type)
+    {
+        scan_slots(instance, object->fields, object->fields + object->num_fields, copy_end, full);
+    }
+}
+
+/* scans the copies from scan on, and copies what they refer to after them */
+static void scan_objects(vm_t *instance, char *scan, char **copy_end, int full)
+{
+    while (scan < *copy_end)
+    {
+        vm_object_t *object = (vm_object_t *)scan;
+
+        scan_fields(instance, object, copy_end, full);
+        scan += get_heap_object_size(object);
+    }
+}
+
+/* copies the object the slot refers to, once, and points the slot at the copy */
+static void evacuate(vm_t *instance, vm_value_t *slot, char **copy_end)
+{
+    vm_object_t *object = (vm_object_t *)get_reference_value(*slot);
+    vm_object_t *copy = object->forward;
+
+    assert(is_in_nursery(instance, object) || is_in_heap_space(instance, object));
+
+    if (NULL == copy)
+    {
+        copy = (vm_object_t *)*copy_end;
+        memcpy(copy, object, get_heap_object_size(object));
+        *copy_end += get_heap_object_size(object);
+
+        // nothing refers to the nursery after a collection, the set is emptied
+        copy->flags &= ~OBJECT_REMEMBERED;
+        object->forward = copy;
+    }
+
+    *slot = make_reference_value(copy);
+}
+
+static void record_pause(vm_t *instance, double start, int full)
+{
+    double pause = get_monotonic_time() - start;
+
+    instance->gc_stats.live_bytes = (size_t)(instance->heap_top - instance->heap_space);
+    instance->gc_stats.total_pause_time += pause;
+    instance->gc_stats.max_pause_time = (pause > instance->gc_stats.max_pause_time ?
+                                         pause : instance->gc_stats.max_pause_time);
+    ++instance->gc_stats.collections;
+
+    if (!full)
+    {
+        instance->gc_stats.minor_pause_time += pause;
+        ++instance->gc_stats.minor_collections;
+    }
+}
+
+static int is_in_heap_space(const vm_t *instance, const void *address)
+{
+    return (const char *)address >= instance->heap_space && (const char *)address < instance->heap_end;
+}
@@ -0,0 +1,1050 @@
+#include <assert.h>    /* assert    */
+#include <stddef.h>    /* offsetof  */
+#include <stdlib.h>    /* malloc    */
+#include <string.h>    /* memcpy    */
+#include <sys/mman.h>  /* mmap      */
+
+#include "opcodes.h"   /* opcodes           */
+#include "vm_impl.h"   /* private vm header */
+#include "vm_util.h"   /* utility functions */
+#include "vm_jit.h"    /* jit               */
+#include "vm_fusion.h" /* superinstructions */
+
+#if HAS_JIT
+
+/*
+* A baseline template jit. A hot method is compiled over its code range, one
+* template per instruction the verifier found reachable, into a function of
+* the form
+*
+*   unsigned int method(vm_t *instance, vm_value_t *locals, unsigned int entry)
+*
+* Locals and the operand stack stay in the vm stack, but every operand stack
+* depth is known at compile time, so each slot is a fixed displacement from
+* locals and no osp is kept at run time. Values pushed by ipush, iload and
+* cload are not written until an instruction needs them, and the last result
+* stays in eax, which removes most of the stack traffic of integer code.
+*
+* Instructions without a template (calls, returns, printing, strings) exit
+* to the interpreter: the operand stack is written back, osp is set and the
+* index of the instruction is returned. The instruction right after such an
+* exit is an entry point, so once the interpreter has run the instruction it
+* jumps back into the native code through the entry table.
+*
+* Branches are jumps between entry points: values are written back before a
+* branch and every branch target starts with the whole operand stack in
+* memory, at the depth the verifier recorded for it. A method whose loop is
+* hot is entered at the loop header the same way (jit_enter_loop).
+*/
+
+typedef unsigned int (*jit_function_t)(vm_t *instance, vm_value_t *locals, unsigned int entry);
+
+enum jit_value_kind
+{
+    JIT_VALUE_MEMORY,   // in its operand stack slot
+    JIT_VALUE_CONSTANT, // an integer known at compile time
+    JIT_VALUE_LOCAL,    // still in a local variable
+    JIT_VALUE_REGISTER  // in eax
+};
+
+typedef struct jit_value
+{
+    enum jit_value_kind kind;
+    int arg; // the constant or the local index
+} jit_value_t;
+
+typedef struct jit_buffer
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    int failed; // an allocation failed, the buffer is incomplete
+} jit_buffer_t;
+
+typedef struct jit_fixup
+{
+    size_t offset; // of the rel32 of a jump in the body
+    unsigned int target; // the instruction it jumps to
+} jit_fixup_t;
+
+typedef struct jit_compiler
+{
+    const vm_program_t *program;
+    const vm_method_meta_t *method;
+    unsigned int start; // index of the first instruction
+    unsigned int end;   // index of the last instruction of the code range
+
+    jit_buffer_t body;
+    int *entries; // body offset of every entry point, -1 for other instructions, ENTRY_TARGET until compiled
+    jit_fixup_t *fixups; // the jumps to patch once every entry is known
+    unsigned int num_fixups;
+    int needs_entry; // the next instruction is not reached by falling through, only through the entry table
+
+    jit_value_t *stack; // the operand stack at compile time
+    int depth;
+    int register_owner; // the stack position whose value is in eax, -1 for none
+    int frame_size; // params, locals and the separator slot
+} jit_compiler_t;
+
+/* x86-64 encodings, rsi holds locals and rdi the instance */
+#define X86_RET 0xC3
+#define X86_CDQ 0x99
+#define MODRM_EAX_RSI 0x86 // [rsi + disp32], eax
+#define MODRM_ECX_RSI 0x8E // [rsi + disp32], ecx
+#define MODRM_EAX_RDI 0x87 // [rdi + disp32], eax
+
+#define ENTRY_TARGET -2 // a branch target, it becomes an entry point when it is compiled
+
+#define PROLOGUE_SIZE 37
+#define PROLOGUE_FALLBACK 36 // the ret that hands unknown entries back to the interpreter
+
+static jit_function_t compile_hot_method(const vm_program_t *program, vm_method_meta_t *method);
+static int run_native_frame(vm_t *instance, jit_function_t code);
+static int compile_method(jit_compiler_t *compiler);
+static int compile_instruction(jit_compiler_t *compiler, unsigned int ip);
+static void compile_exit(jit_compiler_t *compiler, unsigned int ip);
+static void compile_arithmetic(jit_compiler_t *compiler, enum opcodes opcode);
+static void compile_idiv(jit_compiler_t *compiler, unsigned int ip);
+static void compile_istore(jit_compiler_t *compiler, int index);
+static void compile_branch(jit_compiler_t *compiler, enum opcodes opcode, unsigned int target);
+static void open_entry(jit_compiler_t *compiler, unsigned int ip);
+static void emit_jump(jit_compiler_t *compiler, int condition_code, unsigned int target);
+static void patch_fixups(jit_compiler_t *compiler);
+static void push_value(jit_compiler_t *compiler, enum jit_value_kind kind, int arg);
+static void load_eax(jit_compiler_t *compiler, int position);
+static void spill(jit_compiler_t *compiler, int position);
+static void spill_all(jit_compiler_t *compiler);
+static void emit_exit(jit_compiler_t *compiler, unsigned int ip, int depth);
+static void emit_operand(jit_compiler_t *compiler, int position, int opcode_size,
+                         const unsigned char *memory_opcode, const unsigned char *imm_opcode);
+static void emit_modrm_disp(jit_buffer_t *buffer, int modrm, int disp);
+static void emit_byte(jit_buffer_t *buffer, int byte);
+static void emit_int(jit_buffer_t *buffer, int value);
+static void *link_code(jit_compiler_t *compiler, size_t *code_size);
+static int local_disp(int index);
+static int slot_disp(jit_compiler_t *compiler, int position);
+static int type_disp(jit_compiler_t *compiler, int position);
+
+int jit_enter_method(vm_t *instance, vm_method_meta_t *method)
+{
+    jit_function_t code = NULL;
+
+    assert(instance && method);
+
+    code = (jit_function_t)__atomic_load_n(&method->jit_code, __ATOMIC_ACQUIRE);
+    if (NULL == code)
+    {
+        if (__atomic_add_fetch(&method->num_calls, 1, __ATOMIC_RELAXED) < instance->jit_threshold)
+        {
+            return 0;
+        }
+
+        code = compile_hot_method(instance->program, method);
+        if (NULL == code)
+        {
+            return 0;
+        }
+    }
+
+    return run_native_frame(instance, code);
+}
+
+int jit_enter_loop(vm_t *instance)
+{
+    vm_method_meta_t *method = NULL;
+    jit_function_t code = NULL;
+
+    assert(instance && instance->stack_trace);
+
+    // the frames only see their method as const, its jit fields are shared through atomics
+    method = (vm_method_meta_t *)instance->stack_trace->method_meta;
+
+    code = (jit_function_t)__atomic_load_n(&method->jit_code, __ATOMIC_ACQUIRE);
+    if (NULL == code)
+    {
+        // a method that failed to compile would otherwise retry on every iteration
+        if (JIT_STATE_NONE != __atomic_load_n(&method->jit_state, __ATOMIC_ACQUIRE) ||
+            __atomic_add_fetch(&method->num_backedges, 1, __ATOMIC_RELAXED) < instance->jit_threshold)
+        {
+            return 0;
+        }
+
+        code = compile_hot_method(instance->program, method);
+        if (NULL == code)
+        {
+            return 0;
+        }
+    }
+
+    return run_native_frame(instance, code);
+}
+
+void free_jit_code(vm_program_t *program)
+{
+    vm_method_meta_t *method = NULL;
+
+    assert(program);
+
+    if (NULL == program->constant_pool)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < program->constant_pool_size; ++i)
+    {
+        if (!is_value_type(program->constant_pool[i], VM_TYPE_METHOD) ||
+            NULL == get_method_value(program->constant_pool[i]))
+        {
+            continue;
+        }
+
+        method = get_method_value(program->constant_pool[i]);
+        if (NULL != method->jit_code)
+        {
+            munmap(method->jit_code, method->jit_code_size);
+            method->jit_code = NULL;
+        }
+    }
+}
+
+
+/* STATIC FUNCTIONS */
+
+/* the first thread to get here compiles, the others keep interpreting */
+static jit_function_t compile_hot_method(const vm_program_t *program, vm_method_meta_t *method)
+{
+    jit_compiler_t compiler = {0};
+    int expected = JIT_STATE_NONE;
+    void *code = NULL;
+    size_t code_size = 0;
+
+    if (!__atomic_compare_exchange_n(&method->jit_state, &expected, JIT_STATE_COMPILING,
+                                     0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return (jit_function_t)__atomic_load_n(&method->jit_code, __ATOMIC_ACQUIRE);
+    }
+
+    compiler.program = program;
+    compiler.method = method;
+
+    if (0 == compile_method(&compiler))
+    {
+        code = link_code(&compiler, &code_size);
+    }
+
+    free(compiler.body.data);
+    free(compiler.entries);
+    free(compiler.fixups);
+    free(compiler.stack);
+
+    if (NULL == code)
+    {
+        __atomic_store_n(&method->jit_state, JIT_STATE_FAILED, __ATOMIC_RELEASE);
+
+        return NULL;
+    }
+
+    method->jit_code_size = code_size;
+    __atomic_store_n(&method->jit_code, code, __ATOMIC_RELEASE);
+    __atomic_store_n(&method->jit_state, JIT_STATE_COMPILED, __ATOMIC_RELEASE);
+
+    return (jit_function_t)code;
+}
+
+/*
+* Runs the method of the current frame until it returns. The native code
+* hands back every instruction it has no template for, which is run here,
+* together with the whole call when it is a call to an interpreted method.
+* A tailcall to another method leaves the frame to the interpreter, one to
+* the method itself continues at its entry.
+*/
+static int run_native_frame(vm_t *instance, jit_function_t code)
+{
+    const vm_stack_frame_t *frame = instance->stack_trace;
+    const vm_method_meta_t *method = frame->method_meta;
+    const vm_instruction_t *instruction = NULL;
+    unsigned int entry = instance->ip;
+    int res = 0;
+
+    for (;;)
+    {
+        instance->ip = code(instance, &instance->stack[instance->lap], entry);
+
+        do
+        {
+            instruction = read_next_instruction(instance);
+            res = instance->opcode_handlers[instruction->opcode](instance);
+            if (0 != res || VM_RUNNING != instance->state)
+            {
+                return res;
+            }
+        } while (instance->stack_trace > frame);
+
+        if (instance->stack_trace < frame || frame->method_meta != method)
+        {
+            return 0; // the method returned, or its frame went to another one
+        }
+
+        entry = instance->ip;
+    }
+}
+
+static int compile_method(jit_compiler_t *compiler)
+{
+    const vm_program_t *program = compiler->program;
+    const vm_instruction_t *instruction = NULL;
+    unsigned int ip = 0, num_instructions = 0;
+
+    // the range and the depths come from the verifier, which every method passed before it runs
+    if (NULL == program->stack_depths || 0 == compiler->method->code_length)
+    {
+        return -1;
+    }
+
+    compiler->start = compiler->method->offset;
+    compiler->end = compiler->start + compiler->method->code_length - 1;
+
+    num_instructions = compiler->end - compiler->start + 1;
+    compiler->entries = (int *)malloc(sizeof(int) * num_instructions);
+    compiler->fixups = (jit_fixup_t *)malloc(sizeof(jit_fixup_t) * num_instructions);
+    compiler->stack = (jit_value_t *)malloc(sizeof(jit_value_t) * (num_instructions + 1));
+    if (NULL == compiler->entries || NULL == compiler->fixups || NULL == compiler->stack)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < num_instructions; ++i)
+    {
+        compiler->entries[i] = -1;
+    }
+
+    // code of another method inside the range of a v1 file may be anything, it is left to the interpreter
+    for (ip = compiler->start; ip <= compiler->end; ++ip)
+    {
+        instruction = &program->instructions[ip];
+        if (-1 == program->stack_depths[ip])
+        {
+            continue;
+        }
+
+        if (program->stack_depths[ip] > (int)num_instructions)
+        {
+            return -1;
+        }
+
+        if (OP_GOTO <= instruction->opcode && OP_IF_ICMPLE >= instruction->opcode)
+        {
+            if ((unsigned int)instruction->arg < compiler->start || (unsigned int)instruction->arg > compiler->end)
+            {
+                return -1;
+            }
+            compiler->entries[instruction->arg - compiler->start] = ENTRY_TARGET;
+        }
+    }
+
+    compiler->frame_size = compiler->method->num_params + compiler->method->num_locals + 1;
+    compiler->needs_entry = 1;
+
+    for (ip = compiler->start; ip <= compiler->end; ++ip)
+    {
+        // not reached by any method
+        if (-1 == program->stack_depths[ip])
+        {
+            compiler->needs_entry = 1;
+            continue;
+        }
+
+        if (compiler->needs_entry || ENTRY_TARGET == compiler->entries[ip - compiler->start])
+        {
+            open_entry(compiler, ip);
+        }
+
+        if (0 != compile_instruction(compiler, ip))
+        {
+            return -1;
+        }
+    }
+
+    patch_fixups(compiler);
+
+    return (compiler->body.failed ? -1 : 0);
+}
+
+static int compile_instruction(jit_compiler_t *compiler, unsigned int ip)
+{
+    const vm_instruction_t *instruction = &compiler->program->instructions[ip];
+    const vm_value_t *constant = NULL;
+    enum opcodes opcode = OP_NOOP;
+
+    // superinstructions are compiled one instruction at a time, like the originals
+    opcode = get_unfused_opcode(instruction->opcode);
+
+    switch (opcode)
+    {
+        case OP_NOOP:
+            return 0;
+
+        case OP_POP:
+            if (compiler->register_owner == compiler->depth - 1)
+            {
+                compiler->register_owner = -1;
+            }
+            --compiler->depth;
+            return 0;
+
+        case OP_IPUSH:
+            push_value(compiler, JIT_VALUE_CONSTANT, instruction->arg);
+            return 0;
+
+        case OP_ILOAD:
+            push_value(compiler, JIT_VALUE_LOCAL, instruction->arg);
+            return 0;
+
+        case OP_ISTORE:
+            compile_istore(compiler, instruction->arg);
+            return 0;
+
+        case OP_IADD:
+        case OP_ISUB:
+        case OP_IMULT:
+            compile_arithmetic(compiler, opcode);
+            return 0;
+
+        case OP_IDIV:
+            compile_idiv(compiler, ip);
+            return 0;
+
+        case OP_INEG:
+            load_eax(compiler, compiler->depth - 1);
+            emit_byte(&compiler->body, 0xF7); // neg eax
+            emit_byte(&compiler->body, 0xD8);
+            return 0;
+
+        case OP_GOTO:
+        case OP_IFEQ:
+        case OP_IFNE:
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+            compile_branch(compiler, opcode, (unsigned int)instruction->arg);
+            return 0;
+
+        case OP_CLOAD:
+            constant = &compiler->program->constant_pool[instruction->arg];
+            if (is_value_type(*constant, VM_TYPE_INTEGER))
+            {
+                push_value(compiler, JIT_VALUE_CONSTANT, get_integer_value(*constant));
+                return 0;
+            }
+            compile_exit(compiler, ip);
+            return 0;
+
+        default:
+            compile_exit(compiler, ip);
+            return 0;
+    }
+}
+
+/* hands the instruction to the interpreter, the next one is an entry point */
+static void compile_exit(jit_compiler_t *compiler, unsigned int ip)
+{
+    spill_all(compiler);
+    emit_exit(compiler, ip, compiler->depth);
+
+    compiler->needs_entry = 1;
+}
+
+static void compile_arithmetic(jit_compiler_t *compiler, enum opcodes opcode)
+{
+    static const unsigned char add_memory[] = { 0x03 }, add_imm[] = { 0x05 };
+    static const unsigned char sub_memory[] = { 0x2B }, sub_imm[] = { 0x2D };
+    static const unsigned char mult_memory[] = { 0x0F, 0xAF }, mult_imm[] = { 0x69 };
+    int left = compiler->depth - 2, right = compiler->depth - 1;
+    int commutative = (OP_ISUB != opcode);
+    const unsigned char *memory_opcode = NULL, *imm_opcode = NULL;
+    int opcode_size = 1;
+
+    switch (opcode)
+    {
+        case OP_IADD:
+            memory_opcode = add_memory;
+            imm_opcode = add_imm;
+            break;
+        case OP_ISUB:
+            memory_opcode = sub_memory;
+            imm_opcode = sub_imm;
+            break;
+        default:
+            memory_opcode = mult_memory;
+            imm_opcode = mult_imm;
+            opcode_size = 2;
+            break;
+    }
+
+    if (JIT_VALUE_REGISTER == compiler->stack[right].kind && commutative)
+    {
+        emit_operand(compiler, left, opcode_size, memory_opcode, imm_opcode);
+    }
+    else if (JIT_VALUE_REGISTER == compiler->stack[right].kind)
+    {
+        emit_byte(&compiler->body, 0x89); // mov ecx, eax
+        emit_byte(&compiler->body, 0xC1);
+        compiler->register_owner = -1;
+        load_eax(compiler, left);
+        emit_byte(&compiler->body, 0x29); // sub eax, ecx
+        emit_byte(&compiler->body, 0xC8);
+    }
+    else
+    {
+        load_eax(compiler, left);
+        emit_operand(compiler, right, opcode_size, memory_opcode, imm_opcode);
+    }
+
+    --compiler->depth;
+    compiler->stack[left].kind = JIT_VALUE_REGISTER;
+    compiler->register_owner = left;
+}
+
+/*
+* A zero divisor exits to the interpreter, which reports it. idiv traps on
+* INT_MIN / -1, so a divisor of -1 negates instead, like divide_integers.
+*/
+static void compile_idiv(jit_compiler_t *compiler, unsigned int ip)
+{
+    int left = compiler->depth - 2, right = compiler->depth - 1;
+    jit_value_t divisor = compiler->stack[right];
+    size_t skip = 0;
+
+    if (JIT_VALUE_CONSTANT == divisor.kind && -1 == divisor.arg)
+    {
+        load_eax(compiler, left);
+        emit_byte(&compiler->body, 0xF7); // neg eax
+        emit_byte(&compiler->body, 0xD8);
+    }
+    else if (JIT_VALUE_CONSTANT == divisor.kind && 0 != divisor.arg)
+    {
+        load_eax(compiler, left);
+        emit_byte(&compiler->body, 0xB9); // mov ecx, imm32
+        emit_int(&compiler->body, divisor.arg);
+        emit_byte(&compiler->body, X86_CDQ);
+        emit_byte(&compiler->body, 0xF7); // idiv ecx
+        emit_byte(&compiler->body, 0xF9);
+    }
+    else
+    {
+        spill_all(compiler);
+
+        emit_byte(&compiler->body, 0x83); // cmp dword [rsi + disp32], 0
+        emit_modrm_disp(&compiler->body, 0xBE, slot_disp(compiler, right));
+        emit_byte(&compiler->body, 0x00);
+        emit_byte(&compiler->body, 0x75); // jne over the exit
+        skip = compiler->body.size;
+        emit_byte(&compiler->body, 0x00);
+        emit_exit(compiler, ip, compiler->depth);
+        if (!compiler->body.failed)
+        {
+            compiler->body.data[skip] = (unsigned char)(compiler->body.size - skip - 1);
+        }
+
+        emit_byte(&compiler->body, 0x8B); // mov ecx, [rsi + disp32]
+        emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, slot_disp(compiler, right));
+        load_eax(compiler, left);
+
+        emit_byte(&compiler->body, 0x83); // cmp ecx, -1
+        emit_byte(&compiler->body, 0xF9);
+        emit_byte(&compiler->body, 0xFF);
+        emit_byte(&compiler->body, 0x75); // jne over the negation
+        emit_byte(&compiler->body, 0x04);
+        emit_byte(&compiler->body, 0xF7); // neg eax
+        emit_byte(&compiler->body, 0xD8);
+        emit_byte(&compiler->body, 0xEB); // jmp over the division
+        emit_byte(&compiler->body, 0x03);
+        emit_byte(&compiler->body, X86_CDQ);
+        emit_byte(&compiler->body, 0xF7); // idiv ecx
+        emit_byte(&compiler->body, 0xF9);
+    }
+
+    --compiler->depth;
+    compiler->stack[left].kind = JIT_VALUE_REGISTER;
+    compiler->register_owner = left;
+}
+
+static void compile_istore(jit_compiler_t *compiler, int index)
+{
+    int top = compiler->depth - 1;
+    jit_value_t value = compiler->stack[top];
+
+    // values still read from this local have to be taken before it changes
+    for (int i = 0; i < top; ++i)
+    {
+        if (JIT_VALUE_LOCAL == compiler->stack[i].kind && index == compiler->stack[i].arg)
+        {
+            spill(compiler, i);
+        }
+    }
+
+    switch (value.kind)
+    {
+        case JIT_VALUE_CONSTANT:
+            emit_byte(&compiler->body, 0xC7); // mov dword [rsi + disp32], imm32
+            emit_modrm_disp(&compiler->body, 0x86, local_disp(index));
+            emit_int(&compiler->body, value.arg);
+            break;
+
+        case JIT_VALUE_REGISTER:
+            emit_byte(&compiler->body, 0x89); // mov [rsi + disp32], eax
+            emit_modrm_disp(&compiler->body, MODRM_EAX_RSI, local_disp(index));
+            compiler->register_owner = -1;
+            break;
+
+        case JIT_VALUE_LOCAL:
+            if (index == value.arg)
+            {
+                break;
+            }
+            emit_byte(&compiler->body, 0x8B); // mov ecx, [rsi + disp32]
+            emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, local_disp(value.arg));
+            emit_byte(&compiler->body, 0x89); // mov [rsi + disp32], ecx
+            emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, local_disp(index));
+            break;
+
+        default:
+            emit_byte(&compiler->body, 0x8B); // mov ecx, [rsi + disp32]
+            emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, slot_disp(compiler, top));
+            emit_byte(&compiler->body, 0x89); // mov [rsi + disp32], ecx
+            emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, local_disp(index));
+            break;
+    }
+
+    --compiler->depth;
+}
+
+/*
+* The operands are compared in eax, with everything below them written back
+* first, since the target expects the whole operand stack in memory. The
+* instruction after a conditional branch keeps what is left of it.
+*/
+static void compile_branch(jit_compiler_t *compiler, enum opcodes opcode, unsigned int target)
+{
+    static const unsigned char cmp_memory[] = { 0x3B }, cmp_imm[] = { 0x3D };
+    int left = compiler->depth - 2, right = compiler->depth - 1;
+    int condition_code = 0;
+
+    switch (opcode)
+    {
+        case OP_GOTO:
+            spill_all(compiler);
+            emit_jump(compiler, 0, target);
+            compiler->needs_entry = 1;
+            return;
+
+        case OP_IFEQ:
+        case OP_IFNE:
+            for (int i = 0; i < right; ++i)
+            {
+                spill(compiler, i);
+            }
+            load_eax(compiler, right);
+            emit_byte(&compiler->body, 0x85); // test eax, eax
+            emit_byte(&compiler->body, 0xC0);
+            compiler->depth -= 1;
+            condition_code = (OP_IFEQ == opcode ? 0x84 : 0x85); // je, jne
+            break;
+
+        default:
+            for (int i = 0; i < left; ++i)
+            {
+                spill(compiler, i);
+            }
+            if (JIT_VALUE_REGISTER == compiler->stack[right].kind)
+            {
+                emit_byte(&compiler->body, 0x89); // mov ecx, eax
+                emit_byte(&compiler->body, 0xC1);
+                compiler->register_owner = -1;
+                load_eax(compiler, left);
+                emit_byte(&compiler->body, 0x39); // cmp eax, ecx
+                emit_byte(&compiler->body, 0xC8);
+            }
+            else
+            {
+                load_eax(compiler, left);
+                emit_operand(compiler, right, 1, cmp_memory, cmp_imm);
+            }
+            compiler->depth -= 2;
+
+            switch (opcode)
+            {
+                case OP_IF_ICMPEQ:
+                    condition_code = 0x84; // je
+                    break;
+                case OP_IF_ICMPNE:
+                    condition_code = 0x85; // jne
+                    break;
+                case OP_IF_ICMPLT:
+                    condition_code = 0x8C; // jl
+                    break;
+                case OP_IF_ICMPGE:
+                    condition_code = 0x8D; // jge
+                    break;
+                case OP_IF_ICMPGT:
+                    condition_code = 0x8F; // jg
+                    break;
+                default:
+                    condition_code = 0x8E; // jle
+                    break;
+            }
+            break;
+    }
+
+    // the compared values are gone, eax holds nothing of the operand stack
+    compiler->register_owner = -1;
+    emit_jump(compiler, condition_code, target);
+}
+
+/* the code from ip on is entered with the operand stack in memory */
+static void open_entry(jit_compiler_t *compiler, unsigned int ip)
+{
+    if (!compiler->needs_entry)
+    {
+        spill_all(compiler);
+    }
+
+    compiler->depth = compiler->program->stack_depths[ip];
+    for (int i = 0; i < compiler->depth; ++i)
+    {
+        compiler->stack[i].kind = JIT_VALUE_MEMORY;
+    }
+    compiler->register_owner = -1;
+
+    compiler->entries[ip - compiler->start] = (int)compiler->body.size;
+    compiler->needs_entry = 0;
+}
+
+/* jmp rel32, or jcc rel32 for a condition code, patched by patch_fixups */
+static void emit_jump(jit_compiler_t *compiler, int condition_code, unsigned int target)
+{
+    if (0 == condition_code)
+    {
+        emit_byte(&compiler->body, 0xE9);
+    }
+    else
+    {
+        emit_byte(&compiler->body, 0x0F);
+        emit_byte(&compiler->body, condition_code);
+    }
+
+    compiler->fixups[compiler->num_fixups].offset = compiler->body.size;
+    compiler->fixups[compiler->num_fixups].target = target;
+    ++compiler->num_fixups;
+
+    emit_int(&compiler->body, 0);
+}
+
+static void patch_fixups(jit_compiler_t *compiler)
+{
+    jit_fixup_t *fixup = NULL;
+    int rel = 0;
+
+    if (compiler->body.failed)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < compiler->num_fixups; ++i)
+    {
+        fixup = &compiler->fixups[i];
+        assert(0 <= compiler->entries[fixup->target - compiler->start]);
+        rel = compiler->entries[fixup->target - compiler->start] - (int)(fixup->offset + 4);
+        memcpy(compiler->body.data + fixup->offset, &rel, sizeof(int));
+    }
+}
+
+static void push_value(jit_compiler_t *compiler, enum jit_value_kind kind, int arg)
+{
+    compiler->stack[compiler->depth].kind = kind;
+    compiler->stack[compiler->depth].arg = arg;
+    ++compiler->depth;
+}
+
+static void load_eax(jit_compiler_t *compiler, int position)
+{
+    jit_value_t *value = &compiler->stack[position];
+
+    if (JIT_VALUE_REGISTER == value->kind)
+    {
+        return;
+    }
+
+    if (-1 != compiler->register_owner)
+    {
+        spill(compiler, compiler->register_owner);
+    }
+
+    switch (value->kind)
+    {
+        case JIT_VALUE_CONSTANT:
+            emit_byte(&compiler->body, 0xB8); // mov eax, imm32
+            emit_int(&compiler->body, value->arg);
+            break;
+
+        case JIT_VALUE_LOCAL:
+            emit_byte(&compiler->body, 0x8B); // mov eax, [rsi + disp32]
+            emit_modrm_disp(&compiler->body, MODRM_EAX_RSI, local_disp(value->arg));
+            break;
+
+        default:
+            emit_byte(&compiler->body, 0x8B); // mov eax, [rsi + disp32]
+            emit_modrm_disp(&compiler->body, MODRM_EAX_RSI, slot_disp(compiler, position));
+            break;
+    }
+
+    value->kind = JIT_VALUE_REGISTER;
+    compiler->register_owner = position;
+}
+
+/* writes a value to its operand stack slot, with its type */
+static void spill(jit_compiler_t *compiler, int position)
+{
+    jit_value_t *value = &compiler->stack[position];
+
+    switch (value->kind)
+    {
+        case JIT_VALUE_MEMORY:
+            return;
+
+        case JIT_VALUE_CONSTANT:
+            emit_byte(&compiler->body, 0xC7); // mov dword [rsi + disp32], imm32
+            emit_modrm_disp(&compiler->body, 0x86, slot_disp(compiler, position));
+            emit_int(&compiler->body, value->arg);
+            break;
+
+        case JIT_VALUE_LOCAL:
+            emit_byte(&compiler->body, 0x8B); // mov ecx, [rsi + disp32]
+            emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, local_disp(value->arg));
+            emit_byte(&compiler->body, 0x89); // mov [rsi + disp32], ecx
+            emit_modrm_disp(&compiler->body, MODRM_ECX_RSI, slot_disp(compiler, position));
+            break;
+
+        case JIT_VALUE_REGISTER:
+            emit_byte(&compiler->body, 0x89); // mov [rsi + disp32], eax
+            emit_modrm_disp(&compiler->body, MODRM_EAX_RSI, slot_disp(compiler, position));
+            compiler->register_owner = -1;
+            break;
+    }
+
+    emit_byte(&compiler->body, 0xC7); // mov dword [rsi + disp32], VALUE_INTEGER_TYPE_WORD
+    emit_modrm_disp(&compiler->body, 0x86, type_disp(compiler, position));
+    emit_int(&compiler->body, (int)VALUE_INTEGER_TYPE_WORD);
+
+    value->kind = JIT_VALUE_MEMORY;
+}
+
+static void spill_all(jit_compiler_t *compiler)
+{
+    for (int i = 0; i < compiler->depth; ++i)
+    {
+        spill(compiler, i);
+    }
+}
+
+/* instance->osp = instance->sp + 1 + depth; return ip */
+static void emit_exit(jit_compiler_t *compiler, unsigned int ip, int depth)
+{
+    jit_buffer_t *body = &compiler->body;
+
+    emit_byte(body, 0x8B); // mov eax, [rdi + disp32]
+    emit_modrm_disp(body, MODRM_EAX_RDI, (int)offsetof(vm_t, sp));
+    emit_byte(body, 0x05); // add eax, imm32
+    emit_int(body, 1 + depth);
+    emit_byte(body, 0x89); // mov [rdi + disp32], eax
+    emit_modrm_disp(body, MODRM_EAX_RDI, (int)offsetof(vm_t, osp));
+    emit_byte(body, 0xB8); // mov eax, imm32
+    emit_int(body, (int)ip);
+    emit_byte(body, X86_RET);
+}
+
+/* op eax, value: an immediate for constants, memory for the rest */
+static void emit_operand(jit_compiler_t *compiler, int position, int opcode_size,
+                         const unsigned char *memory_opcode, const unsigned char *imm_opcode)
+{
+    jit_value_t *value = &compiler->stack[position];
+
+    if (JIT_VALUE_CONSTANT == value->kind)
+    {
+        emit_byte(&compiler->body, imm_opcode[0]);
+        if (0x69 == imm_opcode[0])
+        {
+            emit_byte(&compiler->body, 0xC0); // imul eax, eax, imm32
+        }
+        emit_int(&compiler->body, value->arg);
+
+        return;
+    }
+
+    for (int i = 0; i < opcode_size; ++i)
+    {
+        emit_byte(&compiler->body, memory_opcode[i]);
+    }
+    emit_modrm_disp(&compiler->body, MODRM_EAX_RSI,
+        (JIT_VALUE_LOCAL == value->kind ? local_disp(value->arg) : slot_disp(compiler, position)));
+}
+
+static void emit_modrm_disp(jit_buffer_t *buffer, int modrm, int disp)
+{
+    emit_byte(buffer, modrm);
+    emit_int(buffer, disp);
+}
+
+static void emit_byte(jit_buffer_t *buffer, int byte)
+{
+    unsigned char *data = NULL;
+
+    if (buffer->size == buffer->capacity)
+    {
+        data = (unsigned char *)realloc(buffer->data, (buffer->capacity + 64) * 2);
+        if (NULL == data)
+        {
+            buffer->failed = 1;
+
+            return;
+        }
+        buffer->data = data;
+        buffer->capacity = (buffer->capacity + 64) * 2;
+    }
+
+    buffer->data[buffer->size++] = (unsigned char)byte;
+}
+
+static void emit_int(jit_buffer_t *buffer, int value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        emit_byte(buffer, (value >> (i * 8)) & 0xFF);
+    }
+}
+
+/*
+* Lays out the prologue, the body and the entry table in executable memory.
+* The prologue jumps through the table to the entry; entries that are not in
+* the table are handed straight back to the interpreter.
+*/
+static void *link_code(jit_compiler_t *compiler, size_t *code_size)
+{
+    unsigned int num_instructions = compiler->end - compiler->start + 1;
+    jit_buffer_t prologue = {0};
+    size_t table_offset = 0, size = 0;
+    unsigned char *code = NULL;
+    int target = 0;
+
+    table_offset = (PROLOGUE_SIZE + compiler->body.size + 3) & ~(size_t)3;
+    size = table_offset + sizeof(int) * num_instructions;
+
+    emit_byte(&prologue, 0x89); // mov eax, edx
+    emit_byte(&prologue, 0xD0);
+    emit_byte(&prologue, 0x81); // sub edx, start
+    emit_byte(&prologue, 0xEA);
+    emit_int(&prologue, (int)compiler->start);
+    emit_byte(&prologue, 0x81); // cmp edx, num_instructions
+    emit_byte(&prologue, 0xFA);
+    emit_int(&prologue, (int)num_instructions);
+    emit_byte(&prologue, 0x0F); // jae fallback
+    emit_byte(&prologue, 0x83);
+    emit_int(&prologue, PROLOGUE_FALLBACK - (int)(prologue.size + 4));
+    emit_byte(&prologue, 0x48); // lea rax, [rip + table]
+    emit_byte(&prologue, 0x8D);
+    emit_byte(&prologue, 0x05);
+    emit_int(&prologue, (int)table_offset - (int)(prologue.size + 4));
+    emit_byte(&prologue, 0x48); // movsxd rcx, dword [rax + rdx * 4]
+    emit_byte(&prologue, 0x63);
+    emit_byte(&prologue, 0x0C);
+    emit_byte(&prologue, 0x90);
+    emit_byte(&prologue, 0x48); // add rax, rcx
+    emit_byte(&prologue, 0x01);
+    emit_byte(&prologue, 0xC8);
+    emit_byte(&prologue, 0xFF); // jmp rax
+    emit_byte(&prologue, 0xE0);
+    emit_byte(&prologue, X86_RET); // fallback, eax still holds the entry
+
+    if (prologue.failed)
+    {
+        free(prologue.data);
+
+        return NULL;
+    }
+    assert(PROLOGUE_SIZE == prologue.size);
+
+    code = (unsigned char *)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == code)
+    {
+        free(prologue.data);
+
+        return NULL;
+    }
+
+    memcpy(code, prologue.data, PROLOGUE_SIZE);
+    memcpy(code + PROLOGUE_SIZE, compiler->body.data, compiler->body.size);
+    memset(code + PROLOGUE_SIZE + compiler->body.size, 0xCC,
+           table_offset - PROLOGUE_SIZE - compiler->body.size);
+    free(prologue.data);
+
+    for (unsigned int i = 0; i < num_instructions; ++i)
+    {
+        target = (0 > compiler->entries[i] ?
+                  PROLOGUE_FALLBACK : PROLOGUE_SIZE + compiler->entries[i]);
+        target -= (int)table_offset;
+        memcpy(code + table_offset + sizeof(int) * i, &target, sizeof(int));
+    }
+
+    if (0 != mprotect(code, size, PROT_READ | PROT_EXEC))
+    {
+        munmap(code, size);
+
+        return NULL;
+    }
+
+    *code_size = size;
+
+    return code;
+}
+
+static int local_disp(int index)
+{
+    return index * (int)sizeof(vm_value_t) + VALUE_PAYLOAD_OFFSET;
+}
+
+static int slot_disp(jit_compiler_t *compiler, int position)
+{
+    return (compiler->frame_size + position) * (int)sizeof(vm_value_t) + VALUE_PAYLOAD_OFFSET;
+}
+
+static int type_disp(jit_compiler_t *compiler, int position)
+{
+    return (compiler->frame_size + position) * (int)sizeof(vm_value_t) + VALUE_TYPE_OFFSET;
+}
+
+#else
+
+int jit_enter_method(vm_t *instance, vm_method_meta_t *method)
+{
+    assert(instance && method);
+
+    return 0;
+}
+
+int jit_enter_loop(vm_t *instance)
+{
+    assert(instance);
+
+    return 0;
+}
+
+void free_jit_code(vm_program_t *program)
+{
+    assert(program);
+}
+
+#endif // HAS_JIT
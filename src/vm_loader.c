@@ -0,0 +1,674 @@
+#include <assert.h>    /* assert    */
+#include <pthread.h>   /* pthread_mutex_lock */
+#include <stdio.h>     /* fprintf   */
+#include <stdlib.h>    /* calloc    */
+#include <string.h>    /* memcpy    */
+
+#include "opcodes.h"     /* opcodes           */
+#include "vm_impl.h"     /* private vm header */
+#include "vm_util.h"     /* utility functions */
+#include "vm_fusion.h"   /* superinstructions */
+#include "vm_threaded.h" /* threaded engine   */
+#include "vm_register.h" /* register engine   */
+#include "vm_verifier.h" /* bytecode verifier */
+#include "vm_loader.h"   /* v2 files          */
+#include "vm_dense.h"    /* dense encoding    */
+
+#define MAIN_METHOD_NAME "main"
+
+typedef struct code_range
+{
+    uint64_t first;
+    uint64_t end;
+} code_range_t;
+
+static const vm_file_section_t *find_section(vm_program_t *program, enum vm_file_sections id, size_t entry_size);
+static int load_dense_code(vm_program_t *program, const vm_file_section_t *methods,
+                           const vm_file_section_t *dense, const vm_file_section_t *dense_methods);
+static int compare_ranges(const void *a, const void *b);
+static int load_methods(vm_program_t *program, const vm_file_section_t *methods, const vm_file_section_t *strings,
+                        const uint32_t *dense_offsets);
+static int load_constants(vm_program_t *program, const vm_file_section_t *constants, const vm_file_section_t *strings);
+static int load_debug_lines(vm_program_t *program, const vm_file_section_t *debug);
+static char *get_blob_string(vm_program_t *program, const vm_file_section_t *strings,
+                             unsigned int offset, unsigned int length);
+static int prepare_method_locked(vm_program_t *program, vm_method_meta_t *method);
+static int decode_method_and_callees(vm_program_t *program, vm_method_meta_t *method);
+static int prepare_reachable_methods(vm_program_t *program);
+
+int is_program_v2(const vm_program_t *program)
+{
+    unsigned int magic_num = 0;
+
+    assert(program && program->code);
+
+    if (program->code_size < sizeof(magic_num))
+    {
+        return 0;
+    }
+    memcpy(&magic_num, program->code, sizeof(magic_num));
+
+    return MAGIC_NUM_V2 == magic_num;
+}
+
+int load_program_v2(vm_program_t *program)
+{
+    const vm_file_header_t *header = NULL;
+    const vm_file_section_t *constants = NULL, *methods = NULL, *strings = NULL, *code = NULL;
+    const vm_file_section_t *dense = NULL, *dense_methods = NULL;
+    const uint32_t *dense_offsets = NULL;
+
+    assert(program && program->code);
+
+    header = (const vm_file_header_t *)program->code;
+    if (program->code_size < sizeof(vm_file_header_t) ||
+        program->code_size - sizeof(vm_file_header_t) < header->num_sections * sizeof(vm_file_section_t))
+    {
+        print_load_error(program, "section table is out of file bounds!");
+
+        return -1;
+    }
+
+    if (BYTECODE_VERSION != header->version)
+    {
+        fprintf(program->err, "unsupported bytecode version: %u\n", header->version);
+
+        return -1;
+    }
+
+    constants = find_section(program, VM_SECTION_CONSTANTS, sizeof(vm_file_constant_t));
+    methods = find_section(program, VM_SECTION_METHODS, sizeof(vm_file_method_t));
+    strings = find_section(program, VM_SECTION_STRINGS, 1);
+    code = find_section(program, VM_SECTION_CODE, sizeof(vm_instruction_t));
+    dense = find_section(program, VM_SECTION_DENSE_CODE, 1);
+    dense_methods = find_section(program, VM_SECTION_DENSE_METHODS, sizeof(uint32_t));
+    if (NULL == constants || NULL == methods || NULL == strings ||
+        (NULL == code && (NULL == dense || NULL == dense_methods)))
+    {
+        print_load_error(program, "missing or malformed section!");
+
+        return -1;
+    }
+
+    if (NULL != code)
+    {
+        program->file_instructions = (const vm_instruction_t *)&program->code[code->offset];
+        program->num_instructions = code->size / sizeof(vm_instruction_t);
+    }
+    else
+    {
+        if (0 != load_dense_code(program, methods, dense, dense_methods))
+        {
+            return -1;
+        }
+        dense_offsets = (const uint32_t *)&program->code[dense_methods->offset];
+    }
+
+    if (0 != load_methods(program, methods, strings, dense_offsets) ||
+        0 != load_constants(program, constants, strings) ||
+        0 != load_debug_lines(program, find_section(program, VM_SECTION_DEBUG, sizeof(vm_file_line_t))))
+    {
+        return -1;
+    }
+
+    if (0 != program->main_method->num_params)
+    {
+        fprintf(program->err, "[verifier] main method can not take parameters\n");
+
+        return -1;
+    }
+
+    // nothing runs before prepare_method verified it
+    program->verified = 1;
+    program->lazy = 1;
+
+    return prepare_method(program, (vm_method_meta_t *)program->main_method);
+}
+
+int prepare_method(vm_program_t *program, vm_method_meta_t *method)
+{
+    int res = 0;
+
+    assert(program && method);
+
+    if (is_method_prepared(method))
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&program->prepare_lock);
+    res = prepare_method_locked(program, method);
+    pthread_mutex_unlock(&program->prepare_lock);
+
+    return res;
+}
+
+int prepare_reachable_code(vm_program_t *program)
+{
+    int res = 0;
+
+    assert(program);
+
+    if (!program->lazy)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&program->prepare_lock);
+    res = prepare_reachable_methods(program);
+    pthread_mutex_unlock(&program->prepare_lock);
+
+    return res;
+}
+
+void prepare_register_code(vm_program_t *program)
+{
+    assert(program);
+
+    if (!program->lazy)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&program->prepare_lock);
+
+    if (!program->register_prepared)
+    {
+        program->register_prepared = 1;
+
+        // a method that failed verification can't be translated, the stack engines report it when called
+        if (0 == prepare_reachable_methods(program))
+        {
+            translate_register_code(program);
+        }
+    }
+
+    pthread_mutex_unlock(&program->prepare_lock);
+}
+
+unsigned int get_source_line(const vm_program_t *program, unsigned int ip)
+{
+    unsigned int low = 0, high = 0, middle = 0;
+
+    assert(program);
+
+    if (NULL == program->debug_lines)
+    {
+        return 0;
+    }
+
+    // the last entry at or before ip
+    high = program->num_debug_lines;
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (program->debug_lines[middle].ip <= ip)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return (0 == low ? 0 : program->debug_lines[low - 1].line);
+}
+
+
+/* STATIC FUNCTIONS */
+static const vm_file_section_t *find_section(vm_program_t *program, enum vm_file_sections id, size_t entry_size)
+{
+    const vm_file_header_t *header = (const vm_file_header_t *)program->code;
+    const vm_file_section_t *sections = (const vm_file_section_t *)(header + 1);
+
+    for (unsigned int i = 0; i < header->num_sections; ++i)
+    {
+        if (id != sections[i].id)
+        {
+            continue;
+        }
+
+        // sections are read in place, so they have to be aligned for their entries
+        if (0 != sections[i].offset % sizeof(uint32_t) ||
+            sections[i].offset > program->code_size ||
+            sections[i].size > program->code_size - sections[i].offset ||
+            0 != sections[i].size % entry_size)
+        {
+            return NULL;
+        }
+
+        return &sections[i];
+    }
+
+    return NULL;
+}
+
+/*
+* A file with only dense code gets file_instructions decoded method by
+* method, as they are prepared. The ranges of its methods may not overlap,
+* decoding one could otherwise change instructions that were verified as
+* part of another. Every instruction takes at least a byte, so a file can't
+* ask for more instructions than its dense code has bytes.
+*/
+static int load_dense_code(vm_program_t *program, const vm_file_section_t *methods,
+                           const vm_file_section_t *dense, const vm_file_section_t *dense_methods)
+{
+    const vm_file_method_t *entries = (const vm_file_method_t *)&program->code[methods->offset];
+    unsigned int num_methods = methods->size / sizeof(vm_file_method_t);
+    code_range_t *ranges = NULL;
+    uint64_t end = 0;
+
+    if (dense_methods->size / sizeof(uint32_t) != num_methods)
+    {
+        print_load_error(program, "dense code offsets don't match the method table!");
+
+        return -1;
+    }
+
+    ranges = (code_range_t *)malloc(sizeof(code_range_t) * (num_methods + 1));
+    if (NULL == ranges)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < num_methods; ++i)
+    {
+        ranges[i].first = entries[i].code_offset;
+        ranges[i].end = (uint64_t)entries[i].code_offset + entries[i].code_length;
+        end = (ranges[i].end > end ? ranges[i].end : end);
+    }
+
+    qsort(ranges, num_methods, sizeof(code_range_t), compare_ranges);
+    for (unsigned int i = 1; i < num_methods; ++i)
+    {
+        if (ranges[i].first < ranges[i - 1].end)
+        {
+            print_load_error(program, "method code ranges overlap!");
+            free(ranges);
+
+            return -1;
+        }
+    }
+    free(ranges);
+
+    if (end > dense->size)
+    {
+        print_load_error(program, "method code ranges are out of code bounds!");
+
+        return -1;
+    }
+
+    // the methods that were not prepared yet stay zeroed, like fused_instructions
+    program->decoded_instructions = (vm_instruction_t *)calloc(end + 1, sizeof(vm_instruction_t));
+    program->dense_offsets = (unsigned int *)calloc(end + 1, sizeof(unsigned int));
+    if (NULL == program->decoded_instructions || NULL == program->dense_offsets)
+    {
+        return -1;
+    }
+
+    program->file_instructions = program->decoded_instructions;
+    program->num_instructions = end;
+    program->dense_code = (const unsigned char *)&program->code[dense->offset];
+    program->dense_code_size = dense->size;
+    program->dense_prepared = 1;
+
+    return 0;
+}
+
+static int compare_ranges(const void *a, const void *b)
+{
+    const code_range_t *range_a = (const code_range_t *)a;
+    const code_range_t *range_b = (const code_range_t *)b;
+
+    return (range_a->first > range_b->first) - (range_a->first < range_b->first);
+}
+
+/*
+* Decodes every method header in one pass, with one allocation for the metas
+* and one for their types. The bodies are only checked to be inside the code.
+*/
+static int load_methods(vm_program_t *program, const vm_file_section_t *methods, const vm_file_section_t *strings,
+                        const uint32_t *dense_offsets)
+{
+    const vm_file_method_t *entries = (const vm_file_method_t *)&program->code[methods->offset];
+    const unsigned char *types = NULL;
+    vm_method_meta_t *method = NULL;
+    enum vm_types *cur_types = NULL;
+    unsigned int num_types = 0, count = 0;
+
+    program->num_methods = methods->size / sizeof(vm_file_method_t);
+
+    for (unsigned int i = 0; i < program->num_methods; ++i)
+    {
+        num_types += entries[i].num_params + entries[i].num_locals;
+    }
+
+    program->method_table = (vm_method_meta_t *)calloc(program->num_methods + 1, sizeof(vm_method_meta_t));
+    program->method_types = (enum vm_types *)malloc(sizeof(enum vm_types) * (num_types + 1));
+    if (NULL == program->method_table || NULL == program->method_types)
+    {
+        return -1;
+    }
+
+    cur_types = program->method_types;
+    for (unsigned int i = 0; i < program->num_methods; ++i)
+    {
+        method = &program->method_table[i];
+
+        method->name = get_blob_string(program, strings, entries[i].name_offset, entries[i].name_length);
+        if (NULL == method->name)
+        {
+            return -1;
+        }
+
+        count = entries[i].num_params + entries[i].num_locals;
+        if (entries[i].types_offset > strings->size || count > strings->size - entries[i].types_offset)
+        {
+            fprintf(program->err, "types of method: %s are out of file bounds!\n", method->name);
+
+            return -1;
+        }
+
+        if (entries[i].code_offset >= program->num_instructions ||
+            0 == entries[i].code_length ||
+            entries[i].code_length > program->num_instructions - entries[i].code_offset)
+        {
+            fprintf(program->err, "code of method: %s is out of code bounds!\n", method->name);
+
+            return -1;
+        }
+
+        types = (const unsigned char *)&program->code[strings->offset + entries[i].types_offset];
+
+        method->return_type = entries[i].return_type;
+        method->num_params = entries[i].num_params;
+        method->param_types = cur_types;
+        method->num_locals = entries[i].num_locals;
+        method->local_types = cur_types + method->num_params;
+        for (unsigned int j = 0; j < count; ++j)
+        {
+            cur_types[j] = types[j];
+        }
+        cur_types += count;
+
+        if (0 != init_local_template(method))
+        {
+            return -1;
+        }
+
+        method->offset = entries[i].code_offset;
+        method->code_length = entries[i].code_length;
+        method->dense_offset = (NULL == dense_offsets ? 0 : dense_offsets[i]);
+        method->prepare_state = METHOD_UNPREPARED;
+
+        check_main_method(program, MAIN_METHOD_NAME, method);
+    }
+
+    if (NULL == program->main_method)
+    {
+        print_load_error(program, "no main method was found!");
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int load_constants(vm_program_t *program, const vm_file_section_t *constants, const vm_file_section_t *strings)
+{
+    const vm_file_constant_t *entries = (const vm_file_constant_t *)&program->code[constants->offset];
+    vm_value_t *cur_value = NULL;
+    char *string = NULL;
+    uint64_t bits = 0;
+    float float_value = 0;
+    double double_value = 0;
+
+    program->constant_pool_size = constants->size / sizeof(vm_file_constant_t);
+
+    program->constant_pool = (vm_value_t *)calloc(program->constant_pool_size + 1, sizeof(vm_value_t));
+    if (NULL == program->constant_pool)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < program->constant_pool_size; ++i)
+    {
+        cur_value = &program->constant_pool[i];
+        bits = ((uint64_t)entries[i].b << 32) | entries[i].a;
+
+        switch (entries[i].type)
+        {
+            case VM_TYPE_BYTE:
+                *cur_value = make_byte_value((char)entries[i].a);
+                break;
+            case VM_TYPE_INTEGER:
+                *cur_value = make_integer_value((int)entries[i].a);
+                break;
+            case VM_TYPE_FLOAT:
+                memcpy(&float_value, &entries[i].a, sizeof(float_value));
+                *cur_value = make_float_value(float_value);
+                break;
+            case VM_TYPE_LONG:
+                *cur_value = make_long_value((long)bits);
+                break;
+            case VM_TYPE_DOUBLE:
+                memcpy(&double_value, &bits, sizeof(double_value));
+                *cur_value = make_double_value(double_value);
+                break;
+            case VM_TYPE_STRING:
+                string = get_blob_string(program, strings, entries[i].a, entries[i].b);
+                if (NULL == string)
+                {
+                    return -1;
+                }
+                *cur_value = make_string_value(string);
+                break;
+            case VM_TYPE_REFERENCE:
+                // objects only exist on the heap of a context, a reference constant is null
+                *cur_value = make_empty_value(VM_TYPE_REFERENCE);
+                break;
+            case VM_TYPE_METHOD:
+                if (entries[i].a >= program->num_methods)
+                {
+                    fprintf(program->err, "constant %u refers to method %u, out of method table bounds!\n",
+                        i, entries[i].a);
+
+                    return -1;
+                }
+                *cur_value = make_method_value(&program->method_table[entries[i].a]);
+                break;
+            default:
+                fprintf(program->err, "constant %u is of unknown type: 0x%x!\n", i, entries[i].type);
+
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int load_debug_lines(vm_program_t *program, const vm_file_section_t *debug)
+{
+    const vm_file_line_t *lines = NULL;
+    unsigned int num_lines = 0;
+
+    // debug info is optional
+    if (NULL == debug)
+    {
+        return 0;
+    }
+
+    lines = (const vm_file_line_t *)&program->code[debug->offset];
+    num_lines = debug->size / sizeof(vm_file_line_t);
+
+    for (unsigned int i = 1; i < num_lines; ++i)
+    {
+        if (lines[i].ip < lines[i - 1].ip)
+        {
+            print_load_error(program, "debug lines are not sorted!");
+
+            return -1;
+        }
+    }
+
+    program->debug_lines = lines;
+    program->num_debug_lines = num_lines;
+
+    return 0;
+}
+
+/* strings are used in place, the byte after their length has to end them */
+static char *get_blob_string(vm_program_t *program, const vm_file_section_t *strings,
+                             unsigned int offset, unsigned int length)
+{
+    char *string = NULL;
+
+    if (offset >= strings->size || length >= strings->size - offset)
+    {
+        print_load_error(program, "string constant is out of file bounds!");
+
+        return NULL;
+    }
+
+    string = &program->code[strings->offset + offset];
+    if ('\0' != string[length])
+    {
+        print_load_error(program, "string constant is not terminated!");
+
+        return NULL;
+    }
+
+    return string;
+}
+
+/*
+* Called with prepare_lock held. The state is published last, with release
+* semantics, so a context that sees METHOD_READY also sees the translated
+* code of the method.
+*/
+static int prepare_method_locked(vm_program_t *program, vm_method_meta_t *method)
+{
+    int res = 0;
+
+    switch (method->prepare_state)
+    {
+        case METHOD_READY:
+            return 0;
+        case METHOD_FAILED:
+            return -1;
+        default:
+            break;
+    }
+
+    if (NULL != program->decoded_instructions)
+    {
+        res = decode_method_and_callees(program, method);
+    }
+    if (0 == res)
+    {
+        res = verify_lazy_method(program, method);
+    }
+    if (0 == res)
+    {
+        res = fuse_method_superinstructions(program, method);
+    }
+    if (0 == res)
+    {
+        res = translate_threaded_method(program, method);
+    }
+
+    __atomic_store_n(&method->prepare_state, (0 == res ? METHOD_READY : METHOD_FAILED), __ATOMIC_RELEASE);
+
+    return res;
+}
+
+/*
+* The verifier types the callees of a method from their code, so with dense
+* code they are decoded together with it.
+*/
+static int decode_method_and_callees(vm_program_t *program, vm_method_meta_t *method)
+{
+    const vm_instruction_t *instruction = NULL;
+    int res = 0;
+
+    res = decode_dense_method(program, method);
+
+    for (unsigned int ip = method->offset; ip < method->offset + method->code_length && 0 == res; ++ip)
+    {
+        instruction = &program->file_instructions[ip];
+        if ((OP_CALL != instruction->opcode && OP_TAILCALL != instruction->opcode) ||
+            instruction->arg < 0 || (unsigned int)instruction->arg >= program->constant_pool_size)
+        {
+            continue;
+        }
+
+        // bad constants are reported by the verifier
+        if (is_value_type(program->constant_pool[instruction->arg], VM_TYPE_METHOD))
+        {
+            res = decode_dense_method(program, get_method_value(program->constant_pool[instruction->arg]));
+        }
+    }
+
+    return res;
+}
+
+/*
+* Prepares every method main can call, directly or not. Calls always name
+* their method by constant, so this is all the code a run can reach and
+* methods that are never called stay unprepared.
+*/
+static int prepare_reachable_methods(vm_program_t *program)
+{
+    vm_method_meta_t **pending = NULL;
+    vm_method_meta_t *method = NULL, *callee = NULL;
+    const vm_instruction_t *instruction = NULL;
+    unsigned char *seen = NULL;
+    unsigned int num_pending = 0;
+    int res = 0;
+
+    pending = (vm_method_meta_t **)malloc(sizeof(vm_method_meta_t *) * (program->num_methods + 1));
+    seen = (unsigned char *)calloc(program->num_methods + 1, sizeof(unsigned char));
+    if (NULL == pending || NULL == seen)
+    {
+        free(pending);
+        free(seen);
+
+        return -1;
+    }
+
+    method = (vm_method_meta_t *)program->main_method;
+    seen[method - program->method_table] = 1;
+    pending[num_pending++] = method;
+
+    while (0 < num_pending && 0 == res)
+    {
+        method = pending[--num_pending];
+
+        res = prepare_method_locked(program, method);
+
+        // only reachable code was verified, a call after the last return can name anything
+        for (unsigned int ip = method->offset; ip < method->offset + method->code_length && 0 == res; ++ip)
+        {
+            instruction = &program->file_instructions[ip];
+            if ((OP_CALL != instruction->opcode && OP_TAILCALL != instruction->opcode) ||
+                instruction->arg < 0 || (unsigned int)instruction->arg >= program->constant_pool_size ||
+                !is_value_type(program->constant_pool[instruction->arg], VM_TYPE_METHOD))
+            {
+                continue;
+            }
+
+            callee = get_method_value(program->constant_pool[instruction->arg]);
+            if (!seen[callee - program->method_table])
+            {
+                seen[callee - program->method_table] = 1;
+                pending[num_pending++] = callee;
+            }
+        }
+    }
+
+    free(pending);
+    free(seen);
+
+    return res;
+}
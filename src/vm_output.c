@@ -0,0 +1,182 @@
+#include <assert.h>    /* assert   */
+#include <stdio.h>     /* fwrite   */
+#include <stdlib.h>    /* realloc  */
+#include <string.h>    /* memcpy   */
+
+#include "vm_impl.h"   /* private vm header */
+#include "vm_output.h" /* output buffer     */
+
+// the longest printed number, -9223372036854775808 or a %.15g double, and its newline
+#define MAX_NUMBER_LENGTH 32
+
+static char *format_decimal(char *end, long value);
+
+int alloc_output_buffer(vm_t *instance, size_t size)
+{
+    char *buffer = NULL;
+
+    assert(instance);
+
+    flush_output(instance);
+
+    if (0 != size)
+    {
+        buffer = (char *)realloc(instance->output_buffer, size);
+        if (NULL == buffer)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        free(instance->output_buffer);
+    }
+
+    instance->output_buffer = buffer;
+    instance->output_capacity = size;
+
+    return 0;
+}
+
+void free_output_buffer(vm_t *instance)
+{
+    assert(instance);
+
+    flush_output(instance);
+
+    free(instance->output_buffer);
+    instance->output_buffer = NULL;
+    instance->output_capacity = 0;
+}
+
+void write_output(vm_t *instance, const char *data, size_t length)
+{
+    assert(instance && instance->output && data);
+
+    if (0 == length)
+    {
+        return;
+    }
+
+    if (instance->output_used + length > instance->output_capacity)
+    {
+        flush_output(instance);
+
+        // what can't fit even an empty buffer goes straight to the file
+        if (length > instance->output_capacity)
+        {
+            fwrite(data, 1, length, instance->output);
+            fflush(instance->output);
+
+            return;
+        }
+    }
+
+    memcpy(instance->output_buffer + instance->output_used, data, length);
+    instance->output_used += length;
+}
+
+void flush_output(vm_t *instance)
+{
+    assert(instance);
+
+    // every write that skipped the buffer was flushed already, and the file
+    // of a context between runs may be closed, like the streams of vm_runner
+    if (0 == instance->output_used)
+    {
+        return;
+    }
+
+    assert(instance->output);
+
+    fwrite(instance->output_buffer, 1, instance->output_used, instance->output);
+    instance->output_used = 0;
+    fflush(instance->output);
+}
+
+void output_integer(vm_t *instance, int value)
+{
+    output_long(instance, value);
+}
+
+void output_long(vm_t *instance, long value)
+{
+    char text[MAX_NUMBER_LENGTH];
+    char *start = NULL;
+
+    text[MAX_NUMBER_LENGTH - 1] = '\n';
+    start = format_decimal(&text[MAX_NUMBER_LENGTH - 1], value);
+
+    write_output(instance, start, &text[MAX_NUMBER_LENGTH] - start);
+}
+
+void output_float(vm_t *instance, float value)
+{
+    char text[MAX_NUMBER_LENGTH];
+    int length = snprintf(text, sizeof(text), "%.7g\n", value);
+
+    write_output(instance, text, (size_t)length);
+}
+
+void output_double(vm_t *instance, double value)
+{
+    char text[MAX_NUMBER_LENGTH];
+    int length = snprintf(text, sizeof(text), "%.15g\n", value);
+
+    write_output(instance, text, (size_t)length);
+}
+
+void output_string(vm_t *instance, const char *value)
+{
+    assert(value);
+
+    write_output(instance, value, strlen(value));
+    write_output(instance, "\n", 1);
+}
+
+
+/* STATIC FUNCTIONS */
+/* writes the digits of value right before end, two at a time, and returns the first one */
+static char *format_decimal(char *end, long value)
+{
+    static const char digit_pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+    // negated as unsigned, so the smallest long has a magnitude too
+    unsigned long magnitude = (value < 0 ? 0UL - (unsigned long)value : (unsigned long)value);
+    char *digit = end;
+
+    while (magnitude >= 100)
+    {
+        unsigned int pair = (unsigned int)(magnitude % 100) * 2;
+
+        magnitude /= 100;
+        *--digit = digit_pairs[pair + 1];
+        *--digit = digit_pairs[pair];
+    }
+
+    if (magnitude >= 10)
+    {
+        *--digit = digit_pairs[magnitude * 2 + 1];
+        *--digit = digit_pairs[magnitude * 2];
+    }
+    else
+    {
+        *--digit = (char)('0' + magnitude);
+    }
+
+    if (value < 0)
+    {
+        *--digit = '-';
+    }
+
+    return digit;
+}
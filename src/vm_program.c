@@ -0,0 +1,260 @@
+#include <assert.h>    /* assert    */
+#include <pthread.h>   /* pthread_mutex_init */
+#include <stdint.h>    /* uint64_t  */
+#include <stdio.h>     /* FILE      */
+#include <stdlib.h>    /* malloc    */
+#include <string.h>    /* strlen    */
+
+#include "opcodes.h"   /* opcodes */
+#include "vm_impl.h"   /* private vm header */
+#include "vm_util.h"   /* utility functions */
+#include "vm_threaded.h" /* threaded engine */
+#include "vm_jit.h"      /* jit             */
+#include "vm_fusion.h"   /* superinstructions */
+#include "vm_register.h" /* register engine   */
+#include "vm_verifier.h" /* bytecode verifier */
+#include "vm_loader.h"   /* v2 files          */
+#include "vm_dense.h"    /* dense encoding    */
+
+#include "vm.h"        /* public vm header */
+
+#define MAGIC_NUM 0xBABEFACE
+#define MAIN_METHOD_NAME "main"
+
+#define DEFAULT_ERR stderr
+
+static int build_constant_pool(vm_program_t *program);
+static int load_program_v1(vm_program_t *program);
+
+vm_program_t *vm_program_load(const char *file_path, FILE *err)
+{
+    int res = 0;
+    vm_program_t *program = NULL;
+
+    assert(NULL != file_path);
+
+    program = (vm_program_t *)calloc(1, sizeof(vm_program_t));
+    if (NULL == program)
+    {
+        return NULL;
+    }
+
+    program->magic_num = MAGIC_NUM;
+    program->err = (NULL == err ? DEFAULT_ERR : err);
+    pthread_mutex_init(&program->prepare_lock, NULL);
+
+    res = load_bytecode_from_file(file_path, program);
+    if (0 != res)
+    {
+        vm_program_free(program);
+
+        return NULL;
+    }
+
+    // v2 files only decode their headers here, methods are prepared on their first call
+    res = (is_program_v2(program) ? load_program_v2(program) : load_program_v1(program));
+    if (0 != res)
+    {
+        print_load_error(program, "could not load file:");
+        print_load_error(program, file_path);
+        vm_program_free(program);
+
+        return NULL;
+    }
+    init_unchecked_opcode_handlers(program->opcode_handlers);
+
+    return program;
+}
+
+void vm_program_free(vm_program_t *program)
+{
+    assert(program);
+
+    free_jit_code(program);
+    free_constant_pool(program);
+    free_threaded_code(program);
+    free_register_code(program);
+    free_dense_code(program);
+    free_stack_depths(program);
+    free_fused_instructions(program);
+    free_code(program);
+    pthread_mutex_destroy(&program->prepare_lock);
+
+    free(program);
+}
+
+
+/* STATIC FUNCTIONS */
+/* v1 files are read in order, and every method is verified and translated up front */
+static int load_program_v1(vm_program_t *program)
+{
+    int res = 0;
+
+    res = validate_magic_number(program);
+    if (0 != res)
+    {
+        print_load_error(program, "file with wrong magic number!");
+
+        return -1;
+    }
+
+    res = build_constant_pool(program);
+    if (0 != res)
+    {
+        return -1;
+    }
+
+    res = verify_program(program);
+    if (0 != res)
+    {
+        print_load_error(program, "file failed verification!");
+
+        return -1;
+    }
+
+    res = fuse_superinstructions(program);
+    if (0 != res)
+    {
+        return -1;
+    }
+
+    res = translate_threaded_code(program);
+    if (0 != res)
+    {
+        return -1;
+    }
+
+    return translate_register_code(program);
+}
+
+static int build_constant_pool(vm_program_t *program)
+{
+    char cur_opcode = 0;
+    int cur_type = 0;
+    vm_value_t *cur_value = NULL;
+    vm_method_meta_t *cur_method = NULL;
+    int str_len = 0;
+    int size = 0;
+    uint64_t bits = 0;
+    float float_value = 0;
+    double double_value = 0;
+
+    assert(program);
+
+    program->constant_pool_size = read_byte_value(program);
+
+    program->constant_pool = (vm_value_t *)calloc(program->constant_pool_size, sizeof(vm_value_t));
+    if (NULL == program->constant_pool)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < program->constant_pool_size; ++i)
+    {
+        cur_type = read_byte_value(program);
+        cur_value = &program->constant_pool[i];
+        
+        switch (cur_type)
+        {
+            case VM_TYPE_BYTE:
+                *cur_value = make_byte_value(read_byte_value(program));
+                break;
+            case VM_TYPE_INTEGER:
+                *cur_value = make_integer_value(read_int_value(program));
+                break;
+            case VM_TYPE_FLOAT:
+                bits = (uint32_t)read_int_value(program);
+                memcpy(&float_value, &bits, sizeof(float_value));
+                *cur_value = make_float_value(float_value);
+                break;
+            case VM_TYPE_LONG:
+                // 64-bit constants are two ints, the low one first
+                bits = (uint32_t)read_int_value(program);
+                bits |= (uint64_t)(uint32_t)read_int_value(program) << 32;
+                *cur_value = make_long_value((long)bits);
+                break;
+            case VM_TYPE_DOUBLE:
+                bits = (uint32_t)read_int_value(program);
+                bits |= (uint64_t)(uint32_t)read_int_value(program) << 32;
+                memcpy(&double_value, &bits, sizeof(double_value));
+                *cur_value = make_double_value(double_value);
+                break;
+            case VM_TYPE_STRING:
+                *cur_value = make_string_value(read_string_value(program));
+                if (NULL == get_string_value(*cur_value))
+                {
+                    return -1;
+                }
+                break;
+            case VM_TYPE_REFERENCE:
+                // objects only exist on the heap of a context, a reference constant is null
+                *cur_value = make_empty_value(VM_TYPE_REFERENCE);
+                break;
+            case VM_TYPE_METHOD:
+                cur_method = (vm_method_meta_t *)calloc(1, sizeof(vm_method_meta_t));
+                if (NULL == cur_method) 
+                {
+                    return -1;
+                }
+
+                cur_method->name = read_string_value(program);
+                if (NULL == cur_method->name)
+                {
+                    return -1;
+                }
+
+                cur_method->return_type = read_byte_value(program);
+
+                cur_method->num_locals = read_byte_value(program);
+                cur_method->local_types = (enum vm_types *)malloc(sizeof(int) * cur_method->num_locals);
+                if (NULL == cur_method->local_types) 
+                {
+                    return -1;
+                }
+                for (int i = 0; i < cur_method->num_locals; ++i)
+                {
+                    cur_method->local_types[i] = read_byte_value(program);
+                }
+
+                cur_method->num_params = read_byte_value(program);
+                cur_method->param_types = (enum vm_types *)malloc(sizeof(int) * cur_method->num_params);
+                if (NULL == cur_method->param_types) 
+                {
+                    return -1;
+                }
+                for (int i = 0; i < cur_method->num_params; ++i)
+                {
+                    cur_method->param_types[i] = read_byte_value(program);
+                }
+
+                cur_method->offset = read_int_value(program);
+                if (0 != init_local_template(cur_method))
+                {
+                    return -1;
+                }
+                cur_method->prepare_state = METHOD_READY; // the whole program is prepared below, or the load fails
+
+                *cur_value = make_method_value(cur_method);
+
+                if (-1 == check_main_method(program, MAIN_METHOD_NAME, cur_method))
+                {
+                    return -1;
+                }
+
+                break;
+        }
+    }
+
+    if (NULL == program->main_method) 
+    {
+        print_load_error(program, "no main method was found!");
+        
+        return -1;
+    }
+    // move to point to first instruction
+    program->instructions = (vm_instruction_t *)&program->code[program->read_offset];
+    program->file_instructions = program->instructions;
+    program->num_instructions = (program->code_size - program->read_offset) / sizeof(vm_instruction_t);
+    
+    return 0;
+}
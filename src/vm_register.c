@@ -0,0 +1,987 @@
+#include <assert.h>    /* assert    */
+#include <stdio.h>     /* fprintf   */
+#include <stdlib.h>    /* malloc    */
+
+#include "opcodes.h"     /* opcodes           */
+#include "vm_impl.h"     /* private vm header */
+#include "vm_util.h"     /* utility functions */
+#include "vm_fusion.h"   /* superinstructions */
+#include "vm_threaded.h" /* HAS_COMPUTED_GOTO */
+#include "vm_register.h" /* register engine   */
+#include "vm_loader.h"   /* method_state      */
+#include "vm_output.h"   /* print buffer      */
+#include "vm_numeric.h"  /* integer semantics */
+
+/*
+* The translator runs the stack bytecode of a method with an abstract
+* operand stack. ipush and iload only push a description of the value, an
+* immediate or the local's register, and the instruction that consumes it
+* reads it from there. Results are written to the register of the operand
+* stack slot they would have been pushed to, and a result that is stored
+* right away is written to the local instead. What is left is one register
+* instruction per arithmetic operation, print, call, return and branch.
+*
+* Branches take the operand stack in its slot registers: everything left on
+* it is materialized before a branch, and the translation of a branch
+* target starts over with every operand in its slot, at the depth the
+* verifier recorded for it.
+*/
+
+enum operand_kind
+{
+    OPERAND_SLOT,      // in the register of its operand stack slot
+    OPERAND_IMMEDIATE, // an integer known at translation time
+    OPERAND_LOCAL      // still in the register of a local
+};
+
+typedef struct operand
+{
+    enum operand_kind kind;
+    int value; // the immediate or the local index
+} operand_t;
+
+typedef struct register_translator
+{
+    vm_program_t *program;
+    const vm_method_meta_t *method;
+
+    operand_t *stack; // the abstract operand stack
+    int depth;
+    int frame_size; // params, locals and the separator slot
+
+    vm_register_instruction_t *code;
+    unsigned int size;
+    unsigned int capacity;
+    int last_result; // the emitted instruction whose result is the top of the stack, -1 for none
+
+    int *addresses; // the register code index of every instruction, ADDRESS_TARGET for branch targets until then
+    int needs_entry; // the next instruction is only reached by a branch
+} register_translator_t;
+
+#define ADDRESS_TARGET -2
+
+static int translate_method(register_translator_t *translator, vm_method_meta_t *method);
+static int translate_instruction(register_translator_t *translator, const vm_instruction_t *instruction);
+static int translate_branch(register_translator_t *translator, const vm_instruction_t *instruction);
+static int open_entry(register_translator_t *translator, unsigned int ip);
+static int link_branches(register_translator_t *translator, const vm_method_meta_t *method);
+static int materialize_all(register_translator_t *translator, int depth);
+static int translate_arithmetic(register_translator_t *translator, enum opcodes opcode);
+static int translate_store(register_translator_t *translator, int index);
+static int fold_arithmetic(enum opcodes opcode, int left, int right, int *result);
+static int emit(register_translator_t *translator, enum register_opcodes opcode, int dst, int a, int b);
+static int materialize(register_translator_t *translator, int position);
+static int get_register(register_translator_t *translator, int position);
+static int get_slot_register(register_translator_t *translator, int position);
+
+int translate_register_code(vm_program_t *program)
+{
+    register_translator_t translator = {0};
+    int res = 0;
+
+    assert(program && program->verified);
+
+    translator.program = program;
+    translator.stack = (operand_t *)malloc(sizeof(operand_t) * (program->num_instructions + 1));
+    translator.addresses = (int *)malloc(sizeof(int) * (program->num_instructions + 1));
+    if (NULL == translator.stack || NULL == translator.addresses)
+    {
+        free(translator.stack);
+        free(translator.addresses);
+
+        return -1;
+    }
+
+    // lazily loaded programs leave the methods nothing calls unprepared, and untranslated
+    for (unsigned int i = 0; i < program->constant_pool_size && 0 == res; ++i)
+    {
+        if (is_value_type(program->constant_pool[i], VM_TYPE_METHOD) &&
+            METHOD_READY == get_method_value(program->constant_pool[i])->prepare_state)
+        {
+            res = translate_method(&translator, get_method_value(program->constant_pool[i]));
+        }
+    }
+
+    free(translator.stack);
+    free(translator.addresses);
+
+    // a program the register engine can't run is left to the stack engines
+    if (0 != res)
+    {
+        free(translator.code);
+
+        return 0;
+    }
+
+    program->register_code = translator.code;
+    program->register_code_size = translator.size;
+
+    return 0;
+}
+
+void free_register_code(vm_program_t *program)
+{
+    assert(program);
+
+    free(program->register_code);
+    program->register_code = NULL;
+    program->register_code_size = 0;
+}
+
+int run_register_code(vm_t *instance)
+{
+#if HAS_COMPUTED_GOTO
+    static const void *labels[NUM_REGISTER_OPCODES] = {
+        [R_MOVE]   = &&op_move,
+        [R_LOADI]  = &&op_loadi,
+        [R_LOADK]  = &&op_loadk,
+        [R_ADD]    = &&op_add,
+        [R_ADDI]   = &&op_addi,
+        [R_SUB]    = &&op_sub,
+        [R_SUBI]   = &&op_subi,
+        [R_MUL]    = &&op_mul,
+        [R_MULI]   = &&op_muli,
+        [R_DIV]    = &&op_div,
+        [R_DIVI]   = &&op_divi,
+        [R_NEG]    = &&op_neg,
+        [R_IPRINT] = &&op_iprint,
+        [R_SPRINT] = &&op_sprint,
+        [R_FLUSH]  = &&op_flush,
+        [R_CALL]   = &&op_call,
+        [R_TAILCALL] = &&op_tailcall,
+        [R_RET]    = &&op_ret,
+        [R_IRET]   = &&op_iret,
+        [R_SRET]   = &&op_sret,
+        [R_STOP]   = &&op_stop,
+        [R_JUMP]   = &&op_jump,
+        [R_JEQ]    = &&op_jeq,
+        [R_JNE]    = &&op_jne,
+        [R_JLT]    = &&op_jlt,
+        [R_JGE]    = &&op_jge,
+        [R_JGT]    = &&op_jgt,
+        [R_JLE]    = &&op_jle,
+        [R_JEQI]   = &&op_jeqi,
+        [R_JNEI]   = &&op_jnei,
+        [R_JLTI]   = &&op_jlti,
+        [R_JGEI]   = &&op_jgei,
+        [R_JGTI]   = &&op_jgti,
+        [R_JLEI]   = &&op_jlei,
+        [R_SWITCH] = &&op_switch,
+    };
+#define TARGET(name, opcode) name:
+#define DISPATCH() goto *labels[pc->opcode]
+#define END_DISPATCH()
+#else
+#define TARGET(name, opcode) case opcode:
+#define DISPATCH() goto dispatch
+#define END_DISPATCH() }
+#endif
+
+    const vm_register_instruction_t *code = NULL;
+    const vm_register_instruction_t *pc = NULL;
+    const vm_value_t *constant_pool = NULL;
+    const vm_method_meta_t *method = NULL;
+    vm_value_t *registers = NULL;
+    vm_value_t result = {0};
+
+    assert(instance && instance->program && instance->program->register_code);
+
+    code = instance->program->register_code;
+    constant_pool = instance->program->constant_pool;
+    pc = code + instance->ip;
+    registers = &instance->stack[instance->lap];
+
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+#define INTEGER(r) get_integer_value(registers[r])
+#define SET_INTEGER(r, expression) (registers[r] = make_integer_value(expression))
+
+#if HAS_COMPUTED_GOTO
+    DISPATCH();
+#else
+dispatch:
+    switch (pc->opcode)
+    {
+#endif
+
+TARGET(op_move, R_MOVE)
+    registers[pc->dst] = registers[pc->a];
+    NEXT();
+
+TARGET(op_loadi, R_LOADI)
+    SET_INTEGER(pc->dst, pc->a);
+    NEXT();
+
+TARGET(op_loadk, R_LOADK)
+    registers[pc->dst] = constant_pool[pc->a];
+    NEXT();
+
+TARGET(op_add, R_ADD)
+    SET_INTEGER(pc->dst, add_integers(INTEGER(pc->a), INTEGER(pc->b)));
+    NEXT();
+
+TARGET(op_addi, R_ADDI)
+    SET_INTEGER(pc->dst, add_integers(INTEGER(pc->a), pc->b));
+    NEXT();
+
+TARGET(op_sub, R_SUB)
+    SET_INTEGER(pc->dst, subtract_integers(INTEGER(pc->a), INTEGER(pc->b)));
+    NEXT();
+
+TARGET(op_subi, R_SUBI)
+    SET_INTEGER(pc->dst, subtract_integers(INTEGER(pc->a), pc->b));
+    NEXT();
+
+TARGET(op_mul, R_MUL)
+    SET_INTEGER(pc->dst, multiply_integers(INTEGER(pc->a), INTEGER(pc->b)));
+    NEXT();
+
+TARGET(op_muli, R_MULI)
+    SET_INTEGER(pc->dst, multiply_integers(INTEGER(pc->a), pc->b));
+    NEXT();
+
+TARGET(op_div, R_DIV)
+    if (0 == INTEGER(pc->b))
+    {
+        report_error(instance, "[idiv] failed, division by zero\n");
+        instance->ip = pc - code + 1;
+
+        return -1;
+    }
+    SET_INTEGER(pc->dst, divide_integers(INTEGER(pc->a), INTEGER(pc->b)));
+    NEXT();
+
+TARGET(op_divi, R_DIVI)
+    SET_INTEGER(pc->dst, divide_integers(INTEGER(pc->a), pc->b));
+    NEXT();
+
+TARGET(op_neg, R_NEG)
+    SET_INTEGER(pc->dst, negate_integer(INTEGER(pc->a)));
+    NEXT();
+
+TARGET(op_iprint, R_IPRINT)
+    output_integer(instance, INTEGER(pc->a));
+    NEXT();
+
+TARGET(op_sprint, R_SPRINT)
+    output_string(instance, get_string_value(registers[pc->a]));
+    NEXT();
+
+TARGET(op_flush, R_FLUSH)
+    flush_output(instance);
+    NEXT();
+
+TARGET(op_call, R_CALL)
+    method = get_method_value(constant_pool[pc->a]);
+
+    // the arguments are the top of the caller's operand stack
+    instance->ip = pc - code + 1;
+    instance->osp = instance->lap + pc->b + method->num_params;
+    if (0 != open_stack_frame(instance, method))
+    {
+        report_error(instance, "[call] failed, could not open stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    pc = code + method->register_offset;
+    registers = &instance->stack[instance->lap];
+    DISPATCH();
+
+TARGET(op_tailcall, R_TAILCALL)
+    method = get_method_value(constant_pool[pc->a]);
+
+    instance->osp = instance->lap + pc->b + method->num_params;
+    if (0 != reuse_stack_frame(instance, method))
+    {
+        report_error(instance, "[tailcall] failed, could not reuse stack frame for method: %s!\n",
+            method->name);
+
+        return -1;
+    }
+
+    pc = code + method->register_offset;
+    registers = &instance->stack[instance->lap];
+    DISPATCH();
+
+TARGET(op_ret, R_RET)
+    pop_stack_frame(instance);
+    if (VM_RUNNING != instance->state)
+    {
+        return 0;
+    }
+
+    pc = code + instance->ip;
+    registers = &instance->stack[instance->lap];
+    DISPATCH();
+
+TARGET(op_iret, R_IRET)
+TARGET(op_sret, R_SRET)
+    result = registers[pc->a];
+
+    pop_stack_frame(instance);
+    if (VM_RUNNING != instance->state)
+    {
+        return 0;
+    }
+
+    instance->stack[instance->osp] = result;
+    ++instance->osp;
+
+    pc = code + instance->ip;
+    registers = &instance->stack[instance->lap];
+    DISPATCH();
+
+TARGET(op_stop, R_STOP)
+    instance->state = VM_FINISHED;
+    instance->ip = pc - code + 1;
+
+    return 0;
+
+#define JUMP_IF(condition)                                \
+    do {                                                  \
+        pc = ((condition) ? code + pc->dst : pc + 1);     \
+        DISPATCH();                                       \
+    } while (0)
+
+TARGET(op_jump, R_JUMP)
+    pc = code + pc->dst;
+    DISPATCH();
+
+TARGET(op_jeq, R_JEQ)
+    JUMP_IF(INTEGER(pc->a) == INTEGER(pc->b));
+
+TARGET(op_jne, R_JNE)
+    JUMP_IF(INTEGER(pc->a) != INTEGER(pc->b));
+
+TARGET(op_jlt, R_JLT)
+    JUMP_IF(INTEGER(pc->a) < INTEGER(pc->b));
+
+TARGET(op_jge, R_JGE)
+    JUMP_IF(INTEGER(pc->a) >= INTEGER(pc->b));
+
+TARGET(op_jgt, R_JGT)
+    JUMP_IF(INTEGER(pc->a) > INTEGER(pc->b));
+
+TARGET(op_jle, R_JLE)
+    JUMP_IF(INTEGER(pc->a) <= INTEGER(pc->b));
+
+TARGET(op_jeqi, R_JEQI)
+    JUMP_IF(INTEGER(pc->a) == pc->b);
+
+TARGET(op_jnei, R_JNEI)
+    JUMP_IF(INTEGER(pc->a) != pc->b);
+
+TARGET(op_jlti, R_JLTI)
+    JUMP_IF(INTEGER(pc->a) < pc->b);
+
+TARGET(op_jgei, R_JGEI)
+    JUMP_IF(INTEGER(pc->a) >= pc->b);
+
+TARGET(op_jgti, R_JGTI)
+    JUMP_IF(INTEGER(pc->a) > pc->b);
+
+TARGET(op_jlei, R_JLEI)
+    JUMP_IF(INTEGER(pc->a) <= pc->b);
+
+#undef JUMP_IF
+
+TARGET(op_switch, R_SWITCH)
+    // the table is one R_JUMP per entry, its target is taken directly
+    pc = ((unsigned int)INTEGER(pc->a) < (unsigned int)pc->b ?
+          code + pc[1 + INTEGER(pc->a)].dst :
+          code + pc->dst);
+    DISPATCH();
+
+END_DISPATCH()
+
+#undef TARGET
+#undef DISPATCH
+#undef END_DISPATCH
+#undef NEXT
+#undef INTEGER
+#undef SET_INTEGER
+}
+
+
+/* STATIC FUNCTIONS */
+static int translate_method(register_translator_t *translator, vm_method_meta_t *method)
+{
+    const vm_program_t *program = translator->program;
+    const vm_instruction_t *instruction = NULL;
+    unsigned int ip = 0, end = method->offset + method->code_length;
+
+    translator->method = method;
+    translator->depth = 0;
+    translator->frame_size = method->num_params + method->num_locals + 1;
+    translator->last_result = -1;
+    translator->needs_entry = 1;
+
+    method->register_offset = translator->size;
+
+    for (ip = method->offset; ip < end; ++ip)
+    {
+        translator->addresses[ip] = -1;
+    }
+
+    for (ip = method->offset; ip < end; ++ip)
+    {
+        instruction = &program->instructions[ip];
+        if (-1 != program->stack_depths[ip] &&
+            OP_GOTO <= instruction->opcode && OP_IF_ICMPLE >= instruction->opcode)
+        {
+            // a target out of the range is code of another method of a v1 file
+            if ((unsigned int)instruction->arg < method->offset || (unsigned int)instruction->arg >= end)
+            {
+                return -1;
+            }
+            translator->addresses[instruction->arg] = ADDRESS_TARGET;
+        }
+    }
+
+    // the verifier knows which instructions run and how deep the operand stack is at each
+    for (ip = method->offset; ip < end; ++ip)
+    {
+        if (-1 == program->stack_depths[ip])
+        {
+            translator->needs_entry = 1;
+            continue;
+        }
+
+        if ((translator->needs_entry || ADDRESS_TARGET == translator->addresses[ip]) &&
+            0 != open_entry(translator, ip))
+        {
+            return -1;
+        }
+
+        translator->addresses[ip] = (int)translator->size;
+        instruction = &program->instructions[ip];
+
+        if (OP_GOTO <= get_unfused_opcode(instruction->opcode) &&
+            OP_TABLESWITCH >= get_unfused_opcode(instruction->opcode))
+        {
+            if (0 != translate_branch(translator, instruction))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        if (0 != translate_instruction(translator, instruction))
+        {
+            return -1;
+        }
+
+        switch (instruction->opcode)
+        {
+            case OP_TAILCALL:
+            case OP_RET:
+            case OP_IRET:
+            case OP_SRET:
+            case OP_STOP:
+                translator->needs_entry = 1;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return link_branches(translator, method);
+}
+
+static int translate_instruction(register_translator_t *translator, const vm_instruction_t *instruction)
+{
+    const vm_value_t *constant = NULL;
+    const vm_method_meta_t *callee = NULL;
+    operand_t *top = NULL;
+    enum opcodes opcode = OP_NOOP;
+    int base = 0;
+
+    // superinstructions are translated one instruction at a time, like the originals
+    opcode = get_unfused_opcode(instruction->opcode);
+
+    switch (opcode)
+    {
+        case OP_NOOP:
+        case OP_HALT:
+            return 0;
+
+        case OP_POP:
+            --translator->depth;
+            translator->last_result = -1;
+            return 0;
+
+        case OP_ILOAD:
+        case OP_SLOAD:
+            top = &translator->stack[translator->depth++];
+            top->kind = OPERAND_LOCAL;
+            top->value = instruction->arg;
+            translator->last_result = -1;
+            return 0;
+
+        case OP_IPUSH:
+            top = &translator->stack[translator->depth++];
+            top->kind = OPERAND_IMMEDIATE;
+            top->value = instruction->arg;
+            translator->last_result = -1;
+            return 0;
+
+        case OP_CLOAD:
+            constant = &translator->program->constant_pool[instruction->arg];
+            top = &translator->stack[translator->depth++];
+            if (is_value_type(*constant, VM_TYPE_INTEGER))
+            {
+                top->kind = OPERAND_IMMEDIATE;
+                top->value = get_integer_value(*constant);
+                translator->last_result = -1;
+
+                return 0;
+            }
+            top->kind = OPERAND_SLOT;
+
+            return emit(translator, R_LOADK, get_slot_register(translator, translator->depth - 1),
+                        instruction->arg, 0);
+
+        case OP_ISTORE:
+        case OP_SSTORE:
+            return translate_store(translator, instruction->arg);
+
+        case OP_IADD:
+        case OP_ISUB:
+        case OP_IMULT:
+        case OP_IDIV:
+        case OP_INEG:
+            return translate_arithmetic(translator, opcode);
+
+        case OP_IPRINT:
+        case OP_SPRINT:
+        case OP_IRET:
+        case OP_SRET:
+            if (OPERAND_IMMEDIATE == translator->stack[translator->depth - 1].kind &&
+                0 != materialize(translator, translator->depth - 1))
+            {
+                return -1;
+            }
+            --translator->depth;
+
+            switch (opcode)
+            {
+                case OP_IPRINT:
+                    return emit(translator, R_IPRINT, 0, get_register(translator, translator->depth), 0);
+                case OP_SPRINT:
+                    return emit(translator, R_SPRINT, 0, get_register(translator, translator->depth), 0);
+                case OP_IRET:
+                    return emit(translator, R_IRET, 0, get_register(translator, translator->depth), 0);
+                default:
+                    return emit(translator, R_SRET, 0, get_register(translator, translator->depth), 0);
+            }
+
+        case OP_CALL:
+        case OP_TAILCALL:
+            callee = get_method_value(translator->program->constant_pool[instruction->arg]);
+            base = translator->depth - callee->num_params;
+
+            // the arguments have to be in place, the callee's frame starts at them
+            for (int i = base; i < translator->depth; ++i)
+            {
+                if (0 != materialize(translator, i))
+                {
+                    return -1;
+                }
+            }
+
+            translator->depth = base;
+            if (0 != emit(translator, (OP_CALL == opcode ? R_CALL : R_TAILCALL), 0, instruction->arg,
+                          get_slot_register(translator, base)))
+            {
+                return -1;
+            }
+
+            if (0 != callee->result_type)
+            {
+                translator->stack[translator->depth].kind = OPERAND_SLOT;
+                ++translator->depth;
+            }
+
+            return 0;
+
+        case OP_RET:
+            return emit(translator, R_RET, 0, 0, 0);
+
+        case OP_STOP:
+            return emit(translator, R_STOP, 0, 0, 0);
+
+        case OP_FLUSH:
+            return emit(translator, R_FLUSH, 0, 0, 0);
+
+        default:
+            return -1;
+    }
+}
+
+/* branches leave the operand stack in its slots, their targets are patched by link_branches */
+static int translate_branch(register_translator_t *translator, const vm_instruction_t *instruction)
+{
+    operand_t *left = NULL, *right = NULL;
+    int taken_depth = 0;
+
+    switch (instruction->opcode)
+    {
+        case OP_GOTO:
+            translator->needs_entry = 1;
+            if (0 != materialize_all(translator, translator->depth))
+            {
+                return -1;
+            }
+            return emit(translator, R_JUMP, instruction->arg, 0, 0);
+
+        case OP_IFEQ:
+        case OP_IFNE:
+            taken_depth = translator->depth - 1;
+            if (0 != materialize_all(translator, taken_depth) ||
+                (OPERAND_IMMEDIATE == translator->stack[taken_depth].kind &&
+                 0 != materialize(translator, taken_depth)))
+            {
+                return -1;
+            }
+            translator->depth = taken_depth;
+            return emit(translator, (OP_IFEQ == instruction->opcode ? R_JEQI : R_JNEI), instruction->arg,
+                        get_register(translator, taken_depth), 0);
+
+        case OP_TABLESWITCH:
+            taken_depth = translator->depth - 1;
+            translator->needs_entry = 1;
+            if (0 != materialize_all(translator, taken_depth) ||
+                (OPERAND_IMMEDIATE == translator->stack[taken_depth].kind &&
+                 0 != materialize(translator, taken_depth)))
+            {
+                return -1;
+            }
+            translator->depth = taken_depth;
+            // dst is the instruction after the table until it is linked
+            return emit(translator, R_SWITCH, (int)(instruction - translator->program->instructions) + 1 +
+                        instruction->arg, get_register(translator, taken_depth), instruction->arg);
+
+        default:
+            taken_depth = translator->depth - 2;
+            left = &translator->stack[taken_depth];
+            right = &translator->stack[taken_depth + 1];
+            if (0 != materialize_all(translator, taken_depth) ||
+                (OPERAND_IMMEDIATE == left->kind && 0 != materialize(translator, taken_depth)))
+            {
+                return -1;
+            }
+            translator->depth = taken_depth;
+
+            if (OPERAND_IMMEDIATE == right->kind)
+            {
+                return emit(translator, R_JEQI + (instruction->opcode - OP_IF_ICMPEQ), instruction->arg,
+                            get_register(translator, taken_depth), right->value);
+            }
+
+            return emit(translator, R_JEQ + (instruction->opcode - OP_IF_ICMPEQ), instruction->arg,
+                        get_register(translator, taken_depth), get_register(translator, taken_depth + 1));
+    }
+}
+
+/* a branch target, or code after a return, starts with the operand stack in its slots */
+static int open_entry(register_translator_t *translator, unsigned int ip)
+{
+    if (!translator->needs_entry && 0 != materialize_all(translator, translator->depth))
+    {
+        return -1;
+    }
+
+    translator->depth = translator->program->stack_depths[ip];
+    for (int i = 0; i < translator->depth; ++i)
+    {
+        translator->stack[i].kind = OPERAND_SLOT;
+    }
+    translator->last_result = -1;
+    translator->needs_entry = 0;
+
+    return 0;
+}
+
+/*
+* Turns the instruction indices in the dst of the branches of the method into
+* register code indices. A table of a switch has to be one R_JUMP per goto,
+* which it is when the stack is in its slots, but anything else is left to
+* the stack engines.
+*/
+static int link_branches(register_translator_t *translator, const vm_method_meta_t *method)
+{
+    vm_register_instruction_t *instruction = NULL;
+
+    for (unsigned int i = method->register_offset; i < translator->size; ++i)
+    {
+        instruction = &translator->code[i];
+        if (R_JUMP > instruction->opcode || R_SWITCH < instruction->opcode)
+        {
+            continue;
+        }
+
+        if (R_SWITCH == instruction->opcode)
+        {
+            if (i + instruction->b >= translator->size)
+            {
+                return -1;
+            }
+            for (int entry = 1; entry <= instruction->b; ++entry)
+            {
+                if (R_JUMP != instruction[entry].opcode)
+                {
+                    return -1;
+                }
+            }
+        }
+
+        instruction->dst = translator->addresses[instruction->dst];
+        if (0 > instruction->dst)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* writes the operands below depth to their slots */
+static int materialize_all(register_translator_t *translator, int depth)
+{
+    for (int i = 0; i < depth; ++i)
+    {
+        if (0 != materialize(translator, i))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int translate_arithmetic(register_translator_t *translator, enum opcodes opcode)
+{
+    static const enum register_opcodes register_opcodes[][2] = {
+        // register form, immediate form
+        [OP_IADD - OP_IADD]  = { R_ADD, R_ADDI },
+        [OP_ISUB - OP_IADD]  = { R_SUB, R_SUBI },
+        [OP_IMULT - OP_IADD] = { R_MUL, R_MULI },
+        [OP_IDIV - OP_IADD]  = { R_DIV, R_DIVI },
+    };
+    operand_t *left = NULL, *right = NULL, swap = {0};
+    int result = 0, dst = 0;
+
+    if (OP_INEG == opcode)
+    {
+        left = &translator->stack[translator->depth - 1];
+        if (OPERAND_IMMEDIATE == left->kind)
+        {
+            left->value = negate_integer(left->value);
+            translator->last_result = -1;
+
+            return 0;
+        }
+
+        dst = get_slot_register(translator, translator->depth - 1);
+        if (0 != emit(translator, R_NEG, dst, get_register(translator, translator->depth - 1), 0))
+        {
+            return -1;
+        }
+        left->kind = OPERAND_SLOT;
+        translator->last_result = translator->size - 1;
+
+        return 0;
+    }
+
+    left = &translator->stack[translator->depth - 2];
+    right = &translator->stack[translator->depth - 1];
+
+    if (OPERAND_IMMEDIATE == left->kind && OPERAND_IMMEDIATE == right->kind &&
+        0 == fold_arithmetic(opcode, left->value, right->value, &result))
+    {
+        --translator->depth;
+        left->value = result;
+        translator->last_result = -1;
+
+        return 0;
+    }
+
+    // the immediate form takes the immediate on the right
+    if (OPERAND_IMMEDIATE == left->kind && (OP_IADD == opcode || OP_IMULT == opcode))
+    {
+        swap = *left;
+        *left = *right;
+        *right = swap;
+    }
+
+    if (OPERAND_IMMEDIATE == left->kind && 0 != materialize(translator, translator->depth - 2))
+    {
+        return -1;
+    }
+
+    if (OPERAND_IMMEDIATE == right->kind && OP_IDIV == opcode && 0 == right->value &&
+        0 != materialize(translator, translator->depth - 1))
+    {
+        return -1;
+    }
+
+    dst = get_slot_register(translator, translator->depth - 2);
+    if (OPERAND_IMMEDIATE == right->kind)
+    {
+        result = emit(translator, register_opcodes[opcode - OP_IADD][1], dst,
+                      get_register(translator, translator->depth - 2), right->value);
+    }
+    else
+    {
+        result = emit(translator, register_opcodes[opcode - OP_IADD][0], dst,
+                      get_register(translator, translator->depth - 2),
+                      get_register(translator, translator->depth - 1));
+    }
+    if (0 != result)
+    {
+        return -1;
+    }
+
+    --translator->depth;
+    left->kind = OPERAND_SLOT;
+    translator->last_result = translator->size - 1;
+
+    return 0;
+}
+
+static int translate_store(register_translator_t *translator, int index)
+{
+    operand_t *top = &translator->stack[translator->depth - 1];
+    int pending = 0;
+
+    for (int i = 0; i < translator->depth - 1; ++i)
+    {
+        pending |= (OPERAND_LOCAL == translator->stack[i].kind && index == translator->stack[i].value);
+    }
+
+    // the result that is being stored can be written to the local directly
+    if (OPERAND_SLOT == top->kind && -1 != translator->last_result && !pending)
+    {
+        translator->code[translator->last_result].dst = index;
+        translator->last_result = -1;
+        --translator->depth;
+
+        return 0;
+    }
+
+    // values still read from the local have to be taken before it changes
+    for (int i = 0; i < translator->depth - 1 && pending; ++i)
+    {
+        if (OPERAND_LOCAL == translator->stack[i].kind && index == translator->stack[i].value &&
+            0 != materialize(translator, i))
+        {
+            return -1;
+        }
+    }
+
+    --translator->depth;
+
+    if (OPERAND_IMMEDIATE == top->kind)
+    {
+        return emit(translator, R_LOADI, index, top->value, 0);
+    }
+
+    if (OPERAND_LOCAL == top->kind && index == top->value)
+    {
+        translator->last_result = -1;
+
+        return 0;
+    }
+
+    return emit(translator, R_MOVE, index, get_register(translator, translator->depth), 0);
+}
+
+/* folds two immediates, fails for what has to be left to run time */
+static int fold_arithmetic(enum opcodes opcode, int left, int right, int *result)
+{
+    switch (opcode)
+    {
+        case OP_IADD:
+            *result = add_integers(left, right);
+            return 0;
+        case OP_ISUB:
+            *result = subtract_integers(left, right);
+            return 0;
+        case OP_IMULT:
+            *result = multiply_integers(left, right);
+            return 0;
+        default:
+            if (0 == right)
+            {
+                return -1;
+            }
+            *result = divide_integers(left, right);
+            return 0;
+    }
+}
+
+static int emit(register_translator_t *translator, enum register_opcodes opcode, int dst, int a, int b)
+{
+    vm_register_instruction_t *code = NULL;
+
+    if (translator->size == translator->capacity)
+    {
+        code = (vm_register_instruction_t *)realloc(translator->code,
+            sizeof(vm_register_instruction_t) * (translator->capacity + 64) * 2);
+        if (NULL == code)
+        {
+            return -1;
+        }
+        translator->code = code;
+        translator->capacity = (translator->capacity + 64) * 2;
+    }
+
+    code = &translator->code[translator->size++];
+    code->opcode = opcode;
+    code->dst = dst;
+    code->a = a;
+    code->b = b;
+
+    translator->last_result = -1;
+
+    return 0;
+}
+
+/* writes an operand to the register of its operand stack slot */
+static int materialize(register_translator_t *translator, int position)
+{
+    operand_t *operand = &translator->stack[position];
+    int res = 0;
+
+    switch (operand->kind)
+    {
+        case OPERAND_IMMEDIATE:
+            res = emit(translator, R_LOADI, get_slot_register(translator, position), operand->value, 0);
+            break;
+
+        case OPERAND_LOCAL:
+            res = emit(translator, R_MOVE, get_slot_register(translator, position), operand->value, 0);
+            break;
+
+        default:
+            return 0;
+    }
+
+    operand->kind = OPERAND_SLOT;
+
+    return res;
+}
+
+static int get_register(register_translator_t *translator, int position)
+{
+    operand_t *operand = &translator->stack[position];
+
+    return (OPERAND_LOCAL == operand->kind ? operand->value : get_slot_register(translator, position));
+}
+
+static int get_slot_register(register_translator_t *translator, int position)
+{
+    return translator->frame_size + position;
+}
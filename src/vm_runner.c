@@ -0,0 +1,560 @@
+#include <assert.h>    /* assert          */
+#include <pthread.h>   /* pthread_create  */
+#include <stdio.h>     /* open_memstream  */
+#include <stdlib.h>    /* malloc          */
+#include <string.h>    /* memset          */
+#include <time.h>      /* clock_gettime   */
+#include <unistd.h>    /* sysconf         */
+
+#include "vm_impl.h"   /* private vm header */
+#include "vm_loader.h" /* prepare_reachable_code */
+
+#include "vm_runner.h" /* public runner header */
+
+/*
+* A job queue per worker. The owner takes jobs from the tail and thieves take
+* them from the head, so the two ends only meet when the queue is almost
+* empty. Jobs are never added while a batch is running, which means a worker
+* that finds every queue empty is done.
+*/
+typedef struct vm_runner_queue
+{
+    pthread_mutex_t lock;
+    unsigned int *jobs;
+    unsigned int head;
+    unsigned int tail;
+} vm_runner_queue_t;
+
+/* a distinct path of the batch, loaded once and shared by all of its jobs */
+typedef struct vm_runner_program
+{
+    const char *path;
+    vm_program_t *program; // NULL when it failed to load
+    FILE *err; // the program reports to it until it is freed
+    char *err_buffer;
+    size_t err_size;
+    char *errors; // what loading and preparing it printed, copied to the output of its jobs
+    size_t errors_size;
+} vm_runner_program_t;
+
+/* a job and its path, sorted to find the distinct paths */
+typedef struct vm_runner_path
+{
+    const char *path;
+    unsigned int job;
+} vm_runner_path_t;
+
+typedef struct vm_runner_worker
+{
+    vm_runner_t *runner;
+    unsigned int index;
+    pthread_t thread;
+    vm_context_t *context; // created by the first job, then moved from program to program
+    vm_runner_queue_t queue;
+    unsigned int num_stolen; // jobs this worker took from other queues in the current batch
+} vm_runner_worker_t;
+
+struct vm_runner
+{
+    vm_runner_worker_t *workers;
+    unsigned int num_workers;
+    unsigned int num_threads; // the number of workers whose thread was started
+
+    unsigned int stack_size;
+    enum vm_engine engine;
+
+    pthread_mutex_t lock;
+    pthread_cond_t batch_ready; // signaled when a batch is queued or the runner shuts down
+    pthread_cond_t batch_done;  // signaled by the last worker to finish a batch
+    unsigned int batch; // incremented for every batch
+    unsigned int num_busy; // workers still running the current batch
+    int shutdown;
+
+    const char *const *paths; // the current batch
+    vm_job_result_t *results;
+    vm_runner_program_t *programs; // the distinct paths of the batch
+    unsigned int num_programs;
+    unsigned int *job_programs; // the index in programs of every job
+};
+
+static void *worker_main(void *arg);
+static int take_job(vm_runner_worker_t *worker, unsigned int *job);
+static int pop_job(vm_runner_queue_t *queue, unsigned int *job);
+static int steal_job(vm_runner_queue_t *queue, unsigned int *job);
+static int load_programs(vm_runner_t *runner, const char *const *paths, unsigned int num_jobs);
+static void free_programs(vm_runner_t *runner);
+static int compare_path(const void *first, const void *second);
+static void run_job(vm_runner_worker_t *worker, const vm_runner_program_t *program, vm_job_result_t *result);
+static void collect_stats(vm_runner_t *runner,
+                          const vm_job_result_t *results,
+                          unsigned int num_jobs,
+                          double elapsed,
+                          vm_runner_stats_t *stats);
+static int compare_latency(const void *first, const void *second);
+static double now(void);
+
+vm_runner_t *vm_runner_create(unsigned int num_workers,
+                              unsigned int stack_size,
+                              enum vm_engine engine)
+{
+    vm_runner_t *runner = NULL;
+    long num_cores = 0;
+
+    if (0 == num_workers)
+    {
+        num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cores > 0 ? (unsigned int)num_cores : 1);
+    }
+
+    runner = (vm_runner_t *)calloc(1, sizeof(vm_runner_t));
+    if (NULL == runner)
+    {
+        return NULL;
+    }
+
+    runner->workers = (vm_runner_worker_t *)calloc(num_workers, sizeof(vm_runner_worker_t));
+    if (NULL == runner->workers)
+    {
+        free(runner);
+
+        return NULL;
+    }
+
+    runner->num_workers = num_workers;
+    runner->stack_size = stack_size;
+    runner->engine = engine;
+
+    pthread_mutex_init(&runner->lock, NULL);
+    pthread_cond_init(&runner->batch_ready, NULL);
+    pthread_cond_init(&runner->batch_done, NULL);
+
+    for (unsigned int i = 0; i < num_workers; ++i)
+    {
+        runner->workers[i].runner = runner;
+        runner->workers[i].index = i;
+        pthread_mutex_init(&runner->workers[i].queue.lock, NULL);
+    }
+
+    for (unsigned int i = 0; i < num_workers; ++i)
+    {
+        if (0 != pthread_create(&runner->workers[i].thread, NULL, worker_main, &runner->workers[i]))
+        {
+            vm_runner_free(runner);
+
+            return NULL;
+        }
+        ++runner->num_threads;
+    }
+
+    return runner;
+}
+
+int vm_runner_run(vm_runner_t *runner,
+                  const char *const *paths,
+                  unsigned int num_jobs,
+                  vm_job_result_t *results,
+                  vm_runner_stats_t *stats)
+{
+    vm_runner_queue_t *queue = NULL;
+    double start = 0;
+
+    assert(runner && (0 == num_jobs || (paths && results)));
+
+    memset(results, 0, sizeof(vm_job_result_t) * num_jobs);
+
+    for (unsigned int i = 0; i < runner->num_workers; ++i)
+    {
+        queue = &runner->workers[i].queue;
+
+        free(queue->jobs);
+        queue->jobs = (unsigned int *)malloc(sizeof(unsigned int) * (num_jobs / runner->num_workers + 1));
+        if (NULL == queue->jobs)
+        {
+            return -1;
+        }
+        queue->head = 0;
+        queue->tail = 0;
+        runner->workers[i].num_stolen = 0;
+    }
+
+    // deal the jobs round-robin, stealing evens out whatever this gets wrong
+    for (unsigned int job = 0; job < num_jobs; ++job)
+    {
+        queue = &runner->workers[job % runner->num_workers].queue;
+        queue->jobs[queue->tail++] = job;
+    }
+
+    start = now();
+
+    if (0 != load_programs(runner, paths, num_jobs))
+    {
+        free_programs(runner);
+
+        return -1;
+    }
+
+    pthread_mutex_lock(&runner->lock);
+    runner->paths = paths;
+    runner->results = results;
+    runner->num_busy = runner->num_workers;
+    ++runner->batch;
+    pthread_cond_broadcast(&runner->batch_ready);
+
+    while (0 != runner->num_busy)
+    {
+        pthread_cond_wait(&runner->batch_done, &runner->lock);
+    }
+    runner->paths = NULL;
+    runner->results = NULL;
+    pthread_mutex_unlock(&runner->lock);
+
+    free_programs(runner);
+
+    if (NULL != stats)
+    {
+        collect_stats(runner, results, num_jobs, now() - start, stats);
+    }
+
+    return 0;
+}
+
+void vm_runner_free_results(vm_job_result_t *results, unsigned int num_jobs)
+{
+    assert(results || 0 == num_jobs);
+
+    for (unsigned int i = 0; i < num_jobs; ++i)
+    {
+        free(results[i].output);
+        results[i].output = NULL;
+        results[i].output_size = 0;
+    }
+}
+
+void vm_runner_free(vm_runner_t *runner)
+{
+    assert(runner);
+
+    pthread_mutex_lock(&runner->lock);
+    runner->shutdown = 1;
+    pthread_cond_broadcast(&runner->batch_ready);
+    pthread_mutex_unlock(&runner->lock);
+
+    for (unsigned int i = 0; i < runner->num_threads; ++i)
+    {
+        pthread_join(runner->workers[i].thread, NULL);
+    }
+
+    for (unsigned int i = 0; i < runner->num_workers; ++i)
+    {
+        if (NULL != runner->workers[i].context)
+        {
+            vm_context_free(runner->workers[i].context);
+        }
+        free(runner->workers[i].queue.jobs);
+        pthread_mutex_destroy(&runner->workers[i].queue.lock);
+    }
+
+    pthread_cond_destroy(&runner->batch_done);
+    pthread_cond_destroy(&runner->batch_ready);
+    pthread_mutex_destroy(&runner->lock);
+
+    free(runner->workers);
+    free(runner);
+}
+
+
+/* STATIC FUNCTIONS */
+static void *worker_main(void *arg)
+{
+    vm_runner_worker_t *worker = (vm_runner_worker_t *)arg;
+    vm_runner_t *runner = worker->runner;
+    unsigned int seen_batch = 0;
+    unsigned int job = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&runner->lock);
+        while (!runner->shutdown && seen_batch == runner->batch)
+        {
+            pthread_cond_wait(&runner->batch_ready, &runner->lock);
+        }
+        if (runner->shutdown)
+        {
+            pthread_mutex_unlock(&runner->lock);
+
+            return NULL;
+        }
+        seen_batch = runner->batch;
+        pthread_mutex_unlock(&runner->lock);
+
+        while (0 == take_job(worker, &job))
+        {
+            run_job(worker, &runner->programs[runner->job_programs[job]], &runner->results[job]);
+        }
+
+        pthread_mutex_lock(&runner->lock);
+        if (0 == --runner->num_busy)
+        {
+            pthread_cond_signal(&runner->batch_done);
+        }
+        pthread_mutex_unlock(&runner->lock);
+    }
+}
+
+static int take_job(vm_runner_worker_t *worker, unsigned int *job)
+{
+    vm_runner_t *runner = worker->runner;
+    unsigned int victim = 0;
+
+    if (0 == pop_job(&worker->queue, job))
+    {
+        return 0;
+    }
+
+    for (unsigned int i = 1; i < runner->num_workers; ++i)
+    {
+        victim = (worker->index + i) % runner->num_workers;
+
+        if (0 == steal_job(&runner->workers[victim].queue, job))
+        {
+            ++worker->num_stolen;
+
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int pop_job(vm_runner_queue_t *queue, unsigned int *job)
+{
+    int res = -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *job = queue->jobs[--queue->tail];
+        res = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return res;
+}
+
+static int steal_job(vm_runner_queue_t *queue, unsigned int *job)
+{
+    int res = -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->head < queue->tail)
+    {
+        *job = queue->jobs[queue->head++];
+        res = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return res;
+}
+
+/*
+* Loads every distinct path of the batch once, before the workers start.
+* The jobs of a path share its program, which only needs a context of its
+* own per worker. Its reachable methods are prepared here, once for all of
+* them, so a verifier error shows in the output of every job as it did when
+* each job loaded its own copy.
+*/
+static int load_programs(vm_runner_t *runner, const char *const *paths, unsigned int num_jobs)
+{
+    vm_runner_program_t *program = NULL;
+    vm_runner_path_t *order = NULL;
+
+    runner->programs = (vm_runner_program_t *)calloc(num_jobs + 1, sizeof(vm_runner_program_t));
+    runner->job_programs = (unsigned int *)malloc(sizeof(unsigned int) * (num_jobs + 1));
+    order = (vm_runner_path_t *)malloc(sizeof(vm_runner_path_t) * (num_jobs + 1));
+    if (NULL == runner->programs || NULL == runner->job_programs || NULL == order)
+    {
+        free(order);
+
+        return -1;
+    }
+
+    // the jobs sorted by path, so the jobs of a path are next to each other
+    for (unsigned int job = 0; job < num_jobs; ++job)
+    {
+        order[job].path = paths[job];
+        order[job].job = job;
+    }
+    qsort(order, num_jobs, sizeof(vm_runner_path_t), compare_path);
+
+    for (unsigned int i = 0; i < num_jobs; ++i)
+    {
+        if (0 == i || 0 != strcmp(order[i].path, program->path))
+        {
+            program = &runner->programs[runner->num_programs++];
+            program->path = order[i].path;
+
+            program->err = open_memstream(&program->err_buffer, &program->err_size);
+            if (NULL == program->err)
+            {
+                free(order);
+
+                return -1;
+            }
+            program->program = vm_program_load(program->path, program->err);
+            if (NULL != program->program)
+            {
+                // a failure is reported to err and again by the jobs that call the method
+                prepare_reachable_code(program->program);
+            }
+
+            // later lazy preparation under prepare_lock may still grow err_buffer
+            fflush(program->err);
+            program->errors = (char *)malloc(program->err_size + 1);
+            if (NULL == program->errors)
+            {
+                free(order);
+
+                return -1;
+            }
+            memcpy(program->errors, program->err_buffer, program->err_size);
+            program->errors_size = program->err_size;
+        }
+
+        runner->job_programs[order[i].job] = runner->num_programs - 1;
+    }
+
+    free(order);
+
+    return 0;
+}
+
+static void free_programs(vm_runner_t *runner)
+{
+    for (unsigned int i = 0; i < runner->num_programs; ++i)
+    {
+        if (NULL != runner->programs[i].program)
+        {
+            vm_program_free(runner->programs[i].program);
+        }
+        if (NULL != runner->programs[i].err)
+        {
+            fclose(runner->programs[i].err);
+        }
+        free(runner->programs[i].err_buffer);
+        free(runner->programs[i].errors);
+    }
+
+    free(runner->programs);
+    free(runner->job_programs);
+    runner->programs = NULL;
+    runner->job_programs = NULL;
+    runner->num_programs = 0;
+}
+
+static int compare_path(const void *first, const void *second)
+{
+    return strcmp(((const vm_runner_path_t *)first)->path, ((const vm_runner_path_t *)second)->path);
+}
+
+static void run_job(vm_runner_worker_t *worker, const vm_runner_program_t *program, vm_job_result_t *result)
+{
+    vm_runner_t *runner = worker->runner;
+    FILE *output = NULL;
+    double start = now();
+
+    result->status = -1;
+    result->worker = worker->index;
+
+    output = open_memstream(&result->output, &result->output_size);
+    if (NULL == output)
+    {
+        result->latency = now() - start;
+
+        return;
+    }
+
+    fwrite(program->errors, 1, program->errors_size, output);
+    if (NULL != program->program)
+    {
+        if (NULL == worker->context)
+        {
+            worker->context = vm_context_create(program->program, runner->stack_size, 0,
+                                                output, NULL, output, runner->engine);
+        }
+        else
+        {
+            vm_context_set_program(worker->context, program->program);
+            vm_context_set_io(worker->context, output, NULL, output);
+        }
+
+        if (NULL != worker->context)
+        {
+            vm_run(worker->context);
+            result->status = (VM_FINISHED == worker->context->state ? 0 : -1);
+        }
+    }
+
+    fclose(output);
+    result->latency = now() - start;
+}
+
+static void collect_stats(vm_runner_t *runner,
+                          const vm_job_result_t *results,
+                          unsigned int num_jobs,
+                          double elapsed,
+                          vm_runner_stats_t *stats)
+{
+    double *latencies = NULL;
+
+    memset(stats, 0, sizeof(vm_runner_stats_t));
+
+    stats->num_jobs = num_jobs;
+    stats->num_workers = runner->num_workers;
+    stats->elapsed = elapsed;
+    stats->throughput = (elapsed > 0 ? num_jobs / elapsed : 0);
+
+    for (unsigned int i = 0; i < runner->num_workers; ++i)
+    {
+        stats->num_stolen += runner->workers[i].num_stolen;
+    }
+
+    if (0 == num_jobs)
+    {
+        return;
+    }
+
+    latencies = (double *)malloc(sizeof(double) * num_jobs);
+    if (NULL == latencies)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < num_jobs; ++i)
+    {
+        latencies[i] = results[i].latency;
+        stats->num_failed += (0 != results[i].status);
+    }
+    qsort(latencies, num_jobs, sizeof(double), compare_latency);
+
+    stats->latency_p50 = latencies[(num_jobs - 1) / 2];
+    stats->latency_p99 = latencies[(num_jobs * 99 + 99) / 100 - 1];
+    stats->latency_max = latencies[num_jobs - 1];
+
+    free(latencies);
+}
+
+static int compare_latency(const void *first, const void *second)
+{
+    double a = *(const double *)first, b = *(const double *)second;
+
+    return (a > b) - (a < b);
+}
+
+static double now(void)
+{
+    struct timespec time = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
@@ -0,0 +1,161 @@
+#include <assert.h>    /* assert       */
+#include <pthread.h>   /* pthread_once */
+#include <setjmp.h>    /* sigsetjmp    */
+#include <signal.h>    /* sigaction    */
+#include <stdint.h>    /* UINT8_MAX    */
+#include <sys/mman.h>  /* mmap         */
+#include <unistd.h>    /* sysconf      */
+
+#include "vm_impl.h"     /* private vm header */
+#include "vm_util.h"     /* print_error       */
+#include "vm_verifier.h" /* MAX_OPERAND_DEPTH */
+#include "vm_stack.h"    /* stack guard       */
+
+// the largest frame: params and locals, the separator slot and a full operand stack
+#define MAX_FRAME_SLOTS (UINT8_MAX * 2 + 1 + MAX_OPERAND_DEPTH)
+
+/* the run of a context on this thread, the fault handler unwinds to it */
+typedef struct stack_guard
+{
+    const vm_t *instance;
+    sigjmp_buf overflow;
+} stack_guard_t;
+
+static __thread stack_guard_t *current_guard = NULL;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+static struct sigaction previous_action;
+
+static void install_fault_handler(void);
+static void handle_fault(int signal_number, siginfo_t *info, void *context);
+static size_t round_to_pages(size_t size);
+static size_t get_guard_size(void);
+
+int alloc_stack(vm_t *instance)
+{
+    size_t stack_bytes = 0, guard_size = 0;
+    void *mapping = NULL;
+
+    assert(instance && 0 < instance->stack_size);
+
+    pthread_once(&handler_once, install_fault_handler);
+
+    stack_bytes = round_to_pages(instance->stack_size);
+    guard_size = get_guard_size();
+
+    // reserve everything inaccessible, then open up the stack itself
+    mapping = mmap(NULL, stack_bytes + guard_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == mapping)
+    {
+        return -1;
+    }
+
+    if (0 != mprotect(mapping, stack_bytes, PROT_READ | PROT_WRITE))
+    {
+        munmap(mapping, stack_bytes + guard_size);
+
+        return -1;
+    }
+
+    instance->stack = (vm_value_t *)mapping;
+    instance->stack_guard = (char *)mapping + stack_bytes;
+    instance->stack_guard_size = guard_size;
+
+    return 0;
+}
+
+void free_stack(vm_t *instance)
+{
+    assert(instance);
+
+    if (NULL != instance->stack)
+    {
+        munmap(instance->stack, (size_t)(instance->stack_guard - (char *)instance->stack) + instance->stack_guard_size);
+    }
+
+    instance->stack = NULL;
+    instance->stack_guard = NULL;
+    instance->stack_guard_size = 0;
+}
+
+int run_guarded(vm_t *instance, int (*engine)(vm_t *instance))
+{
+    stack_guard_t guard = {0};
+    stack_guard_t *previous = current_guard;
+    int res = 0;
+
+    assert(instance && engine);
+
+    guard.instance = instance;
+
+    // the mask is saved too, SIGSEGV is blocked while the handler runs
+    if (0 != sigsetjmp(guard.overflow, 1))
+    {
+        current_guard = previous;
+        print_error(instance, "stack overflow");
+
+        return -1;
+    }
+
+    current_guard = &guard;
+    res = engine(instance);
+    current_guard = previous;
+
+    return res;
+}
+
+
+/* STATIC FUNCTIONS */
+static void install_fault_handler(void)
+{
+    struct sigaction action = {0};
+
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGSEGV, &action, &previous_action);
+}
+
+/*
+* Only faults on the guard of the context running on this thread are
+* handled, anything else goes to the handler that was there before, or
+* kills the process as it would have without this one.
+*/
+static void handle_fault(int signal_number, siginfo_t *info, void *context)
+{
+    stack_guard_t *guard = current_guard;
+    const char *address = (const char *)info->si_addr;
+
+    if (NULL != guard &&
+        address >= guard->instance->stack_guard &&
+        address < guard->instance->stack_guard + guard->instance->stack_guard_size)
+    {
+        siglongjmp(guard->overflow, 1);
+    }
+
+    if ((previous_action.sa_flags & SA_SIGINFO) && NULL != previous_action.sa_sigaction)
+    {
+        previous_action.sa_sigaction(signal_number, info, context);
+    }
+    else if (SIG_DFL != previous_action.sa_handler && SIG_IGN != previous_action.sa_handler)
+    {
+        previous_action.sa_handler(signal_number);
+    }
+    else
+    {
+        // returning retries the access, which now faults with the default action
+        signal(SIGSEGV, SIG_DFL);
+    }
+}
+
+static size_t round_to_pages(size_t size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+static size_t get_guard_size(void)
+{
+    return round_to_pages(sizeof(vm_value_t) * MAX_FRAME_SLOTS);
+}
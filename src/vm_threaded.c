@@ -0,0 +1,698 @@
+#include <assert.h>    /* assert    */
+#include <stdio.h>     /* fprintf   */
+#include <stdlib.h>    /* malloc    */
+
+#include "opcodes.h"     /* opcodes          */
+#include "vm_impl.h"     /* private vm header */
+#include "vm_util.h"     /* utility functions */
+#include "vm_threaded.h" /* threaded engine   */
+#include "vm_jit.h"      /* loops moving to native code */
+#include "vm_output.h"   /* print buffer      */
+#include "vm_numeric.h"  /* integer semantics */
+
+#if HAS_COMPUTED_GOTO
+
+static int threaded_engine(vm_t *instance,
+                           vm_program_t *program_to_translate,
+                           const vm_method_meta_t *method_to_translate);
+static int translate_instructions(vm_program_t *program,
+                                  const vm_method_meta_t *method,
+                                  const void *const *labels,
+                                  const void *generic_label,
+                                  const void *end_label);
+static void resolve_call(const vm_program_t *program,
+                         vm_threaded_instruction_t *instruction,
+                         const void *generic_label);
+
+int run_threaded_code(vm_t *instance)
+{
+    assert(instance && instance->program && instance->program->threaded_code);
+
+    return threaded_engine(instance, NULL, NULL);
+}
+
+int translate_threaded_code(vm_program_t *program)
+{
+    assert(program);
+
+    return threaded_engine(NULL, program, NULL);
+}
+
+int translate_threaded_method(vm_program_t *program, const vm_method_meta_t *method)
+{
+    assert(program && method);
+
+    return threaded_engine(NULL, program, method);
+}
+
+/*
+* The threaded engine translates the instructions once into an array of
+* { label, arg } pairs and then jumps from one inline handler straight to the
+* next one. ip, sp, lap and osp are kept in locals and only written back to the
+* instance when an opcode is delegated to its handler in opcode_handlers.
+* Every inline handler falls back to the regular handler when one of its
+* checks fails, so error reporting stays in one place (src/opcodes.c).
+* Verified programs are translated to the *_unchecked labels, which sit right
+* after the checks of the same opcode and skip them.
+* The labels only exist inside this function, so it also does the translation
+* when called with program_to_translate, of method_to_translate only if set.
+*/
+static int threaded_engine(vm_t *instance,
+                           vm_program_t *program_to_translate,
+                           const vm_method_meta_t *method_to_translate)
+{
+    static const void *labels[NUM_OPCODES] = {
+        [0 ... NUM_OPCODES - 1] = &&op_generic,
+
+        [OP_NOOP]   = &&op_noop,
+        [OP_POP]    = &&op_pop,
+
+        [OP_ILOAD]  = &&op_iload,
+        [OP_ISTORE] = &&op_istore,
+        [OP_IPUSH]  = &&op_ipush,
+        [OP_IADD]   = &&op_iadd,
+        [OP_ISUB]   = &&op_isub,
+        [OP_IMULT]  = &&op_imult,
+        [OP_IDIV]   = &&op_idiv,
+        [OP_INEG]   = &&op_ineg,
+        [OP_IPRINT] = &&op_iprint,
+
+        [OP_SLOAD]  = &&op_sload,
+        [OP_SSTORE] = &&op_sstore,
+        [OP_SPRINT] = &&op_sprint,
+
+        [OP_RLOAD]  = &&op_rload,
+        [OP_RSTORE] = &&op_rstore,
+        [OP_RNULL]  = &&op_rnull,
+
+        [OP_CLOAD]  = &&op_cload,
+    };
+
+    static const void *unchecked_labels[NUM_OPCODES] = {
+        [0 ... NUM_OPCODES - 1] = &&op_generic,
+
+        [OP_NOOP]   = &&op_noop,
+        [OP_POP]    = &&op_pop_unchecked,
+
+        [OP_ILOAD]  = &&op_iload_unchecked,
+        [OP_ISTORE] = &&op_istore_unchecked,
+        [OP_IPUSH]  = &&op_ipush,
+        [OP_IADD]   = &&op_iadd_unchecked,
+        [OP_ISUB]   = &&op_isub_unchecked,
+        [OP_IMULT]  = &&op_imult_unchecked,
+        [OP_IDIV]   = &&op_idiv_unchecked,
+        [OP_INEG]   = &&op_ineg_unchecked,
+        [OP_IPRINT] = &&op_iprint_unchecked,
+
+        [OP_GOTO]        = &&op_goto,
+        [OP_IFEQ]        = &&op_ifeq,
+        [OP_IFNE]        = &&op_ifne,
+        [OP_IF_ICMPEQ]   = &&op_if_icmpeq,
+        [OP_IF_ICMPNE]   = &&op_if_icmpne,
+        [OP_IF_ICMPLT]   = &&op_if_icmplt,
+        [OP_IF_ICMPGE]   = &&op_if_icmpge,
+        [OP_IF_ICMPGT]   = &&op_if_icmpgt,
+        [OP_IF_ICMPLE]   = &&op_if_icmple,
+        [OP_TABLESWITCH] = &&op_tableswitch,
+
+        [OP_SLOAD]  = &&op_sload_unchecked,
+        [OP_SSTORE] = &&op_sstore_unchecked,
+        [OP_SPRINT] = &&op_sprint_unchecked,
+
+        [OP_RLOAD]  = &&op_rload_unchecked,
+        [OP_RSTORE] = &&op_rstore_unchecked,
+        [OP_RNULL]  = &&op_rnull,
+
+        [OP_CLOAD]  = &&op_cload_unchecked,
+
+        [OP_CALL]     = &&op_call_resolved,
+        [OP_TAILCALL] = &&op_tailcall_resolved,
+        [OP_RET]      = &&op_ret,
+
+        [OP_IADD_LL]    = &&op_iadd_ll,
+        [OP_ISUB_LL]    = &&op_isub_ll,
+        [OP_IMULT_LL]   = &&op_imult_ll,
+        [OP_IADD_LI]    = &&op_iadd_li,
+        [OP_ISUB_LI]    = &&op_isub_li,
+        [OP_IMULT_LI]   = &&op_imult_li,
+        [OP_IADD_LLS]   = &&op_iadd_lls,
+        [OP_ISUB_LLS]   = &&op_isub_lls,
+        [OP_ISTORE_IMM] = &&op_istore_imm,
+        [OP_ILOAD2]     = &&op_iload2,
+    };
+
+    const vm_threaded_instruction_t *code = NULL;
+    const vm_threaded_instruction_t *pc = NULL;
+    const vm_value_t *constant_pool = NULL;
+    vm_value_t *stack = NULL;
+    unsigned int sp = 0, lap = 0, osp = 0;
+    int count_loops = 0;
+    int res = 0;
+
+    if (NULL != program_to_translate)
+    {
+        return translate_instructions(program_to_translate,
+                                      method_to_translate,
+                                      (program_to_translate->verified ? unchecked_labels : labels),
+                                      &&op_generic,
+                                      &&op_end);
+    }
+
+#define LOAD_STATE()                      \
+    do {                                  \
+        pc = code + instance->ip;         \
+        sp = instance->sp;                \
+        lap = instance->lap;              \
+        osp = instance->osp;              \
+    } while (0)
+
+#define SAVE_STATE()                      \
+    do {                                  \
+        instance->ip = pc - code + 1;     \
+        instance->sp = sp;                \
+        instance->lap = lap;              \
+        instance->osp = osp;              \
+    } while (0)
+
+#define DISPATCH() goto *pc->handler
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+#define OPERAND_STACK_SIZE() ((int)(osp - sp - 1))
+
+    code = instance->program->threaded_code;
+    constant_pool = instance->program->constant_pool;
+    stack = instance->stack;
+    count_loops = (VM_ENGINE_JIT == instance->engine);
+    LOAD_STATE();
+    DISPATCH();
+
+op_generic:
+    SAVE_STATE();
+    res = instance->opcode_handlers[instance->program->instructions[pc - code].opcode](instance);
+    if (0 != res || VM_RUNNING != instance->state)
+    {
+        return res;
+    }
+    LOAD_STATE();
+    DISPATCH();
+
+op_end:
+    print_error(instance, "reached the end of the code region");
+    SAVE_STATE();
+
+    return -1;
+
+op_noop:
+    NEXT();
+
+op_pop:
+    if (OPERAND_STACK_SIZE() <= 0)
+    {
+        goto op_generic;
+    }
+op_pop_unchecked:
+    --osp;
+    NEXT();
+
+op_iload:
+    if (!is_value_type(stack[lap + pc->arg], VM_TYPE_INTEGER))
+    {
+        goto op_generic;
+    }
+op_iload_unchecked:
+    stack[osp] = stack[lap + pc->arg];
+    ++osp;
+    NEXT();
+
+op_istore:
+    if (OPERAND_STACK_SIZE() <= 0 ||
+        !is_value_type(stack[osp - 1], VM_TYPE_INTEGER) ||
+        !is_value_type(stack[lap + pc->arg], VM_TYPE_INTEGER))
+    {
+        goto op_generic;
+    }
+op_istore_unchecked:
+    --osp;
+    stack[lap + pc->arg] = stack[osp];
+    NEXT();
+
+op_ipush:
+    stack[osp] = make_integer_value(pc->arg);
+    ++osp;
+    NEXT();
+
+#define INTEGER_OPERANDS_OK() \
+    (OPERAND_STACK_SIZE() >= 2 && \
+     is_value_type(stack[osp - 2], VM_TYPE_INTEGER) && \
+     is_value_type(stack[osp - 1], VM_TYPE_INTEGER))
+
+op_iadd:
+    if (!INTEGER_OPERANDS_OK())
+    {
+        goto op_generic;
+    }
+op_iadd_unchecked:
+    --osp;
+    stack[osp - 1] =
+        make_integer_value(add_integers(get_integer_value(stack[osp - 1]), get_integer_value(stack[osp])));
+    NEXT();
+
+op_isub:
+    if (!INTEGER_OPERANDS_OK())
+    {
+        goto op_generic;
+    }
+op_isub_unchecked:
+    --osp;
+    stack[osp - 1] =
+        make_integer_value(subtract_integers(get_integer_value(stack[osp - 1]), get_integer_value(stack[osp])));
+    NEXT();
+
+op_imult:
+    if (!INTEGER_OPERANDS_OK())
+    {
+        goto op_generic;
+    }
+op_imult_unchecked:
+    --osp;
+    stack[osp - 1] =
+        make_integer_value(multiply_integers(get_integer_value(stack[osp - 1]), get_integer_value(stack[osp])));
+    NEXT();
+
+op_idiv:
+    if (!INTEGER_OPERANDS_OK())
+    {
+        goto op_generic;
+    }
+op_idiv_unchecked:
+    if (0 == get_integer_value(stack[osp - 1]))
+    {
+        goto op_generic;
+    }
+    --osp;
+    stack[osp - 1] =
+        make_integer_value(divide_integers(get_integer_value(stack[osp - 1]), get_integer_value(stack[osp])));
+    NEXT();
+
+#undef INTEGER_OPERANDS_OK
+
+op_ineg:
+    if (OPERAND_STACK_SIZE() <= 0 || !is_value_type(stack[osp - 1], VM_TYPE_INTEGER))
+    {
+        goto op_generic;
+    }
+op_ineg_unchecked:
+    stack[osp - 1] = make_integer_value(negate_integer(get_integer_value(stack[osp - 1])));
+    NEXT();
+
+op_iprint:
+    if (OPERAND_STACK_SIZE() <= 0 || !is_value_type(stack[osp - 1], VM_TYPE_INTEGER))
+    {
+        goto op_generic;
+    }
+op_iprint_unchecked:
+    --osp;
+    output_integer(instance, get_integer_value(stack[osp]));
+    NEXT();
+
+/*
+* Branches only exist in verified programs, the checked labels leave them to
+* their handlers. A taken branch is a single jump to its target, except for a
+* back-edge on the jit engine, which is handed to jit_enter_loop so a hot loop
+* continues in native code.
+*/
+#define BRANCH_IF(condition)                                \
+    do {                                                    \
+        if (!(condition))                                   \
+        {                                                   \
+            NEXT();                                         \
+        }                                                   \
+        if (count_loops && code + pc->arg <= pc)            \
+        {                                                   \
+            goto op_loop;                                   \
+        }                                                   \
+        pc = code + pc->arg;                                \
+        DISPATCH();                                         \
+    } while (0)
+
+op_goto:
+    BRANCH_IF(1);
+
+op_ifeq:
+    --osp;
+    BRANCH_IF(0 == get_integer_value(stack[osp]));
+
+op_ifne:
+    --osp;
+    BRANCH_IF(0 != get_integer_value(stack[osp]));
+
+op_if_icmpeq:
+    osp -= 2;
+    BRANCH_IF(get_integer_value(stack[osp]) == get_integer_value(stack[osp + 1]));
+
+op_if_icmpne:
+    osp -= 2;
+    BRANCH_IF(get_integer_value(stack[osp]) != get_integer_value(stack[osp + 1]));
+
+op_if_icmplt:
+    osp -= 2;
+    BRANCH_IF(get_integer_value(stack[osp]) < get_integer_value(stack[osp + 1]));
+
+op_if_icmpge:
+    osp -= 2;
+    BRANCH_IF(get_integer_value(stack[osp]) >= get_integer_value(stack[osp + 1]));
+
+op_if_icmpgt:
+    osp -= 2;
+    BRANCH_IF(get_integer_value(stack[osp]) > get_integer_value(stack[osp + 1]));
+
+op_if_icmple:
+    osp -= 2;
+    BRANCH_IF(get_integer_value(stack[osp]) <= get_integer_value(stack[osp + 1]));
+
+op_tableswitch:
+    --osp;
+    // the table is all gotos, an index in range goes straight to the target of its goto
+    pc = ((unsigned int)get_integer_value(stack[osp]) < (unsigned int)pc->arg ?
+          code + pc[1 + get_integer_value(stack[osp])].arg :
+          pc + 1 + pc->arg);
+    DISPATCH();
+
+op_loop:
+    instance->ip = (unsigned int)pc->arg;
+    instance->sp = sp;
+    instance->lap = lap;
+    instance->osp = osp;
+    res = jit_enter_loop(instance);
+    if (0 != res || VM_RUNNING != instance->state)
+    {
+        return res;
+    }
+    LOAD_STATE();
+    DISPATCH();
+
+#undef BRANCH_IF
+
+op_sload:
+    if (!is_value_type(stack[lap + pc->arg], VM_TYPE_STRING))
+    {
+        goto op_generic;
+    }
+op_sload_unchecked:
+    stack[osp] = stack[lap + pc->arg];
+    ++osp;
+    NEXT();
+
+op_sstore:
+    if (OPERAND_STACK_SIZE() <= 0 ||
+        !is_value_type(stack[osp - 1], VM_TYPE_STRING) ||
+        !is_value_type(stack[lap + pc->arg], VM_TYPE_STRING))
+    {
+        goto op_generic;
+    }
+op_sstore_unchecked:
+    --osp;
+    stack[lap + pc->arg] = stack[osp];
+    NEXT();
+
+op_sprint:
+    if (OPERAND_STACK_SIZE() <= 0 || !is_value_type(stack[osp - 1], VM_TYPE_STRING))
+    {
+        goto op_generic;
+    }
+op_sprint_unchecked:
+    --osp;
+    output_string(instance, get_string_value(stack[osp]));
+    NEXT();
+
+op_rload:
+    if (!is_value_type(stack[lap + pc->arg], VM_TYPE_REFERENCE))
+    {
+        goto op_generic;
+    }
+op_rload_unchecked:
+    stack[osp] = stack[lap + pc->arg];
+    ++osp;
+    NEXT();
+
+op_rstore:
+    if (OPERAND_STACK_SIZE() <= 0 ||
+        !is_value_type(stack[osp - 1], VM_TYPE_REFERENCE) ||
+        !is_value_type(stack[lap + pc->arg], VM_TYPE_REFERENCE))
+    {
+        goto op_generic;
+    }
+op_rstore_unchecked:
+    --osp;
+    stack[lap + pc->arg] = stack[osp];
+    NEXT();
+
+op_rnull:
+    stack[osp] = make_empty_value(VM_TYPE_REFERENCE);
+    ++osp;
+    NEXT();
+
+op_cload:
+    if ((unsigned int)pc->arg >= instance->program->constant_pool_size)
+    {
+        goto op_generic;
+    }
+op_cload_unchecked:
+    stack[osp] = constant_pool[pc->arg];
+    ++osp;
+    NEXT();
+
+/*
+* The callee of a verified call or tailcall is resolved once, when the code
+* is translated, and the frames trust the verified argument types.
+*/
+op_call_resolved:
+    SAVE_STATE();
+    if (0 != open_stack_frame(instance, pc->method))
+    {
+        report_error(instance, "[call] failed, could not open stack frame for method: %s!\n",
+            pc->method->name);
+
+        return -1;
+    }
+
+    instance->ip = pc->method->offset;
+    if (VM_ENGINE_JIT == instance->engine)
+    {
+        // the frames only see their method as const, its jit fields are shared through atomics
+        res = jit_enter_method(instance, (vm_method_meta_t *)pc->method);
+        if (0 != res || VM_RUNNING != instance->state)
+        {
+            return res;
+        }
+    }
+    LOAD_STATE();
+    DISPATCH();
+
+op_tailcall_resolved:
+    SAVE_STATE();
+    if (0 != reuse_stack_frame(instance, pc->method))
+    {
+        report_error(instance, "[tailcall] failed, could not reuse stack frame for method: %s!\n",
+            pc->method->name);
+
+        return -1;
+    }
+
+    instance->ip = pc->method->offset;
+    LOAD_STATE();
+    DISPATCH();
+
+op_ret:
+    SAVE_STATE();
+    pop_stack_frame(instance);
+    if (VM_RUNNING != instance->state)
+    {
+        return 0;
+    }
+    LOAD_STATE();
+    DISPATCH();
+
+/*
+* Superinstructions only exist in verified programs. Their operands are the
+* args of the instructions they replaced, pc[1].arg and so on, and they
+* continue after the last of them.
+*/
+#define LOCAL(i) get_integer_value(stack[lap + pc[i].arg])
+#define SET_LOCAL(i, value) (stack[lap + pc[i].arg] = make_integer_value(value))
+#define PUSH_FUSED(result, length)                \
+    do {                                          \
+        stack[osp] = make_integer_value(result);  \
+        ++osp;                                    \
+        pc += (length) - 1;                       \
+        NEXT();                                   \
+    } while (0)
+
+op_iadd_ll:
+    PUSH_FUSED(add_integers(LOCAL(0), LOCAL(1)), 3);
+
+op_isub_ll:
+    PUSH_FUSED(subtract_integers(LOCAL(0), LOCAL(1)), 3);
+
+op_imult_ll:
+    PUSH_FUSED(multiply_integers(LOCAL(0), LOCAL(1)), 3);
+
+op_iadd_li:
+    PUSH_FUSED(add_integers(LOCAL(0), pc[1].arg), 3);
+
+op_isub_li:
+    PUSH_FUSED(subtract_integers(LOCAL(0), pc[1].arg), 3);
+
+op_imult_li:
+    PUSH_FUSED(multiply_integers(LOCAL(0), pc[1].arg), 3);
+
+op_iadd_lls:
+    SET_LOCAL(3, add_integers(LOCAL(0), LOCAL(1)));
+    pc += 3;
+    NEXT();
+
+op_isub_lls:
+    SET_LOCAL(3, subtract_integers(LOCAL(0), LOCAL(1)));
+    pc += 3;
+    NEXT();
+
+op_istore_imm:
+    SET_LOCAL(1, pc->arg);
+    pc += 1;
+    NEXT();
+
+op_iload2:
+    stack[osp] = stack[lap + pc[0].arg];
+    stack[osp + 1] = stack[lap + pc[1].arg];
+    osp += 2;
+    pc += 1;
+    NEXT();
+
+#undef LOCAL
+#undef SET_LOCAL
+#undef PUSH_FUSED
+#undef LOAD_STATE
+#undef SAVE_STATE
+#undef DISPATCH
+#undef NEXT
+#undef OPERAND_STACK_SIZE
+}
+
+void free_threaded_code(vm_program_t *program)
+{
+    assert(program);
+
+    free(program->threaded_code);
+    program->threaded_code = NULL;
+}
+
+/* STATIC FUNCTIONS */
+static int translate_instructions(vm_program_t *program,
+                                  const vm_method_meta_t *method,
+                                  const void *const *labels,
+                                  const void *generic_label,
+                                  const void *end_label)
+{
+    vm_threaded_instruction_t *code = program->threaded_code;
+    unsigned int first = 0, end = 0, opcode = 0;
+
+    assert(program && labels && generic_label && end_label);
+
+    if (NULL == code)
+    {
+        // one extra slot so running off the end of the code is caught
+        code = (vm_threaded_instruction_t *)malloc(sizeof(vm_threaded_instruction_t) *
+                                                   (program->num_instructions + 1));
+        if (NULL == code)
+        {
+            return -1;
+        }
+
+        code[program->num_instructions].handler = end_label;
+        code[program->num_instructions].arg = 0;
+
+        program->threaded_code = code;
+    }
+
+    first = (NULL == method ? 0 : method->offset);
+    end = (NULL == method ? program->num_instructions : method->offset + method->code_length);
+
+    for (unsigned int i = first; i < end; ++i)
+    {
+        opcode = (unsigned int)program->instructions[i].opcode;
+
+        // unknown opcodes are no-ops, like opcode_unknown
+        code[i].handler = (opcode < NUM_OPCODES ? labels[opcode] : labels[OP_NOOP]);
+        code[i].arg = program->instructions[i].arg;
+
+        if ((OP_CALL == opcode || OP_TAILCALL == opcode) && program->verified)
+        {
+            resolve_call(program, &code[i], generic_label);
+        }
+    }
+
+    return 0;
+}
+
+/*
+* Only reachable code is verified, and a call after the last return can name
+* anything, so such a call is left to the handler and its checks.
+*/
+static void resolve_call(const vm_program_t *program,
+                         vm_threaded_instruction_t *instruction,
+                         const void *generic_label)
+{
+    int index = instruction->arg;
+
+    if (index < 0 || (unsigned int)index >= program->constant_pool_size ||
+        !is_value_type(program->constant_pool[index], VM_TYPE_METHOD))
+    {
+        instruction->handler = generic_label;
+        return;
+    }
+
+    instruction->method = get_method_value(program->constant_pool[index]);
+}
+
+#else
+
+/* no labels as values, the threaded engine runs through the handlers table */
+int run_threaded_code(vm_t *instance)
+{
+    const vm_instruction_t *instruction = NULL;
+    int res = 0;
+
+    assert(instance);
+
+    while (VM_RUNNING == instance->state && 0 == res)
+    {
+        instruction = read_next_instruction(instance);
+        res = instance->opcode_handlers[instruction->opcode](instance);
+    }
+
+    return res;
+}
+
+int translate_threaded_code(vm_program_t *program)
+{
+    assert(program);
+
+    program->threaded_code = NULL;
+
+    return 0;
+}
+
+int translate_threaded_method(vm_program_t *program, const vm_method_meta_t *method)
+{
+    assert(program && method);
+
+    return 0;
+}
+
+void free_threaded_code(vm_program_t *program)
+{
+    assert(program);
+
+    program->threaded_code = NULL;
+}
+
+#endif // HAS_COMPUTED_GOTO
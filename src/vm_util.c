@@ -1,60 +1,40 @@
 #include <assert.h>    /* assert    */
+#include <stdarg.h>    /* va_list   */
 #include <stdio.h>     /* printf    */
 #include <sys/mman.h>  /* mmap      */
 #include <sys/stat.h>  /* fstat     */
 #include <fcntl.h>     /* O_RDONLY  */
 #include <stdlib.h>    /* free      */
-#include <string.h>    /* strlen    */
+#include <string.h>    /* memchr    */
+#include <time.h>      /* clock_gettime */
+#include <unistd.h>    /* close     */
 
 #include "vm_util.h"
+#include "vm_loader.h" /* prepare_method */
+#include "vm_dense.h"  /* prepare_dense_code */
+#include "vm_output.h" /* flush_output */
+
+static int check_argument_types(vm_t *instance, const vm_method_meta_t *method_meta, unsigned int args);
 
 #define FILE_PERM O_RDONLY
 #define MAP_PERM PROT_READ
 
-int validate_magic_number(vm_t *instance)
+int validate_magic_number(vm_program_t *program)
 {
-    assert(instance && instance->code);
+    assert(program && program->code);
 
-    return (instance->magic_num != read_int_value(instance));
+    return (program->magic_num != read_int_value(program));
 }
 
-int check_main_method(vm_t *instance, 
+int check_main_method(vm_program_t *program, 
                       const char *main_method_name, 
                       vm_method_meta_t *method_meta)
 {
-    unsigned int old_sp = 0;
-    int num_locals = 0, num_params = 0;
-    vm_stack_frame_t *new_stack_frame = NULL;
-
-    assert(instance && main_method_name && method_meta);
+    assert(program && main_method_name && method_meta);
 
     if (0 == strcmp(main_method_name, method_meta->name))
     {
-        old_sp = instance->sp;
-        instance->sp = instance->osp + method_meta->num_locals;
-        instance->stack[instance->sp].type = VM_TYPE_INTEGER;
-        instance->stack[instance->sp].value.integer_value = old_sp;
-
-        instance->lap = instance->osp - method_meta->num_params;
-        instance->osp = instance->sp + 1;
-
-        new_stack_frame = (vm_stack_frame_t *)malloc(sizeof(vm_stack_frame_t));
-        if (NULL == new_stack_frame)
-        {
-            return -1;
-        }
-        new_stack_frame->method_meta = method_meta;
-        new_stack_frame->prev = instance->stack_trace;
-        instance->stack_trace = new_stack_frame;
-
-        num_locals = method_meta->num_locals;
-        num_params = method_meta->num_params;
-
-        // allocate local variables
-        for (int i = 0; i < num_locals; ++i)
-        {
-            instance->stack[instance->lap + i + num_params].type = method_meta->local_types[i];
-        }
+        program->main_method = method_meta;
     }
 
     return 0;
@@ -64,39 +44,39 @@ void print_vm_value(vm_value_t *vm_value)
 {
     assert(vm_value);
 
-    switch (vm_value->type)
+    switch (get_value_type(*vm_value))
     {
         case VM_TYPE_BYTE:
-            printf("{ type: byte, value: %d}\n", vm_value->value.byte_value);
+            printf("{ type: byte, value: %d}\n", get_byte_value(*vm_value));
             break;
 
         case VM_TYPE_INTEGER:
-            printf("{ type: int, value: %d}\n", vm_value->value.integer_value);
+            printf("{ type: int, value: %d}\n", get_integer_value(*vm_value));
             break;
 
         case VM_TYPE_FLOAT:
-            printf("{ type: float, value: %f}\n", vm_value->value.float_value);
+            printf("{ type: float, value: %f}\n", get_float_value(*vm_value));
             break;
         
         case VM_TYPE_LONG:
-            printf("{ type: long, value: %ld}\n", vm_value->value.long_value);
+            printf("{ type: long, value: %ld}\n", get_long_value(*vm_value));
             break;
 
         case VM_TYPE_DOUBLE:
-            printf("{ type: double, value: %lf}\n", vm_value->value.double_value);
+            printf("{ type: double, value: %lf}\n", get_double_value(*vm_value));
             break;
 
         case VM_TYPE_STRING:
-            printf("{ type: string, value: \"%s\"}\n", vm_value->value.string_value);
+            printf("{ type: string, value: \"%s\"}\n", get_string_value(*vm_value));
             break;
 
         case VM_TYPE_REFERENCE:
-            printf("{ type: ref, value: %p}\n", vm_value->value.reference_value);
+            printf("{ type: ref, value: %p}\n", get_reference_value(*vm_value));
             break;
         
         case VM_TYPE_METHOD:
             printf("{ type: method, value: \"%s\", offset: %u}\n", 
-                vm_value->value.method_value->name, vm_value->value.method_value->offset);
+                get_method_value(*vm_value)->name, get_method_value(*vm_value)->offset);
             break;
     
         default:
@@ -133,47 +113,68 @@ void print_error(vm_t *instance, const char *message)
 {
     assert(instance && instance->err);
 
-    fprintf(instance->err, "[-] %s\n", message);
+    flush_output(instance);
+    report_error(instance, "[-] %s\n", message);
+}
+
+void report_error(vm_t *instance, const char *format, ...)
+{
+    va_list args;
+
+    assert(instance && instance->err && format);
+
+    flush_output(instance);
+
+    va_start(args, format);
+    vfprintf(instance->err, format, args);
+    va_end(args);
+}
+
+void print_load_error(vm_program_t *program, const char *message)
+{
+    assert(program && program->err);
+
+    fprintf(program->err, "[-] %s\n", message);
 }
 
 void print_output(vm_t *instance, const char *message)
 {
-    assert(instance && instance->output);
+    assert(instance && instance->output && message);
 
-    fprintf(instance->output, "%s", message);
+    write_output(instance, message, strlen(message));
 }
 
-int read_byte_value(vm_t *instance)
+int read_byte_value(vm_program_t *program)
 {
     char *reader = NULL;
 
-    assert(instance && instance->code);
+    assert(program && program->code);
 
-    reader = &instance->code[instance->ip];
-    ++instance->ip;
+    reader = &program->code[program->read_offset];
+    ++program->read_offset;
 
     return *reader;
 }
 
-int read_int_value(vm_t *instance)
+int read_int_value(vm_program_t *program)
 {
     int *reader = NULL;
     
-    assert(instance);
+    assert(program);
 
-    reader = (int *)&instance->code[instance->ip];
-    instance->ip += sizeof(int);
+    reader = (int *)&program->code[program->read_offset];
+    program->read_offset += sizeof(int);
 
     return *reader;
 }
 
-vm_instruction_t *read_next_instruction(vm_t *instance)
+const vm_instruction_t *read_next_instruction(vm_t *instance)
 {
-    vm_instruction_t *instruction = NULL;
+    const vm_instruction_t *instruction = NULL;
 
-    assert(instance && instance->code);
+    assert(instance && instance->program);
 
-    instruction = &instance->instructions[instance->ip];
+    instruction = &instance->program->instructions[instance->ip];
     ++instance->ip;
 
     return instruction;
@@ -181,30 +182,35 @@ vm_instruction_t *read_next_instruction(vm_t *instance)
 
 int get_instruction_arg(vm_t *instance)
 {
-    assert(instance && instance->instructions);
+    assert(instance && instance->program);
 
-    return instance->instructions[instance->ip - 1].arg;
+    return instance->program->instructions[instance->ip - 1].arg;
 }
 
-char *read_string_value(vm_t *instance)
+char *read_string_value(vm_program_t *program)
 {
-    int str_len = 0;
-    char *str = NULL;
     char *reader = NULL;
+    char *end = NULL;
 
-    assert(instance);
+    assert(program && program->code);
+
+    if (program->read_offset >= program->code_size)
+    {
+        return NULL;
+    }
 
-    reader = &instance->code[instance->ip];
-    str_len = strlen(reader);
-    str = (char *)malloc(sizeof(char) * (str_len + 1));
-    if (NULL == str)
+    // strings are used in place, the mapping lives as long as the program
+    reader = &program->code[program->read_offset];
+    end = (char *)memchr(reader, '\0', program->code_size - program->read_offset);
+    if (NULL == end)
     {
+        print_load_error(program, "string constant is not terminated!");
+
         return NULL;
     }
-    strcpy(str, reader);
-    instance->ip += (str_len + 1);
+    program->read_offset += (end - reader) + 1;
 
-    return str;
+    return reader;
 }
 
 int get_operand_stack_size(vm_t *instance)
@@ -225,110 +231,225 @@ vm_value_t *get_constant_var(vm_t *instance, int index)
 {
     assert(instance);
 
-    return &instance->constant_pool[index];
+    return &instance->program->constant_pool[index];
 }
 
-int open_stack_frame(vm_t *instance, vm_method_meta_t *method_meta)
+int open_main_frame(vm_t *instance)
 {
-    unsigned int old_sp = 0;
+    const vm_method_meta_t *main_method = NULL;
     int num_locals = 0, num_params = 0;
-    vm_stack_frame_t *new_stack_frame = NULL;
 
-    assert(instance && method_meta);
+    assert(instance && instance->program && instance->program->main_method);
 
-    old_sp = instance->sp;
+    main_method = instance->program->main_method;
 
-    instance->sp = instance->osp + method_meta->num_locals;
-    instance->stack[instance->sp].type = VM_TYPE_INTEGER;
-    instance->stack[instance->sp].value.integer_value = old_sp;
+    if (VM_ENGINE_REGISTER == instance->engine)
+    {
+        prepare_register_code((vm_program_t *)instance->program);
+    }
+    if (VM_ENGINE_DENSE == instance->engine)
+    {
+        prepare_dense_code((vm_program_t *)instance->program);
+    }
 
-    instance->lap = instance->osp - method_meta->num_params;
+    instance->stack_trace = NULL;
+    instance->ip = main_method->offset;
+    if (VM_ENGINE_REGISTER == instance->engine && NULL != instance->program->register_code)
+    {
+        instance->ip = main_method->register_offset;
+    }
+    if (VM_ENGINE_DENSE == instance->engine && NULL != instance->program->dense_code)
+    {
+        instance->ip = main_method->dense_offset;
+    }
+    instance->sp = 0;
+    instance->lap = 0;
+    instance->osp = 0;
+
+    if (0 != push_stack_frame(instance, main_method))
+    {
+        return -1;
+    }
+
+    instance->sp = instance->osp + main_method->num_locals;
+    instance->lap = instance->osp - main_method->num_params;
     instance->osp = instance->sp + 1;
 
-    new_stack_frame = (vm_stack_frame_t *)malloc(sizeof(vm_stack_frame_t));
-    if (NULL == new_stack_frame)
+    num_locals = main_method->num_locals;
+    num_params = main_method->num_params;
+
+    // allocate local variables
+    memcpy(&instance->stack[instance->lap + num_params], main_method->local_template,
+        sizeof(vm_value_t) * num_locals);
+
+    return 0;
+}
+
+int push_stack_frame(vm_t *instance, const vm_method_meta_t *method_meta)
+{
+    vm_stack_frame_t *frame = NULL;
+
+    assert(instance && instance->frames && method_meta);
+
+    if (NULL == instance->stack_trace)
+    {
+        frame = instance->frames;
+    }
+    else if (instance->stack_trace + 1 < instance->frames + instance->max_frames)
+    {
+        frame = instance->stack_trace + 1;
+    }
+    else
+    {
+        print_error(instance, "call stack overflow");
+
+        return -1;
+    }
+
+    // the arguments belong to the callee, the caller gets them popped on return
+    frame->method_meta = method_meta;
+    frame->return_ip = instance->ip;
+    frame->saved_sp = instance->sp;
+    frame->saved_lap = instance->lap;
+    frame->saved_osp = instance->osp - method_meta->num_params;
+
+    instance->stack_trace = frame;
+
+    return 0;
+}
+
+int open_stack_frame(vm_t *instance, const vm_method_meta_t *method_meta)
+{
+    int num_locals = 0, num_params = 0;
+
+    assert(instance && method_meta);
+
+    // methods of a v2 file are verified and translated on their first call
+    if (!is_method_prepared(method_meta) &&
+        0 != prepare_method((vm_program_t *)instance->program, (vm_method_meta_t *)method_meta))
     {
         return -1;
     }
-    new_stack_frame->method_meta = method_meta;
-    new_stack_frame->prev = instance->stack_trace;
-    instance->stack_trace = new_stack_frame;
+
+    if (0 != push_stack_frame(instance, method_meta))
+    {
+        return -1;
+    }
+
+    // stack[sp] separates the locals from the operand stack
+    instance->lap = instance->osp - method_meta->num_params;
+    instance->osp += method_meta->frame_size;
+    instance->sp = instance->osp - 1;
 
     num_locals = method_meta->num_locals;
     num_params = method_meta->num_params;
 
-    // validate argument types
-    for (int i = 0; i < num_params; ++i)
+    // the verifier proved the argument types of every call in a verified program
+    if (!instance->program->verified && 0 != check_argument_types(instance, method_meta, instance->lap))
     {
-        if (instance->stack[instance->lap + i].type != method_meta->param_types[i])
-        {
-            fprintf(instance->err, "wrong argument types for method: %s\n", method_meta->name);
-            fprintf(instance->err, "expected type: %s, got type: %s\n",
-                get_type_name(method_meta->param_types[i]),
-                get_type_name(instance->stack[instance->lap + i].type));
-
-            return -1;
-        }
+        return -1;
     }
 
     // allocate local variables
-    for (int i = 0; i < num_locals; ++i)
+    memcpy(&instance->stack[instance->lap + num_params], method_meta->local_template,
+        sizeof(vm_value_t) * num_locals);
+
+    return 0;
+}
+
+int reuse_stack_frame(vm_t *instance, const vm_method_meta_t *method_meta)
+{
+    unsigned int args = 0;
+    int num_locals = 0, num_params = 0;
+
+    assert(instance && instance->stack_trace && method_meta);
+
+    if (!is_method_prepared(method_meta) &&
+        0 != prepare_method((vm_program_t *)instance->program, (vm_method_meta_t *)method_meta))
+    {
+        return -1;
+    }
+
+    num_locals = method_meta->num_locals;
+    num_params = method_meta->num_params;
+    args = instance->osp - num_params;
+
+    if (!instance->program->verified && 0 != check_argument_types(instance, method_meta, args))
+    {
+        return -1;
+    }
+
+    // the frame returns to the same caller, only its method changes
+    instance->stack_trace->method_meta = method_meta;
+
+    // the arguments become the params, in place of the params and locals of the returning method
+    memmove(&instance->stack[instance->lap], &instance->stack[args], sizeof(vm_value_t) * num_params);
+    instance->osp = instance->lap + num_params + method_meta->frame_size;
+    instance->sp = instance->osp - 1;
+
+    memcpy(&instance->stack[instance->lap + num_params], method_meta->local_template,
+        sizeof(vm_value_t) * num_locals);
+
+    return 0;
+}
+
+int init_local_template(vm_method_meta_t *method_meta)
+{
+    assert(method_meta);
+
+    // one extra value, so a method without locals still gets a template
+    method_meta->local_template = (vm_value_t *)malloc(sizeof(vm_value_t) * (method_meta->num_locals + 1));
+    if (NULL == method_meta->local_template)
     {
-        instance->stack[instance->lap + i + num_params].type = method_meta->local_types[i];
+        return -1;
     }
 
-    // save last ip for when you return
-    instance->stack_trace->prev->method_meta->ip = instance->ip;
+    for (int i = 0; i < method_meta->num_locals; ++i)
+    {
+        method_meta->local_template[i] = make_empty_value(method_meta->local_types[i]);
+    }
+    method_meta->frame_size = method_meta->num_locals + 1;
 
     return 0;
 }
 
 void pop_stack_frame(vm_t *instance)
 {
-    vm_stack_frame_t *prev_frame = NULL;
-    int prev_osp = 0, prev_lap = 0, prev_sp = 0;
-    int prev_num_locals = 0, prev_num_params = 0;
+    vm_stack_frame_t *frame = NULL;
 
-    assert(instance);
+    assert(instance && instance->stack_trace);
 
-    prev_frame = instance->stack_trace->prev;
-    if (NULL == prev_frame)
+    frame = instance->stack_trace;
+    if (instance->frames == frame)
     {
         instance->state = VM_FINISHED; // returned from main
 
         return;
     }
 
-    prev_osp = instance->lap;
-    prev_sp = instance->stack[instance->sp].value.integer_value;
-    prev_num_locals = prev_frame->method_meta->num_locals;
-    prev_num_params = prev_frame->method_meta->num_params;
-    prev_lap = prev_osp - prev_num_locals + prev_num_params;
+    instance->osp = frame->saved_osp;
+    instance->lap = frame->saved_lap;
+    instance->sp = frame->saved_sp;
+    instance->ip = frame->return_ip;
 
-    instance->osp = prev_osp;
-    instance->lap = prev_lap;
-    instance->sp = prev_sp;
-    instance->ip = prev_frame->method_meta->ip;
-
-    prev_frame = instance->stack_trace->prev;
-    free(instance->stack_trace);
-    instance->stack_trace = prev_frame;
+    instance->stack_trace = frame - 1;
 }
 
-int load_bytecode_from_file(const char *file_path, vm_t *instance)
+int load_bytecode_from_file(const char *file_path, vm_program_t *program)
 {
     int res = 0, fd = 0;
     size_t file_size = 0;
     struct stat file_stat = {0};
+    char *code = NULL;
 
     assert(NULL != file_path);
-    assert(NULL != instance);
+    assert(NULL != program);
 
     fd = open(file_path, FILE_PERM);
     if (-1 == fd)
     {
-        print_error(instance, "error: could not open file:");
-        print_error(instance, file_path);
+        print_load_error(program, "error: could not open file:");
+        print_load_error(program, file_path);
 
         return -1;
     }
@@ -336,100 +457,123 @@ int load_bytecode_from_file(const char *file_path, vm_t *instance)
     res = fstat(fd, &file_stat);
     if (0 != res)
     {
-        print_error(instance, "error: could not read file:");
-        print_error(instance, file_path);
+        print_load_error(program, "error: could not read file:");
+        print_load_error(program, file_path);
+        close(fd);
 
         return -1;
     }
 
     file_size = file_stat.st_size;
 
-    instance->code = (char *)mmap(NULL, file_size, MAP_PERM, MAP_PRIVATE, fd, 0);
-    if (MAP_FAILED == instance->code)
+    code = (char *)mmap(NULL, file_size, MAP_PERM, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file referenced
+    if (MAP_FAILED == code)
     {
-        print_error(instance, "error: could not map file:");
-        print_error(instance, file_path);
+        print_load_error(program, "error: could not map file:");
+        print_load_error(program, file_path);
 
         return -1;
     }
-    instance->code_size = file_size;
+    program->code = code;
+    program->code_size = file_size;
 
     return 0;
 }
 
-void free_heap(vm_t *instance) 
+double get_monotonic_time(void)
 {
-    assert(instance);
+    struct timespec now;
 
-    free(instance->heap);
-    instance->heap = NULL;
-}
+    clock_gettime(CLOCK_MONOTONIC, &now);
 
-void free_stack(vm_t *instance) 
-{
-    assert(instance);
-
-    free(instance->stack);
-    instance->stack = NULL;
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
 void free_stack_frames(vm_t *instance)
 {
-    vm_stack_frame_t *prev = NULL;
     assert(instance);
 
-    while (NULL != instance->stack_trace)
-    {
-        prev = instance->stack_trace->prev;
-        free(instance->stack_trace);
-        instance->stack_trace = prev;
-    }
+    free(instance->frames);
+    instance->frames = NULL;
+    instance->stack_trace = NULL;
 }
 
-void free_constant_pool(vm_t *instance) 
+void free_constant_pool(vm_program_t *program) 
 {
     vm_value_t cur_value = {0};
+    vm_method_meta_t *cur_method = NULL;
 
-    assert(instance);
+    assert(program);
 
-    for (int i = 0; i < instance->constant_pool_size; ++i)
+    // the methods of a v2 file live in the method table
+    for (int i = 0; NULL != program->constant_pool && NULL == program->method_table &&
+                    i < program->constant_pool_size; ++i)
     {
-        cur_value = instance->constant_pool[i];
-        if (VM_TYPE_STRING == cur_value.type) // TODO: add reference type support 
-        {
-            free(cur_value.value.string_value);
-            cur_value.value.string_value = NULL;
-        }
-        else if (VM_TYPE_METHOD == cur_value.type)
+        cur_value = program->constant_pool[i];
+        // strings and method names point into the mapped code and are not freed
+        if (is_value_type(cur_value, VM_TYPE_METHOD) && NULL != get_method_value(cur_value))
         {
-            free(cur_value.value.method_value->name);
-            cur_value.value.method_value->name = NULL;
-            free(cur_value.value.method_value->local_types);
-            cur_value.value.method_value->local_types = NULL;
-            free(cur_value.value.method_value->param_types);
-            cur_value.value.method_value->param_types = NULL;
-            free(cur_value.value.method_value);
-            cur_value.value.method_value = NULL;
+            cur_method = get_method_value(cur_value);
+            cur_method->name = NULL;
+            free(cur_method->local_types);
+            cur_method->local_types = NULL;
+            free(cur_method->param_types);
+            cur_method->param_types = NULL;
+            free(cur_method->local_template);
+            cur_method->local_template = NULL;
+            free(cur_method);
         }
     }
 
-    free(instance->constant_pool);
-    instance->constant_pool = NULL;
+    for (unsigned int i = 0; NULL != program->method_table && i < program->num_methods; ++i)
+    {
+        free(program->method_table[i].local_template);
+        program->method_table[i].local_template = NULL;
+    }
+
+    free(program->constant_pool);
+    program->constant_pool = NULL;
+    free(program->method_table);
+    program->method_table = NULL;
+    free(program->method_types);
+    program->method_types = NULL;
 }
 
-void free_code(vm_t *instance) 
+void free_code(vm_program_t *program) 
 {
     int res = 0;
-    assert(instance);
+    assert(program);
 
-    if (NULL != instance->code) 
+    if (NULL != program->code) 
     {
-        res = munmap(instance->code, instance->code_size);
+        res = munmap(program->code, program->code_size);
         if (0 != res)
         {
-            print_error(instance, "error: could not unmap file");
+            print_load_error(program, "error: could not unmap file");
+        }
+    }
+    program->instructions = NULL;
+    program->code = NULL;
+}
+
+
+/* STATIC FUNCTIONS */
+/* the arguments of a call to method_meta start at stack[args] */
+static int check_argument_types(vm_t *instance, const vm_method_meta_t *method_meta, unsigned int args)
+{
+    for (int i = 0; i < method_meta->num_params; ++i)
+    {
+        if (!is_value_type(instance->stack[args + i], method_meta->param_types[i]))
+        {
+            report_error(instance, "wrong argument types for method: %s\n", method_meta->name);
+            report_error(instance, "expected type: %s, got type: %s\n",
+                get_type_name(method_meta->param_types[i]),
+                get_type_name(get_value_type(instance->stack[args + i])));
+
+            return -1;
         }
     }
-    instance->instructions = NULL;
-    instance->code = NULL;
-}
\ No newline at end of file
+
+    return 0;
+}
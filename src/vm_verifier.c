@@ -0,0 +1,1223 @@
+#include <assert.h>    /* assert    */
+#include <stdarg.h>    /* va_list   */
+#include <stdio.h>     /* fprintf   */
+#include <stdlib.h>    /* malloc    */
+#include <string.h>    /* memcpy    */
+
+#include "opcodes.h"     /* opcodes           */
+#include "vm_impl.h"     /* private vm header */
+#include "vm_util.h"     /* utility functions */
+#include "vm_loader.h"   /* method_state      */
+#include "vm_verifier.h" /* verifier          */
+#include "vm_heap.h"     /* MAX_OBJECT_FIELDS, array elements */
+
+#define RESULT_VOID 0    // result type of a method that returns with ret
+#define RESULT_UNKNOWN -1 // no return was found yet
+
+typedef struct verifier
+{
+    vm_program_t *program;
+    vm_method_meta_t *method; // the method being verified
+    const vm_instruction_t *instructions; // the instructions as they are in the file
+
+    unsigned int first; // the arrays below cover the instructions from first on
+    unsigned int count;
+
+    int *depths;            // operand stack depth at each instruction, -1 if not reached
+    unsigned char **types;  // operand stack types at each instruction
+    unsigned int *reached;  // instructions reached in the current method
+    unsigned int num_reached;
+
+    unsigned int *worklist;
+    unsigned int worklist_size;
+    unsigned int *successors; // room for the successors of any instruction, a tableswitch has many
+
+    unsigned char *stack; // the abstract operand stack of the current instruction
+    int depth;
+    int max_depth;
+} verifier_t;
+
+static int init_verifier(verifier_t *verifier, vm_program_t *program, unsigned int first, unsigned int count);
+static void destroy_verifier(verifier_t *verifier);
+static int type_method(vm_program_t *program, vm_method_meta_t *method);
+static int find_result_type(verifier_t *verifier, vm_method_meta_t *method);
+static int verify_method(verifier_t *verifier, vm_method_meta_t *method);
+static int is_in_window(verifier_t *verifier, unsigned int ip);
+static int verify_instruction(verifier_t *verifier, unsigned int ip);
+static int get_successors(verifier_t *verifier, unsigned int ip, unsigned int *successors);
+static int check_branch_target(verifier_t *verifier, unsigned int ip, int target);
+static int record_stack_depths(verifier_t *verifier, vm_method_meta_t *method);
+static int init_stack_depths(vm_program_t *program);
+static int merge_state(verifier_t *verifier, unsigned int from, unsigned int to);
+static int push_type(verifier_t *verifier, unsigned int ip, int type);
+static int pop_type(verifier_t *verifier, unsigned int ip, int type);
+static int get_local_type(verifier_t *verifier, unsigned int ip, int index);
+static vm_method_meta_t *get_method_constant(verifier_t *verifier, unsigned int ip, int index);
+static int get_field_type(enum opcodes opcode);
+static int get_numeric_type(enum opcodes opcode);
+static int get_return_type(enum opcodes opcode);
+static void get_conversion_types(enum opcodes opcode, int *from, int *to);
+static void verify_error(verifier_t *verifier, unsigned int ip, const char *format, ...);
+
+int verify_program(vm_program_t *program)
+{
+    verifier_t verifier = {0};
+    int res = 0;
+
+    assert(program && program->constant_pool && program->file_instructions);
+
+    if (0 != init_stack_depths(program) ||
+        0 != init_verifier(&verifier, program, 0, program->num_instructions))
+    {
+        print_load_error(program, "[verifier] out of memory");
+        destroy_verifier(&verifier);
+
+        return -1;
+    }
+
+    // callers need the result type of their callees, so find them all first
+    for (unsigned int i = 0; i < program->constant_pool_size && 0 == res; ++i)
+    {
+        if (is_value_type(program->constant_pool[i], VM_TYPE_METHOD))
+        {
+            res = find_result_type(&verifier, get_method_value(program->constant_pool[i]));
+        }
+    }
+
+    for (unsigned int i = 0; i < program->constant_pool_size && 0 == res; ++i)
+    {
+        if (is_value_type(program->constant_pool[i], VM_TYPE_METHOD))
+        {
+            res = verify_method(&verifier, get_method_value(program->constant_pool[i]));
+        }
+    }
+
+    if (0 == res && 0 != program->main_method->num_params)
+    {
+        fprintf(program->err, "[verifier] main method can not take parameters\n");
+        res = -1;
+    }
+
+    destroy_verifier(&verifier);
+
+    program->verified = (0 == res);
+
+    return res;
+}
+
+int verify_lazy_method(vm_program_t *program, vm_method_meta_t *method)
+{
+    verifier_t verifier = {0};
+    const vm_instruction_t *instruction = NULL;
+    vm_value_t *constant = NULL;
+    int res = 0;
+
+    assert(program && method && program->file_instructions);
+
+    // calls push what the callee returns, so the callees are typed first
+    for (unsigned int ip = method->offset; ip < method->offset + method->code_length && 0 == res; ++ip)
+    {
+        instruction = &program->file_instructions[ip];
+        if ((OP_CALL != instruction->opcode && OP_TAILCALL != instruction->opcode) ||
+            instruction->arg < 0 || (unsigned int)instruction->arg >= program->constant_pool_size)
+        {
+            continue;
+        }
+
+        // bad constants are reported by verify_method
+        constant = &program->constant_pool[instruction->arg];
+        if (is_value_type(*constant, VM_TYPE_METHOD))
+        {
+            res = type_method(program, get_method_value(*constant));
+        }
+    }
+
+    if (0 == res)
+    {
+        res = type_method(program, method);
+    }
+
+    if (0 != res)
+    {
+        return -1;
+    }
+
+    if (0 != init_stack_depths(program) ||
+        0 != init_verifier(&verifier, program, method->offset, method->code_length))
+    {
+        print_load_error(program, "[verifier] out of memory");
+        destroy_verifier(&verifier);
+
+        return -1;
+    }
+
+    res = verify_method(&verifier, method);
+
+    destroy_verifier(&verifier);
+
+    return res;
+}
+
+void free_stack_depths(vm_program_t *program)
+{
+    assert(program);
+
+    free(program->stack_depths);
+    program->stack_depths = NULL;
+}
+
+/* STATIC FUNCTIONS */
+static int init_verifier(verifier_t *verifier, vm_program_t *program, unsigned int first, unsigned int count)
+{
+    assert(verifier && program);
+
+    verifier->program = program;
+    verifier->instructions = program->file_instructions;
+    verifier->first = first;
+    verifier->count = count;
+    verifier->max_depth = MAX_OPERAND_DEPTH;
+
+    verifier->depths = (int *)malloc(sizeof(int) * (count + 1));
+    verifier->types = (unsigned char **)calloc(count + 1, sizeof(unsigned char *));
+    verifier->reached = (unsigned int *)malloc(sizeof(unsigned int) * (count + 1));
+    verifier->worklist = (unsigned int *)malloc(sizeof(unsigned int) * (count + 1));
+    verifier->successors = (unsigned int *)malloc(sizeof(unsigned int) * (count + 1));
+    verifier->stack = (unsigned char *)malloc(sizeof(unsigned char) * (verifier->max_depth + 1));
+
+    if (NULL == verifier->depths || NULL == verifier->types ||
+        NULL == verifier->reached || NULL == verifier->worklist ||
+        NULL == verifier->successors || NULL == verifier->stack)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        verifier->depths[i] = -1;
+    }
+
+    return 0;
+}
+
+static void destroy_verifier(verifier_t *verifier)
+{
+    assert(verifier);
+
+    if (NULL != verifier->types)
+    {
+        for (unsigned int i = 0; i < verifier->count; ++i)
+        {
+            free(verifier->types[i]);
+        }
+    }
+
+    free(verifier->depths);
+    free(verifier->types);
+    free(verifier->reached);
+    free(verifier->worklist);
+    free(verifier->successors);
+    free(verifier->stack);
+}
+
+/* finds the result type of a method of a v2 file, over its own code range */
+static int type_method(vm_program_t *program, vm_method_meta_t *method)
+{
+    verifier_t verifier = {0};
+    int res = 0;
+
+    if (METHOD_UNPREPARED != method->prepare_state)
+    {
+        return 0;
+    }
+
+    if (0 != init_verifier(&verifier, program, method->offset, method->code_length))
+    {
+        print_load_error(program, "[verifier] out of memory");
+        destroy_verifier(&verifier);
+
+        return -1;
+    }
+
+    res = find_result_type(&verifier, method);
+    if (0 == res)
+    {
+        __atomic_store_n(&method->prepare_state, METHOD_TYPED, __ATOMIC_RELAXED);
+    }
+
+    destroy_verifier(&verifier);
+
+    return res;
+}
+
+/*
+* Walks every instruction reachable from the method entry and collects the
+* return instructions. All of them have to agree on what the method returns.
+*/
+static int find_result_type(verifier_t *verifier, vm_method_meta_t *method)
+{
+    unsigned int *successors = verifier->successors;
+    unsigned int ip = 0;
+    int num_successors = 0;
+    int result_type = RESULT_UNKNOWN, cur_type = 0;
+
+    verifier->method = method;
+    verifier->worklist_size = 0;
+    verifier->num_reached = 0;
+
+    if (!is_in_window(verifier, method->offset))
+    {
+        verify_error(verifier, method->offset, "method entry is out of code bounds");
+
+        return -1;
+    }
+
+    verifier->worklist[verifier->worklist_size++] = method->offset;
+    verifier->depths[method->offset - verifier->first] = 0;
+    verifier->reached[verifier->num_reached++] = method->offset - verifier->first;
+
+    while (0 < verifier->worklist_size)
+    {
+        ip = verifier->worklist[--verifier->worklist_size];
+
+        cur_type = get_return_type(verifier->instructions[ip].opcode);
+        if (RESULT_UNKNOWN != cur_type)
+        {
+            if (RESULT_UNKNOWN != result_type && cur_type != result_type)
+            {
+                verify_error(verifier, ip, "method returns both %s and %s",
+                    (RESULT_VOID == result_type ? "void" : get_type_name(result_type)),
+                    (RESULT_VOID == cur_type ? "void" : get_type_name(cur_type)));
+
+                return -1;
+            }
+            result_type = cur_type;
+        }
+
+        num_successors = get_successors(verifier, ip, successors);
+        if (0 > num_successors)
+        {
+            return -1;
+        }
+
+        for (int i = 0; i < num_successors; ++i)
+        {
+            if (!is_in_window(verifier, successors[i]))
+            {
+                verify_error(verifier, ip, "execution falls off the end of the code");
+
+                return -1;
+            }
+
+            if (-1 == verifier->depths[successors[i] - verifier->first])
+            {
+                verifier->depths[successors[i] - verifier->first] = 0;
+                verifier->reached[verifier->num_reached++] = successors[i] - verifier->first;
+                verifier->worklist[verifier->worklist_size++] = successors[i];
+            }
+        }
+    }
+
+    // reset only what was touched, methods are usually much smaller than the code
+    for (unsigned int i = 0; i < verifier->num_reached; ++i)
+    {
+        verifier->depths[verifier->reached[i]] = -1;
+    }
+
+    // a method that never returns (it stops the machine) leaves nothing behind
+    method->result_type = (RESULT_UNKNOWN == result_type ? RESULT_VOID : result_type);
+
+    return 0;
+}
+
+/*
+* Abstract interpretation of a single method: every reachable instruction is
+* visited with the types of the operand stack at that point, and every path
+* into an instruction has to arrive with the same stack.
+*/
+static int verify_method(verifier_t *verifier, vm_method_meta_t *method)
+{
+    unsigned int *successors = verifier->successors;
+    unsigned int ip = 0;
+    int num_successors = 0, res = 0;
+
+    verifier->method = method;
+    verifier->worklist_size = 0;
+    verifier->num_reached = 0;
+
+    verifier->depth = 0;
+    res = merge_state(verifier, method->offset, method->offset);
+
+    while (0 == res && 0 < verifier->worklist_size)
+    {
+        ip = verifier->worklist[--verifier->worklist_size];
+
+        verifier->depth = verifier->depths[ip - verifier->first];
+        memcpy(verifier->stack, verifier->types[ip - verifier->first], verifier->depth);
+
+        res = verify_instruction(verifier, ip);
+
+        num_successors = (0 == res ? get_successors(verifier, ip, successors) : 0);
+        if (0 > num_successors)
+        {
+            res = -1;
+        }
+
+        for (int i = 0; i < num_successors && 0 == res; ++i)
+        {
+            res = merge_state(verifier, ip, successors[i]);
+        }
+    }
+
+    if (0 == res)
+    {
+        res = record_stack_depths(verifier, method);
+    }
+
+    for (unsigned int i = 0; i < verifier->num_reached; ++i)
+    {
+        verifier->depths[verifier->reached[i]] = -1;
+        free(verifier->types[verifier->reached[i]]);
+        verifier->types[verifier->reached[i]] = NULL;
+    }
+
+    return res;
+}
+
+static int verify_instruction(verifier_t *verifier, unsigned int ip)
+{
+    const vm_instruction_t *instruction = &verifier->instructions[ip];
+    vm_method_meta_t *callee = NULL;
+    int index = 0, type = 0, value_type = 0;
+
+    switch (instruction->opcode)
+    {
+        /* special operations */
+        case OP_NOOP:
+        case OP_HALT:
+        case OP_STOP:
+        case OP_RET:
+        case OP_FLUSH:
+            return 0;
+
+        case OP_POP:
+            return pop_type(verifier, ip, 0);
+
+        case OP_CALL:
+        case OP_TAILCALL:
+            callee = get_method_constant(verifier, ip, instruction->arg);
+            if (NULL == callee)
+            {
+                return -1;
+            }
+
+            for (int i = callee->num_params - 1; i >= 0; --i)
+            {
+                if (0 != pop_type(verifier, ip, callee->param_types[i]))
+                {
+                    return -1;
+                }
+            }
+
+            type = callee->result_type;
+
+            // the callee returns for the method, which has to return the same
+            if (OP_TAILCALL == instruction->opcode &&
+                (!is_in_window(verifier, ip + 1) || type != get_return_type(verifier->instructions[ip + 1].opcode)))
+            {
+                verify_error(verifier, ip, "tailcall to method: %s is not followed by a return of %s",
+                    callee->name, (RESULT_VOID == type ? "void" : get_type_name(type)));
+
+                return -1;
+            }
+
+            return (RESULT_VOID == type ? 0 : push_type(verifier, ip, type));
+
+        /* integer operations */
+        case OP_ILOAD:
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (VM_TYPE_INTEGER != type)
+            {
+                verify_error(verifier, ip, "iload of local %d of type: %s",
+                    instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_ISTORE:
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (VM_TYPE_INTEGER != type)
+            {
+                verify_error(verifier, ip, "istore to local %d of type: %s",
+                    instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_IPUSH:
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_IADD:
+        case OP_ISUB:
+        case OP_IMULT:
+        case OP_IDIV:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER) ||
+                0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_INEG:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_IPRINT:
+            return pop_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_IRET:
+            return pop_type(verifier, ip, VM_TYPE_INTEGER);
+
+        /* control flow, the targets are checked with the successors */
+        case OP_GOTO:
+            return 0;
+
+        case OP_IFEQ:
+        case OP_IFNE:
+            return pop_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_TABLESWITCH:
+            // the engines jump straight to the target of the goto, so the table holds nothing else
+            for (int i = 1; i <= instruction->arg && is_in_window(verifier, ip + i); ++i)
+            {
+                if (OP_GOTO != verifier->instructions[ip + i].opcode)
+                {
+                    verify_error(verifier, ip, "tableswitch entry %d is not a goto", i - 1);
+
+                    return -1;
+                }
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_INTEGER);
+
+        /* string operations */
+        case OP_SLOAD:
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (VM_TYPE_STRING != type)
+            {
+                verify_error(verifier, ip, "sload of local %d of type: %s",
+                    instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_STRING);
+
+        case OP_SSTORE:
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (VM_TYPE_STRING != type)
+            {
+                verify_error(verifier, ip, "sstore to local %d of type: %s",
+                    instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_STRING);
+
+        case OP_SPRINT:
+            return pop_type(verifier, ip, VM_TYPE_STRING);
+
+        case OP_SRET:
+            return pop_type(verifier, ip, VM_TYPE_STRING);
+
+        /* reference operations */
+        case OP_RLOAD:
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (VM_TYPE_REFERENCE != type)
+            {
+                verify_error(verifier, ip, "rload of local %d of type: %s",
+                    instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_RSTORE:
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (VM_TYPE_REFERENCE != type)
+            {
+                verify_error(verifier, ip, "rstore to local %d of type: %s",
+                    instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_RNULL:
+            return push_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_RRET:
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_NEW:
+            if (instruction->arg < 0 || instruction->arg > MAX_OBJECT_FIELDS)
+            {
+                verify_error(verifier, ip, "an object can not have %d fields", instruction->arg);
+
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        // objects are not typed, the field index and the field type are checked when they run
+        case OP_IGETFIELD:
+        case OP_SGETFIELD:
+        case OP_RGETFIELD:
+            if (0 != pop_type(verifier, ip, VM_TYPE_REFERENCE))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, get_field_type(instruction->opcode));
+
+        case OP_IPUTFIELD:
+        case OP_SPUTFIELD:
+        case OP_RPUTFIELD:
+            if (0 != pop_type(verifier, ip, get_field_type(instruction->opcode)))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        /* constant pool operations */
+        case OP_CLOAD:
+            index = instruction->arg;
+            if (index < 0 || (unsigned int)index >= verifier->program->constant_pool_size)
+            {
+                verify_error(verifier, ip, "constant %d is out of constant pool bounds", index);
+
+                return -1;
+            }
+
+            return push_type(verifier, ip, get_value_type(verifier->program->constant_pool[index]));
+
+        /* array operations, the element type of an array is checked when it runs */
+        case OP_NEWARRAY:
+            if (0 == get_array_element_size((enum vm_types)instruction->arg))
+            {
+                verify_error(verifier, ip, "an array can not hold elements of type: %d", instruction->arg);
+
+                return -1;
+            }
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_ALEN:
+        case OP_ASUM:
+            if (0 != pop_type(verifier, ip, VM_TYPE_REFERENCE))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_BALOAD:
+        case OP_IALOAD:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER) ||
+                0 != pop_type(verifier, ip, VM_TYPE_REFERENCE))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_BASTORE:
+        case OP_IASTORE:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER) ||
+                0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_AFILL:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        // count, destination index, destination, source index, source
+        case OP_ACOPY:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER) ||
+                0 != pop_type(verifier, ip, VM_TYPE_INTEGER) ||
+                0 != pop_type(verifier, ip, VM_TYPE_REFERENCE) ||
+                0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        case OP_ADOT:
+            if (0 != pop_type(verifier, ip, VM_TYPE_REFERENCE) ||
+                0 != pop_type(verifier, ip, VM_TYPE_REFERENCE))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_AADD:
+            if (0 != pop_type(verifier, ip, VM_TYPE_REFERENCE) ||
+                0 != pop_type(verifier, ip, VM_TYPE_REFERENCE))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        /* long, float and double operations, of the type of their family */
+        case OP_LLOAD:
+        case OP_FLOAD:
+        case OP_DLOAD:
+            value_type = get_numeric_type(instruction->opcode);
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (value_type != type)
+            {
+                verify_error(verifier, ip, "%s load of local %d of type: %s",
+                    get_type_name(value_type), instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return push_type(verifier, ip, value_type);
+
+        case OP_LSTORE:
+        case OP_FSTORE:
+        case OP_DSTORE:
+            value_type = get_numeric_type(instruction->opcode);
+            type = get_local_type(verifier, ip, instruction->arg);
+            if (0 == type)
+            {
+                return -1;
+            }
+            if (value_type != type)
+            {
+                verify_error(verifier, ip, "%s store to local %d of type: %s",
+                    get_type_name(value_type), instruction->arg, get_type_name(type));
+
+                return -1;
+            }
+
+            return pop_type(verifier, ip, value_type);
+
+        case OP_LPUSH:
+        case OP_FPUSH:
+        case OP_DPUSH:
+            return push_type(verifier, ip, get_numeric_type(instruction->opcode));
+
+        case OP_LADD:
+        case OP_LSUB:
+        case OP_LMULT:
+        case OP_LDIV:
+        case OP_FADD:
+        case OP_FSUB:
+        case OP_FMULT:
+        case OP_FDIV:
+        case OP_DADD:
+        case OP_DSUB:
+        case OP_DMULT:
+        case OP_DDIV:
+            value_type = get_numeric_type(instruction->opcode);
+            if (0 != pop_type(verifier, ip, value_type) ||
+                0 != pop_type(verifier, ip, value_type))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, value_type);
+
+        case OP_LNEG:
+        case OP_FNEG:
+        case OP_DNEG:
+        case OP_DSQRT:
+            value_type = get_numeric_type(instruction->opcode);
+            if (0 != pop_type(verifier, ip, value_type))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, value_type);
+
+        case OP_LPRINT:
+        case OP_FPRINT:
+        case OP_DPRINT:
+        case OP_LRET:
+        case OP_FRET:
+        case OP_DRET:
+            return pop_type(verifier, ip, get_numeric_type(instruction->opcode));
+
+        case OP_LCMP:
+        case OP_FCMP:
+        case OP_DCMP:
+            value_type = get_numeric_type(instruction->opcode);
+            if (0 != pop_type(verifier, ip, value_type) ||
+                0 != pop_type(verifier, ip, value_type))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, VM_TYPE_INTEGER);
+
+        case OP_LALOAD:
+        case OP_FALOAD:
+        case OP_DALOAD:
+            if (0 != pop_type(verifier, ip, VM_TYPE_INTEGER) ||
+                0 != pop_type(verifier, ip, VM_TYPE_REFERENCE))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, get_numeric_type(instruction->opcode));
+
+        case OP_LASTORE:
+        case OP_FASTORE:
+        case OP_DASTORE:
+            if (0 != pop_type(verifier, ip, get_numeric_type(instruction->opcode)) ||
+                0 != pop_type(verifier, ip, VM_TYPE_INTEGER))
+            {
+                return -1;
+            }
+
+            return pop_type(verifier, ip, VM_TYPE_REFERENCE);
+
+        /* conversions */
+        case OP_I2L:
+        case OP_I2F:
+        case OP_I2D:
+        case OP_L2I:
+        case OP_L2F:
+        case OP_L2D:
+        case OP_F2I:
+        case OP_F2L:
+        case OP_F2D:
+        case OP_D2I:
+        case OP_D2L:
+        case OP_D2F:
+            get_conversion_types(instruction->opcode, &type, &value_type);
+            if (0 != pop_type(verifier, ip, type))
+            {
+                return -1;
+            }
+
+            return push_type(verifier, ip, value_type);
+
+        default:
+            verify_error(verifier, ip, "unknown opcode: 0x%x", instruction->opcode);
+
+            return -1;
+    }
+}
+
+/* returns -1 after reporting a branch that leaves the method */
+static int get_successors(verifier_t *verifier, unsigned int ip, unsigned int *successors)
+{
+    const vm_instruction_t *instruction = &verifier->instructions[ip];
+
+    switch (instruction->opcode)
+    {
+        case OP_STOP:
+        case OP_RET:
+        case OP_IRET:
+        case OP_SRET:
+        case OP_RRET:
+        case OP_LRET:
+        case OP_FRET:
+        case OP_DRET:
+            return 0;
+
+        case OP_GOTO:
+            successors[0] = (unsigned int)instruction->arg;
+
+            return (0 == check_branch_target(verifier, ip, instruction->arg) ? 1 : -1);
+
+        case OP_IFEQ:
+        case OP_IFNE:
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+            successors[0] = ip + 1;
+            successors[1] = (unsigned int)instruction->arg;
+
+            return (0 == check_branch_target(verifier, ip, instruction->arg) ? 2 : -1);
+
+        case OP_TABLESWITCH:
+            if (0 > instruction->arg || !is_in_window(verifier, ip + instruction->arg))
+            {
+                verify_error(verifier, ip, "tableswitch of %d entries runs past the end of the code",
+                    instruction->arg);
+
+                return -1;
+            }
+
+            // every goto of the table, and the instruction after it for the indices out of range
+            for (int i = 0; i <= instruction->arg; ++i)
+            {
+                successors[i] = ip + 1 + i;
+            }
+
+            return instruction->arg + 1;
+
+        default:
+            successors[0] = ip + 1;
+
+            return 1;
+    }
+}
+
+/* branches stay inside their method, v1 files only know where it starts */
+static int check_branch_target(verifier_t *verifier, unsigned int ip, int target)
+{
+    if (0 > target || (unsigned int)target < verifier->method->offset || !is_in_window(verifier, target))
+    {
+        verify_error(verifier, ip, "branch target %d is outside the method", target);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+* Stores the operand stack depth of every instruction the method reaches to
+* the program, for the jit to know it at branch targets. Code shared by two
+* methods has to be reached with the same depth. The code range of a method
+* of a v1 file ends with the last instruction it reaches.
+*/
+static int record_stack_depths(verifier_t *verifier, vm_method_meta_t *method)
+{
+    int *stack_depths = verifier->program->stack_depths;
+    unsigned int ip = 0, last = method->offset;
+
+    for (unsigned int i = 0; i < verifier->num_reached; ++i)
+    {
+        ip = verifier->first + verifier->reached[i];
+
+        if (-1 != stack_depths[ip] && verifier->depths[verifier->reached[i]] != stack_depths[ip])
+        {
+            verify_error(verifier, ip, "operand stack depth differs from another method sharing the code");
+
+            return -1;
+        }
+
+        stack_depths[ip] = verifier->depths[verifier->reached[i]];
+        last = (ip > last ? ip : last);
+    }
+
+    if (0 == method->code_length)
+    {
+        method->code_length = last - method->offset + 1;
+    }
+
+    return 0;
+}
+
+/* one depth per instruction of the program, -1 until a verified method reaches it */
+static int init_stack_depths(vm_program_t *program)
+{
+    if (NULL != program->stack_depths)
+    {
+        return 0;
+    }
+
+    program->stack_depths = (int *)malloc(sizeof(int) * program->num_instructions);
+    if (NULL == program->stack_depths)
+    {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < program->num_instructions; ++i)
+    {
+        program->stack_depths[i] = -1;
+    }
+
+    return 0;
+}
+
+static int merge_state(verifier_t *verifier, unsigned int from, unsigned int to)
+{
+    unsigned int index = 0;
+
+    if (!is_in_window(verifier, to))
+    {
+        verify_error(verifier, from, "execution falls off the end of the code");
+
+        return -1;
+    }
+
+    index = to - verifier->first;
+    if (-1 == verifier->depths[index])
+    {
+        verifier->types[index] = (unsigned char *)malloc(sizeof(unsigned char) * (verifier->depth + 1));
+        if (NULL == verifier->types[index])
+        {
+            verify_error(verifier, from, "out of memory");
+
+            return -1;
+        }
+        memcpy(verifier->types[index], verifier->stack, verifier->depth);
+        verifier->depths[index] = verifier->depth;
+
+        verifier->reached[verifier->num_reached++] = index;
+        verifier->worklist[verifier->worklist_size++] = to;
+
+        return 0;
+    }
+
+    if (verifier->depths[index] != verifier->depth ||
+        0 != memcmp(verifier->types[index], verifier->stack, verifier->depth))
+    {
+        verify_error(verifier, from, "operand stack does not match at instruction %u", to);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int push_type(verifier_t *verifier, unsigned int ip, int type)
+{
+    if (verifier->depth >= verifier->max_depth)
+    {
+        verify_error(verifier, ip, "operand stack overflow");
+
+        return -1;
+    }
+
+    verifier->stack[verifier->depth++] = (unsigned char)type;
+
+    return 0;
+}
+
+/* pops the top of the abstract stack, type 0 accepts any type */
+static int pop_type(verifier_t *verifier, unsigned int ip, int type)
+{
+    int top = 0;
+
+    if (0 >= verifier->depth)
+    {
+        verify_error(verifier, ip, "operand stack is empty");
+
+        return -1;
+    }
+
+    top = verifier->stack[--verifier->depth];
+    if (0 != type && top != type)
+    {
+        verify_error(verifier, ip, "expected %s on the operand stack, got: %s",
+            get_type_name(type), get_type_name(top));
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int get_local_type(verifier_t *verifier, unsigned int ip, int index)
+{
+    vm_method_meta_t *method = verifier->method;
+
+    if (index < 0 || index >= method->num_params + method->num_locals)
+    {
+        verify_error(verifier, ip, "local %d is out of bounds", index);
+
+        return 0;
+    }
+
+    if (index < method->num_params)
+    {
+        return method->param_types[index];
+    }
+
+    return method->local_types[index - method->num_params];
+}
+
+static vm_method_meta_t *get_method_constant(verifier_t *verifier, unsigned int ip, int index)
+{
+    vm_value_t *value = NULL;
+
+    if (index < 0 || (unsigned int)index >= verifier->program->constant_pool_size)
+    {
+        verify_error(verifier, ip, "constant %d is out of constant pool bounds", index);
+
+        return NULL;
+    }
+
+    value = &verifier->program->constant_pool[index];
+    if (!is_value_type(*value, VM_TYPE_METHOD))
+    {
+        verify_error(verifier, ip, "constant %d is of type: %s, expected a method",
+            index, get_type_name(get_value_type(*value)));
+
+        return NULL;
+    }
+
+    return get_method_value(*value);
+}
+
+/* the type a field opcode reads or writes */
+static int get_field_type(enum opcodes opcode)
+{
+    switch (opcode)
+    {
+        case OP_IGETFIELD:
+        case OP_IPUTFIELD:
+            return VM_TYPE_INTEGER;
+        case OP_SGETFIELD:
+        case OP_SPUTFIELD:
+            return VM_TYPE_STRING;
+        default:
+            return VM_TYPE_REFERENCE;
+    }
+}
+
+/* the type a long, float or double opcode works on, by the range of its family */
+static int get_numeric_type(enum opcodes opcode)
+{
+    if (opcode >= OP_LLOAD && opcode <= OP_LASTORE)
+    {
+        return VM_TYPE_LONG;
+    }
+    if (opcode >= OP_FLOAD && opcode <= OP_FASTORE)
+    {
+        return VM_TYPE_FLOAT;
+    }
+
+    return VM_TYPE_DOUBLE;
+}
+
+/* what a return instruction leaves for the caller, RESULT_UNKNOWN for any other instruction */
+static int get_return_type(enum opcodes opcode)
+{
+    switch (opcode)
+    {
+        case OP_RET:
+            return RESULT_VOID;
+        case OP_IRET:
+            return VM_TYPE_INTEGER;
+        case OP_SRET:
+            return VM_TYPE_STRING;
+        case OP_RRET:
+            return VM_TYPE_REFERENCE;
+        case OP_LRET:
+            return VM_TYPE_LONG;
+        case OP_FRET:
+            return VM_TYPE_FLOAT;
+        case OP_DRET:
+            return VM_TYPE_DOUBLE;
+        default:
+            return RESULT_UNKNOWN;
+    }
+}
+
+static void get_conversion_types(enum opcodes opcode, int *from, int *to)
+{
+    static const int types[] = { VM_TYPE_INTEGER, VM_TYPE_LONG, VM_TYPE_FLOAT, VM_TYPE_DOUBLE };
+    int index = opcode - OP_I2L;
+
+    // three conversions from each type, to the other three in the order of types
+    *from = types[index / 3];
+    *to = types[(index % 3 < index / 3 ? index % 3 : index % 3 + 1)];
+}
+
+/* the instructions being checked: a v2 method's own range, or the whole code of a v1 file */
+static int is_in_window(verifier_t *verifier, unsigned int ip)
+{
+    return ip >= verifier->first && ip - verifier->first < verifier->count;
+}
+
+static void verify_error(verifier_t *verifier, unsigned int ip, const char *format, ...)
+{
+    va_list args;
+    unsigned int line = get_source_line(verifier->program, ip);
+
+    if (0 != line)
+    {
+        fprintf(verifier->program->err, "[verifier] method: %s, instruction %u, line %u: ",
+            verifier->method->name, ip, line);
+    }
+    else
+    {
+        fprintf(verifier->program->err, "[verifier] method: %s, instruction %u: ",
+            verifier->method->name, ip);
+    }
+
+    va_start(args, format);
+    vfprintf(verifier->program->err, format, args);
+    va_end(args);
+
+    fprintf(verifier->program->err, "\n");
+}
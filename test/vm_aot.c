@@ -0,0 +1,74 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm_aot.h"
+
+/*
+* Translates a program to C with the translator of the library. file.bcc
+* is written to file.c, or to -o. The result is built against the library:
+*
+*   vm_aot [-o output.c] file.bcc
+*   gcc -O2 -DVM_COMPACT_VALUES=0 -Iinclude file.c -Llib -lvm -lm -o file
+*/
+
+/* file.bcc becomes file.c, any other name gets .c appended */
+static char *get_output_path(const char *input_path)
+{
+    size_t length = strlen(input_path);
+    char *output_path = (char *)malloc(length + sizeof(".c"));
+
+    if (NULL == output_path)
+    {
+        return NULL;
+    }
+
+    memcpy(output_path, input_path, length + 1);
+    if (length >= 4 && 0 == strcmp(input_path + length - 4, ".bcc"))
+    {
+        length -= 4;
+    }
+    strcpy(output_path + length, ".c");
+
+    return output_path;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    char *output_path = NULL;
+    int option = 0, res = 0;
+
+    while (-1 != (option = getopt(argc, argv, "o:")))
+    {
+        switch (option)
+        {
+            case 'o': output = optarg; break;
+            default:
+                puts("[-] usage: vm_aot [-o output.c] file.bcc");
+                return 1;
+        }
+    }
+
+    if (optind + 1 != argc)
+    {
+        puts("[-] usage: vm_aot [-o output.c] file.bcc");
+        return 1;
+    }
+
+    if (NULL == output)
+    {
+        output_path = get_output_path(argv[optind]);
+        if (NULL == output_path)
+        {
+            printf("[!] out of memory\n");
+            return 1;
+        }
+        output = output_path;
+    }
+
+    res = vm_aot_translate_file(argv[optind], output, stderr);
+    free(output_path);
+
+    return (0 == res ? 0 : 1);
+}
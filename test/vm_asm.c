@@ -0,0 +1,89 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm_assembler.h"
+
+/*
+* Assembles .bc files with the assembler of the library, in one process.
+* Every file.bc is written to file.bcc, or to -o when there is one file.
+*
+*   vm_asm [--fixed] [-O] [-o output.bcc] file.bc...
+*/
+
+/* file.bc becomes file.bcc, any other name gets .bcc appended */
+static char *get_output_path(const char *input_path)
+{
+    size_t length = strlen(input_path);
+    char *output_path = (char *)malloc(length + sizeof(".bcc"));
+
+    if (NULL == output_path)
+    {
+        return NULL;
+    }
+
+    memcpy(output_path, input_path, length + 1);
+    if (length >= 3 && 0 == strcmp(input_path + length - 3, ".bc"))
+    {
+        length -= 3;
+    }
+    strcpy(output_path + length, ".bcc");
+
+    return output_path;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option options[] =
+    {
+        { "fixed", no_argument, NULL, 'f' },
+        { NULL, 0, NULL, 0 }
+    };
+    unsigned int flags = 0, num_failed = 0;
+    const char *output = NULL;
+    char *output_path = NULL;
+    int option = 0;
+
+    while (-1 != (option = getopt_long(argc, argv, "fOo:", options, NULL)))
+    {
+        switch (option)
+        {
+            case 'f': flags |= VM_ASSEMBLE_FIXED_WIDTH; break;
+            case 'O': flags |= VM_ASSEMBLE_OPTIMIZE; break;
+            case 'o': output = optarg; break;
+            default:
+                puts("[-] usage: vm_asm [--fixed] [-O] [-o output.bcc] file.bc...");
+                return 1;
+        }
+    }
+
+    if (optind == argc)
+    {
+        puts("[-] missing file name!");
+        return 1;
+    }
+
+    if (NULL != output && argc - optind > 1)
+    {
+        puts("[-] -o takes a single input file");
+        return 1;
+    }
+
+    for (int i = optind; i < argc; ++i)
+    {
+        output_path = (NULL == output ? get_output_path(argv[i]) : NULL);
+        if (NULL == output && NULL == output_path)
+        {
+            printf("[!] out of memory\n");
+            return 1;
+        }
+
+        if (0 != vm_assemble_file(argv[i], (NULL == output ? output_path : output), flags, stdout))
+        {
+            ++num_failed;
+        }
+        free(output_path);
+    }
+
+    return (0 == num_failed ? 0 : 1);
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "vm_runner.h"
+
+/*
+* Runs a corpus of .bcc files through the job runner and reports throughput
+* and latency percentiles.
+*
+*   vm_run_jobs [-j workers] [-n repeat] [-e handlers|threaded|jit|register|dense] [-v] file.bcc...
+*/
+
+static enum vm_engine parse_engine(const char *name)
+{
+    if (0 == strcmp(name, "handlers"))
+    {
+        return VM_ENGINE_HANDLERS;
+    }
+    if (0 == strcmp(name, "threaded"))
+    {
+        return VM_ENGINE_THREADED;
+    }
+    if (0 == strcmp(name, "jit"))
+    {
+        return VM_ENGINE_JIT;
+    }
+    if (0 == strcmp(name, "register"))
+    {
+        return VM_ENGINE_REGISTER;
+    }
+    if (0 == strcmp(name, "dense"))
+    {
+        return VM_ENGINE_DENSE;
+    }
+
+    return VM_ENGINE_DEFAULT;
+}
+
+int main(int argc, char *argv[]) 
+{
+    enum vm_engine engine = VM_ENGINE_DEFAULT;
+    unsigned int num_workers = 0, repeat = 1, num_files = 0, num_jobs = 0;
+    int verbose = 0, option = 0;
+    const char **paths = NULL;
+    vm_job_result_t *results = NULL;
+    vm_runner_stats_t stats = {0};
+    vm_runner_t *runner = NULL;
+
+    while (-1 != (option = getopt(argc, argv, "j:n:e:v")))
+    {
+        switch (option)
+        {
+            case 'j': num_workers = (unsigned int)atoi(optarg); break;
+            case 'n': repeat = (unsigned int)atoi(optarg); break;
+            case 'e': engine = parse_engine(optarg); break;
+            case 'v': verbose = 1; break;
+            default:
+                puts("[-] usage: vm_run_jobs [-j workers] [-n repeat] [-e engine] [-v] file.bcc...");
+                return 1;
+        }
+    }
+
+    num_files = argc - optind;
+    if (0 == num_files || 0 == repeat)
+    {
+        puts("[-] missing file name!");
+        return 1;
+    }
+
+    num_jobs = num_files * repeat;
+    paths = (const char **)malloc(sizeof(char *) * num_jobs);
+    results = (vm_job_result_t *)malloc(sizeof(vm_job_result_t) * num_jobs);
+    runner = vm_runner_create(num_workers, 0, engine);
+    if (NULL == paths || NULL == results || NULL == runner)
+    {
+        printf("[!] could not create the runner\n");
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < num_jobs; ++i)
+    {
+        paths[i] = argv[optind + i % num_files];
+    }
+
+    vm_runner_run(runner, paths, num_jobs, results, &stats);
+
+    for (unsigned int i = 0; i < num_jobs; ++i)
+    {
+        if (verbose || 0 != results[i].status)
+        {
+            printf("[%s] %s (worker %u, %.1f us)\n", (0 == results[i].status ? "+" : "-"),
+                paths[i], results[i].worker, results[i].latency * 1e6);
+            fwrite(results[i].output, 1, results[i].output_size, stdout);
+        }
+    }
+
+    printf("jobs: %u, failed: %u, workers: %u, stolen: %u\n",
+        stats.num_jobs, stats.num_failed, stats.num_workers, stats.num_stolen);
+    printf("throughput: %.0f jobs/s (%.3fs)\n", stats.throughput, stats.elapsed);
+    printf("latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        stats.latency_p50 * 1e6, stats.latency_p99 * 1e6, stats.latency_max * 1e6);
+
+    vm_runner_free_results(results, num_jobs);
+    vm_runner_free(runner);
+    free(results);
+    free(paths);
+
+    return (0 == stats.num_failed ? 0 : 1);
+}
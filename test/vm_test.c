@@ -1,17 +1,56 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "vm.h"
 
+static enum vm_engine parse_engine(const char *name)
+{
+    if (0 == strcmp(name, "handlers"))
+    {
+        return VM_ENGINE_HANDLERS;
+    }
+    if (0 == strcmp(name, "threaded"))
+    {
+        return VM_ENGINE_THREADED;
+    }
+    if (0 == strcmp(name, "jit"))
+    {
+        return VM_ENGINE_JIT;
+    }
+    if (0 == strcmp(name, "register"))
+    {
+        return VM_ENGINE_REGISTER;
+    }
+    if (0 == strcmp(name, "dense"))
+    {
+        return VM_ENGINE_DENSE;
+    }
+
+    return VM_ENGINE_DEFAULT;
+}
+
 int main(int argc, char *argv[]) 
 {
+    enum vm_engine engine = VM_ENGINE_DEFAULT;
+
     if (argc < 2)
     {
         puts("[-] missing file name!");
     }
     else 
     {
-        vm_t *new_vm = vm_create(argv[1], 0, 0, stdin, stdout, stderr);
+        if (argc > 2)
+        {
+            engine = parse_engine(argv[2]);
+        }
+
+        vm_t *new_vm = vm_create(argv[1], 0, 0, stdout, stdin, stderr, engine);
         if (NULL != new_vm)
         {
+            if (argc > 3)
+            {
+                vm_context_set_jit_threshold(new_vm, (unsigned int)atoi(argv[3]));
+            }
             vm_run(new_vm);
             vm_free(new_vm);
         }
@@ -23,4 +62,4 @@ int main(int argc, char *argv[])
     }
 
     return 0;
-}
\ No newline at end of file
+}